@@ -4,6 +4,7 @@
 #include "global_state.h"
 #include "serial.h"
 #include "utils.h"
+#include "bm_job_slab.h"
 
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
@@ -300,13 +301,8 @@ void BM1366_send_work(void * pvParameters, bm_job * next_bm_job)
     memcpy(job.prev_block_hash, next_bm_job->prev_block_hash, 32);
     memcpy(&job.version, &next_bm_job->version, 4);
 
-    if (GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job.job_id] != NULL) {
-        free_bm_job(GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job.job_id]);
-    }
-
-    GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job.job_id] = next_bm_job;
-
     pthread_mutex_lock(&GLOBAL_STATE->valid_jobs_lock);
+    GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job.job_id] = bm_job_slab_store(job.job_id, next_bm_job, GLOBAL_STATE->valid_jobs[job.job_id]);
     GLOBAL_STATE->valid_jobs[job.job_id] = 1;
     pthread_mutex_unlock(&GLOBAL_STATE->valid_jobs_lock);
 
@@ -349,7 +345,8 @@ task_result * BM1366_process_work(void * pvParameters)
 
     GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
 
-    if (GLOBAL_STATE->valid_jobs[job_id] == 0) {
+    // A job invalidated by a new block still has its slot, the result task drops its nonces
+    if (GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id] == NULL) {
         ESP_LOGW(TAG, "Invalid job nonce found, 0x%02X", job_id);
         return NULL;
     }
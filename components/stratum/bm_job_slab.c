@@ -0,0 +1,58 @@
+#include "bm_job_slab.h"
+
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static const char *TAG = "bm_job_slab";
+
+static bm_job *slab;
+static bool slot_used[BM_JOB_SLAB_SIZE];
+static bm_job_slab_stats slab_stats;
+
+esp_err_t bm_job_slab_init(void)
+{
+    if (slab != NULL) {
+        return ESP_OK;
+    }
+
+    slab = heap_caps_calloc_prefer(BM_JOB_SLAB_SIZE, sizeof(bm_job), 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT);
+    if (slab == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %d jobs", BM_JOB_SLAB_SIZE);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bm_job *bm_job_slab_store(uint8_t job_id, const bm_job *job, bool still_valid)
+{
+    bm_job *slot = &slab[job_id % BM_JOB_SLAB_SIZE];
+
+    if (still_valid) {
+        slab_stats.overwrites++;
+    } else if (slot_used[job_id % BM_JOB_SLAB_SIZE]) {
+        slab_stats.reuses++;
+    }
+    slab_stats.stores++;
+    slot_used[job_id % BM_JOB_SLAB_SIZE] = true;
+
+    memcpy(slot, job, sizeof(bm_job));
+    return slot;
+}
+
+int bm_job_slab_invalidate(uint8_t pool, uint8_t generation, uint8_t *valid_jobs)
+{
+    int invalidated = 0;
+    for (int i = 0; i < BM_JOB_SLAB_SIZE; i++) {
+        if (slot_used[i] && valid_jobs[i] != 0 && slab[i].pool == pool && slab[i].generation != generation) {
+            valid_jobs[i] = 0;
+            invalidated++;
+        }
+    }
+    return invalidated;
+}
+
+void bm_job_slab_get_stats(bm_job_slab_stats *stats)
+{
+    *stats = slab_stats;
+}
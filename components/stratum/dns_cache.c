@@ -0,0 +1,275 @@
+#include "dns_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "freertos/FreeRTOS.h"
+
+#define DNS_HEADER_LEN 12
+#define DNS_CLASS_IN 1
+#define DNS_FLAG_QR 0x8000
+#define DNS_FLAG_RD 0x0100
+#define DNS_RCODE_MASK 0x000f
+#define DNS_RCODE_NXDOMAIN 3
+
+static dns_cache_entry cache[DNS_CACHE_SIZE];
+static portMUX_TYPE cache_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint16_t read_u16(const uint8_t *p)
+{
+    return (uint16_t) (p[0] << 8 | p[1]);
+}
+
+static uint32_t read_u32(const uint8_t *p)
+{
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+static void write_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xff;
+}
+
+int dns_build_query(uint8_t *dest, size_t size, uint16_t id, const char *hostname, uint16_t type)
+{
+    size_t name_len = strlen(hostname);
+    if (name_len > 0 && hostname[name_len - 1] == '.') {
+        name_len--;
+    }
+    // Labels plus the terminating zero, type and class
+    if (name_len == 0 || name_len > 253 || DNS_HEADER_LEN + name_len + 2 + 4 > size) {
+        return -1;
+    }
+
+    memset(dest, 0, DNS_HEADER_LEN);
+    write_u16(dest, id);
+    write_u16(dest + 2, DNS_FLAG_RD);
+    write_u16(dest + 4, 1);
+
+    uint8_t *p = dest + DNS_HEADER_LEN;
+    const char *label = hostname;
+    const char *end = hostname + name_len;
+    while (label < end) {
+        const char *dot = memchr(label, '.', end - label);
+        size_t label_len = (dot ? dot : end) - label;
+        if (label_len == 0 || label_len > 63) {
+            return -1;
+        }
+        *p++ = label_len;
+        memcpy(p, label, label_len);
+        p += label_len;
+        label += label_len + 1;
+    }
+    *p++ = 0;
+    write_u16(p, type);
+    write_u16(p + 2, DNS_CLASS_IN);
+    p += 4;
+
+    return p - dest;
+}
+
+// Offset after the name at pos, compressed or not, or 0 if it runs past the end
+static size_t skip_name(const uint8_t *response, size_t len, size_t pos)
+{
+    while (pos < len) {
+        uint8_t label_len = response[pos];
+        if (label_len == 0) {
+            return pos + 1;
+        }
+        if ((label_len & 0xc0) == 0xc0) {
+            return pos + 2 <= len ? pos + 2 : 0;
+        }
+        if (label_len & 0xc0) {
+            return 0;
+        }
+        pos += 1 + label_len;
+    }
+    return 0;
+}
+
+int dns_parse_response(const uint8_t *response, size_t len, uint16_t id, dns_address *addresses, int max_addresses,
+                       uint32_t *ttl_s)
+{
+    if (len < DNS_HEADER_LEN || read_u16(response) != id) {
+        return -1;
+    }
+    uint16_t flags = read_u16(response + 2);
+    if (!(flags & DNS_FLAG_QR)) {
+        return -1;
+    }
+    uint16_t rcode = flags & DNS_RCODE_MASK;
+    if (rcode == DNS_RCODE_NXDOMAIN) {
+        return 0;
+    }
+    if (rcode != 0) {
+        return -1;
+    }
+
+    uint16_t questions = read_u16(response + 4);
+    uint16_t answers = read_u16(response + 6);
+    size_t pos = DNS_HEADER_LEN;
+
+    for (int i = 0; i < questions; i++) {
+        pos = skip_name(response, len, pos);
+        if (pos == 0 || pos + 4 > len) {
+            return -1;
+        }
+        pos += 4;
+    }
+
+    int count = 0;
+    uint32_t min_ttl = UINT32_MAX;
+    for (int i = 0; i < answers; i++) {
+        pos = skip_name(response, len, pos);
+        if (pos == 0 || pos + 10 > len) {
+            // A truncated answer still has the records before the cut
+            break;
+        }
+        uint16_t type = read_u16(response + pos);
+        uint16_t class = read_u16(response + pos + 2);
+        uint32_t ttl = read_u32(response + pos + 4);
+        uint16_t rdlength = read_u16(response + pos + 8);
+        pos += 10;
+        if (pos + rdlength > len) {
+            break;
+        }
+
+        if (class == DNS_CLASS_IN && count < max_addresses &&
+            ((type == DNS_TYPE_A && rdlength == 4) || (type == DNS_TYPE_AAAA && rdlength == 16))) {
+            dns_address *address = &addresses[count++];
+            memset(address, 0, sizeof(*address));
+            address->family = type == DNS_TYPE_A ? AF_INET : AF_INET6;
+            memcpy(address->addr, response + pos, rdlength);
+            if (ttl < min_ttl) {
+                min_ttl = ttl;
+            }
+        }
+        pos += rdlength;
+    }
+
+    if (ttl_s != NULL) {
+        *ttl_s = count > 0 ? min_ttl : 0;
+    }
+    return count;
+}
+
+void dns_interleave_addresses(dns_address *addresses, int count)
+{
+    dns_address sorted[DNS_CACHE_MAX_ADDRESSES];
+    if (count > DNS_CACHE_MAX_ADDRESSES) {
+        count = DNS_CACHE_MAX_ADDRESSES;
+    }
+
+    int v4 = 0;
+    int v6 = 0;
+    for (int i = 0; i < count; i++) {
+        bool want_v4 = i % 2 == 0;
+        // Next of the wanted family, the other one when it ran out
+        for (int pass = 0; pass < 2; pass++) {
+            int family = want_v4 == (pass == 0) ? AF_INET : AF_INET6;
+            int *next = family == AF_INET ? &v4 : &v6;
+            while (*next < count && addresses[*next].family != family) {
+                (*next)++;
+            }
+            if (*next < count) {
+                sorted[i] = addresses[(*next)++];
+                break;
+            }
+        }
+    }
+    memcpy(addresses, sorted, count * sizeof(dns_address));
+}
+
+bool dns_parse_literal(const char *hostname, dns_address *address)
+{
+    memset(address, 0, sizeof(*address));
+    if (inet_pton(AF_INET, hostname, address->addr) == 1) {
+        address->family = AF_INET;
+        return true;
+    }
+
+    char host[INET6_ADDRSTRLEN];
+    const char *scope = strchr(hostname, '%');
+    size_t host_len = scope ? (size_t) (scope - hostname) : strlen(hostname);
+    if (host_len >= sizeof(host)) {
+        return false;
+    }
+    memcpy(host, hostname, host_len);
+    host[host_len] = '\0';
+    if (inet_pton(AF_INET6, host, address->addr) != 1) {
+        return false;
+    }
+    address->family = AF_INET6;
+    if (scope != NULL) {
+        address->scope_id = strtoul(scope + 1, NULL, 10);
+    }
+    return true;
+}
+
+int dns_address_to_string(const dns_address *address, char *dest, size_t size)
+{
+    if (inet_ntop(address->family, address->addr, dest, size) == NULL) {
+        return snprintf(dest, size, "[invalid %s addr]", address->family == AF_INET ? "IPv4" : "IPv6");
+    }
+    size_t len = strlen(dest);
+    if (address->family == AF_INET6 && address->scope_id != 0) {
+        len += snprintf(dest + len, size - len, "%%%lu", (unsigned long) address->scope_id);
+    }
+    return len;
+}
+
+int dns_cache_lookup(const char *hostname, int64_t now_us, bool allow_expired, dns_address *addresses, int max_addresses)
+{
+    int count = 0;
+
+    taskENTER_CRITICAL(&cache_lock);
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        dns_cache_entry *entry = &cache[i];
+        if (entry->count == 0 || strcmp(entry->hostname, hostname) != 0) continue;
+        if (allow_expired || now_us < entry->expires_us) {
+            count = entry->count < max_addresses ? entry->count : max_addresses;
+            memcpy(addresses, entry->addresses, count * sizeof(dns_address));
+            entry->used_us = now_us;
+        }
+        break;
+    }
+    taskEXIT_CRITICAL(&cache_lock);
+
+    return count;
+}
+
+void dns_cache_store(const char *hostname, const dns_address *addresses, int count, uint32_t ttl_s, int64_t now_us)
+{
+    if (count <= 0 || strlen(hostname) >= DNS_CACHE_HOSTNAME_LEN) return;
+    if (count > DNS_CACHE_MAX_ADDRESSES) count = DNS_CACHE_MAX_ADDRESSES;
+    if (ttl_s < DNS_CACHE_MIN_TTL_S) ttl_s = DNS_CACHE_MIN_TTL_S;
+    if (ttl_s > DNS_CACHE_MAX_TTL_S) ttl_s = DNS_CACHE_MAX_TTL_S;
+
+    taskENTER_CRITICAL(&cache_lock);
+    dns_cache_entry *slot = NULL;
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        if (cache[i].count > 0 && strcmp(cache[i].hostname, hostname) == 0) {
+            slot = &cache[i];
+            break;
+        }
+        if (slot == NULL || cache[i].count == 0 || (slot->count > 0 && cache[i].used_us < slot->used_us)) {
+            slot = &cache[i];
+        }
+    }
+    strcpy(slot->hostname, hostname);
+    memcpy(slot->addresses, addresses, count * sizeof(dns_address));
+    slot->count = count;
+    slot->expires_us = now_us + ttl_s * 1000000LL;
+    slot->used_us = now_us;
+    taskEXIT_CRITICAL(&cache_lock);
+}
+
+void dns_cache_reset(void)
+{
+    taskENTER_CRITICAL(&cache_lock);
+    memset(cache, 0, sizeof(cache));
+    taskEXIT_CRITICAL(&cache_lock);
+}
@@ -0,0 +1,54 @@
+#ifndef BM_JOB_SLAB_H
+#define BM_JOB_SLAB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "mining.h"
+
+// One slot per ASIC job id
+#define BM_JOB_SLAB_SIZE 128
+
+typedef struct
+{
+    uint32_t stores;      // jobs copied into the slab
+    uint32_t reuses;      // slot held an earlier job that was already invalidated
+    uint32_t overwrites;  // slot held a job that was still valid, its late nonces are lost
+} bm_job_slab_stats;
+
+/**
+ * @brief Allocate the slab once, later calls are no-ops
+ */
+esp_err_t bm_job_slab_init(void);
+
+/**
+ * @brief Copy a job into the slot for its ASIC job id
+ *
+ * Jobs are fixed size with job id and extranonce2 stored inline, so dispatching
+ * a job does not touch the heap. The slot stays valid until the same id is
+ * stored again. Callers serialize stores and reads with valid_jobs_lock.
+ *
+ * @param job_id ASIC job id, below BM_JOB_SLAB_SIZE
+ * @param job The job to copy in
+ * @param still_valid Whether the slot's previous job was still valid, for the statistics
+ * @return The slot holding the copy
+ */
+bm_job *bm_job_slab_store(uint8_t job_id, const bm_job *job, bool still_valid);
+
+/**
+ * @brief Invalidate the jobs a pool sent for an earlier block
+ *
+ * A new prevhash makes every job of the pool stale at once. Instead of waiting
+ * for each slot to be overwritten, all jobs of the pool built in another block
+ * generation are cleared in valid_jobs. Callers hold valid_jobs_lock.
+ *
+ * @param pool Pool whose jobs to check, jobs of other pools are kept
+ * @param generation The pool's block generation, jobs built in it are kept
+ * @param valid_jobs One flag per ASIC job id
+ * @return Number of jobs invalidated
+ */
+int bm_job_slab_invalidate(uint8_t pool, uint8_t generation, uint8_t *valid_jobs);
+
+void bm_job_slab_get_stats(bm_job_slab_stats *stats);
+
+#endif // BM_JOB_SLAB_H
@@ -0,0 +1,90 @@
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DNS_CACHE_SIZE 4
+#define DNS_CACHE_MAX_ADDRESSES 8
+#define DNS_CACHE_HOSTNAME_LEN 254
+// Answers are kept at least this long, also when their TTL is 0
+#define DNS_CACHE_MIN_TTL_S 30
+#define DNS_CACHE_MAX_TTL_S 3600
+
+#define DNS_TYPE_A 1
+#define DNS_TYPE_AAAA 28
+
+typedef struct
+{
+    uint8_t family;     // AF_INET or AF_INET6
+    uint8_t addr[16];   // network byte order, the first 4 bytes for AF_INET
+    uint32_t scope_id;  // interface of an IPv6 link-local address, 0 otherwise
+} dns_address;
+
+/**
+ * Pool hostnames with every A and AAAA address the name server returned.
+ *
+ * lwIP's getaddrinfo gives one address and no TTL, so a reconnect to a pool
+ * with a dead first address keeps trying that one. Entries are kept for their
+ * TTL, and past it when the name server can not be reached.
+ */
+typedef struct
+{
+    char hostname[DNS_CACHE_HOSTNAME_LEN];
+    dns_address addresses[DNS_CACHE_MAX_ADDRESSES];
+    int count;
+    int64_t expires_us;
+    int64_t used_us;
+} dns_cache_entry;
+
+/**
+ * @brief Build a recursive query for one record type
+ *
+ * @return Length of the query, -1 if the hostname does not fit or is invalid
+ */
+int dns_build_query(uint8_t *dest, size_t size, uint16_t id, const char *hostname, uint16_t type);
+
+/**
+ * @brief Collect the A and AAAA records of the answer to the query with this id
+ *
+ * Records of a CNAME chain are all in the answer section, their names are not
+ * compared with the hostname asked for.
+ *
+ * @param ttl_s Lowest TTL of the addresses
+ * @return Number of addresses, 0 for a name without addresses, -1 if it is not
+ *         a valid answer to the query
+ */
+int dns_parse_response(const uint8_t *response, size_t len, uint16_t id, dns_address *addresses, int max_addresses,
+                       uint32_t *ttl_s);
+
+/**
+ * @brief Order addresses to alternate between IPv4 and IPv6, IPv4 first
+ *
+ * Each family keeps the order of the name server.
+ */
+void dns_interleave_addresses(dns_address *addresses, int count);
+
+/**
+ * @brief Parse a literal IPv4 or IPv6 address, with an optional %scope for IPv6
+ */
+bool dns_parse_literal(const char *hostname, dns_address *address);
+
+int dns_address_to_string(const dns_address *address, char *dest, size_t size);
+
+/**
+ * @brief Addresses of hostname
+ *
+ * @param allow_expired Also return an entry past its TTL
+ * @return Number of addresses copied, 0 if there is no entry
+ */
+int dns_cache_lookup(const char *hostname, int64_t now_us, bool allow_expired, dns_address *addresses, int max_addresses);
+
+/**
+ * @brief Add or replace the entry of hostname, the least recently used one makes room
+ */
+void dns_cache_store(const char *hostname, const dns_address *addresses, int count, uint32_t ttl_s, int64_t now_us);
+
+void dns_cache_reset(void);
+
+#endif // DNS_CACHE_H
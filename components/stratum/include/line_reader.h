@@ -0,0 +1,72 @@
+#ifndef LINE_READER_H
+#define LINE_READER_H
+
+#include <stddef.h>
+#include "esp_err.h"
+
+/**
+ * @brief Fixed-capacity receive buffer that splits a byte stream into '\n' terminated lines
+ *
+ * Data is written straight into the buffer by the transport and lines are handed out
+ * as views into it, terminated in place. The newline search resumes where the previous
+ * one stopped, so every received byte is scanned once. The only copy is moving a partial
+ * line to the front when the write position reaches the end of the buffer.
+ */
+typedef struct
+{
+    char *buffer;
+    size_t capacity;
+    size_t head; // start of the next unconsumed line
+    size_t tail; // end of the received data
+    size_t scan; // data between head and scan is known to contain no newline
+} line_reader_t;
+
+/**
+ * @brief Allocate the buffer of a line reader (PSRAM preferred)
+ *
+ * @param reader Line reader to initialize
+ * @param capacity Buffer size, which is also the maximum line length
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the buffer could not be allocated
+ */
+esp_err_t line_reader_init(line_reader_t *reader, size_t capacity);
+
+/**
+ * @brief Release the buffer of a line reader
+ */
+void line_reader_free(line_reader_t *reader);
+
+/**
+ * @brief Discard all buffered data
+ */
+void line_reader_reset(line_reader_t *reader);
+
+/**
+ * @brief Get the free space at the end of the buffer to receive into
+ *
+ * May move a pending partial line to the front of the buffer, which invalidates
+ * lines previously returned by line_reader_next_line.
+ *
+ * @param reader Line reader
+ * @param available Set to the number of bytes that can be written
+ * @return Write position, or NULL if a single line fills the whole buffer
+ */
+char *line_reader_get_write_space(line_reader_t *reader, size_t *available);
+
+/**
+ * @brief Mark bytes written to the space from line_reader_get_write_space as received
+ */
+void line_reader_commit(line_reader_t *reader, size_t len);
+
+/**
+ * @brief Get the next complete line, without the trailing '\n'
+ *
+ * The returned view is NUL terminated and stays valid until the next call to
+ * line_reader_get_write_space or line_reader_reset.
+ *
+ * @param reader Line reader
+ * @param len Set to the line length if not NULL
+ * @return Line, or NULL if no complete line has been received yet
+ */
+char *line_reader_next_line(line_reader_t *reader, size_t *len);
+
+#endif // LINE_READER_H
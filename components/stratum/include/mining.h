@@ -2,6 +2,10 @@
 #define MINING_H_
 
 #include "stratum_api.h"
+#include "mbedtls/sha256.h"
+
+#define MAX_JOB_ID_LEN 64
+#define MAX_EXTRANONCE2_LEN 32
 
 typedef struct
 {
@@ -19,19 +23,104 @@ typedef struct
     uint8_t midstate2[32];
     uint8_t midstate3[32];
     double pool_diff;
-    char *jobid;
-    char *extranonce2;
+    // little endian 256 bit targets, compared against the nonce hash
+    uint8_t pool_target[32];
+    uint8_t network_target[32];
+    char jobid[MAX_JOB_ID_LEN + 1];
+    char extranonce2[MAX_EXTRANONCE2_LEN * 2 + 1];
+    uint8_t pool;  // connection the job's work came from, its shares go back there
+    uint8_t generation;  // block generation of the pool when the job was built
 } bm_job;
 
-void free_bm_job(bm_job *job);
+typedef struct
+{
+    // coinbase_1 | extranonce_1 | extranonce_2 | coinbase_2
+    uint8_t *data;
+    size_t len;
+    size_t capacity;
+    size_t extranonce_1_offset;
+    size_t extranonce_1_len;
+    size_t extranonce_2_offset;
+    size_t extranonce_2_len;
+    // SHA-256 state after the full 64 byte blocks in front of extranonce_2
+    mbedtls_sha256_context prefix_ctx;
+    size_t prefix_len;
+} coinbase_template;
+
+typedef struct
+{
+    uint32_t ntime_window;  // seconds past the notify ntime a job may use, 0 disables ntime rolling
+    uint32_t ntime_offset;
+    uint64_t extranonce_2;
+    bool started;
+} job_roller;
 
 void calculate_coinbase_tx_hash(const char *coinbase_1, const char *coinbase_2,
                                 const char *extranonce, const char *extranonce_2, uint8_t dest[32]);
 
+/**
+ * @brief Lay out the binary coinbase transaction of a notify once, so rolling
+ * extranonce_2 only rewrites those bytes instead of decoding the hex again
+ *
+ * The buffer is kept and only grows between notifies. The hash state of the
+ * constant prefix is cached too, so each job only hashes the blocks from
+ * extranonce_2 on.
+ *
+ * @return false if the buffer could not be allocated
+ */
+bool coinbase_template_build(coinbase_template *tpl, const mining_notify *notify,
+                             const char *extranonce, size_t extranonce_2_len);
+
+/**
+ * @brief Check whether the template was built for this extranonce_1 and extranonce_2 length
+ */
+bool coinbase_template_matches(const coinbase_template *tpl, const char *extranonce, size_t extranonce_2_len);
+
+/**
+ * @brief Write extranonce_2 into the template, same bytes as extranonce_2_generate
+ */
+void coinbase_template_set_extranonce_2(coinbase_template *tpl, uint64_t extranonce_2);
+
+void coinbase_template_hash(const coinbase_template *tpl, uint8_t dest[32]);
+
+void coinbase_template_free(coinbase_template *tpl);
+
+void job_roller_init(job_roller *roller, uint32_t ntime_window);
+
+/**
+ * @brief Step to the next job for the same notify
+ *
+ * ntime is rolled through the window first, only then extranonce_2 is
+ * incremented and ntime starts over at the notify value.
+ *
+ * @return true if only ntime changed, so the previous job's merkle root and
+ * midstates are still valid
+ */
+bool job_roller_next(job_roller *roller);
+
+/**
+ * @brief Derive a job from one for the same notify and extranonce_2 with another ntime
+ *
+ * ntime is in the second header block, so merkle root, midstates and targets carry over.
+ */
+void roll_bm_job_ntime(const bm_job *job, uint32_t ntime, bm_job *dest);
+
 void calculate_merkle_root_hash(const uint8_t coinbase_tx_hash[32], const uint8_t merkle_branches[][32], const int num_merkle_branches, uint8_t dest[32]);
 
+/**
+ * @brief Decode a notify prev_block_hash into the byte order of bm_job.prev_block_hash
+ */
+void job_prev_block_hash(const char *prev_block_hash, uint8_t dest[32]);
+
 void construct_bm_job(mining_notify *params, const uint8_t merkle_root[32], const uint32_t version_mask, const double difficulty, bm_job* new_job);
 
+/**
+ * @brief Double SHA-256 of the header for a returned nonce and version, little endian
+ */
+void calculate_nonce_hash(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version, uint8_t dest[32]);
+
+double nonce_hash_difficulty(const uint8_t hash[32]);
+
 double test_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version);
 
 void extranonce_2_generate(uint64_t extranonce_2, uint32_t length, char dest[static length * 2 + 1]);
@@ -0,0 +1,24 @@
+#ifndef MINING_NOTIFY_PARSER_H
+#define MINING_NOTIFY_PARSER_H
+
+#include <stdbool.h>
+#include "stratum_api.h"
+
+/**
+ * @brief Parse a mining.notify message without building a cJSON tree
+ *
+ * Single pass over the known notify layout: the top level keys may come in any
+ * order, params are decoded straight into a pooled mining_notify. Anything
+ * outside the common shape (other methods, escaped strings, unexpected types,
+ * hex fields longer than 32 bits, too many merkle branches, malformed JSON) is
+ * rejected so the caller can fall back to the generic cJSON parser, which gives
+ * identical results for everything this parser accepts.
+ *
+ * @param json NUL terminated JSON-RPC line
+ * @param message_id Set to the message id, or -1 if it is not a number
+ * @param notify Set to the new notify on success, released with STRATUM_V1_free_mining_notify
+ * @return true if the message was parsed, false if the generic parser must be used
+ */
+bool mining_notify_parse(const char *json, int *message_id, mining_notify **notify);
+
+#endif // MINING_NOTIFY_PARSER_H
@@ -0,0 +1,63 @@
+#ifndef MINING_NOTIFY_POOL_H
+#define MINING_NOTIFY_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stratum_api.h"
+#include "work_queue.h"
+
+// Notifies alive at once. create_jobs_task is fed by two work queues, the primary
+// connection's and the pool split's, and keeps the current notify of both pool
+// sources. The hot standby keeps its newest notify for a takeover. In flight: one
+// parsed by stratum_task, one parsed or copied by the standby and one dequeued by
+// create_jobs_task before it replaces its source's.
+#define MINING_NOTIFY_WORK_QUEUES 2
+#define MINING_NOTIFY_POOL_SOURCES 2
+#define MINING_NOTIFY_STANDBY 1
+#define MINING_NOTIFY_IN_FLIGHT 3
+#define MINING_NOTIFY_LIVE_MAX (MINING_NOTIFY_WORK_QUEUES * QUEUE_SIZE + MINING_NOTIFY_POOL_SOURCES + \
+                                MINING_NOTIFY_STANDBY + MINING_NOTIFY_IN_FLIGHT)
+
+#define MINING_NOTIFY_POOL_SIZE MINING_NOTIFY_LIVE_MAX
+
+typedef struct
+{
+    uint32_t allocations;     // notifies created
+    uint32_t block_reuses;    // served from a pooled block without touching the heap
+    uint32_t block_grows;     // pooled block replaced by a larger one
+    uint32_t heap_fallbacks;  // pool exhausted, allocated from the heap
+    uint32_t in_use;          // pooled blocks currently handed out
+} mining_notify_pool_stats;
+
+/**
+ * @brief Create a mining_notify with all its fields in one contiguous block
+ *
+ * The four strings are copied in and NUL terminated, the coinbase halves are also
+ * decoded to binary, merkle_branches points to room for n_merkle_branches hashes to
+ * be filled in by the caller. Blocks come from a fixed
+ * pool and only grow, so after warm-up a notify costs no heap operations. Released
+ * with STRATUM_V1_free_mining_notify.
+ *
+ * @return The notify, or NULL if out of memory
+ */
+mining_notify *mining_notify_create(const char *job_id, size_t job_id_len,
+                                    const char *prev_block_hash, size_t prev_block_hash_len,
+                                    const char *coinbase_1, size_t coinbase_1_len,
+                                    const char *coinbase_2, size_t coinbase_2_len,
+                                    size_t n_merkle_branches);
+
+/**
+ * @brief Duplicate a notify, for work that is handed to two owners
+ *
+ * @return The copy, or NULL if out of memory
+ */
+mining_notify *mining_notify_copy(const mining_notify *notify);
+
+/**
+ * @brief Return a notify created by mining_notify_create to the pool
+ */
+void mining_notify_release(mining_notify *notify);
+
+void mining_notify_pool_get_stats(mining_notify_pool_stats *stats);
+
+#endif // MINING_NOTIFY_POOL_H
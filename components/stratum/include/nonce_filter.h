@@ -0,0 +1,46 @@
+#ifndef NONCE_FILTER_H
+#define NONCE_FILTER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "mining.h"
+
+// Open-addressed set of recently found nonces, cleared before it gets more than 3/4 full
+#define NONCE_FILTER_SIZE 256
+
+/**
+ * Drops nonces the ASIC reports more than once before they are submitted.
+ *
+ * Entries are a hash of the full header the nonce was found for (prevhash,
+ * merkle root, ntime, version bits and nonce), so the same stratum job id
+ * with another extranonce or another session never collides. Only the result
+ * task checks and inserts, other tasks ask for a reset through the atomic
+ * generation.
+ */
+typedef struct
+{
+    uint64_t keys[NONCE_FILTER_SIZE];  // 0 is an empty slot
+    uint16_t count;
+    uint32_t seen_generation;
+    _Atomic uint32_t generation;
+    _Atomic uint32_t suppressed;
+} nonce_filter;
+
+void nonce_filter_init(nonce_filter *filter);
+
+/**
+ * @brief Ask for the filter to be emptied, called on clean_jobs from any task
+ */
+void nonce_filter_request_reset(nonce_filter *filter);
+
+/**
+ * @brief Remember a nonce, result task only
+ *
+ * @return true if the nonce was already seen for this job, it should not be submitted again
+ */
+bool nonce_filter_check(nonce_filter *filter, const bm_job *job, uint32_t nonce, uint32_t version_bits);
+
+uint32_t nonce_filter_get_suppressed(nonce_filter *filter);
+
+#endif // NONCE_FILTER_H
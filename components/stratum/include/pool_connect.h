@@ -0,0 +1,46 @@
+#ifndef POOL_CONNECT_H
+#define POOL_CONNECT_H
+
+#include <sys/socket.h>
+#include "dns_cache.h"
+#include "esp_transport.h"
+
+// Head start of each connection attempt before the next address is tried too
+#define POOL_CONNECT_ATTEMPT_DELAY_MS 250
+// How long an AAAA answer is waited for once the A answer is in
+#define POOL_CONNECT_RESOLUTION_DELAY_MS 50
+
+/**
+ * @brief Addresses of a pool hostname
+ *
+ * A literal address is returned as is. Otherwise the cache answers, or the A
+ * and AAAA queries go out to name_server together. An AAAA answer that is
+ * slower than the A answer by more than POOL_CONNECT_RESOLUTION_DELAY_MS is
+ * not waited for. Without an answer an expired cache entry is used.
+ *
+ * @param name_server NULL to only use the cache
+ * @return Number of addresses, interleaved IPv4 first, 0 if none was found
+ */
+int pool_resolve(const struct sockaddr *name_server, socklen_t name_server_len, const char *hostname, int timeout_ms,
+                 dns_address *addresses, int max_addresses);
+
+/**
+ * @brief Connect to whichever address answers first
+ *
+ * Happy Eyeballs (RFC 8305): the attempts start POOL_CONNECT_ATTEMPT_DELAY_MS
+ * apart in the given order, or right away when the previous one failed, and
+ * the first one to connect wins. A blackholed address only costs the delay.
+ *
+ * @param winner Index of the address connected to
+ * @return Connected blocking socket, -1 if no address could be reached in time
+ */
+int pool_connect_race(const dns_address *addresses, int count, uint16_t port, int timeout_ms, int *winner);
+
+/**
+ * @brief Plain TCP transport on a socket that is already connected
+ *
+ * The transport owns the socket from here on. Its connect does nothing.
+ */
+esp_transport_handle_t pool_connect_transport(int sock);
+
+#endif // POOL_CONNECT_H
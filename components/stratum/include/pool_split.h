@@ -0,0 +1,67 @@
+#ifndef POOL_SPLIT_H
+#define POOL_SPLIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+#define POOL_SPLIT_MAX_POOLS 4
+
+typedef struct
+{
+    uint16_t weight;
+    bool active;                  // connected and has work, inactive pools are skipped
+    int32_t credit;
+    uint32_t jobs;
+    uint32_t accepted;
+    uint32_t rejected;
+    double accepted_difficulty;   // sum of the pool difficulty of accepted shares
+} pool_split_entry;
+
+/**
+ * Shares ASIC work between concurrently connected pools by weight.
+ *
+ * Each job goes to one pool, picked by smooth weighted round robin: with
+ * weights 80/20 four out of five jobs go to the first pool and the fifth one
+ * is spread between them instead of coming in a burst. Accepted shares are
+ * accounted per pool for the effective hashrate.
+ */
+typedef struct
+{
+    pool_split_entry pools[POOL_SPLIT_MAX_POOLS];
+    int count;
+    int64_t start_us;
+    portMUX_TYPE lock;
+} pool_split;
+
+typedef struct
+{
+    uint16_t weight;
+    bool active;
+    uint32_t jobs;
+    float job_share;      // fraction of all jobs sent to this pool
+    uint32_t accepted;
+    uint32_t rejected;
+    float hashrate;       // GH/s, from the difficulty of accepted shares
+} pool_split_stats;
+
+void pool_split_init(pool_split *split, int count, int64_t now_us);
+
+void pool_split_set_weight(pool_split *split, int pool, uint16_t weight);
+
+void pool_split_set_active(pool_split *split, int pool, bool active);
+
+/**
+ * @brief Pick the pool the next job is for and count the job
+ *
+ * @param force Pool that has to get this job, e.g. for fresh clean_jobs work, or -1.
+ *              It is charged like a regular pick, so the long run split holds.
+ * @return The pool, or -1 if none is active with a weight
+ */
+int pool_split_next(pool_split *split, int force);
+
+void pool_split_record_share(pool_split *split, int pool, double difficulty, bool accepted);
+
+void pool_split_get_stats(pool_split *split, int pool, int64_t now_us, pool_split_stats *stats);
+
+#endif // POOL_SPLIT_H
@@ -0,0 +1,72 @@
+#ifndef REQUEST_TABLE_H
+#define REQUEST_TABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Requests waiting for an answer on any pool connection
+#define REQUEST_TABLE_SIZE 64
+// Every connection counts its ids from 1, an id may sit in this many slots from id % REQUEST_TABLE_SIZE
+#define REQUEST_TABLE_PROBE 4
+// Four buckets per power of two microseconds, up to about 67 s
+#define LATENCY_BUCKETS 104
+
+typedef enum
+{
+    REQUEST_CONFIGURE,
+    REQUEST_SUBSCRIBE,
+    REQUEST_AUTHORIZE,
+    REQUEST_SUGGEST_DIFFICULTY,
+    REQUEST_EXTRANONCE_SUBSCRIBE,
+    REQUEST_SUBMIT,
+    REQUEST_METHOD_COUNT // last
+} request_method;
+
+typedef struct
+{
+    uint32_t sent;
+    uint32_t accepted;
+    uint32_t rejected;
+    uint32_t timed_out;     // no answer in time, or the connection closed first
+    // Upper edge of the latency bucket the percentile falls in, 0 without answers
+    float p50_ms;
+    float p90_ms;
+    float p99_ms;
+} request_method_stats;
+
+/**
+ * @brief Record a request written to the pool
+ *
+ * @param connection Transport the request went out on, each connection has its own ids
+ */
+void request_table_sent(const void *connection, int request_id, request_method method, int64_t sent_us);
+
+/**
+ * @brief Match an answer to its request and add the latency to the method's histogram
+ *
+ * @param connection Transport the answer came in on
+ * @param method Filled with the method of the request
+ * @param latency_ms Filled with the time from send to answer
+ * @return false if the id is not in flight on the connection, it timed out or was never sent
+ */
+bool request_table_complete(const void *connection, int request_id, bool accepted, int64_t receive_us,
+                            request_method *method, float *latency_ms);
+
+/**
+ * @brief Give up on requests sent more than timeout_us ago
+ *
+ * @param connection Only requests sent on this transport, NULL for all of them
+ * @return Number of requests that timed out, a timeout of 0 gives up on all of them
+ */
+int request_table_expire(const void *connection, int64_t now_us, int64_t timeout_us);
+
+void request_table_get_stats(request_method method, request_method_stats *stats);
+
+const char *request_table_method_name(request_method method);
+
+/**
+ * @brief Drop pending requests and histograms, for tests
+ */
+void request_table_reset(void);
+
+#endif // REQUEST_TABLE_H
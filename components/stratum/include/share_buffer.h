@@ -0,0 +1,75 @@
+#ifndef SHARE_BUFFER_H
+#define SHARE_BUFFER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "mining.h"
+
+// Shares kept while the pool is unreachable, the oldest is dropped when full
+#define SHARE_BUFFER_SIZE 32
+#define MAX_EXTRANONCE_1_LEN 16
+
+typedef struct
+{
+    char jobid[MAX_JOB_ID_LEN + 1];
+    char extranonce2[MAX_EXTRANONCE2_LEN * 2 + 1];
+    uint32_t ntime;
+    uint32_t nonce;
+    uint32_t version_bits;
+    uint64_t found_us;            // when the ASIC result was read
+    uint8_t prev_block_hash[32];  // of the job, in bm_job byte order
+    uint8_t pool;                 // bm_job.pool
+    bool block_candidate;         // meets the network target, written ahead of queued shares
+} share_submission;
+
+typedef struct
+{
+    uint32_t buffered;
+    uint32_t replayed;
+    uint32_t discarded_stale;    // other block, or the pool session they belong to is gone
+    uint32_t discarded_full;
+    uint32_t in_use;
+} share_buffer_stats;
+
+/**
+ * @brief Identify a pool by url, port and user, shares are only replayed to the pool they were found for
+ */
+uint32_t share_buffer_pool_id(const char *url, uint16_t port, const char *user);
+
+/**
+ * @brief Keep a share that could not be sent
+ *
+ * @param pool_id Pool the share was found for
+ * @param extranonce_1 Session extranonce_1, part of the coinbase the share commits to
+ * @return false if extranonce_1 is too long to keep, the share is dropped
+ */
+bool share_buffer_add(const share_submission *share, uint32_t pool_id, const char *extranonce_1);
+
+/**
+ * @brief Drop shares for another block, called on clean_jobs
+ *
+ * @param prev_block_hash Of the new work, in bm_job byte order
+ * @return Number of shares dropped
+ */
+int share_buffer_discard_stale(const uint8_t prev_block_hash[32]);
+
+/**
+ * @brief Take the next share that is still valid for a re-authorized session
+ *
+ * Valid means same pool, same extranonce_1 (the session was resumed) and same
+ * block. Shares of this pool that fail the other checks can never be accepted
+ * and are dropped on the way, shares of other pools are kept.
+ *
+ * @return true if dest was filled, false when nothing is left to replay
+ */
+bool share_buffer_take_replay(uint32_t pool_id, const char *extranonce_1, const uint8_t prev_block_hash[32],
+                              share_submission *dest);
+
+void share_buffer_get_stats(share_buffer_stats *stats);
+
+/**
+ * @brief Drop everything, for tests
+ */
+void share_buffer_reset(void);
+
+#endif // SHARE_BUFFER_H
@@ -6,14 +6,16 @@
 #include <stdbool.h>
 #include <sys/time.h>
 #include <esp_transport.h>
+#include "line_reader.h"
 
 #define MAX_MERKLE_BRANCHES 32
 #define HASH_SIZE 32
 #define COINBASE_SIZE 100
 #define COINBASE2_SIZE 128
-#define MAX_REQUEST_IDS 1024
 #define MAX_EXTRANONCE_2_LEN 32
 #define MAX_POOL_MESSAGE_LEN 256
+// Longest stratum line, also the receive buffer size
+#define STRATUM_LINE_BUFFER_SIZE (32 * 1024)
 
 typedef enum
 {
@@ -47,12 +49,19 @@ typedef struct
     char *prev_block_hash;
     char *coinbase_1;
     char *coinbase_2;
+    // coinbase_1 and coinbase_2 decoded once on arrival
+    uint8_t *coinbase_1_bin;
+    size_t coinbase_1_bin_len;
+    uint8_t *coinbase_2_bin;
+    size_t coinbase_2_bin_len;
     uint8_t *merkle_branches;
     size_t n_merkle_branches;
     uint32_t version;
     uint32_t target;
     uint32_t ntime;
     bool clean_jobs;
+    // esp_timer time the notify line was read, 0 if unknown
+    int64_t received_us;
 } mining_notify;
 
 typedef struct
@@ -75,21 +84,43 @@ typedef struct
     char * error_str;
 } StratumApiV1Message;
 
-typedef struct {
-    int64_t timestamp_us;
-    bool tracking;
-} RequestTiming;
-
 esp_transport_handle_t STRATUM_V1_transport_init(tls_mode tls, char * cert);
 
 void STRATUM_V1_initialize_buffer();
 
-char *STRATUM_V1_receive_jsonrpc_line(esp_transport_handle_t transport);
-
-int STRATUM_V1_subscribe(esp_transport_handle_t transport, int send_uid, const char * model);
+// Returns a view into the receive buffer, valid until the next call
+const char *STRATUM_V1_receive_jsonrpc_line(esp_transport_handle_t transport);
+
+/**
+ * @brief Receive a line into a caller owned line reader, for a second pool connection
+ *
+ * @param reader Line reader of the connection, with STRATUM_LINE_BUFFER_SIZE capacity
+ * @param timed_out Set when no line was complete within timeout_ms, the connection is still fine
+ * @return The line, valid until the next call, or NULL on a timeout or error
+ */
+const char *STRATUM_V1_receive_jsonrpc_line_timeout(line_reader_t *reader, esp_transport_handle_t transport, int timeout_ms,
+                                                    bool *timed_out);
+
+/**
+ * @brief Continue receiving from the connection of reader, including lines it already buffered
+ *
+ * The line readers are swapped, reader is left with the old, emptied buffer.
+ */
+void STRATUM_V1_adopt_line_reader(line_reader_t *reader);
+
+/**
+ * @brief Send mining.subscribe
+ *
+ * @param session extranonce_1 of the session to resume, the pool may hand out a new
+ *                one anyway. NULL or empty for a new session.
+ */
+int STRATUM_V1_subscribe(esp_transport_handle_t transport, int send_uid, const char * model, const char * session);
 
 void STRATUM_V1_parse(StratumApiV1Message *message, const char *stratum_json);
 
+// Generic parser for any message, STRATUM_V1_parse only uses it when the mining.notify fast path does not apply
+void STRATUM_V1_parse_cjson(StratumApiV1Message *message, const char *stratum_json);
+
 void STRATUM_V1_reset_message(StratumApiV1Message *message);
 
 void STRATUM_V1_free_mining_notify(mining_notify *params);
@@ -104,10 +135,22 @@ int STRATUM_V1_suggest_difficulty(esp_transport_handle_t transport, int send_uid
 
 int STRATUM_V1_extranonce_subscribe(esp_transport_handle_t transport, int send_uid);
 
-int STRATUM_V1_submit_share(esp_transport_handle_t transport, int send_uid, const char *username, const char *job_id,
-                            const char *extranonce_2, const uint32_t ntime, const uint32_t nonce,
-                            const uint32_t version_bits, uint64_t *out_sent_time_us);
-
-float STRATUM_V1_get_response_time_ms(int request_id, int64_t receive_time_us);
+/**
+ * @brief Format a mining.submit line, including the trailing newline
+ *
+ * @return Length of the line like snprintf, a value >= size means it was truncated
+ */
+int STRATUM_V1_format_submit(char *dest, size_t size, int send_uid, const char *username, const char *job_id,
+                             const char *extranonce_2, const uint32_t ntime, const uint32_t nonce,
+                             const uint32_t version_bits);
+
+/**
+ * @brief Write one or more formatted mining.submit lines with a single transport write
+ *
+ * @param send_uids Request ids of the lines, recorded in the request table
+ * @return Result of esp_transport_write
+ */
+int STRATUM_V1_submit_batch(esp_transport_handle_t transport, const char *lines, size_t len,
+                            const int *send_uids, int n_uids, uint64_t *out_sent_time_us);
 
 #endif // STRATUM_API_H
\ No newline at end of file
@@ -0,0 +1,81 @@
+#ifndef STRATUM_TRACE_H
+#define STRATUM_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "request_table.h"
+
+#define STRATUM_TRACE_SIZE 256
+// Bytes of each line kept in the trace, enough for the method and id
+#define STRATUM_TRACE_PAYLOAD_LEN 96
+// Method of a traced pong, the only message sent without a request table entry
+#define STRATUM_TRACE_TX_PONG REQUEST_METHOD_COUNT
+
+typedef enum
+{
+    STRATUM_TRACE_RX,
+    STRATUM_TRACE_TX,
+} stratum_trace_direction;
+
+typedef struct
+{
+    uint32_t seq;
+    int64_t timestamp_us;
+    int32_t id;         // JSON-RPC id, -1 for notifications
+    uint16_t length;    // length of the whole line, the payload may be cut short
+    uint8_t direction;  // stratum_trace_direction
+    uint8_t method;     // stratum_method when received, request_method or STRATUM_TRACE_TX_PONG when sent
+    uint8_t payload_len;
+    char payload[STRATUM_TRACE_PAYLOAD_LEN];
+} stratum_trace_entry;
+
+/**
+ * Ring of the last stratum messages, recorded in binary on the network path.
+ *
+ * Recording copies the start of the line and a few fields, nothing is
+ * formatted. Text is only produced when the trace is read, for the API or the
+ * websocket. Logging every line in full with ESP_LOGI is a separate switch.
+ */
+esp_err_t stratum_trace_init(void);
+
+/**
+ * @brief Record a line, does nothing before stratum_trace_init
+ *
+ * @param line Line without or with its trailing newline, it is not included either way
+ */
+void stratum_trace_record(stratum_trace_direction direction, uint8_t method, int id, const char *line, size_t len);
+
+/**
+ * @brief Copy the entries from *seq on, oldest first
+ *
+ * Entries already overwritten are skipped. *seq is advanced past the last
+ * entry copied, so the next call continues from there.
+ *
+ * @return Number of entries copied
+ */
+size_t stratum_trace_read(uint32_t *seq, stratum_trace_entry *entries, size_t max_entries);
+
+/**
+ * @brief Sequence number the next recorded entry gets
+ */
+uint32_t stratum_trace_next_seq(void);
+
+const char *stratum_trace_method_name(const stratum_trace_entry *entry);
+
+/**
+ * @brief Format an entry as a log line, including the trailing newline
+ *
+ * @return Length like snprintf
+ */
+int stratum_trace_format(const stratum_trace_entry *entry, char *dest, size_t size);
+
+/**
+ * @brief Switch logging every received and sent line in full on or off
+ */
+void stratum_trace_set_log_payloads(bool enabled);
+
+bool stratum_trace_get_log_payloads(void);
+
+#endif // STRATUM_TRACE_H
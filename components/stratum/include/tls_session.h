@@ -0,0 +1,67 @@
+#ifndef TLS_SESSION_H
+#define TLS_SESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define TLS_SESSION_CACHE_SIZE 4
+#define TLS_SESSION_HOST_LEN 254
+// Bytes kept of the start of each side's handshake: the ServerHello after a HelloRetryRequest
+// and the session ID of a ClientHello
+#define TLS_HELLO_CAPTURE_LEN 512
+
+/**
+ * TLS sessions of the pool endpoints, so a reconnect or a heartbeat probe
+ * resumes instead of running a full handshake.
+ *
+ * Sessions are kept serialized, as saved by the TLS library. That includes
+ * the session ticket when the pool issued one, otherwise the session ID. The
+ * endpoint is the hostname the certificate is checked against and the port.
+ */
+
+typedef struct
+{
+    uint32_t full;
+    uint32_t resumed;
+    // Duration of the latest handshake of each kind, 0 before the first one
+    uint32_t last_full_ms;
+    uint32_t last_resumed_ms;
+} tls_handshake_stats;
+
+/**
+ * @brief Keep a copy of the session of an endpoint, replacing an older one
+ *
+ * The least recently used endpoint makes room.
+ */
+esp_err_t tls_session_store(const char *host, uint16_t port, const uint8_t *session, size_t len);
+
+/**
+ * @brief Copy of the session of an endpoint
+ *
+ * @return Session to free with heap_caps_free, NULL if there is none
+ */
+uint8_t *tls_session_get(const char *host, uint16_t port, size_t *len);
+
+/**
+ * @brief Drop the session of an endpoint, the next handshake is a full one
+ */
+void tls_session_forget(const char *host, uint16_t port);
+
+/**
+ * @brief Whether the server resumed the offered session, read from the hellos
+ *
+ * TLS 1.2 resumes when the ServerHello echoes the session ID of the
+ * ClientHello, TLS 1.3 when the server accepts a pre_shared_key. Both buffers
+ * are the start of what each side sent, TLS records included.
+ */
+bool tls_session_resumed(const uint8_t *client, size_t client_len, const uint8_t *server, size_t server_len);
+
+void tls_session_record_handshake(bool resumed, int64_t duration_us);
+
+void tls_session_get_stats(tls_handshake_stats *stats);
+
+void tls_session_reset(void);
+
+#endif // TLS_SESSION_H
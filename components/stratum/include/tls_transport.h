@@ -0,0 +1,35 @@
+#ifndef TLS_TRANSPORT_H
+#define TLS_TRANSPORT_H
+
+#include "esp_transport.h"
+
+/**
+ * @brief TLS transport that resumes sessions of earlier connections
+ *
+ * Takes the place of esp_transport_ssl, which does not keep sessions. The
+ * session of each endpoint goes to tls_session after a handshake and again
+ * on close, when a TLS 1.3 ticket may have arrived after the handshake.
+ *
+ * Close and destroy free the SSL state, they belong to the task reading the
+ * transport. Any other task only shuts the socket down to wake that read.
+ *
+ * @param cert PEM CA certificate of the pool, NULL for the certificate bundle
+ */
+esp_transport_handle_t tls_transport_init(const char *cert);
+
+/**
+ * @brief Hostname the certificate is checked against, also the endpoint of the session
+ *
+ * Without it connect fails, the host passed to connect is an address.
+ */
+void tls_transport_set_common_name(esp_transport_handle_t t, const char *common_name);
+
+/**
+ * @brief Run the handshake over a socket that is already connected
+ *
+ * The transport owns the socket from here on. Without one, connect opens a
+ * connection to the address it is given.
+ */
+void tls_transport_set_socket(esp_transport_handle_t t, int sock);
+
+#endif // TLS_TRANSPORT_H
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 size_t bin2hex(const uint8_t *buf, size_t buflen, char *hex, size_t hexlen);
 
@@ -15,6 +16,11 @@ void double_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t dest[
 
 void midstate_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t dest[32]);
 
+/**
+ * @brief One SHA-256 compression of a 64 byte block into state, for resuming from a midstate
+ */
+void sha256_transform(uint32_t state[8], const uint8_t block[64]);
+
 void reverse_32bit_words(const uint8_t src[32], uint8_t dest[32]);
 
 void reverse_endianness_per_word(uint8_t data[32]);
@@ -25,6 +31,21 @@ void prettyHex(unsigned char *buf, int len);
 
 double networkDifficulty(uint32_t nBits);
 
+/**
+ * @brief 256 bit share target for a pool difficulty, little endian like a block hash
+ */
+void difficulty_to_target(double difficulty, uint8_t target[32]);
+
+/**
+ * @brief 256 bit network target from the compact nBits encoding, little endian like a block hash
+ */
+void nbits_to_target(uint32_t nBits, uint8_t target[32]);
+
+/**
+ * @brief True if the little endian hash is at or below the target
+ */
+bool hash_meets_target(const uint8_t hash[32], const uint8_t target[32]);
+
 void suffixString(uint64_t val, char * buf, size_t bufsiz, int sigdigits);
 
 float hashCounterToGhs(uint64_t duration_us, uint32_t counter);
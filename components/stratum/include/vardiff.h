@@ -0,0 +1,53 @@
+#ifndef VARDIFF_H
+#define VARDIFF_H
+
+#include <stdint.h>
+
+// The share rate may be off by this factor either way before a new difficulty is suggested
+#define VARDIFF_HYSTERESIS 2.0f
+// Time the pool gets to apply a suggestion before the next one
+#define VARDIFF_MIN_INTERVAL_US (120 * 1000000LL)
+
+/**
+ * Picks the difficulty to suggest to the pool from the measured hashrate.
+ *
+ * The difficulty aims at a share rate instead of being a fixed number, so a
+ * fast board does not flood the pool and ASIC_result_task with shares. It is
+ * rounded to a power of two, and only suggested again once the share rate at
+ * the difficulty the pool set is more than VARDIFF_HYSTERESIS off target.
+ */
+typedef struct
+{
+    float shares_per_minute;   // target, 0 disables the controller
+    uint32_t min_difficulty;   // never suggests less than this
+    uint32_t suggested;        // last difficulty suggested on this connection, 0 before the first
+    int64_t suggested_us;
+} vardiff;
+
+void vardiff_init(vardiff *controller, uint16_t shares_per_minute, uint32_t min_difficulty);
+
+/**
+ * @brief Forget the last suggestion, for a new connection
+ */
+void vardiff_reset(vardiff *controller);
+
+/**
+ * @brief Difficulty that gives shares_per_minute at hashrate_ghs, rounded to a power of two
+ */
+uint32_t vardiff_difficulty_for(float hashrate_ghs, float shares_per_minute);
+
+/**
+ * @brief Expected shares per minute at hashrate_ghs and difficulty
+ */
+float vardiff_share_rate(float hashrate_ghs, double difficulty);
+
+/**
+ * @brief Check the share rate and pick a new difficulty when it drifted
+ *
+ * @param hashrate_ghs Measured hashrate mined on this pool
+ * @param pool_difficulty Difficulty the pool set, 0 if it did not yet
+ * @return Difficulty to suggest, 0 to leave it as it is
+ */
+uint32_t vardiff_update(vardiff *controller, float hashrate_ghs, double pool_difficulty, int64_t now_us);
+
+#endif // VARDIFF_H
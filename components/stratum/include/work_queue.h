@@ -0,0 +1,79 @@
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mining.h"
+
+#define QUEUE_SIZE 12
+
+/**
+ * Lock-free ring between stratum_task (producer) and create_jobs_task (consumer).
+ *
+ * head and tail count up and are taken modulo QUEUE_SIZE. tail is only written by
+ * the producer. head is advanced with a compare-exchange, because the producer
+ * also takes items to drop stale work. A waiting side parks its task handle and
+ * sleeps on its task notification, the other side wakes it after publishing.
+ */
+typedef struct
+{
+    void *_Atomic buffer[QUEUE_SIZE];
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    TaskHandle_t _Atomic waiting_consumer;
+    TaskHandle_t _Atomic waiting_producer;
+    _Atomic uint32_t coalesced;  // notifies dropped by queue_enqueue_latest before they were taken
+} work_queue;
+
+void queue_init(work_queue *queue);
+
+/**
+ * @brief Add work, blocking while the queue is full. Producer only.
+ */
+void queue_enqueue(work_queue *queue, void *new_work);
+
+/**
+ * @brief Publish a notify in place of any pending ones. Producer only.
+ *
+ * Everything still queued is freed, whether the new notify is clean or not, so
+ * the consumer always gets the freshest work next. If a dropped notify had
+ * clean_jobs set, the new one inherits it so the consumer still drops its
+ * old jobs.
+ *
+ * @return Number of notifies dropped
+ */
+int queue_enqueue_latest(work_queue *queue, mining_notify *notify);
+
+/**
+ * @brief Take the oldest work, blocking while the queue is empty. Consumer only.
+ */
+void *queue_dequeue(work_queue *queue);
+
+/**
+ * @brief Take the oldest work, waiting at most timeout_ms. Consumer only.
+ *
+ * The deadline is on the monotonic clock, setting the wall clock does not move it.
+ *
+ * @return The work, or NULL on timeout
+ */
+void *queue_dequeue_timeout(work_queue *queue, int timeout_ms);
+
+/**
+ * @brief Take the oldest work without waiting, from either side
+ *
+ * @return The work, or NULL if the queue is empty
+ */
+void *queue_try_dequeue(work_queue *queue);
+
+int queue_count(work_queue *queue);
+
+uint32_t queue_get_coalesced(work_queue *queue);
+
+/**
+ * @brief Free all queued work with STRATUM_V1_free_mining_notify. Producer only.
+ */
+void queue_clear(work_queue *queue);
+
+#endif // WORK_QUEUE_H
@@ -0,0 +1,79 @@
+#include "line_reader.h"
+
+#include <string.h>
+#include "esp_heap_caps.h"
+
+esp_err_t line_reader_init(line_reader_t *reader, size_t capacity)
+{
+    reader->buffer = heap_caps_malloc_prefer(capacity, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT);
+    if (reader->buffer == NULL) {
+        reader->capacity = 0;
+        return ESP_ERR_NO_MEM;
+    }
+    reader->capacity = capacity;
+    line_reader_reset(reader);
+    return ESP_OK;
+}
+
+void line_reader_free(line_reader_t *reader)
+{
+    heap_caps_free(reader->buffer);
+    reader->buffer = NULL;
+    reader->capacity = 0;
+    line_reader_reset(reader);
+}
+
+void line_reader_reset(line_reader_t *reader)
+{
+    reader->head = 0;
+    reader->tail = 0;
+    reader->scan = 0;
+}
+
+char *line_reader_get_write_space(line_reader_t *reader, size_t *available)
+{
+    if (reader->head == reader->tail) {
+        line_reader_reset(reader);
+    } else if (reader->tail == reader->capacity && reader->head > 0) {
+        // Move the partial line to the front, this is the only copy made
+        size_t pending = reader->tail - reader->head;
+        memmove(reader->buffer, reader->buffer + reader->head, pending);
+        reader->scan -= reader->head;
+        reader->tail = pending;
+        reader->head = 0;
+    }
+
+    *available = reader->capacity - reader->tail;
+    if (*available == 0) {
+        return NULL;
+    }
+    return reader->buffer + reader->tail;
+}
+
+void line_reader_commit(line_reader_t *reader, size_t len)
+{
+    reader->tail += len;
+}
+
+char *line_reader_next_line(line_reader_t *reader, size_t *len)
+{
+    if (reader->scan < reader->head) {
+        reader->scan = reader->head;
+    }
+
+    char *newline = memchr(reader->buffer + reader->scan, '\n', reader->tail - reader->scan);
+    if (newline == NULL) {
+        reader->scan = reader->tail;
+        return NULL;
+    }
+
+    char *line = reader->buffer + reader->head;
+    *newline = '\0';
+    if (len) {
+        *len = newline - line;
+    }
+
+    reader->head = newline - reader->buffer + 1;
+    reader->scan = reader->head;
+    return line;
+}
@@ -1,18 +1,12 @@
 #include <string.h>
 #include <stdio.h>
 #include <limits.h>
+#include <stdlib.h>
 #include "mining.h"
 #include "utils.h"
 #include "mbedtls/sha256.h"
 #include "esp_log.h"
 
-void free_bm_job(bm_job *job)
-{
-    free(job->jobid);
-    free(job->extranonce2);
-    free(job);
-}
-
 void calculate_coinbase_tx_hash(const char *coinbase_1, const char *coinbase_2, const char *extranonce, const char *extranonce_2, uint8_t dest[32])
 {
     size_t len1 = strlen(coinbase_1);
@@ -33,6 +27,109 @@ void calculate_coinbase_tx_hash(const char *coinbase_1, const char *coinbase_2,
     double_sha256_bin(coinbase_tx_bin, coinbase_tx_bin_len, dest);
 }
 
+bool coinbase_template_build(coinbase_template *tpl, const mining_notify *notify,
+                             const char *extranonce, size_t extranonce_2_len)
+{
+    size_t extranonce_1_len = strlen(extranonce) / 2;
+    size_t len = notify->coinbase_1_bin_len + extranonce_1_len + extranonce_2_len + notify->coinbase_2_bin_len;
+
+    if (len > tpl->capacity) {
+        uint8_t *data = realloc(tpl->data, len);
+        if (data == NULL) {
+            return false;
+        }
+        tpl->data = data;
+        tpl->capacity = len;
+    }
+
+    tpl->len = len;
+    tpl->extranonce_1_offset = notify->coinbase_1_bin_len;
+    tpl->extranonce_1_len = extranonce_1_len;
+    tpl->extranonce_2_offset = tpl->extranonce_1_offset + extranonce_1_len;
+    tpl->extranonce_2_len = extranonce_2_len;
+
+    memcpy(tpl->data, notify->coinbase_1_bin, notify->coinbase_1_bin_len);
+    hex2bin(extranonce, tpl->data + tpl->extranonce_1_offset, extranonce_1_len);
+    memset(tpl->data + tpl->extranonce_2_offset, 0, extranonce_2_len);
+    memcpy(tpl->data + tpl->extranonce_2_offset + extranonce_2_len, notify->coinbase_2_bin, notify->coinbase_2_bin_len);
+
+    tpl->prefix_len = tpl->extranonce_2_offset / 64 * 64;
+    mbedtls_sha256_free(&tpl->prefix_ctx);
+    mbedtls_sha256_init(&tpl->prefix_ctx);
+    mbedtls_sha256_starts(&tpl->prefix_ctx, 0);
+    mbedtls_sha256_update(&tpl->prefix_ctx, tpl->data, tpl->prefix_len);
+
+    return true;
+}
+
+bool coinbase_template_matches(const coinbase_template *tpl, const char *extranonce, size_t extranonce_2_len)
+{
+    if (tpl->data == NULL || tpl->extranonce_2_len != extranonce_2_len || strlen(extranonce) / 2 != tpl->extranonce_1_len) {
+        return false;
+    }
+
+    uint8_t extranonce_1[tpl->extranonce_1_len];
+    hex2bin(extranonce, extranonce_1, tpl->extranonce_1_len);
+    return memcmp(extranonce_1, tpl->data + tpl->extranonce_1_offset, tpl->extranonce_1_len) == 0;
+}
+
+void coinbase_template_set_extranonce_2(coinbase_template *tpl, uint64_t extranonce_2)
+{
+    uint8_t *dest = tpl->data + tpl->extranonce_2_offset;
+    size_t copy_len = (tpl->extranonce_2_len < sizeof(uint64_t)) ? tpl->extranonce_2_len : sizeof(uint64_t);
+    memcpy(dest, &extranonce_2, copy_len);
+}
+
+void coinbase_template_hash(const coinbase_template *tpl, uint8_t dest[32])
+{
+    mbedtls_sha256_context ctx;
+    uint8_t first_hash_output[32];
+
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_clone(&ctx, &tpl->prefix_ctx);
+    mbedtls_sha256_update(&ctx, tpl->data + tpl->prefix_len, tpl->len - tpl->prefix_len);
+    mbedtls_sha256_finish(&ctx, first_hash_output);
+    mbedtls_sha256_free(&ctx);
+
+    mbedtls_sha256(first_hash_output, 32, dest, 0);
+}
+
+void coinbase_template_free(coinbase_template *tpl)
+{
+    mbedtls_sha256_free(&tpl->prefix_ctx);
+    free(tpl->data);
+    memset(tpl, 0, sizeof(coinbase_template));
+}
+
+void job_roller_init(job_roller *roller, uint32_t ntime_window)
+{
+    roller->ntime_window = ntime_window;
+    roller->ntime_offset = 0;
+    roller->extranonce_2 = 0;
+    roller->started = false;
+}
+
+bool job_roller_next(job_roller *roller)
+{
+    if (!roller->started) {
+        roller->started = true;
+        return false;
+    }
+    if (roller->ntime_offset < roller->ntime_window) {
+        roller->ntime_offset++;
+        return true;
+    }
+    roller->ntime_offset = 0;
+    roller->extranonce_2++;
+    return false;
+}
+
+void roll_bm_job_ntime(const bm_job *job, uint32_t ntime, bm_job *dest)
+{
+    memcpy(dest, job, sizeof(bm_job));
+    dest->ntime = ntime;
+}
+
 void calculate_merkle_root_hash(const uint8_t coinbase_tx_hash[32], const uint8_t merkle_branches[][32], const int num_merkle_branches, uint8_t dest[32])
 {
     uint8_t both_merkles[64];
@@ -45,6 +142,14 @@ void calculate_merkle_root_hash(const uint8_t coinbase_tx_hash[32], const uint8_
     memcpy(dest, both_merkles, 32);
 }
 
+void job_prev_block_hash(const char *prev_block_hash, uint8_t dest[32])
+{
+    uint8_t bin[32];
+    hex2bin(prev_block_hash, bin, 32);
+    reverse_endianness_per_word(bin);
+    reverse_32bit_words(bin, dest);
+}
+
 // take a mining_notify struct with ascii hex strings and convert it to a bm_job struct
 void construct_bm_job(mining_notify *params, const uint8_t merkle_root[32], const uint32_t version_mask, const double difficulty, bm_job *new_job)
 {
@@ -53,6 +158,9 @@ void construct_bm_job(mining_notify *params, const uint8_t merkle_root[32], cons
     new_job->ntime = params->ntime;
     new_job->starting_nonce = 0;
     new_job->pool_diff = difficulty;
+    difficulty_to_target(difficulty, new_job->pool_target);
+    nbits_to_target(params->target, new_job->network_target);
+    new_job->version_mask = version_mask;
     reverse_32bit_words(merkle_root, new_job->merkle_root);
 
     uint8_t prev_block_hash[32];
@@ -116,31 +224,84 @@ void extranonce_2_generate(uint64_t extranonce_2, uint32_t length, char dest[sta
  */
 static const double truediffone = 26959535291011309493156476344723991336010898738574164086137773096960.0;
 
-/* testing a nonce and return the diff - 0 means invalid */
-double test_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version)
+// Midstate construct_bm_job already computed for this version, if any
+static const uint8_t *job_midstate(const bm_job *job, const uint32_t rolled_version)
 {
-    uint8_t header[80];
+    if (rolled_version == job->version) {
+        return job->midstate;
+    }
+    if (job->num_midstates < 4) {
+        return NULL;
+    }
 
-    // // TODO: use the midstate hash instead of hashing the whole header
-    // uint32_t rolled_version = job->version;
-    // for (int i = 0; i < midstate_index; i++) {
-    //     rolled_version = increment_bitmask(rolled_version, job->version_mask);
-    // }
+    const uint8_t *midstates[] = { job->midstate1, job->midstate2, job->midstate3 };
+    uint32_t version = job->version;
+    for (int i = 0; i < 3; i++) {
+        version = increment_bitmask(version, job->version_mask);
+        if (rolled_version == version) {
+            return midstates[i];
+        }
+    }
+    return NULL;
+}
 
-    // copy data from job to header
-    memcpy(header, &rolled_version, 4);
-    reverse_32bit_words(job->prev_block_hash, header + 4);
-    reverse_32bit_words(job->merkle_root, header + 36);
-    memcpy(header + 68, &job->ntime, 4);
-    memcpy(header + 72, &job->target, 4);
-    memcpy(header + 76, &nonce, 4);
+void calculate_nonce_hash(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version, uint8_t dest[32])
+{
+    const uint8_t *midstate = job_midstate(job, rolled_version);
 
-    uint8_t hash_result[32];
-    double_sha256_bin(header, 80, hash_result);
+    if (midstate != NULL) {
+        // Resume from the first block state, only the last 16 header bytes and padding are left
+        uint8_t state_bytes[32];
+        reverse_32bit_words(midstate, state_bytes);
+        uint32_t state[8];
+        for (int i = 0; i < 8; i++) {
+            state[i] = (uint32_t)state_bytes[4 * i] << 24 | (uint32_t)state_bytes[4 * i + 1] << 16 | (uint32_t)state_bytes[4 * i + 2] << 8 | state_bytes[4 * i + 3];
+        }
+
+        uint8_t block[64] = {0};
+        memcpy(block, job->merkle_root, 4); // last word of the merkle root
+        memcpy(block + 4, &job->ntime, 4);
+        memcpy(block + 8, &job->target, 4);
+        memcpy(block + 12, &nonce, 4);
+        block[16] = 0x80;
+        block[62] = (80 * 8) >> 8;
+        block[63] = (80 * 8) & 0xff;
+        sha256_transform(state, block);
+
+        uint8_t first_hash_output[32];
+        for (int i = 0; i < 8; i++) {
+            first_hash_output[4 * i] = state[i] >> 24;
+            first_hash_output[4 * i + 1] = state[i] >> 16;
+            first_hash_output[4 * i + 2] = state[i] >> 8;
+            first_hash_output[4 * i + 3] = state[i];
+        }
+        mbedtls_sha256(first_hash_output, 32, dest, 0);
+    } else {
+        uint8_t header[80];
+
+        // copy data from job to header
+        memcpy(header, &rolled_version, 4);
+        reverse_32bit_words(job->prev_block_hash, header + 4);
+        reverse_32bit_words(job->merkle_root, header + 36);
+        memcpy(header + 68, &job->ntime, 4);
+        memcpy(header + 72, &job->target, 4);
+        memcpy(header + 76, &nonce, 4);
+
+        double_sha256_bin(header, 80, dest);
+    }
+}
 
-    double d64 = truediffone;
-    double s64 = le256todouble(hash_result);
-    return d64 / s64;
+double nonce_hash_difficulty(const uint8_t hash[32])
+{
+    return truediffone / le256todouble(hash);
+}
+
+/* testing a nonce and return the diff - 0 means invalid */
+double test_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version)
+{
+    uint8_t hash_result[32];
+    calculate_nonce_hash(job, nonce, rolled_version, hash_result);
+    return nonce_hash_difficulty(hash_result);
 }
 
 uint32_t increment_bitmask(const uint32_t value, const uint32_t mask)
@@ -0,0 +1,308 @@
+#include "mining_notify_parser.h"
+
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include "utils.h"
+#include "mining_notify_pool.h"
+
+// Deeper nesting is left to cJSON
+#define MAX_NESTING_DEPTH 32
+// cJSON does not accept longer number literals
+#define MAX_NUMBER_LEN 63
+// Largest id that cannot overflow an int
+#define MAX_ID_DIGITS 9
+
+typedef struct
+{
+    const char *start;
+    size_t len;
+} span_t;
+
+static inline bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static const char *skip_whitespace(const char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+        p++;
+    }
+    return p;
+}
+
+// Strings with escapes are rejected, so the span is the decoded value
+static const char *parse_string(const char *p, span_t *out)
+{
+    if (*p != '"') return NULL;
+    const char *start = ++p;
+    while (*p != '"') {
+        if (*p == '\\' || (unsigned char)*p < 0x20) return NULL;
+        p++;
+    }
+    out->start = start;
+    out->len = p - start;
+    return p + 1;
+}
+
+static const char *skip_number(const char *p)
+{
+    const char *start = p;
+    if (*p == '-') p++;
+    if (*p == '0') {
+        p++;
+    } else if (*p >= '1' && *p <= '9') {
+        while (is_digit(*p)) p++;
+    } else {
+        return NULL;
+    }
+    if (*p == '.') {
+        p++;
+        if (!is_digit(*p)) return NULL;
+        while (is_digit(*p)) p++;
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '+' || *p == '-') p++;
+        if (!is_digit(*p)) return NULL;
+        while (is_digit(*p)) p++;
+    }
+    if (p - start > MAX_NUMBER_LEN) return NULL;
+    return p;
+}
+
+static const char *skip_value(const char *p, int depth)
+{
+    span_t span;
+    switch (*p) {
+        case '"':
+            return parse_string(p, &span);
+        case 't':
+            return strncmp(p, "true", 4) == 0 ? p + 4 : NULL;
+        case 'f':
+            return strncmp(p, "false", 5) == 0 ? p + 5 : NULL;
+        case 'n':
+            return strncmp(p, "null", 4) == 0 ? p + 4 : NULL;
+        case '[':
+        case '{': {
+            if (depth >= MAX_NESTING_DEPTH) return NULL;
+            bool is_object = *p == '{';
+            char close = is_object ? '}' : ']';
+            p = skip_whitespace(p + 1);
+            if (*p == close) return p + 1;
+            for (;;) {
+                if (is_object) {
+                    p = parse_string(p, &span);
+                    if (p == NULL) return NULL;
+                    p = skip_whitespace(p);
+                    if (*p != ':') return NULL;
+                    p = skip_whitespace(p + 1);
+                }
+                p = skip_value(p, depth + 1);
+                if (p == NULL) return NULL;
+                p = skip_whitespace(p);
+                if (*p == close) return p + 1;
+                if (*p != ',') return NULL;
+                p = skip_whitespace(p + 1);
+            }
+        }
+        default:
+            return skip_number(p);
+    }
+}
+
+// cJSON_GetObjectItem matches keys case insensitively
+static bool key_equals(const span_t *key, const char *name)
+{
+    size_t len = strlen(name);
+    return key->len == len && strncasecmp(key->start, name, len) == 0;
+}
+
+static bool parse_hex_u32(const span_t *span, uint32_t *out)
+{
+    if (span->len == 0 || span->len > 8) return false;
+    uint32_t value = 0;
+    for (size_t i = 0; i < span->len; i++) {
+        int nibble = hex_value(span->start[i]);
+        if (nibble < 0) return false;
+        value = (value << 4) | nibble;
+    }
+    *out = value;
+    return true;
+}
+
+static bool parse_id(const char *p, int *message_id)
+{
+    if (*p != '-' && !is_digit(*p)) {
+        *message_id = -1;
+        return true;
+    }
+
+    const char *end = skip_number(p);
+    bool negative = *p == '-';
+    const char *digits = negative ? p + 1 : p;
+    if (end - digits > MAX_ID_DIGITS) return false;
+
+    int value = 0;
+    for (; digits < end; digits++) {
+        if (!is_digit(*digits)) return false; // fraction or exponent
+        value = value * 10 + (*digits - '0');
+    }
+    *message_id = negative ? -value : value;
+    return true;
+}
+
+static const char *parse_merkle_branches(const char *p, const char **branches, size_t *n_branches)
+{
+    size_t count = 0;
+
+    if (*p != '[') return NULL;
+    p = skip_whitespace(p + 1);
+    if (*p != ']') {
+        for (;;) {
+            if (count == MAX_MERKLE_BRANCHES || *p != '"') return NULL;
+            // Checking the hex digits also finds the closing quote, the NUL stops it too
+            const char *start = ++p;
+            for (size_t i = 0; i < HASH_SIZE * 2; i++, p++) {
+                if (hex_value(*p) < 0) return NULL;
+            }
+            if (*p != '"') return NULL;
+            branches[count++] = start;
+            p = skip_whitespace(p + 1);
+            if (*p == ']') break;
+            if (*p != ',') return NULL;
+            p = skip_whitespace(p + 1);
+        }
+    }
+    *n_branches = count;
+    return p + 1;
+}
+
+// params: job_id, prevhash, coinb1, coinb2, merkle_branch, version, nbits, ntime, [...,] clean_jobs
+typedef struct
+{
+    span_t strings[4];
+    span_t version, target, ntime;
+    const char *branches[MAX_MERKLE_BRANCHES];
+    size_t n_branches;
+    const char *last;
+    int count;
+} notify_params;
+
+static const char *parse_params(const char *p, notify_params *params)
+{
+    if (*p != '[') return NULL;
+    p = skip_whitespace(p + 1);
+    if (*p == ']') return p + 1;
+    for (;;) {
+        int index = params->count;
+        params->last = p;
+        if (index < 4) {
+            p = parse_string(p, &params->strings[index]);
+        } else if (index == 4) {
+            p = parse_merkle_branches(p, params->branches, &params->n_branches);
+        } else if (index < 8) {
+            span_t *hex = index == 5 ? &params->version : index == 6 ? &params->target : &params->ntime;
+            p = parse_string(p, hex);
+        } else {
+            p = skip_value(p, 2);
+        }
+        if (p == NULL) return NULL;
+        params->count++;
+
+        p = skip_whitespace(p);
+        if (*p == ']') return p + 1;
+        if (*p != ',') return NULL;
+        p = skip_whitespace(p + 1);
+    }
+}
+
+bool mining_notify_parse(const char *json, int *message_id, mining_notify **notify)
+{
+    const char *method_value = NULL;
+    const char *id_value = NULL;
+    bool have_params = false;
+    notify_params params;
+    span_t key;
+
+    // Top level object in one pass: params is decoded where it stands, of the
+    // other values only the position is recorded
+    const char *p = skip_whitespace(json);
+    if (*p != '{') return false;
+    p = skip_whitespace(p + 1);
+    if (*p != '}') {
+        for (;;) {
+            p = parse_string(p, &key);
+            if (p == NULL) return false;
+            p = skip_whitespace(p);
+            if (*p != ':') return false;
+            const char *value = skip_whitespace(p + 1);
+
+            if (!have_params && key_equals(&key, "params")) {
+                // Anything but the notify layout is left to cJSON, other methods included
+                have_params = true;
+                params.count = 0;
+                params.n_branches = 0;
+                p = parse_params(value, &params);
+            } else {
+                p = skip_value(value, 1);
+                if (method_value == NULL && key_equals(&key, "method")) {
+                    method_value = value;
+                } else if (id_value == NULL && key_equals(&key, "id")) {
+                    id_value = value;
+                }
+            }
+            if (p == NULL) return false;
+
+            p = skip_whitespace(p);
+            if (*p == '}') break;
+            if (*p != ',') return false;
+            p = skip_whitespace(p + 1);
+        }
+    }
+
+    span_t method;
+    if (method_value == NULL || parse_string(method_value, &method) == NULL) return false;
+    if (method.len != strlen("mining.notify") || memcmp(method.start, "mining.notify", method.len) != 0) return false;
+    if (!have_params || params.count < 8) return false;
+
+    int id = -1;
+    if (id_value != NULL && !parse_id(id_value, &id)) return false;
+
+    uint32_t version_value, target_value, ntime_value;
+    if (!parse_hex_u32(&params.version, &version_value)
+        || !parse_hex_u32(&params.target, &target_value)
+        || !parse_hex_u32(&params.ntime, &ntime_value)) {
+        return false;
+    }
+
+    span_t *strings = params.strings;
+    mining_notify *new_work = mining_notify_create(strings[0].start, strings[0].len,
+                                                   strings[1].start, strings[1].len,
+                                                   strings[2].start, strings[2].len,
+                                                   strings[3].start, strings[3].len,
+                                                   params.n_branches);
+    if (new_work == NULL) return false;
+
+    for (size_t i = 0; i < params.n_branches; i++) {
+        hex2bin(params.branches[i], new_work->merkle_branches + HASH_SIZE * i, HASH_SIZE);
+    }
+    new_work->version = version_value;
+    new_work->target = target_value;
+    new_work->ntime = ntime_value;
+    // params can be variable length, clean_jobs is the last one
+    new_work->clean_jobs = strncmp(params.last, "true", 4) == 0;
+
+    *message_id = id;
+    *notify = new_work;
+    return true;
+}
@@ -0,0 +1,200 @@
+#include "mining_notify_pool.h"
+
+#include <string.h>
+#include <stdbool.h>
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "utils.h"
+
+// Block sizes are rounded up so notifies with slightly longer coinbases reuse the same block
+#define BLOCK_GRANULE 256
+
+typedef struct
+{
+    mining_notify *block;
+    size_t capacity;
+    bool in_use;
+} pool_slot;
+
+static pool_slot slots[MINING_NOTIFY_POOL_SIZE];
+static mining_notify_pool_stats pool_stats;
+static portMUX_TYPE pool_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void *block_alloc(size_t size)
+{
+    return heap_caps_malloc_prefer(size, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT);
+}
+
+static mining_notify *acquire_block(size_t size)
+{
+    int best = -1;
+
+    taskENTER_CRITICAL(&pool_lock);
+    // Smallest free block that fits, otherwise the largest free one, which gets grown
+    for (int i = 0; i < MINING_NOTIFY_POOL_SIZE; i++) {
+        if (slots[i].in_use) continue;
+        if (best < 0) {
+            best = i;
+            continue;
+        }
+        bool fits = slots[i].capacity >= size;
+        bool best_fits = slots[best].capacity >= size;
+        if (fits ? (!best_fits || slots[i].capacity < slots[best].capacity)
+                 : (!best_fits && slots[i].capacity > slots[best].capacity)) {
+            best = i;
+        }
+    }
+    if (best >= 0) {
+        slots[best].in_use = true;
+        pool_stats.in_use++;
+    }
+    taskEXIT_CRITICAL(&pool_lock);
+
+    if (best < 0) {
+        mining_notify *block = block_alloc(size);
+        taskENTER_CRITICAL(&pool_lock);
+        pool_stats.heap_fallbacks++;
+        taskEXIT_CRITICAL(&pool_lock);
+        return block;
+    }
+
+    pool_slot *slot = &slots[best];
+    if (slot->capacity >= size) {
+        taskENTER_CRITICAL(&pool_lock);
+        pool_stats.block_reuses++;
+        taskEXIT_CRITICAL(&pool_lock);
+        return slot->block;
+    }
+
+    size_t capacity = (size + BLOCK_GRANULE - 1) / BLOCK_GRANULE * BLOCK_GRANULE;
+    mining_notify *new_block = block_alloc(capacity);
+
+    taskENTER_CRITICAL(&pool_lock);
+    mining_notify *old_block = slot->block;
+    if (new_block != NULL) {
+        slot->block = new_block;
+        slot->capacity = capacity;
+        pool_stats.block_grows++;
+    } else {
+        slot->in_use = false;
+        pool_stats.in_use--;
+    }
+    taskEXIT_CRITICAL(&pool_lock);
+
+    if (new_block != NULL) {
+        heap_caps_free(old_block);
+    }
+    return new_block;
+}
+
+static char *copy_string(uint8_t **cursor, const char *src, size_t len)
+{
+    char *dest = (char *) *cursor;
+    memcpy(dest, src, len);
+    dest[len] = '\0';
+    *cursor += len + 1;
+    return dest;
+}
+
+mining_notify *mining_notify_create(const char *job_id, size_t job_id_len,
+                                    const char *prev_block_hash, size_t prev_block_hash_len,
+                                    const char *coinbase_1, size_t coinbase_1_len,
+                                    const char *coinbase_2, size_t coinbase_2_len,
+                                    size_t n_merkle_branches)
+{
+    size_t coinbase_1_bin_len = coinbase_1_len / 2;
+    size_t coinbase_2_bin_len = coinbase_2_len / 2;
+
+    size_t size = sizeof(mining_notify)
+                + HASH_SIZE * n_merkle_branches
+                + coinbase_1_bin_len
+                + coinbase_2_bin_len
+                + job_id_len + 1
+                + prev_block_hash_len + 1
+                + coinbase_1_len + 1
+                + coinbase_2_len + 1;
+
+    mining_notify *notify = acquire_block(size);
+    if (notify == NULL) {
+        return NULL;
+    }
+
+    taskENTER_CRITICAL(&pool_lock);
+    pool_stats.allocations++;
+    taskEXIT_CRITICAL(&pool_lock);
+
+    memset(notify, 0, sizeof(mining_notify));
+
+    uint8_t *cursor = (uint8_t *) (notify + 1);
+    notify->merkle_branches = cursor;
+    notify->n_merkle_branches = n_merkle_branches;
+    cursor += HASH_SIZE * n_merkle_branches;
+
+    // Filled from the NUL terminated hex copies below
+    notify->coinbase_1_bin = cursor;
+    notify->coinbase_1_bin_len = coinbase_1_bin_len;
+    cursor += coinbase_1_bin_len;
+    notify->coinbase_2_bin = cursor;
+    notify->coinbase_2_bin_len = coinbase_2_bin_len;
+    cursor += coinbase_2_bin_len;
+
+    notify->job_id = copy_string(&cursor, job_id, job_id_len);
+    notify->prev_block_hash = copy_string(&cursor, prev_block_hash, prev_block_hash_len);
+    notify->coinbase_1 = copy_string(&cursor, coinbase_1, coinbase_1_len);
+    notify->coinbase_2 = copy_string(&cursor, coinbase_2, coinbase_2_len);
+
+    hex2bin(notify->coinbase_1, notify->coinbase_1_bin, coinbase_1_bin_len);
+    hex2bin(notify->coinbase_2, notify->coinbase_2_bin, coinbase_2_bin_len);
+
+    return notify;
+}
+
+mining_notify *mining_notify_copy(const mining_notify *notify)
+{
+    mining_notify *copy = mining_notify_create(notify->job_id, strlen(notify->job_id),
+                                               notify->prev_block_hash, strlen(notify->prev_block_hash),
+                                               notify->coinbase_1, strlen(notify->coinbase_1),
+                                               notify->coinbase_2, strlen(notify->coinbase_2),
+                                               notify->n_merkle_branches);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    memcpy(copy->merkle_branches, notify->merkle_branches, HASH_SIZE * notify->n_merkle_branches);
+    copy->version = notify->version;
+    copy->target = notify->target;
+    copy->ntime = notify->ntime;
+    copy->clean_jobs = notify->clean_jobs;
+    copy->received_us = notify->received_us;
+    return copy;
+}
+
+void mining_notify_release(mining_notify *notify)
+{
+    if (notify == NULL) {
+        return;
+    }
+
+    bool pooled = false;
+    taskENTER_CRITICAL(&pool_lock);
+    for (int i = 0; i < MINING_NOTIFY_POOL_SIZE; i++) {
+        if (slots[i].in_use && slots[i].block == notify) {
+            slots[i].in_use = false;
+            pool_stats.in_use--;
+            pooled = true;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&pool_lock);
+
+    if (!pooled) {
+        heap_caps_free(notify);
+    }
+}
+
+void mining_notify_pool_get_stats(mining_notify_pool_stats *stats)
+{
+    taskENTER_CRITICAL(&pool_lock);
+    *stats = pool_stats;
+    taskEXIT_CRITICAL(&pool_lock);
+}
@@ -0,0 +1,71 @@
+#include "nonce_filter.h"
+
+#include <string.h>
+
+static uint64_t fnv1a_64(uint64_t hash, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static void clear(nonce_filter *filter)
+{
+    memset(filter->keys, 0, sizeof(filter->keys));
+    filter->count = 0;
+}
+
+void nonce_filter_init(nonce_filter *filter)
+{
+    clear(filter);
+    filter->seen_generation = 0;
+    atomic_store(&filter->generation, 0);
+    atomic_store(&filter->suppressed, 0);
+}
+
+void nonce_filter_request_reset(nonce_filter *filter)
+{
+    atomic_fetch_add(&filter->generation, 1);
+}
+
+bool nonce_filter_check(nonce_filter *filter, const bm_job *job, uint32_t nonce, uint32_t version_bits)
+{
+    uint32_t generation = atomic_load(&filter->generation);
+    if (generation != filter->seen_generation) {
+        clear(filter);
+        filter->seen_generation = generation;
+    }
+
+    uint64_t key = 14695981039346656037ull;
+    key = fnv1a_64(key, job->prev_block_hash, sizeof(job->prev_block_hash));
+    key = fnv1a_64(key, job->merkle_root, sizeof(job->merkle_root));
+    key = fnv1a_64(key, &job->ntime, sizeof(job->ntime));
+    key = fnv1a_64(key, &version_bits, sizeof(version_bits));
+    key = fnv1a_64(key, &nonce, sizeof(nonce));
+    if (key == 0) key = 1;
+
+    uint32_t slot = key % NONCE_FILTER_SIZE;
+    while (filter->keys[slot] != 0) {
+        if (filter->keys[slot] == key) {
+            atomic_fetch_add(&filter->suppressed, 1);
+            return true;
+        }
+        slot = (slot + 1) % NONCE_FILTER_SIZE;
+    }
+
+    // Duplicates come back within a few jobs, forgetting older nonces only risks a reject
+    if (filter->count >= NONCE_FILTER_SIZE * 3 / 4) {
+        clear(filter);
+        slot = key % NONCE_FILTER_SIZE;
+    }
+    filter->keys[slot] = key;
+    filter->count++;
+    return false;
+}
+
+uint32_t nonce_filter_get_suppressed(nonce_filter *filter)
+{
+    return atomic_load(&filter->suppressed);
+}
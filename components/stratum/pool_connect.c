@@ -0,0 +1,384 @@
+#include "pool_connect.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+
+#define DNS_MAX_MESSAGE 512
+
+static const char *TAG = "pool_connect";
+
+static int wait_socket(int sock, bool write, int timeout_ms)
+{
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(sock, &fds);
+    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+    return select(sock + 1, write ? NULL : &fds, write ? &fds : NULL, NULL, &tv);
+}
+
+static int remaining_ms(int64_t deadline_us)
+{
+    int64_t remaining = deadline_us - esp_timer_get_time();
+    return remaining > 0 ? (remaining + 999) / 1000 : 0;
+}
+
+static int query_name_server(const struct sockaddr *name_server, socklen_t name_server_len, const char *hostname,
+                             int timeout_ms, dns_address *addresses, int max_addresses, uint32_t *ttl_s)
+{
+    static const uint16_t types[] = { DNS_TYPE_A, DNS_TYPE_AAAA };
+    uint8_t queries[2][DNS_MAX_MESSAGE];
+    int query_len[2];
+    uint16_t ids[2];
+    bool answered[2] = { false, false };
+
+    for (int i = 0; i < 2; i++) {
+        ids[i] = esp_random() & 0xffff;
+        query_len[i] = dns_build_query(queries[i], sizeof(queries[i]), ids[i], hostname, types[i]);
+        if (query_len[i] < 0) {
+            ESP_LOGW(TAG, "Not a valid hostname: %s", hostname);
+            return 0;
+        }
+    }
+
+    int sock = socket(name_server->sa_family, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        return 0;
+    }
+    // Only the name server's answers get through
+    if (connect(sock, name_server, name_server_len) < 0) {
+        close(sock);
+        return 0;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    int64_t deadline_us = start_us + timeout_ms * 1000LL;
+    // Sent again halfway if nothing came back, a single lost datagram should not cost the whole timeout
+    int64_t resend_us = start_us + timeout_ms * 500LL;
+    bool resent = false;
+    for (int i = 0; i < 2; i++) {
+        send(sock, queries[i], query_len[i], 0);
+    }
+
+    int count = 0;
+    uint32_t min_ttl = UINT32_MAX;
+    uint8_t response[DNS_MAX_MESSAGE];
+    while (!(answered[0] && answered[1])) {
+        int64_t wait_until = resent ? deadline_us : resend_us;
+        int ready = wait_socket(sock, false, remaining_ms(wait_until));
+        if (ready < 0) {
+            break;
+        }
+        if (ready == 0) {
+            if (esp_timer_get_time() >= deadline_us) {
+                break;
+            }
+            resent = true;
+            for (int i = 0; i < 2; i++) {
+                if (!answered[i]) send(sock, queries[i], query_len[i], 0);
+            }
+            continue;
+        }
+
+        int len = recv(sock, response, sizeof(response), 0);
+        if (len <= 0) {
+            continue;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (answered[i]) continue;
+            uint32_t ttl;
+            int found = dns_parse_response(response, len, ids[i], addresses + count, max_addresses - count, &ttl);
+            if (found < 0) continue;
+            answered[i] = true;
+            count += found;
+            if (found > 0 && ttl < min_ttl) {
+                min_ttl = ttl;
+            }
+            break;
+        }
+        // IPv4 is there, a slow AAAA answer only gets a short grace period
+        if (answered[0] && !answered[1] && count > 0) {
+            int64_t grace_us = esp_timer_get_time() + POOL_CONNECT_RESOLUTION_DELAY_MS * 1000LL;
+            if (grace_us < deadline_us) {
+                deadline_us = grace_us;
+            }
+            resent = true;
+        }
+    }
+    close(sock);
+
+    *ttl_s = count > 0 ? min_ttl : 0;
+    ESP_LOGD(TAG, "%s: %d address(es) in %lld ms", hostname, count, (esp_timer_get_time() - start_us) / 1000);
+    return count;
+}
+
+int pool_resolve(const struct sockaddr *name_server, socklen_t name_server_len, const char *hostname, int timeout_ms,
+                 dns_address *addresses, int max_addresses)
+{
+    if (max_addresses <= 0) {
+        return 0;
+    }
+    if (dns_parse_literal(hostname, &addresses[0])) {
+        return 1;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    int count = dns_cache_lookup(hostname, now_us, false, addresses, max_addresses);
+    if (count > 0) {
+        return count;
+    }
+
+    if (name_server != NULL) {
+        dns_address found[DNS_CACHE_MAX_ADDRESSES];
+        uint32_t ttl_s;
+        count = query_name_server(name_server, name_server_len, hostname, timeout_ms, found, DNS_CACHE_MAX_ADDRESSES, &ttl_s);
+        if (count > 0) {
+            dns_interleave_addresses(found, count);
+            dns_cache_store(hostname, found, count, ttl_s, esp_timer_get_time());
+            count = count < max_addresses ? count : max_addresses;
+            memcpy(addresses, found, count * sizeof(dns_address));
+            return count;
+        }
+    }
+
+    // The name server is unreachable or lost the name, an expired answer beats none
+    count = dns_cache_lookup(hostname, now_us, true, addresses, max_addresses);
+    if (count > 0) {
+        ESP_LOGW(TAG, "No answer for %s, using the expired cache entry", hostname);
+    }
+    return count;
+}
+
+static socklen_t to_sockaddr(const dns_address *address, uint16_t port, struct sockaddr_storage *storage)
+{
+    memset(storage, 0, sizeof(*storage));
+    if (address->family == AF_INET) {
+        struct sockaddr_in *addr4 = (struct sockaddr_in *) storage;
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(port);
+        memcpy(&addr4->sin_addr, address->addr, 4);
+        return sizeof(*addr4);
+    }
+    struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *) storage;
+    addr6->sin6_family = AF_INET6;
+    addr6->sin6_port = htons(port);
+    memcpy(&addr6->sin6_addr, address->addr, 16);
+    addr6->sin6_scope_id = address->scope_id;
+    return sizeof(*addr6);
+}
+
+// Non-blocking connect, 1 if connected already, 0 if in progress, -1 on failure
+static int start_attempt(const dns_address *address, uint16_t port, int *sock_out)
+{
+    struct sockaddr_storage storage;
+    socklen_t len = to_sockaddr(address, port, &storage);
+
+    int sock = socket(address->family, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0) {
+        return -1;
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    *sock_out = sock;
+    if (connect(sock, (struct sockaddr *) &storage, len) == 0) {
+        return 1;
+    }
+    if (errno == EINPROGRESS) {
+        return 0;
+    }
+    close(sock);
+    *sock_out = -1;
+    return -1;
+}
+
+int pool_connect_race(const dns_address *addresses, int count, uint16_t port, int timeout_ms, int *winner)
+{
+    int socks[DNS_CACHE_MAX_ADDRESSES];
+    if (count > DNS_CACHE_MAX_ADDRESSES) {
+        count = DNS_CACHE_MAX_ADDRESSES;
+    }
+    for (int i = 0; i < count; i++) {
+        socks[i] = -1;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    int64_t deadline_us = start_us + timeout_ms * 1000LL;
+    int64_t next_attempt_us = start_us;
+    int next = 0;
+    int pending = 0;
+    int won = -1;
+
+    while (won < 0 && (next < count || pending > 0)) {
+        int64_t now_us = esp_timer_get_time();
+        if (now_us >= deadline_us) {
+            break;
+        }
+
+        if (next < count && (now_us >= next_attempt_us || pending == 0)) {
+            int ret = start_attempt(&addresses[next], port, &socks[next]);
+            if (ret > 0) {
+                won = next;
+            } else if (ret == 0) {
+                pending++;
+                next_attempt_us = now_us + POOL_CONNECT_ATTEMPT_DELAY_MS * 1000LL;
+            }
+            next++;
+            continue;
+        }
+
+        fd_set wfds;
+        FD_ZERO(&wfds);
+        int max_fd = -1;
+        for (int i = 0; i < next; i++) {
+            if (socks[i] < 0) continue;
+            FD_SET(socks[i], &wfds);
+            if (socks[i] > max_fd) max_fd = socks[i];
+        }
+        int64_t wait_until = next < count && next_attempt_us < deadline_us ? next_attempt_us : deadline_us;
+        int wait_ms = remaining_ms(wait_until);
+        struct timeval tv = { .tv_sec = wait_ms / 1000, .tv_usec = (wait_ms % 1000) * 1000 };
+        if (select(max_fd + 1, NULL, &wfds, NULL, &tv) <= 0) {
+            continue;
+        }
+
+        for (int i = 0; i < next && won < 0; i++) {
+            if (socks[i] < 0 || !FD_ISSET(socks[i], &wfds)) continue;
+            int error = 0;
+            socklen_t error_len = sizeof(error);
+            getsockopt(socks[i], SOL_SOCKET, SO_ERROR, &error, &error_len);
+            if (error == 0) {
+                won = i;
+            } else {
+                // Refused or unreachable, the next address does not have to wait
+                close(socks[i]);
+                socks[i] = -1;
+                pending--;
+                next_attempt_us = esp_timer_get_time();
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (i != won && socks[i] >= 0) {
+            close(socks[i]);
+        }
+    }
+    if (won < 0) {
+        return -1;
+    }
+
+    int sock = socks[won];
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) & ~O_NONBLOCK);
+    if (winner != NULL) {
+        *winner = won;
+    }
+
+    char ip[INET6_ADDRSTRLEN + 16];
+    dns_address_to_string(&addresses[won], ip, sizeof(ip));
+    ESP_LOGI(TAG, "Connected to %s (address %d of %d) in %lld ms", ip, won + 1, count, (esp_timer_get_time() - start_us) / 1000);
+    return sock;
+}
+
+typedef struct
+{
+    int sock;
+} socket_transport;
+
+static int socket_transport_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    socket_transport *ctx = esp_transport_get_context_data(t);
+    return ctx->sock >= 0 ? 0 : -1;
+}
+
+static int socket_transport_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    socket_transport *ctx = esp_transport_get_context_data(t);
+    if (ctx->sock < 0) {
+        return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    int ready = wait_socket(ctx->sock, false, timeout_ms);
+    if (ready == 0) {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    if (ready < 0) {
+        return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    int n = recv(ctx->sock, buffer, len, 0);
+    if (n == 0) {
+        return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+    }
+    if (n < 0) {
+        return errno == EAGAIN ? ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT : ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    return n;
+}
+
+static int socket_transport_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    socket_transport *ctx = esp_transport_get_context_data(t);
+    int written = 0;
+    while (written < len) {
+        if (ctx->sock < 0 || wait_socket(ctx->sock, true, timeout_ms) <= 0) {
+            return -1;
+        }
+        int n = send(ctx->sock, buffer + written, len - written, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) continue;
+            return -1;
+        }
+        written += n;
+    }
+    return written;
+}
+
+static int socket_transport_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    socket_transport *ctx = esp_transport_get_context_data(t);
+    return ctx->sock >= 0 ? wait_socket(ctx->sock, false, timeout_ms) : -1;
+}
+
+static int socket_transport_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    socket_transport *ctx = esp_transport_get_context_data(t);
+    return ctx->sock >= 0 ? wait_socket(ctx->sock, true, timeout_ms) : -1;
+}
+
+static int socket_transport_close(esp_transport_handle_t t)
+{
+    socket_transport *ctx = esp_transport_get_context_data(t);
+    if (ctx->sock >= 0) {
+        // Also wakes a read blocked on the socket in another task
+        shutdown(ctx->sock, SHUT_RDWR);
+        close(ctx->sock);
+        ctx->sock = -1;
+    }
+    return 0;
+}
+
+static int socket_transport_destroy(esp_transport_handle_t t)
+{
+    socket_transport_close(t);
+    free(esp_transport_get_context_data(t));
+    return 0;
+}
+
+esp_transport_handle_t pool_connect_transport(int sock)
+{
+    socket_transport *ctx = calloc(1, sizeof(socket_transport));
+    esp_transport_handle_t t = ctx != NULL ? esp_transport_init() : NULL;
+    if (t == NULL) {
+        free(ctx);
+        return NULL;
+    }
+    ctx->sock = sock;
+    esp_transport_set_context_data(t, ctx);
+    esp_transport_set_func(t, socket_transport_connect, socket_transport_read, socket_transport_write, socket_transport_close,
+                           socket_transport_poll_read, socket_transport_poll_write, socket_transport_destroy);
+    return t;
+}
@@ -0,0 +1,111 @@
+#include "pool_split.h"
+
+#include <string.h>
+
+void pool_split_init(pool_split *split, int count, int64_t now_us)
+{
+    memset(split->pools, 0, sizeof(split->pools));
+    split->count = count < POOL_SPLIT_MAX_POOLS ? count : POOL_SPLIT_MAX_POOLS;
+    split->start_us = now_us;
+    portMUX_INITIALIZE(&split->lock);
+}
+
+static void reset_credits(pool_split *split)
+{
+    for (int i = 0; i < split->count; i++) {
+        split->pools[i].credit = 0;
+    }
+}
+
+void pool_split_set_weight(pool_split *split, int pool, uint16_t weight)
+{
+    if (pool < 0 || pool >= split->count) return;
+
+    taskENTER_CRITICAL(&split->lock);
+    if (split->pools[pool].weight != weight) {
+        split->pools[pool].weight = weight;
+        reset_credits(split);
+    }
+    taskEXIT_CRITICAL(&split->lock);
+}
+
+void pool_split_set_active(pool_split *split, int pool, bool active)
+{
+    if (pool < 0 || pool >= split->count) return;
+
+    taskENTER_CRITICAL(&split->lock);
+    if (split->pools[pool].active != active) {
+        split->pools[pool].active = active;
+        // A pool coming back starts even instead of with a burst of saved up jobs
+        reset_credits(split);
+    }
+    taskEXIT_CRITICAL(&split->lock);
+}
+
+int pool_split_next(pool_split *split, int force)
+{
+    int chosen = -1;
+    int32_t total = 0;
+
+    taskENTER_CRITICAL(&split->lock);
+    for (int i = 0; i < split->count; i++) {
+        pool_split_entry *entry = &split->pools[i];
+        if (!entry->active || entry->weight == 0) continue;
+        entry->credit += entry->weight;
+        total += entry->weight;
+        if (chosen < 0 || entry->credit > split->pools[chosen].credit) {
+            chosen = i;
+        }
+    }
+    if (force >= 0 && force < split->count) {
+        chosen = force;
+    }
+    if (chosen >= 0) {
+        split->pools[chosen].credit -= total;
+        split->pools[chosen].jobs++;
+    }
+    taskEXIT_CRITICAL(&split->lock);
+
+    return chosen;
+}
+
+void pool_split_record_share(pool_split *split, int pool, double difficulty, bool accepted)
+{
+    if (pool < 0 || pool >= split->count) return;
+
+    taskENTER_CRITICAL(&split->lock);
+    if (accepted) {
+        split->pools[pool].accepted++;
+        split->pools[pool].accepted_difficulty += difficulty;
+    } else {
+        split->pools[pool].rejected++;
+    }
+    taskEXIT_CRITICAL(&split->lock);
+}
+
+void pool_split_get_stats(pool_split *split, int pool, int64_t now_us, pool_split_stats *stats)
+{
+    memset(stats, 0, sizeof(pool_split_stats));
+    if (pool < 0 || pool >= split->count) return;
+
+    taskENTER_CRITICAL(&split->lock);
+    const pool_split_entry *entry = &split->pools[pool];
+    uint32_t total_jobs = 0;
+    for (int i = 0; i < split->count; i++) {
+        total_jobs += split->pools[i].jobs;
+    }
+    stats->weight = entry->weight;
+    stats->active = entry->active;
+    stats->jobs = entry->jobs;
+    stats->job_share = total_jobs > 0 ? (float) entry->jobs / total_jobs : 0;
+    stats->accepted = entry->accepted;
+    stats->rejected = entry->rejected;
+    double accepted_difficulty = entry->accepted_difficulty;
+    taskEXIT_CRITICAL(&split->lock);
+
+    // Each difficulty 1 share stands for 2^32 hashes on average
+    double elapsed_s = (now_us - split->start_us) / 1e6;
+    if (elapsed_s > 0) {
+        stats->hashrate = accepted_difficulty * 4294967296.0 / elapsed_s / 1e9;
+    }
+}
@@ -0,0 +1,209 @@
+#include "request_table.h"
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+typedef struct
+{
+    const void *connection;
+    int request_id;
+    int64_t sent_us;
+    request_method method;
+    bool pending;
+} request_entry;
+
+typedef struct
+{
+    uint32_t sent;
+    uint32_t accepted;
+    uint32_t rejected;
+    uint32_t timed_out;
+    uint32_t buckets[LATENCY_BUCKETS];
+} method_histogram;
+
+static request_entry entries[REQUEST_TABLE_SIZE];
+static method_histogram histograms[REQUEST_METHOD_COUNT];
+static portMUX_TYPE table_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *METHOD_NAMES[REQUEST_METHOD_COUNT] = {
+    [REQUEST_CONFIGURE] = "configure",
+    [REQUEST_SUBSCRIBE] = "subscribe",
+    [REQUEST_AUTHORIZE] = "authorize",
+    [REQUEST_SUGGEST_DIFFICULTY] = "suggestDifficulty",
+    [REQUEST_EXTRANONCE_SUBSCRIBE] = "extranonceSubscribe",
+    [REQUEST_SUBMIT] = "submit",
+};
+
+// Below 4 us one bucket per us, above that 4 per power of two
+static int latency_bucket(int64_t latency_us)
+{
+    if (latency_us < 4) {
+        return latency_us < 0 ? 0 : latency_us;
+    }
+    int octave = 63 - __builtin_clzll(latency_us);
+    int bucket = (octave - 1) * 4 + ((latency_us >> (octave - 2)) & 3);
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+static float bucket_upper_ms(int bucket)
+{
+    if (bucket < 4) {
+        return (bucket + 1) / 1000.0f;
+    }
+    int octave = bucket / 4 + 1;
+    int64_t upper_us = (int64_t) (5 + bucket % 4) << (octave - 2);
+    return upper_us / 1000.0f;
+}
+
+static float percentile_ms(const uint32_t *buckets, uint32_t total, float percentile)
+{
+    if (total == 0) {
+        return 0;
+    }
+    uint32_t rank = (uint32_t) (total * percentile + 0.5f);
+    if (rank < 1) rank = 1;
+
+    uint32_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return bucket_upper_ms(i);
+        }
+    }
+    return bucket_upper_ms(LATENCY_BUCKETS - 1);
+}
+
+static request_entry *find_entry(const void *connection, int request_id)
+{
+    for (int i = 0; i < REQUEST_TABLE_PROBE; i++) {
+        request_entry *entry = &entries[(request_id + i) % REQUEST_TABLE_SIZE];
+        if (entry->pending && entry->connection == connection && entry->request_id == request_id) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// A free slot, else the oldest request of the ones the id may sit in
+static request_entry *claim_entry(int request_id)
+{
+    request_entry *oldest = NULL;
+    for (int i = 0; i < REQUEST_TABLE_PROBE; i++) {
+        request_entry *entry = &entries[(request_id + i) % REQUEST_TABLE_SIZE];
+        if (!entry->pending) {
+            return entry;
+        }
+        if (oldest == NULL || entry->sent_us < oldest->sent_us) {
+            oldest = entry;
+        }
+    }
+    return oldest;
+}
+
+void request_table_sent(const void *connection, int request_id, request_method method, int64_t sent_us)
+{
+    if (request_id < 0 || method >= REQUEST_METHOD_COUNT) {
+        return;
+    }
+
+    taskENTER_CRITICAL(&table_lock);
+    request_entry *entry = find_entry(connection, request_id);
+    if (entry == NULL) {
+        entry = claim_entry(request_id);
+    }
+    if (entry->pending) {
+        // Still unanswered while newer requests took every slot it could be in
+        histograms[entry->method].timed_out++;
+    }
+    entry->connection = connection;
+    entry->request_id = request_id;
+    entry->sent_us = sent_us;
+    entry->method = method;
+    entry->pending = true;
+    histograms[method].sent++;
+    taskEXIT_CRITICAL(&table_lock);
+}
+
+bool request_table_complete(const void *connection, int request_id, bool accepted, int64_t receive_us,
+                            request_method *method, float *latency_ms)
+{
+    if (request_id < 0) {
+        return false;
+    }
+
+    bool found = false;
+    taskENTER_CRITICAL(&table_lock);
+    request_entry *entry = find_entry(connection, request_id);
+    if (entry != NULL) {
+        entry->pending = false;
+        int64_t latency_us = receive_us - entry->sent_us;
+        method_histogram *histogram = &histograms[entry->method];
+        if (accepted) {
+            histogram->accepted++;
+        } else {
+            histogram->rejected++;
+        }
+        histogram->buckets[latency_bucket(latency_us)]++;
+        *method = entry->method;
+        *latency_ms = latency_us / 1000.0f;
+        found = true;
+    }
+    taskEXIT_CRITICAL(&table_lock);
+
+    return found;
+}
+
+int request_table_expire(const void *connection, int64_t now_us, int64_t timeout_us)
+{
+    int expired = 0;
+
+    taskENTER_CRITICAL(&table_lock);
+    for (int i = 0; i < REQUEST_TABLE_SIZE; i++) {
+        request_entry *entry = &entries[i];
+        if (entry->pending && (connection == NULL || entry->connection == connection) &&
+            now_us - entry->sent_us >= timeout_us) {
+            entry->pending = false;
+            histograms[entry->method].timed_out++;
+            expired++;
+        }
+    }
+    taskEXIT_CRITICAL(&table_lock);
+
+    return expired;
+}
+
+void request_table_get_stats(request_method method, request_method_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (method >= REQUEST_METHOD_COUNT) {
+        return;
+    }
+
+    // Percentiles are computed on a copy, outside the critical section
+    taskENTER_CRITICAL(&table_lock);
+    method_histogram histogram = histograms[method];
+    taskEXIT_CRITICAL(&table_lock);
+
+    stats->sent = histogram.sent;
+    stats->accepted = histogram.accepted;
+    stats->rejected = histogram.rejected;
+    stats->timed_out = histogram.timed_out;
+
+    uint32_t answered = histogram.accepted + histogram.rejected;
+    stats->p50_ms = percentile_ms(histogram.buckets, answered, 0.50f);
+    stats->p90_ms = percentile_ms(histogram.buckets, answered, 0.90f);
+    stats->p99_ms = percentile_ms(histogram.buckets, answered, 0.99f);
+}
+
+const char *request_table_method_name(request_method method)
+{
+    return method < REQUEST_METHOD_COUNT ? METHOD_NAMES[method] : "unknown";
+}
+
+void request_table_reset(void)
+{
+    taskENTER_CRITICAL(&table_lock);
+    memset(entries, 0, sizeof(entries));
+    memset(histograms, 0, sizeof(histograms));
+    taskEXIT_CRITICAL(&table_lock);
+}
@@ -0,0 +1,146 @@
+#include "share_buffer.h"
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+typedef struct
+{
+    share_submission share;
+    uint32_t pool_id;
+    char extranonce_1[MAX_EXTRANONCE_1_LEN * 2 + 1];
+} buffered_share;
+
+// Entries stay in their slot, only the slot indices in order move. Removing a
+// share inside the critical section shifts a few bytes, not whole entries.
+static buffered_share slots[SHARE_BUFFER_SIZE];
+// Slots of the buffered shares, oldest first
+static uint8_t order[SHARE_BUFFER_SIZE];
+static int count;
+static uint32_t used_slots;
+static share_buffer_stats buffer_stats;
+static portMUX_TYPE buffer_lock = portMUX_INITIALIZER_UNLOCKED;
+
+_Static_assert(SHARE_BUFFER_SIZE <= 32, "used_slots has a bit per slot");
+
+static void free_slot(uint8_t slot)
+{
+    used_slots &= ~(1u << slot);
+}
+
+static void remove_oldest(void)
+{
+    free_slot(order[0]);
+    memmove(&order[0], &order[1], count - 1);
+    count--;
+}
+
+uint32_t share_buffer_pool_id(const char *url, uint16_t port, const char *user)
+{
+    // FNV-1a over url, port and user
+    uint32_t hash = 2166136261u;
+    for (const char *p = url; p != NULL && *p; p++) {
+        hash = (hash ^ (uint8_t) *p) * 16777619u;
+    }
+    hash = (hash ^ (port & 0xff)) * 16777619u;
+    hash = (hash ^ (port >> 8)) * 16777619u;
+    for (const char *p = user; p != NULL && *p; p++) {
+        hash = (hash ^ (uint8_t) *p) * 16777619u;
+    }
+    return hash;
+}
+
+bool share_buffer_add(const share_submission *share, uint32_t pool_id, const char *extranonce_1)
+{
+    if (extranonce_1 == NULL || strlen(extranonce_1) > MAX_EXTRANONCE_1_LEN * 2) {
+        return false;
+    }
+
+    taskENTER_CRITICAL(&buffer_lock);
+    if (count == SHARE_BUFFER_SIZE) {
+        remove_oldest();
+        buffer_stats.discarded_full++;
+    }
+    uint8_t slot = __builtin_ctz(~used_slots);
+    used_slots |= 1u << slot;
+    order[count++] = slot;
+    buffered_share *entry = &slots[slot];
+    entry->share = *share;
+    entry->pool_id = pool_id;
+    strcpy(entry->extranonce_1, extranonce_1);
+    buffer_stats.buffered++;
+    buffer_stats.in_use = count;
+    taskEXIT_CRITICAL(&buffer_lock);
+    return true;
+}
+
+int share_buffer_discard_stale(const uint8_t prev_block_hash[32])
+{
+    int dropped = 0;
+
+    taskENTER_CRITICAL(&buffer_lock);
+    // One pass, the shares kept move up in order
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        uint8_t slot = order[i];
+        if (memcmp(slots[slot].share.prev_block_hash, prev_block_hash, 32) != 0) {
+            free_slot(slot);
+            dropped++;
+        } else {
+            order[kept++] = slot;
+        }
+    }
+    count = kept;
+    buffer_stats.discarded_stale += dropped;
+    buffer_stats.in_use = count;
+    taskEXIT_CRITICAL(&buffer_lock);
+
+    return dropped;
+}
+
+bool share_buffer_take_replay(uint32_t pool_id, const char *extranonce_1, const uint8_t prev_block_hash[32],
+                              share_submission *dest)
+{
+    bool found = false;
+
+    taskENTER_CRITICAL(&buffer_lock);
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        uint8_t slot = order[i];
+        buffered_share *entry = &slots[slot];
+        if (found || entry->pool_id != pool_id) {
+            order[kept++] = slot;
+            continue;
+        }
+        bool valid = extranonce_1 != NULL && strcmp(entry->extranonce_1, extranonce_1) == 0
+                     && memcmp(entry->share.prev_block_hash, prev_block_hash, 32) == 0;
+        if (valid) {
+            *dest = entry->share;
+            buffer_stats.replayed++;
+            found = true;
+        } else {
+            buffer_stats.discarded_stale++;
+        }
+        free_slot(slot);
+    }
+    count = kept;
+    buffer_stats.in_use = count;
+    taskEXIT_CRITICAL(&buffer_lock);
+
+    return found;
+}
+
+void share_buffer_get_stats(share_buffer_stats *stats)
+{
+    taskENTER_CRITICAL(&buffer_lock);
+    *stats = buffer_stats;
+    taskEXIT_CRITICAL(&buffer_lock);
+}
+
+void share_buffer_reset(void)
+{
+    taskENTER_CRITICAL(&buffer_lock);
+    count = 0;
+    used_slots = 0;
+    memset(&buffer_stats, 0, sizeof(buffer_stats));
+    taskEXIT_CRITICAL(&buffer_lock);
+}
@@ -10,11 +10,15 @@
 #include "esp_ota_ops.h"
 #include "esp_app_desc.h"
 #include "esp_transport.h"
-#include "esp_transport_ssl.h"
 #include "esp_transport_tcp.h"
-#include "esp_crt_bundle.h"
+#include "tls_transport.h"
 #include "utils.h"
+#include "line_reader.h"
+#include "mining_notify_parser.h"
+#include "mining_notify_pool.h"
 #include "esp_timer.h"
+#include "request_table.h"
+#include "stratum_trace.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -25,30 +29,7 @@
 #define MAX_EXTRANONCE_2_LEN 32
 static const char * TAG = "stratum_api";
 
-static char * json_rpc_buffer = NULL;
-static size_t json_rpc_buffer_size = 0;
-
-static RequestTiming request_timings[MAX_REQUEST_IDS];
-
-static RequestTiming* get_request_timing(int request_id) {
-    if (request_id < 0) return NULL;
-    int index = request_id % MAX_REQUEST_IDS;
-    return &request_timings[index];
-}
-
-float STRATUM_V1_get_response_time_ms(int request_id, int64_t receive_time_us)
-{
-    if (request_id < 0) return -1.0;
-    
-    RequestTiming *timing = get_request_timing(request_id);
-    if (!timing || !timing->tracking) {
-        return -1.0;
-    }
-    
-    float response_time = (receive_time_us - timing->timestamp_us) / 1000.0f;
-    timing->tracking = false;
-    return response_time;
-}
+static line_reader_t line_reader;
 
 esp_transport_handle_t STRATUM_V1_transport_init(tls_mode tls, char * cert)
 {
@@ -61,94 +42,66 @@ esp_transport_handle_t STRATUM_V1_transport_init(tls_mode tls, char * cert)
         transport = esp_transport_tcp_init();
     }
     else{
-        // tls_transport
-        ESP_LOGI(TAG, "Using TLS transport");
-        transport = esp_transport_ssl_init();
-        if (transport == NULL) {
-            ESP_LOGE(TAG, "Failed to initialize SSL transport");
-            return NULL;
-        }
+        // tls_transport, resumes the session of the last connection to the pool
         switch(tls){
             case BUNDLED_CRT:
-                ESP_LOGI(TAG, "Using default cert bundle");
-                esp_transport_ssl_crt_bundle_attach(transport, esp_crt_bundle_attach);
+                ESP_LOGI(TAG, "Using TLS transport with the default cert bundle");
+                transport = tls_transport_init(NULL);
                 break;
             case CUSTOM_CRT:
-                ESP_LOGI(TAG, "Using custom cert");
+                ESP_LOGI(TAG, "Using TLS transport with a custom cert");
                 if (cert == NULL) {
                     ESP_LOGE(TAG, "Error: no TLS certificate");
                     return NULL;
                 }
-                esp_transport_ssl_set_cert_data(transport, cert, strlen(cert));
+                transport = tls_transport_init(cert);
                 break;
             default:
                 ESP_LOGE(TAG, "Invalid TLS mode");
-                esp_transport_destroy(transport);
                 return NULL;
         }
+        if (transport == NULL) {
+            ESP_LOGE(TAG, "Failed to initialize TLS transport");
+            return NULL;
+        }
     }
     return transport;
 }
 
 void STRATUM_V1_initialize_buffer()
 {
-    json_rpc_buffer = malloc(BUFFER_SIZE);
-    json_rpc_buffer_size = BUFFER_SIZE;
-    if (json_rpc_buffer == NULL) {
-        printf("Error: Failed to allocate memory for buffer\n");
-        exit(1);
-    }
-    memset(json_rpc_buffer, 0, BUFFER_SIZE);
-
-    for (int i = 0; i < MAX_REQUEST_IDS; i++) {
-        request_timings[i].timestamp_us = 0;
-        request_timings[i].tracking = false;
+    if (line_reader.buffer == NULL) {
+        if (line_reader_init(&line_reader, STRATUM_LINE_BUFFER_SIZE) != ESP_OK) {
+            printf("Error: Failed to allocate memory for buffer\n");
+            exit(1);
+        }
+    } else {
+        line_reader_reset(&line_reader);
     }
 }
 
 void cleanup_stratum_buffer()
 {
-    free(json_rpc_buffer);
-}
-
-static void realloc_json_buffer(size_t len)
-{
-    size_t old, new;
-
-    old = strlen(json_rpc_buffer);
-    new = old + len + 1;
-
-    if (new < json_rpc_buffer_size) {
-        return;
-    }
-
-    new = new + (BUFFER_SIZE - (new % BUFFER_SIZE));
-    void * new_sockbuf = realloc(json_rpc_buffer, new);
-
-    if (new_sockbuf == NULL) {
-        fprintf(stderr, "Error: realloc failed in recalloc_sock()\n");
-        ESP_LOGI(TAG, "Restarting System because of ERROR: realloc failed in recalloc_sock");
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-        esp_restart();
-    }
-
-    json_rpc_buffer = new_sockbuf;
-    memset(json_rpc_buffer + old, 0, new - old);
-    json_rpc_buffer_size = new;
+    line_reader_free(&line_reader);
 }
 
-char * STRATUM_V1_receive_jsonrpc_line(esp_transport_handle_t transport)
+static const char *receive_line(line_reader_t *reader, esp_transport_handle_t transport, int timeout_ms, bool *timed_out)
 {
-    if (json_rpc_buffer == NULL) {
-        STRATUM_V1_initialize_buffer();
-    }
-    char *line = NULL;
-    char recv_buffer[BUFFER_SIZE];
-    int nbytes;
-
-    while (!strstr(json_rpc_buffer, "\n")) {
-        memset(recv_buffer, 0, BUFFER_SIZE);
-        nbytes = esp_transport_read(transport, recv_buffer, BUFFER_SIZE - 1, TRANSPORT_TIMEOUT_MS);
+    char *line;
+
+    while ((line = line_reader_next_line(reader, NULL)) == NULL) {
+        size_t available;
+        char *recv_buffer = line_reader_get_write_space(reader, &available);
+        if (recv_buffer == NULL) {
+            ESP_LOGE(TAG, "Error: stratum message exceeds %d bytes", STRATUM_LINE_BUFFER_SIZE);
+            line_reader_reset(reader);
+            return NULL;
+        }
+        int nbytes = esp_transport_read(transport, recv_buffer, available, timeout_ms);
+        if (nbytes == 0 && timed_out != NULL) {
+            *timed_out = true;
+            return NULL;
+        }
         if (nbytes < 0) {
             const char *err_str;
             switch(nbytes) {
@@ -166,35 +119,40 @@ char * STRATUM_V1_receive_jsonrpc_line(esp_transport_handle_t transport)
                     break;
             }
             ESP_LOGE(TAG, "Error: transport read failed: %s (code: %d)", err_str, nbytes);
-            if (json_rpc_buffer) {
-                free(json_rpc_buffer);
-                json_rpc_buffer = NULL;
-            }
+            line_reader_reset(reader);
             return NULL;
         }
-        if (nbytes > 0) {
-            realloc_json_buffer(nbytes);
-            strncat(json_rpc_buffer, recv_buffer, nbytes);
-        }
+        line_reader_commit(reader, nbytes);
     }
 
-    // Extract the line
-    size_t buflen = strlen(json_rpc_buffer);
-    char *newline_pos = strchr(json_rpc_buffer, '\n');
-    if (newline_pos) {
-        size_t line_len = newline_pos - json_rpc_buffer;
-        line = strndup(json_rpc_buffer, line_len);  // Copy only up to \n
-        size_t remaining_len = buflen - line_len - 1;
-        if (remaining_len > 0) {
-            memmove(json_rpc_buffer, newline_pos + 1, remaining_len);
-            json_rpc_buffer[remaining_len] = '\0';
-        } else {
-            json_rpc_buffer[0] = '\0';
-        }
-    }
     return line;
 }
 
+const char * STRATUM_V1_receive_jsonrpc_line(esp_transport_handle_t transport)
+{
+    if (line_reader.buffer == NULL) {
+        STRATUM_V1_initialize_buffer();
+    }
+    return receive_line(&line_reader, transport, TRANSPORT_TIMEOUT_MS, NULL);
+}
+
+const char *STRATUM_V1_receive_jsonrpc_line_timeout(line_reader_t *reader, esp_transport_handle_t transport, int timeout_ms,
+                                                    bool *timed_out)
+{
+    *timed_out = false;
+    return receive_line(reader, transport, timeout_ms, timed_out);
+}
+
+void STRATUM_V1_adopt_line_reader(line_reader_t *reader)
+{
+    line_reader_t own = line_reader;
+    line_reader = *reader;
+    *reader = own;
+    if (reader->buffer != NULL) {
+        line_reader_reset(reader);
+    }
+}
+
 void STRATUM_V1_reset_message(StratumApiV1Message *message)
 {
     if (message->error_str) {
@@ -222,9 +180,28 @@ void STRATUM_V1_reset_message(StratumApiV1Message *message)
 
 void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
 {
-    STRATUM_V1_reset_message(message);
+    if (stratum_trace_get_log_payloads()) {
+        ESP_LOGI(TAG, "rx: %s", stratum_json); // debug incoming stratum messages
+    }
+
+    // mining.notify is by far the most frequent and largest message, skip the cJSON tree for it
+    mining_notify * notify;
+    int message_id;
+    if (mining_notify_parse(stratum_json, &message_id, &notify)) {
+        STRATUM_V1_reset_message(message);
+        message->message_id = message_id;
+        message->method = MINING_NOTIFY;
+        message->mining_notification = notify;
+    } else {
+        STRATUM_V1_parse_cjson(message, stratum_json);
+    }
+
+    stratum_trace_record(STRATUM_TRACE_RX, message->method, message->message_id, stratum_json, strlen(stratum_json));
+}
 
-    ESP_LOGI(TAG, "rx: %s", stratum_json); // debug incoming stratum messages
+void STRATUM_V1_parse_cjson(StratumApiV1Message * message, const char * stratum_json)
+{
+    STRATUM_V1_reset_message(message);
 
     cJSON * json = cJSON_Parse(stratum_json);
 
@@ -358,52 +335,46 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
 
     if (message->method == MINING_NOTIFY) {
 
-        mining_notify * new_work = malloc(sizeof(mining_notify));
-        // new_work->difficulty = difficulty;
         cJSON * params = cJSON_GetObjectItem(json, "params");
         if (!params || !cJSON_IsArray(params)) {
             ESP_LOGE(TAG, "Invalid params in mining.notify");
-            free(new_work);
             goto done;
         }
         int params_count = cJSON_GetArraySize(params);
         if (params_count < 8) {
             ESP_LOGE(TAG, "Not enough params in mining.notify: %d", params_count);
-            free(new_work);
             goto done;
         }
         cJSON *job_id_item = cJSON_GetArrayItem(params, 0);
         if (!job_id_item || !cJSON_IsString(job_id_item)) {
             ESP_LOGE(TAG, "Invalid job_id in mining.notify");
-            free(new_work);
             goto done;
         }
-        new_work->job_id = strdup(job_id_item->valuestring);
-        new_work->prev_block_hash = strdup(cJSON_GetArrayItem(params, 1)->valuestring);
-        new_work->coinbase_1 = strdup(cJSON_GetArrayItem(params, 2)->valuestring);
-        new_work->coinbase_2 = strdup(cJSON_GetArrayItem(params, 3)->valuestring);
+        const char * job_id = job_id_item->valuestring;
+        const char * prev_block_hash = cJSON_GetArrayItem(params, 1)->valuestring;
+        const char * coinbase_1 = cJSON_GetArrayItem(params, 2)->valuestring;
+        const char * coinbase_2 = cJSON_GetArrayItem(params, 3)->valuestring;
 
         cJSON * merkle_branch = cJSON_GetArrayItem(params, 4);
         if (!merkle_branch || !cJSON_IsArray(merkle_branch)) {
             ESP_LOGE(TAG, "Invalid merkle_branch in mining.notify");
-            free(new_work->job_id);
-            free(new_work->prev_block_hash);
-            free(new_work->coinbase_1);
-            free(new_work->coinbase_2);
-            free(new_work);
             goto done;
         }
-        new_work->n_merkle_branches = cJSON_GetArraySize(merkle_branch);
-        if (new_work->n_merkle_branches > MAX_MERKLE_BRANCHES) {
-            ESP_LOGE(TAG, "Too many Merkle branches: %d", new_work->n_merkle_branches);
-            free(new_work->job_id);
-            free(new_work->prev_block_hash);
-            free(new_work->coinbase_1);
-            free(new_work->coinbase_2);
-            free(new_work);
+        int n_merkle_branches = cJSON_GetArraySize(merkle_branch);
+        if (n_merkle_branches > MAX_MERKLE_BRANCHES) {
+            ESP_LOGE(TAG, "Too many Merkle branches: %d", n_merkle_branches);
+            goto done;
+        }
+
+        mining_notify * new_work = mining_notify_create(job_id, strlen(job_id),
+                                                        prev_block_hash, strlen(prev_block_hash),
+                                                        coinbase_1, strlen(coinbase_1),
+                                                        coinbase_2, strlen(coinbase_2),
+                                                        n_merkle_branches);
+        if (new_work == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate mining.notify");
             goto done;
         }
-        new_work->merkle_branches = malloc(HASH_SIZE * new_work->n_merkle_branches);
         for (size_t i = 0; i < new_work->n_merkle_branches; i++) {
             hex2bin(cJSON_GetArrayItem(merkle_branch, i)->valuestring, new_work->merkle_branches + HASH_SIZE * i, HASH_SIZE);
         }
@@ -461,47 +432,44 @@ void STRATUM_V1_parse(StratumApiV1Message * message, const char * stratum_json)
 
 void STRATUM_V1_free_mining_notify(mining_notify * params)
 {
-    free(params->job_id);
-    free(params->prev_block_hash);
-    free(params->coinbase_1);
-    free(params->coinbase_2);
-    free(params->merkle_branches);
-    free(params);
+    // All fields live in the same block
+    mining_notify_release(params);
 }
 
-static void stamp_tx(int request_id, uint64_t timestamp_us)
+static void trace_stratum_tx(const char *msg, size_t len, int send_uid, uint8_t method)
 {
-    if (request_id >= 1) {
-        RequestTiming *timing = get_request_timing(request_id);
-        if (timing) {
-            timing->timestamp_us = timestamp_us;
-            timing->tracking = true;
-        }
+    if (stratum_trace_get_log_payloads()) {
+        ESP_LOGI(TAG, "tx: %.*s", (int)(len > 0 && msg[len - 1] == '\n' ? len - 1 : len), msg);
     }
+    stratum_trace_record(STRATUM_TRACE_TX, method, send_uid, msg, len);
 }
 
-static void debug_stratum_tx(const char * msg)
+static int write_request(esp_transport_handle_t transport, const char *msg, int send_uid, request_method method)
 {
-    char *newline = strchr(msg, '\n');
-    if (newline) {
-        ESP_LOGI(TAG, "tx: %.*s", (int)(newline - msg), msg);
-    } else {
-        ESP_LOGI(TAG, "tx: %s", msg);
-    }
+    size_t len = strlen(msg);
+    trace_stratum_tx(msg, len, send_uid, method);
+    request_table_sent(transport, send_uid, method, esp_timer_get_time());
+    return esp_transport_write(transport, msg, len, TRANSPORT_TIMEOUT_MS);
 }
 
-int STRATUM_V1_subscribe(esp_transport_handle_t transport, int send_uid, const char * model)
+int STRATUM_V1_subscribe(esp_transport_handle_t transport, int send_uid, const char * model, const char * session)
 {
     // Subscribe
     char subscribe_msg[BUFFER_SIZE];
     const esp_app_desc_t *app_desc = esp_app_get_description();
     const char *version = app_desc->version;	
-    snprintf(subscribe_msg, sizeof(subscribe_msg),
-        "{\"id\":%d,\"method\":\"mining.subscribe\",\"params\":[\"bitaxe/%s/%s\"]}\n",
-        send_uid, model, version);
-    debug_stratum_tx(subscribe_msg);
+    if (session != NULL && session[0] != '\0') {
+        // Second param is the session to resume, pools that do resume it keep extranonce_1
+        snprintf(subscribe_msg, sizeof(subscribe_msg),
+            "{\"id\":%d,\"method\":\"mining.subscribe\",\"params\":[\"bitaxe/%s/%s\",\"%s\"]}\n",
+            send_uid, model, version, session);
+    } else {
+        snprintf(subscribe_msg, sizeof(subscribe_msg),
+            "{\"id\":%d,\"method\":\"mining.subscribe\",\"params\":[\"bitaxe/%s/%s\"]}\n",
+            send_uid, model, version);
+    }
 
-    return esp_transport_write(transport, subscribe_msg, strlen(subscribe_msg), TRANSPORT_TIMEOUT_MS);
+    return write_request(transport, subscribe_msg, send_uid, REQUEST_SUBSCRIBE);
 }
 
 int STRATUM_V1_suggest_difficulty(esp_transport_handle_t transport, int send_uid, uint32_t difficulty)
@@ -510,9 +478,8 @@ int STRATUM_V1_suggest_difficulty(esp_transport_handle_t transport, int send_uid
     snprintf(difficulty_msg, sizeof(difficulty_msg),
         "{\"id\":%d,\"method\":\"mining.suggest_difficulty\",\"params\":[%ld]}\n",
         send_uid, difficulty);
-    debug_stratum_tx(difficulty_msg);
 
-    return esp_transport_write(transport, difficulty_msg, strlen(difficulty_msg), TRANSPORT_TIMEOUT_MS);
+    return write_request(transport, difficulty_msg, send_uid, REQUEST_SUGGEST_DIFFICULTY);
 }
 
 int STRATUM_V1_extranonce_subscribe(esp_transport_handle_t transport, int send_uid)
@@ -521,9 +488,8 @@ int STRATUM_V1_extranonce_subscribe(esp_transport_handle_t transport, int send_u
     snprintf(extranonce_msg, sizeof(extranonce_msg),
         "{\"id\":%d,\"method\":\"mining.extranonce.subscribe\",\"params\":[]}\n",
         send_uid);
-    debug_stratum_tx(extranonce_msg);
 
-    return esp_transport_write(transport, extranonce_msg, strlen(extranonce_msg), TRANSPORT_TIMEOUT_MS);
+    return write_request(transport, extranonce_msg, send_uid, REQUEST_EXTRANONCE_SUBSCRIBE);
 }
 
 int STRATUM_V1_authorize(esp_transport_handle_t transport, int send_uid, const char * username, const char * pass)
@@ -532,9 +498,8 @@ int STRATUM_V1_authorize(esp_transport_handle_t transport, int send_uid, const c
     snprintf(authorize_msg, sizeof(authorize_msg),
         "{\"id\":%d,\"method\":\"mining.authorize\",\"params\":[\"%s\",\"%s\"]}\n",
         send_uid, username, pass);
-    debug_stratum_tx(authorize_msg);
 
-    return esp_transport_write(transport, authorize_msg, strlen(authorize_msg), TRANSPORT_TIMEOUT_MS);
+    return write_request(transport, authorize_msg, send_uid, REQUEST_AUTHORIZE);
 }
 
 int STRATUM_V1_pong(esp_transport_handle_t transport, int message_id)
@@ -543,12 +508,14 @@ int STRATUM_V1_pong(esp_transport_handle_t transport, int message_id)
     snprintf(pong_msg, sizeof(pong_msg),
         "{\"id\":%d,\"method\":\"pong\",\"params\":[]}\n",
         message_id);
-    debug_stratum_tx(pong_msg);
-    
-    return esp_transport_write(transport, pong_msg, strlen(pong_msg), TRANSPORT_TIMEOUT_MS);
+    size_t len = strlen(pong_msg);
+    trace_stratum_tx(pong_msg, len, message_id, STRATUM_TRACE_TX_PONG);
+
+    return esp_transport_write(transport, pong_msg, len, TRANSPORT_TIMEOUT_MS);
 }
 
-/// @param transport Transport to write to
+/// @param dest Buffer for the line
+/// @param size Size of dest
 /// @param send_uid Message ID
 /// @param username The client’s user name.
 /// @param job_id The job ID for the work being submitted.
@@ -556,26 +523,43 @@ int STRATUM_V1_pong(esp_transport_handle_t transport, int message_id)
 /// @param ntime The hex-encoded time value use in the block header.
 /// @param nonce The hex-encoded nonce value to use in the block header.
 /// @param version_bits The hex-encoded version bits set by miner (BIP310).
-/// @param out_sent_time_us Pointer to store the time when the share was sent.
-int STRATUM_V1_submit_share(esp_transport_handle_t transport, int send_uid, const char * username, const char * job_id,
-                            const char * extranonce_2, const uint32_t ntime,
-                            const uint32_t nonce, const uint32_t version_bits, uint64_t *out_sent_time_us)
+int STRATUM_V1_format_submit(char *dest, size_t size, int send_uid, const char * username, const char * job_id,
+                             const char * extranonce_2, const uint32_t ntime,
+                             const uint32_t nonce, const uint32_t version_bits)
 {
-    char submit_msg[BUFFER_SIZE];
-    snprintf(submit_msg, sizeof(submit_msg),
+    return snprintf(dest, size,
         "{\"id\":%d,\"method\":\"mining.submit\",\"params\":[\"%s\",\"%s\",\"%s\",\"%08lx\",\"%08lx\",\"%08lx\"]}\n",
         send_uid, username, job_id, extranonce_2, ntime, nonce, version_bits);
+}
 
-    int ret = esp_transport_write(transport, submit_msg, strlen(submit_msg), TRANSPORT_TIMEOUT_MS);
+/// @param transport Transport to write to
+/// @param lines mining.submit lines from STRATUM_V1_format_submit, back to back
+/// @param len Length of lines
+/// @param send_uids Message IDs of the lines
+/// @param n_uids Number of lines
+/// @param out_sent_time_us Pointer to store the time when the shares were sent.
+int STRATUM_V1_submit_batch(esp_transport_handle_t transport, const char *lines, size_t len,
+                            const int *send_uids, int n_uids, uint64_t *out_sent_time_us)
+{
+    // Recorded before the write, the answer may be read by stratum_task before it returns
+    int64_t write_start_us = esp_timer_get_time();
+    for (int i = 0; i < n_uids; i++) {
+        request_table_sent(transport, send_uids[i], REQUEST_SUBMIT, write_start_us);
+    }
+
+    int ret = esp_transport_write(transport, lines, len, TRANSPORT_TIMEOUT_MS);
 
-    uint64_t now = esp_timer_get_time();
     if (out_sent_time_us) {
-        *out_sent_time_us = now;
+        *out_sent_time_us = esp_timer_get_time();
     }
 
-    debug_stratum_tx(submit_msg);
-    
-    stamp_tx(send_uid, now);
+    const char *line = lines;
+    for (int i = 0; i < n_uids && line < lines + len; i++) {
+        const char *newline = memchr(line, '\n', lines + len - line);
+        size_t line_len = newline ? newline - line + 1 : lines + len - line;
+        trace_stratum_tx(line, line_len, send_uids[i], REQUEST_SUBMIT);
+        line += line_len;
+    }
 
     return ret;
 }
@@ -586,7 +570,6 @@ int STRATUM_V1_configure_version_rolling(esp_transport_handle_t transport, int s
     snprintf(configure_msg, sizeof(configure_msg),
         "{\"id\":%d,\"method\":\"mining.configure\",\"params\":[[\"version-rolling\"],{\"version-rolling.mask\":\"ffffffff\"}]}\n",
         send_uid);
-    debug_stratum_tx(configure_msg);
 
-    return esp_transport_write(transport, configure_msg, strlen(configure_msg), TRANSPORT_TIMEOUT_MS);
+    return write_request(transport, configure_msg, send_uid, REQUEST_CONFIGURE);
 }
@@ -0,0 +1,139 @@
+#include "stratum_trace.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "stratum_api.h"
+
+static stratum_trace_entry *ring;
+static uint32_t next_seq;
+static portMUX_TYPE trace_lock = portMUX_INITIALIZER_UNLOCKED;
+static atomic_bool log_payloads = true;
+
+static const char *RX_METHOD_NAMES[] = {
+    [STRATUM_UNKNOWN] = "unknown",
+    [MINING_NOTIFY] = "mining.notify",
+    [MINING_SET_DIFFICULTY] = "mining.set_difficulty",
+    [MINING_SET_VERSION_MASK] = "mining.set_version_mask",
+    [MINING_SET_EXTRANONCE] = "mining.set_extranonce",
+    [MINING_PING] = "mining.ping",
+    [STRATUM_RESULT] = "result",
+    [STRATUM_RESULT_SETUP] = "result",
+    [STRATUM_RESULT_VERSION_MASK] = "result",
+    [STRATUM_RESULT_SUBSCRIBE] = "result",
+    [CLIENT_RECONNECT] = "client.reconnect",
+    [CLIENT_SHOW_MESSAGE] = "client.show_message",
+};
+
+static const char *TX_METHOD_NAMES[] = {
+    [REQUEST_CONFIGURE] = "mining.configure",
+    [REQUEST_SUBSCRIBE] = "mining.subscribe",
+    [REQUEST_AUTHORIZE] = "mining.authorize",
+    [REQUEST_SUGGEST_DIFFICULTY] = "mining.suggest_difficulty",
+    [REQUEST_EXTRANONCE_SUBSCRIBE] = "mining.extranonce.subscribe",
+    [REQUEST_SUBMIT] = "mining.submit",
+    [STRATUM_TRACE_TX_PONG] = "pong",
+};
+
+esp_err_t stratum_trace_init(void)
+{
+    if (ring != NULL) {
+        return ESP_OK;
+    }
+    stratum_trace_entry *entries = heap_caps_calloc_prefer(STRATUM_TRACE_SIZE, sizeof(stratum_trace_entry), 2,
+                                                           MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT);
+    if (entries == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    taskENTER_CRITICAL(&trace_lock);
+    ring = entries;
+    taskEXIT_CRITICAL(&trace_lock);
+    return ESP_OK;
+}
+
+void stratum_trace_record(stratum_trace_direction direction, uint8_t method, int id, const char *line, size_t len)
+{
+    if (ring == NULL) {
+        return;
+    }
+    if (len > 0 && line[len - 1] == '\n') {
+        len--;
+    }
+    uint8_t payload_len = len < STRATUM_TRACE_PAYLOAD_LEN ? len : STRATUM_TRACE_PAYLOAD_LEN;
+    int64_t now_us = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&trace_lock);
+    stratum_trace_entry *entry = &ring[next_seq % STRATUM_TRACE_SIZE];
+    entry->seq = next_seq++;
+    entry->timestamp_us = now_us;
+    entry->id = id;
+    entry->length = len > UINT16_MAX ? UINT16_MAX : len;
+    entry->direction = direction;
+    entry->method = method;
+    entry->payload_len = payload_len;
+    memcpy(entry->payload, line, payload_len);
+    taskEXIT_CRITICAL(&trace_lock);
+}
+
+size_t stratum_trace_read(uint32_t *seq, stratum_trace_entry *entries, size_t max_entries)
+{
+    size_t count = 0;
+
+    taskENTER_CRITICAL(&trace_lock);
+    if (ring != NULL) {
+        uint32_t oldest = next_seq > STRATUM_TRACE_SIZE ? next_seq - STRATUM_TRACE_SIZE : 0;
+        // Also restarts a reader that is ahead, e.g. from before a reboot
+        if (*seq < oldest || *seq > next_seq) {
+            *seq = oldest;
+        }
+        while (*seq != next_seq && count < max_entries) {
+            entries[count++] = ring[*seq % STRATUM_TRACE_SIZE];
+            (*seq)++;
+        }
+    }
+    taskEXIT_CRITICAL(&trace_lock);
+
+    return count;
+}
+
+uint32_t stratum_trace_next_seq(void)
+{
+    taskENTER_CRITICAL(&trace_lock);
+    uint32_t seq = next_seq;
+    taskEXIT_CRITICAL(&trace_lock);
+    return seq;
+}
+
+const char *stratum_trace_method_name(const stratum_trace_entry *entry)
+{
+    if (entry->direction == STRATUM_TRACE_RX) {
+        return entry->method < sizeof(RX_METHOD_NAMES) / sizeof(RX_METHOD_NAMES[0]) ? RX_METHOD_NAMES[entry->method] : "unknown";
+    }
+    return entry->method < sizeof(TX_METHOD_NAMES) / sizeof(TX_METHOD_NAMES[0]) ? TX_METHOD_NAMES[entry->method] : "unknown";
+}
+
+int stratum_trace_format(const stratum_trace_entry *entry, char *dest, size_t size)
+{
+    // Same shape as the ESP_LOGI lines it replaces, with the cut noted
+    int truncated = entry->length - entry->payload_len;
+    if (truncated > 0) {
+        return snprintf(dest, size, "I (%" PRId64 ") stratum_api: %s: %.*s... (%d more bytes)\n", entry->timestamp_us / 1000,
+                        entry->direction == STRATUM_TRACE_RX ? "rx" : "tx", entry->payload_len, entry->payload, truncated);
+    }
+    return snprintf(dest, size, "I (%" PRId64 ") stratum_api: %s: %.*s\n", entry->timestamp_us / 1000,
+                    entry->direction == STRATUM_TRACE_RX ? "rx" : "tx", entry->payload_len, entry->payload);
+}
+
+void stratum_trace_set_log_payloads(bool enabled)
+{
+    atomic_store(&log_payloads, enabled);
+}
+
+bool stratum_trace_get_log_payloads(void)
+{
+    return atomic_load(&log_payloads);
+}
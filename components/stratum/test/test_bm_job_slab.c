@@ -0,0 +1,90 @@
+#include "unity.h"
+#include "bm_job_slab.h"
+#include "esp_heap_caps.h"
+
+#include <string.h>
+
+TEST_CASE("Job slab stores jobs inline by job id", "[bm_job_slab]")
+{
+    TEST_ASSERT_EQUAL(ESP_OK, bm_job_slab_init());
+
+    bm_job job = {0};
+    job.version = 0x20000000;
+    strcpy(job.jobid, "6a1b");
+    strcpy(job.extranonce2, "0100000000000000");
+
+    bm_job *slot = bm_job_slab_store(24, &job, false);
+    TEST_ASSERT_EQUAL(0x20000000, slot->version);
+    TEST_ASSERT_EQUAL_STRING("6a1b", slot->jobid);
+    TEST_ASSERT_EQUAL_STRING("0100000000000000", slot->extranonce2);
+
+    // The caller's job can go away, the slot keeps its own copy
+    memset(&job, 0, sizeof(job));
+    TEST_ASSERT_EQUAL_STRING("6a1b", slot->jobid);
+    TEST_ASSERT_EQUAL_PTR(slot, bm_job_slab_store(24, slot, false));
+}
+
+TEST_CASE("Job slab counts reuses and overwrites", "[bm_job_slab]")
+{
+    TEST_ASSERT_EQUAL(ESP_OK, bm_job_slab_init());
+
+    bm_job job = {0};
+    bm_job_slab_stats before, after;
+
+    // Make sure slot 48 has been used before
+    bm_job_slab_store(48, &job, false);
+
+    bm_job_slab_get_stats(&before);
+    bm_job_slab_store(48, &job, false);
+    bm_job_slab_store(48, &job, true);
+    bm_job_slab_get_stats(&after);
+
+    TEST_ASSERT_EQUAL(2, after.stores - before.stores);
+    TEST_ASSERT_EQUAL(1, after.reuses - before.reuses);
+    TEST_ASSERT_EQUAL(1, after.overwrites - before.overwrites);
+}
+
+TEST_CASE("Job slab stores without heap traffic", "[bm_job_slab]")
+{
+    TEST_ASSERT_EQUAL(ESP_OK, bm_job_slab_init());
+
+    bm_job job = {0};
+    strcpy(job.jobid, "ffffffffffffffff");
+    strcpy(job.extranonce2, "ffffffffffffffff");
+
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    for (int i = 0; i < 10000; i++) {
+        // same id sequence as the BM1366 and newer drivers
+        bm_job_slab_store((i * 24) % BM_JOB_SLAB_SIZE, &job, true);
+    }
+    TEST_ASSERT_EQUAL(free_before, heap_caps_get_free_size(MALLOC_CAP_8BIT));
+}
+
+TEST_CASE("Job slab invalidates a pool's jobs of older blocks", "[bm_job_slab]")
+{
+    TEST_ASSERT_EQUAL(ESP_OK, bm_job_slab_init());
+
+    uint8_t valid_jobs[BM_JOB_SLAB_SIZE] = {0};
+    bm_job job = {0};
+
+    // Primary pool jobs of generation 1 and 2, a fallback pool job of generation 1
+    job.pool = 0;
+    job.generation = 1;
+    bm_job_slab_store(8, &job, false);
+    bm_job_slab_store(16, &job, false);
+    job.generation = 2;
+    bm_job_slab_store(24, &job, false);
+    job.pool = 1;
+    job.generation = 1;
+    bm_job_slab_store(32, &job, false);
+    valid_jobs[8] = valid_jobs[16] = valid_jobs[24] = valid_jobs[32] = 1;
+
+    TEST_ASSERT_EQUAL(2, bm_job_slab_invalidate(0, 2, valid_jobs));
+    TEST_ASSERT_EQUAL(0, valid_jobs[8]);
+    TEST_ASSERT_EQUAL(0, valid_jobs[16]);
+    TEST_ASSERT_EQUAL(1, valid_jobs[24]);
+    TEST_ASSERT_EQUAL(1, valid_jobs[32]);
+
+    // Nothing left to invalidate for the same generation
+    TEST_ASSERT_EQUAL(0, bm_job_slab_invalidate(0, 2, valid_jobs));
+}
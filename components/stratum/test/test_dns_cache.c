@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "unity.h"
+#include "dns_cache.h"
+
+static const uint8_t A_RESPONSE[] = {
+    0x12, 0x34, 0x81, 0x80, 0x00, 0x01, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00,
+    // pool.example.com A IN
+    0x04, 'p', 'o', 'o', 'l', 0x07, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0x03, 'c', 'o', 'm', 0x00,
+    0x00, 0x01, 0x00, 0x01,
+    // CNAME to eu.example.com, TTL 600
+    0xc0, 0x0c, 0x00, 0x05, 0x00, 0x01, 0x00, 0x00, 0x02, 0x58, 0x00, 0x05,
+    0x02, 'e', 'u', 0xc0, 0x11,
+    // eu.example.com A 192.0.2.1, TTL 300
+    0xc0, 0x2e, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x01, 0x2c, 0x00, 0x04,
+    192, 0, 2, 1,
+    // eu.example.com A 192.0.2.2, TTL 120
+    0xc0, 0x2e, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x78, 0x00, 0x04,
+    192, 0, 2, 2,
+};
+
+static dns_address ipv4(uint8_t last)
+{
+    dns_address address = { .family = AF_INET, .addr = { 192, 0, 2, last } };
+    return address;
+}
+
+static dns_address ipv6(uint8_t last)
+{
+    dns_address address = { .family = AF_INET6, .addr = { 0x20, 0x01, 0x0d, 0xb8, [15] = last } };
+    return address;
+}
+
+TEST_CASE("DNS query has the hostname as labels", "[dns_cache]")
+{
+    uint8_t query[512];
+    int len = dns_build_query(query, sizeof(query), 0x1234, "pool.example.com.", DNS_TYPE_AAAA);
+
+    // Same question as the response above, asking for AAAA
+    TEST_ASSERT_EQUAL(34, len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(A_RESPONSE, query, 2);
+    TEST_ASSERT_EQUAL_HEX8(0x01, query[2]);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(A_RESPONSE + 12, query + 12, 18);
+    TEST_ASSERT_EQUAL_HEX8(DNS_TYPE_AAAA, query[31]);
+
+    TEST_ASSERT_EQUAL(-1, dns_build_query(query, sizeof(query), 1, "pool..example.com", DNS_TYPE_A));
+    TEST_ASSERT_EQUAL(-1, dns_build_query(query, sizeof(query), 1, "", DNS_TYPE_A));
+    TEST_ASSERT_EQUAL(-1, dns_build_query(query, 20, 1, "pool.example.com", DNS_TYPE_A));
+}
+
+TEST_CASE("DNS response follows compressed names and CNAMEs", "[dns_cache]")
+{
+    dns_address addresses[4];
+    uint32_t ttl;
+    TEST_ASSERT_EQUAL(2, dns_parse_response(A_RESPONSE, sizeof(A_RESPONSE), 0x1234, addresses, 4, &ttl));
+    TEST_ASSERT_EQUAL(120, ttl);
+    TEST_ASSERT_EQUAL(AF_INET, addresses[0].family);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(((uint8_t[]) { 192, 0, 2, 1 }), addresses[0].addr, 4);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(((uint8_t[]) { 192, 0, 2, 2 }), addresses[1].addr, 4);
+
+    // Room for one
+    TEST_ASSERT_EQUAL(1, dns_parse_response(A_RESPONSE, sizeof(A_RESPONSE), 0x1234, addresses, 1, &ttl));
+
+    // Answer to another query
+    TEST_ASSERT_EQUAL(-1, dns_parse_response(A_RESPONSE, sizeof(A_RESPONSE), 0x4321, addresses, 4, &ttl));
+
+    // Cut in the last record, the first one is still good
+    TEST_ASSERT_EQUAL(1, dns_parse_response(A_RESPONSE, sizeof(A_RESPONSE) - 2, 0x1234, addresses, 4, &ttl));
+    // Cut in the question
+    TEST_ASSERT_EQUAL(-1, dns_parse_response(A_RESPONSE, 20, 0x1234, addresses, 4, &ttl));
+}
+
+TEST_CASE("DNS response without addresses", "[dns_cache]")
+{
+    dns_address addresses[4];
+    uint32_t ttl;
+    uint8_t response[sizeof(A_RESPONSE)];
+
+    // NXDOMAIN
+    memcpy(response, A_RESPONSE, 34);
+    response[3] = 0x83;
+    response[7] = 0;
+    TEST_ASSERT_EQUAL(0, dns_parse_response(response, 34, 0x1234, addresses, 4, &ttl));
+
+    // SERVFAIL is no answer
+    response[3] = 0x82;
+    TEST_ASSERT_EQUAL(-1, dns_parse_response(response, 34, 0x1234, addresses, 4, &ttl));
+
+    // A query is no response
+    memcpy(response, A_RESPONSE, sizeof(A_RESPONSE));
+    response[2] = 0x01;
+    TEST_ASSERT_EQUAL(-1, dns_parse_response(response, sizeof(response), 0x1234, addresses, 4, &ttl));
+
+    // Reserved label type
+    memcpy(response, A_RESPONSE, sizeof(A_RESPONSE));
+    response[12] = 0x40;
+    TEST_ASSERT_EQUAL(-1, dns_parse_response(response, sizeof(response), 0x1234, addresses, 4, &ttl));
+}
+
+TEST_CASE("DNS addresses alternate between the families", "[dns_cache]")
+{
+    dns_address addresses[] = { ipv6(1), ipv6(2), ipv6(3), ipv4(1), ipv4(2) };
+    dns_interleave_addresses(addresses, 5);
+
+    TEST_ASSERT_EQUAL(AF_INET, addresses[0].family);
+    TEST_ASSERT_EQUAL(1, addresses[0].addr[3]);
+    TEST_ASSERT_EQUAL(AF_INET6, addresses[1].family);
+    TEST_ASSERT_EQUAL(1, addresses[1].addr[15]);
+    TEST_ASSERT_EQUAL(AF_INET, addresses[2].family);
+    TEST_ASSERT_EQUAL(2, addresses[2].addr[3]);
+    TEST_ASSERT_EQUAL(2, addresses[3].addr[15]);
+    TEST_ASSERT_EQUAL(3, addresses[4].addr[15]);
+}
+
+TEST_CASE("DNS literal addresses", "[dns_cache]")
+{
+    dns_address address;
+    char text[64];
+
+    TEST_ASSERT_TRUE(dns_parse_literal("192.0.2.7", &address));
+    TEST_ASSERT_EQUAL(AF_INET, address.family);
+    dns_address_to_string(&address, text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("192.0.2.7", text);
+
+    TEST_ASSERT_TRUE(dns_parse_literal("fe80::1%2", &address));
+    TEST_ASSERT_EQUAL(AF_INET6, address.family);
+    TEST_ASSERT_EQUAL_UINT32(2, address.scope_id);
+    dns_address_to_string(&address, text, sizeof(text));
+    TEST_ASSERT_EQUAL_STRING("fe80::1%2", text);
+
+    TEST_ASSERT_FALSE(dns_parse_literal("pool.example.com", &address));
+}
+
+TEST_CASE("DNS cache honours the TTL", "[dns_cache]")
+{
+    dns_cache_reset();
+    dns_address stored[] = { ipv4(1), ipv6(1) };
+    dns_address addresses[4];
+
+    dns_cache_store("pool.example.com", stored, 2, 300, 0);
+    TEST_ASSERT_EQUAL(2, dns_cache_lookup("pool.example.com", 299999999, false, addresses, 4));
+    TEST_ASSERT_EQUAL_MEMORY(stored, addresses, sizeof(stored));
+    TEST_ASSERT_EQUAL(0, dns_cache_lookup("other.example.com", 0, false, addresses, 4));
+
+    // Expired, unless nothing better is around
+    TEST_ASSERT_EQUAL(0, dns_cache_lookup("pool.example.com", 300000000, false, addresses, 4));
+    TEST_ASSERT_EQUAL(2, dns_cache_lookup("pool.example.com", 300000000, true, addresses, 4));
+
+    // TTL 0 is held for the minimum
+    dns_cache_store("pool.example.com", stored, 1, 0, 0);
+    TEST_ASSERT_EQUAL(1, dns_cache_lookup("pool.example.com", DNS_CACHE_MIN_TTL_S * 1000000LL - 1, false, addresses, 4));
+}
+
+TEST_CASE("DNS cache replaces the least recently used hostname", "[dns_cache]")
+{
+    dns_cache_reset();
+    dns_address stored = ipv4(1);
+    dns_address address;
+    char hostname[32];
+
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        snprintf(hostname, sizeof(hostname), "pool%d.example.com", i);
+        dns_cache_store(hostname, &stored, 1, 300, i);
+    }
+    // pool0 is used again, pool1 is the oldest now
+    TEST_ASSERT_EQUAL(1, dns_cache_lookup("pool0.example.com", 10, false, &address, 1));
+    dns_cache_store("new.example.com", &stored, 1, 300, 11);
+
+    TEST_ASSERT_EQUAL(1, dns_cache_lookup("pool0.example.com", 12, false, &address, 1));
+    TEST_ASSERT_EQUAL(0, dns_cache_lookup("pool1.example.com", 12, true, &address, 1));
+    TEST_ASSERT_EQUAL(1, dns_cache_lookup("new.example.com", 12, false, &address, 1));
+}
@@ -0,0 +1,184 @@
+#include "unity.h"
+#include "line_reader.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Recorded pool session: subscribe/authorize results, difficulty, a notify and share results
+static const char *pool_traffic[] = {
+    "{\"result\":[[[\"mining.notify\",\"695482c0\"]],\"4de05269\",8],\"id\":2,\"error\":null}\n",
+    "{\"id\":3,\"error\":null,\"result\":true}\n",
+    "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[1638]}\n",
+    "{\"id\":null,\"method\":\"mining.notify\",\"params\":"
+    "[\"1b4c3d9041\","
+    "\"ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000\","
+    "\"01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020cfabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000\","
+    "\"41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c2952534b424c4f434b3a4cb4cb2ddfc37c41baf5ef6b6b4899e3253a8f1dfc7e5dd68a5b5b27005014ef0000000000000000266a24aa21a9ed5caa249f1af9fbf71c986fea8e076ca34ae3514fb2f86400561b28c7b15949bf00000000\","
+    "[\"ae23055e00f0f697cc3640124812d96d4fe8bdfa03484c1c638ce5a1c0e9aa81\",\"980fb87cb61021dd7afd314fcb0dabd096f3d56a7377f6f320684652e7410a21\",\"a52e9868343c55ce405be8971ff340f562ae9ab6353f07140d01666180e19b52\",\"7435bdfa004e603953b2ed39f118803934d9cf17b06d979ceb682f2251bafac2\",\"2a91f061a22d27cb8f44eea79938fb241ebeb359891aa907f05ffde7ed44e52e\",\"302401f80eb5e958155135e25200bb8ea181ad2d05e804a531c7314d86403cdc\",\"318ecb6161eb9b4cfd802bd730e2d36c167ddf102e70aa7b4158e2870dd47392\",\"1114332a9858e0cf84b2425bb1e59eaabf91dd102d114aa443d57fc1b3beb0c9\",\"f43f38095c810613ed795a44d9fab02ff25269706f454885db9be05cdf9c06e1\",\"3e2fc26b27fddc39668b59099cd9635761bb72ed92404204e12bdff08b16fb75\",\"463c19427286342120039a83218fa87ce45448e246895abac11fff0036076758\",\"03d287f655813e540ddb9c4e7aeb922478662b0f5d8e9d0cbd564b20146bab76\"],"
+    "\"20000004\",\"1705c739\",\"64495522\",true]}\n",
+    "{\"id\":5,\"error\":null,\"result\":true}\n",
+    "{\"id\":6,\"result\":null,\"error\":[23,\"Duplicate share\",null]}\n",
+};
+
+#define POOL_TRAFFIC_COUNT (sizeof(pool_traffic) / sizeof(pool_traffic[0]))
+
+// Feed data into the reader in chunks of chunk_size bytes, returns the number of lines read
+static int replay(line_reader_t *reader, const char *data, size_t data_len, size_t chunk_size, const char **lines, int max_lines)
+{
+    int count = 0;
+    size_t offset = 0;
+    while (offset < data_len) {
+        size_t available;
+        char *dest = line_reader_get_write_space(reader, &available);
+        TEST_ASSERT_NOT_NULL(dest);
+        size_t n = data_len - offset;
+        if (n > chunk_size) n = chunk_size;
+        if (n > available) n = available;
+        memcpy(dest, data + offset, n);
+        line_reader_commit(reader, n);
+        offset += n;
+
+        char *line;
+        while ((line = line_reader_next_line(reader, NULL)) != NULL) {
+            if (lines && count < max_lines) {
+                lines[count] = line;
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+TEST_CASE("Line reader splits lines received in pieces", "[line_reader]")
+{
+    line_reader_t reader;
+    TEST_ASSERT_EQUAL(ESP_OK, line_reader_init(&reader, 256));
+
+    const char *data = "{\"id\":1}\n{\"id\":2}\n{\"id\":3}";
+    size_t len;
+    size_t available;
+
+    char *dest = line_reader_get_write_space(&reader, &available);
+    memcpy(dest, data, 5);
+    line_reader_commit(&reader, 5);
+    TEST_ASSERT_NULL(line_reader_next_line(&reader, &len));
+
+    dest = line_reader_get_write_space(&reader, &available);
+    memcpy(dest, data + 5, strlen(data) - 5);
+    line_reader_commit(&reader, strlen(data) - 5);
+
+    TEST_ASSERT_EQUAL_STRING("{\"id\":1}", line_reader_next_line(&reader, &len));
+    TEST_ASSERT_EQUAL(8, len);
+    TEST_ASSERT_EQUAL_STRING("{\"id\":2}", line_reader_next_line(&reader, &len));
+    TEST_ASSERT_NULL(line_reader_next_line(&reader, &len));
+
+    dest = line_reader_get_write_space(&reader, &available);
+    memcpy(dest, "\n", 1);
+    line_reader_commit(&reader, 1);
+    TEST_ASSERT_EQUAL_STRING("{\"id\":3}", line_reader_next_line(&reader, &len));
+    TEST_ASSERT_NULL(line_reader_next_line(&reader, &len));
+
+    line_reader_free(&reader);
+}
+
+TEST_CASE("Line reader moves a partial line to the front when full", "[line_reader]")
+{
+    line_reader_t reader;
+    TEST_ASSERT_EQUAL(ESP_OK, line_reader_init(&reader, 16));
+
+    size_t available;
+    char *dest = line_reader_get_write_space(&reader, &available);
+    TEST_ASSERT_EQUAL(16, available);
+    memcpy(dest, "0123456789\nabcde", 16);
+    line_reader_commit(&reader, 16);
+
+    TEST_ASSERT_EQUAL_STRING("0123456789", line_reader_next_line(&reader, NULL));
+    TEST_ASSERT_NULL(line_reader_next_line(&reader, NULL));
+
+    dest = line_reader_get_write_space(&reader, &available);
+    TEST_ASSERT_EQUAL_PTR(reader.buffer + 5, dest);
+    TEST_ASSERT_EQUAL(11, available);
+    memcpy(dest, "fgh\n", 4);
+    line_reader_commit(&reader, 4);
+
+    TEST_ASSERT_EQUAL_STRING("abcdefgh", line_reader_next_line(&reader, NULL));
+
+    line_reader_free(&reader);
+}
+
+TEST_CASE("Line reader reports a line that does not fit", "[line_reader]")
+{
+    line_reader_t reader;
+    TEST_ASSERT_EQUAL(ESP_OK, line_reader_init(&reader, 8));
+
+    size_t available;
+    char *dest = line_reader_get_write_space(&reader, &available);
+    memcpy(dest, "01234567", 8);
+    line_reader_commit(&reader, 8);
+    TEST_ASSERT_NULL(line_reader_next_line(&reader, NULL));
+    TEST_ASSERT_NULL(line_reader_get_write_space(&reader, &available));
+    TEST_ASSERT_EQUAL(0, available);
+
+    line_reader_reset(&reader);
+    TEST_ASSERT_NOT_NULL(line_reader_get_write_space(&reader, &available));
+    TEST_ASSERT_EQUAL(8, available);
+
+    line_reader_free(&reader);
+}
+
+TEST_CASE("Line reader returns recorded pool traffic for any chunk size", "[line_reader]")
+{
+    char data[4096] = "";
+    for (int i = 0; i < POOL_TRAFFIC_COUNT; i++) {
+        strcat(data, pool_traffic[i]);
+    }
+
+    const size_t chunk_sizes[] = {1, 7, 64, 536, 1460, sizeof(data)};
+    for (int c = 0; c < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); c++) {
+        line_reader_t reader;
+        TEST_ASSERT_EQUAL(ESP_OK, line_reader_init(&reader, 2048));
+
+        const char *lines[POOL_TRAFFIC_COUNT];
+        int count = replay(&reader, data, strlen(data), chunk_sizes[c], lines, POOL_TRAFFIC_COUNT);
+        TEST_ASSERT_EQUAL(POOL_TRAFFIC_COUNT, count);
+
+        // The last line is still intact, all others may have been moved
+        size_t last_len = strlen(pool_traffic[POOL_TRAFFIC_COUNT - 1]) - 1;
+        TEST_ASSERT_EQUAL_STRING_LEN(pool_traffic[POOL_TRAFFIC_COUNT - 1], lines[POOL_TRAFFIC_COUNT - 1], last_len);
+
+        line_reader_free(&reader);
+    }
+}
+
+TEST_CASE("Line reader replay throughput", "[line_reader][benchmark][not-on-qemu]")
+{
+    static char data[4096];
+    data[0] = '\0';
+    for (int i = 0; i < POOL_TRAFFIC_COUNT; i++) {
+        strcat(data, pool_traffic[i]);
+    }
+    size_t data_len = strlen(data);
+
+    line_reader_t reader;
+    TEST_ASSERT_EQUAL(ESP_OK, line_reader_init(&reader, 32 * 1024));
+
+    const int iterations = 500;
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    int64_t start = esp_timer_get_time();
+    int lines = 0;
+    for (int i = 0; i < iterations; i++) {
+        lines += replay(&reader, data, data_len, 1460, NULL, 0);
+    }
+    int64_t duration_us = esp_timer_get_time() - start;
+    size_t free_after = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+
+    TEST_ASSERT_EQUAL(iterations * POOL_TRAFFIC_COUNT, lines);
+    TEST_ASSERT_EQUAL(free_before, free_after);
+
+    printf("line reader: %d lines, %.0f bytes/s, no allocations\n",
+           lines, (double) data_len * iterations * 1000000.0 / duration_us);
+
+    line_reader_free(&reader);
+}
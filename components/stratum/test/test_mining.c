@@ -1,9 +1,12 @@
 #include "unity.h"
 #include "mining.h"
 #include "utils.h"
+#include "mining_notify_pool.h"
+#include "esp_timer.h"
 
 #include <limits.h>
 #include <string.h>
+#include <stdio.h>
 
 TEST_CASE("Check coinbase tx construction", "[mining]")
 {
@@ -25,6 +28,150 @@ TEST_CASE("Check coinbase tx construction", "[mining]")
     TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_coinbase_tx_hash, coinbase_tx_hash, 32);
 }
 
+static mining_notify *create_coinbase_notify(const char *coinbase_1, const char *coinbase_2)
+{
+    return mining_notify_create("1", 1, "", 0, coinbase_1, strlen(coinbase_1), coinbase_2, strlen(coinbase_2), 0);
+}
+
+TEST_CASE("Coinbase template matches hex coinbase tx hash", "[mining]")
+{
+    const char *coinbase_1 = "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008";
+    const char *coinbase_2 = "072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000";
+    const char *extranonce = "e9695791";
+    const uint32_t extranonce_2_lens[] = { 4, 8, 12 };
+    const uint64_t extranonce_2_values[] = { 0, 1, 0x99999999, 0x0123456789abcdefULL };
+
+    mining_notify *notify = create_coinbase_notify(coinbase_1, coinbase_2);
+    TEST_ASSERT_NOT_NULL(notify);
+
+    coinbase_template tpl = {0};
+    for (int i = 0; i < sizeof(extranonce_2_lens) / sizeof(extranonce_2_lens[0]); i++) {
+        uint32_t extranonce_2_len = extranonce_2_lens[i];
+        TEST_ASSERT_TRUE(coinbase_template_build(&tpl, notify, extranonce, extranonce_2_len));
+        TEST_ASSERT_TRUE(coinbase_template_matches(&tpl, extranonce, extranonce_2_len));
+        TEST_ASSERT_FALSE(coinbase_template_matches(&tpl, "e9695792", extranonce_2_len));
+        TEST_ASSERT_FALSE(coinbase_template_matches(&tpl, extranonce, extranonce_2_len + 1));
+
+        for (int j = 0; j < sizeof(extranonce_2_values) / sizeof(extranonce_2_values[0]); j++) {
+            char extranonce_2[extranonce_2_len * 2 + 1];
+            extranonce_2_generate(extranonce_2_values[j], extranonce_2_len, extranonce_2);
+            uint8_t expected[32];
+            calculate_coinbase_tx_hash(coinbase_1, coinbase_2, extranonce, extranonce_2, expected);
+
+            uint8_t actual[32];
+            coinbase_template_set_extranonce_2(&tpl, extranonce_2_values[j]);
+            coinbase_template_hash(&tpl, actual);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, actual, 32);
+        }
+    }
+
+    coinbase_template_free(&tpl);
+    STRATUM_V1_free_mining_notify(notify);
+}
+
+TEST_CASE("Coinbase template cached prefix matches full hash", "[mining]")
+{
+    // Coinbase pairs from the vectors above, plus generated ones so extranonce_2
+    // starts before, on and after every 64 byte block boundary
+    const char *vectors[][3] = {
+        { "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008",
+          "072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000",
+          "e9695791" },
+        { "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008e969579199999999072f736c7573682f0000000001",
+          "1976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000",
+          "00f2052a" },
+        { "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff2503777d07062f503253482f0405b8c75208f800880e000000000b2f436f696e48756e74722f0000000001",
+          "1976a914c633315d376c20a973a758f7422d67f7bfed9c5888ac00000000",
+          "603f352a" },
+    };
+    static char generated[2 * 200 + 1];
+    coinbase_template tpl = {0};
+
+    for (int i = 0; i < sizeof(vectors) / sizeof(vectors[0]) + 200; i++) {
+        const char *coinbase_1, *coinbase_2, *extranonce;
+        if (i < sizeof(vectors) / sizeof(vectors[0])) {
+            coinbase_1 = vectors[i][0];
+            coinbase_2 = vectors[i][1];
+            extranonce = vectors[i][2];
+        } else {
+            size_t len = i - sizeof(vectors) / sizeof(vectors[0]);
+            for (size_t j = 0; j < 2 * len; j++) generated[j] = "0123456789abcdef"[(j * 5 + len) % 16];
+            generated[2 * len] = '\0';
+            coinbase_1 = generated;
+            coinbase_2 = vectors[0][1];
+            extranonce = vectors[0][2];
+        }
+
+        mining_notify *notify = create_coinbase_notify(coinbase_1, coinbase_2);
+        TEST_ASSERT_NOT_NULL(notify);
+        TEST_ASSERT_TRUE(coinbase_template_build(&tpl, notify, extranonce, 4));
+        TEST_ASSERT_EQUAL(0, tpl.prefix_len % 64);
+        TEST_ASSERT_LESS_OR_EQUAL(tpl.extranonce_2_offset, tpl.prefix_len);
+
+        for (uint64_t extranonce_2 = 0; extranonce_2 < 3; extranonce_2++) {
+            char extranonce_2_str[9];
+            extranonce_2_generate(extranonce_2, 4, extranonce_2_str);
+            uint8_t expected[32];
+            calculate_coinbase_tx_hash(coinbase_1, coinbase_2, extranonce, extranonce_2_str, expected);
+
+            uint8_t actual[32];
+            coinbase_template_set_extranonce_2(&tpl, extranonce_2);
+            coinbase_template_hash(&tpl, actual);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, actual, 32);
+        }
+        STRATUM_V1_free_mining_notify(notify);
+    }
+
+    coinbase_template_free(&tpl);
+}
+
+TEST_CASE("Coinbase template job throughput", "[mining][benchmark][not-on-qemu]")
+{
+    const int iterations = 500;
+    const char *extranonce = "e9695791";
+    const uint32_t extranonce_2_len = 8;
+    static char coinbase_1[2 * 200 + 1];
+    static char coinbase_2[2 * 400 + 1];
+    uint8_t merkle_branches[12][32] = {0};
+    uint8_t coinbase_tx_hash[32];
+    uint8_t merkle_root[32];
+
+    // Coinbase sizes seen on pools with long payout outputs
+    for (int i = 0; i < sizeof(coinbase_1) - 1; i++) coinbase_1[i] = "0123456789abcdef"[(i * 7) % 16];
+    for (int i = 0; i < sizeof(coinbase_2) - 1; i++) coinbase_2[i] = "0123456789abcdef"[(i * 11) % 16];
+
+    mining_notify *notify = create_coinbase_notify(coinbase_1, coinbase_2);
+    TEST_ASSERT_NOT_NULL(notify);
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        char extranonce_2[extranonce_2_len * 2 + 1];
+        extranonce_2_generate(i, extranonce_2_len, extranonce_2);
+        calculate_coinbase_tx_hash(notify->coinbase_1, notify->coinbase_2, extranonce, extranonce_2, coinbase_tx_hash);
+        calculate_merkle_root_hash(coinbase_tx_hash, merkle_branches, 12, merkle_root);
+    }
+    int64_t hex_us = esp_timer_get_time() - start;
+
+    coinbase_template tpl = {0};
+    start = esp_timer_get_time();
+    TEST_ASSERT_TRUE(coinbase_template_build(&tpl, notify, extranonce, extranonce_2_len));
+    for (int i = 0; i < iterations; i++) {
+        char extranonce_2[extranonce_2_len * 2 + 1];
+        extranonce_2_generate(i, extranonce_2_len, extranonce_2);
+        coinbase_template_set_extranonce_2(&tpl, i);
+        coinbase_template_hash(&tpl, coinbase_tx_hash);
+        calculate_merkle_root_hash(coinbase_tx_hash, merkle_branches, 12, merkle_root);
+    }
+    int64_t template_us = esp_timer_get_time() - start;
+
+    printf("coinbase jobs/s: hex %.0f, template %.0f\n",
+           iterations * 1e6 / hex_us, iterations * 1e6 / template_us);
+    TEST_ASSERT_LESS_THAN(hex_us, template_us);
+
+    coinbase_template_free(&tpl);
+    STRATUM_V1_free_mining_notify(notify);
+}
+
 // Values calculated from esp-miner/components/stratum/test/verifiers/merklecalc.py
 TEST_CASE("Validate merkle root calculation", "[mining]")
 {
@@ -236,3 +383,225 @@ TEST_CASE("Test nonce diff checking 2", "[mining test_nonce][not-on-qemu]")
     double diff = test_nonce_value(&job, nonce, rolled_version);
     TEST_ASSERT_EQUAL_INT(683, (int)diff);
 }
+
+// test_nonce_value before midstates were reused: the whole header double hashed
+static double full_header_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version)
+{
+    uint8_t header[80];
+    memcpy(header, &rolled_version, 4);
+    reverse_32bit_words(job->prev_block_hash, header + 4);
+    reverse_32bit_words(job->merkle_root, header + 36);
+    memcpy(header + 68, &job->ntime, 4);
+    memcpy(header + 72, &job->target, 4);
+    memcpy(header + 76, &nonce, 4);
+
+    uint8_t hash_result[32];
+    double_sha256_bin(header, 80, hash_result);
+    return 26959535291011309493156476344723991336010898738574164086137773096960.0 / le256todouble(hash_result);
+}
+
+static uint32_t xorshift32(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static void random_job(uint32_t *seed, uint32_t version_mask, bm_job *job)
+{
+    char prev_block_hash[65];
+    uint8_t bytes[32];
+    uint8_t merkle_root[32];
+
+    for (int i = 0; i < 32; i++) bytes[i] = xorshift32(seed);
+    bin2hex(bytes, 32, prev_block_hash, sizeof(prev_block_hash));
+    for (int i = 0; i < 32; i++) merkle_root[i] = xorshift32(seed);
+
+    mining_notify notify_message = {0};
+    notify_message.prev_block_hash = prev_block_hash;
+    notify_message.version = 0x20000000 | (xorshift32(seed) & 0x1fffe000);
+    notify_message.target = 0x17000000 | (xorshift32(seed) & 0xffffff);
+    notify_message.ntime = xorshift32(seed);
+    memset(job, 0, sizeof(bm_job));
+    construct_bm_job(&notify_message, merkle_root, version_mask, 1000, job);
+}
+
+TEST_CASE("Nonce check from midstate matches full header hash", "[mining test_nonce]")
+{
+    uint32_t seed = 0x6d696e65;
+    int midstate_hits = 0;
+
+    for (int i = 0; i < 200; i++) {
+        bm_job job;
+        random_job(&seed, (i % 2) ? STRATUM_DEFAULT_VERSION_MASK : 0, &job);
+
+        uint32_t versions[5] = { job.version };
+        for (int v = 1; v < 4; v++) {
+            versions[v] = increment_bitmask(versions[v - 1], STRATUM_DEFAULT_VERSION_MASK);
+        }
+        // Anything else the chip may roll to goes through the full hash
+        versions[4] = (job.version & ~STRATUM_DEFAULT_VERSION_MASK) | (xorshift32(&seed) & STRATUM_DEFAULT_VERSION_MASK);
+
+        for (int v = 0; v < 5; v++) {
+            uint32_t nonce = xorshift32(&seed);
+            double expected = full_header_nonce_value(&job, nonce, versions[v]);
+            TEST_ASSERT_EQUAL_DOUBLE(expected, test_nonce_value(&job, nonce, versions[v]));
+            if (v == 0 || (v < 4 && job.num_midstates == 4)) midstate_hits++;
+        }
+    }
+    TEST_ASSERT_EQUAL(100 + 100 * 4, midstate_hits);
+}
+
+TEST_CASE("Nonce check from midstate latency", "[mining test_nonce][benchmark][not-on-qemu]")
+{
+    const int iterations = 2000;
+    uint32_t seed = 0x6e6f6e63;
+    bm_job job;
+    random_job(&seed, STRATUM_DEFAULT_VERSION_MASK, &job);
+    uint32_t rolled_version = increment_bitmask(job.version, STRATUM_DEFAULT_VERSION_MASK);
+    volatile double sink = 0;
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        sink += full_header_nonce_value(&job, i, rolled_version);
+    }
+    int64_t full_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        sink += test_nonce_value(&job, i, rolled_version);
+    }
+    int64_t midstate_us = esp_timer_get_time() - start;
+
+    printf("nonce check: full header %.2f us, from midstate %.2f us\n",
+           (double) full_us / iterations, (double) midstate_us / iterations);
+    TEST_ASSERT_LESS_THAN(full_us, midstate_us);
+}
+
+TEST_CASE("Nonce decision by target compare latency", "[mining test_nonce][benchmark][not-on-qemu]")
+{
+    const int iterations = 5000;
+    uint32_t seed = 0x74617267;
+    bm_job job;
+    random_job(&seed, 0, &job);
+    job.pool_diff = 1000;
+    difficulty_to_target(job.pool_diff, job.pool_target);
+    nbits_to_target(job.target, job.network_target);
+
+    static uint8_t hashes[64][32];
+    for (int i = 0; i < 64; i++) {
+        for (int j = 0; j < 32; j++) hashes[i][j] = xorshift32(&seed);
+        // about half of them are shares
+        hashes[i][31] = hashes[i][30] = hashes[i][29] = hashes[i][28] = 0;
+        if (i % 2) memset(hashes[i] + 24, 0, 4);
+    }
+
+    int double_shares = 0, integer_shares = 0;
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        double diff = nonce_hash_difficulty(hashes[i % 64]);
+        if (diff >= job.pool_diff) double_shares++;
+        if (diff >= networkDifficulty(job.target)) double_shares++;
+    }
+    int64_t double_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        if (hash_meets_target(hashes[i % 64], job.pool_target)) integer_shares++;
+        if (hash_meets_target(hashes[i % 64], job.network_target)) integer_shares++;
+    }
+    int64_t integer_us = esp_timer_get_time() - start;
+
+    printf("nonce decision: double %.3f us, integer %.3f us\n",
+           (double) double_us / iterations, (double) integer_us / iterations);
+    TEST_ASSERT_EQUAL(double_shares, integer_shares);
+    TEST_ASSERT_LESS_THAN(double_us, integer_us);
+}
+
+TEST_CASE("ntime rolling reuses the merkle root and submits the rolled ntime", "[mining]")
+{
+    const char *coinbase_1 = "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008";
+    const char *coinbase_2 = "072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000";
+    const char *prev_block_hash = "bf44fd3513dc7b837d60e5c628b572b448d204a8000007490000000000000000";
+    const char *extranonce = "e9695791";
+    const uint32_t extranonce_2_len = 4;
+    const uint32_t ntime_window = 7;
+    static bm_job jobs[400];
+    const int n_jobs = sizeof(jobs) / sizeof(jobs[0]);
+
+    mining_notify *notify = mining_notify_create("1", 1, prev_block_hash, strlen(prev_block_hash),
+                                                 coinbase_1, strlen(coinbase_1), coinbase_2, strlen(coinbase_2), 0);
+    TEST_ASSERT_NOT_NULL(notify);
+    notify->version = 0x20000004;
+    notify->target = 0x1705dd01;
+    notify->ntime = 0x64658bd8;
+
+    coinbase_template tpl = {0};
+    TEST_ASSERT_TRUE(coinbase_template_build(&tpl, notify, extranonce, extranonce_2_len));
+
+    // Same steps as generate_work in create_jobs_task
+    job_roller roller;
+    job_roller_init(&roller, ntime_window);
+    int merkle_roots = 0;
+    for (int i = 0; i < n_jobs; i++) {
+        bool ntime_roll = job_roller_next(&roller);
+        uint32_t ntime = notify->ntime + roller.ntime_offset;
+        if (ntime_roll) {
+            roll_bm_job_ntime(&jobs[i - 1], ntime, &jobs[i]);
+        } else {
+            uint8_t coinbase_tx_hash[32];
+            uint8_t merkle_root[32];
+            coinbase_template_set_extranonce_2(&tpl, roller.extranonce_2);
+            coinbase_template_hash(&tpl, coinbase_tx_hash);
+            calculate_merkle_root_hash(coinbase_tx_hash, NULL, 0, merkle_root);
+            merkle_roots++;
+            memset(&jobs[i], 0, sizeof(bm_job));
+            construct_bm_job(notify, merkle_root, STRATUM_DEFAULT_VERSION_MASK, 1000, &jobs[i]);
+            extranonce_2_generate(roller.extranonce_2, extranonce_2_len, jobs[i].extranonce2);
+            jobs[i].ntime = ntime;
+        }
+    }
+    TEST_ASSERT_EQUAL(n_jobs / (ntime_window + 1), merkle_roots);
+
+    uint32_t seed = 0x6e74696d;
+    for (int i = 0; i < n_jobs; i++) {
+        const bm_job *job = &jobs[i];
+        TEST_ASSERT_GREATER_OR_EQUAL_UINT32(notify->ntime, job->ntime);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(notify->ntime + ntime_window, job->ntime);
+
+        // No two jobs share work
+        for (int j = 0; j < i; j++) {
+            TEST_ASSERT_FALSE(jobs[j].ntime == job->ntime && strcmp(jobs[j].extranonce2, job->extranonce2) == 0);
+        }
+
+        // Midstates cover only the first header block, ntime is not in it
+        mining_notify rolled_notify = *notify;
+        rolled_notify.ntime = job->ntime;
+        uint8_t merkle_root[32];
+        reverse_32bit_words(job->merkle_root, merkle_root);
+        bm_job expected;
+        memset(&expected, 0, sizeof(bm_job));
+        construct_bm_job(&rolled_notify, merkle_root, STRATUM_DEFAULT_VERSION_MASK, 1000, &expected);
+        TEST_ASSERT_EQUAL(expected.ntime, job->ntime);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.midstate, job->midstate, 32);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.midstate3, job->midstate3, 32);
+
+        // What the pool rebuilds from the submitted extranonce_2 and ntime
+        uint8_t coinbase_tx_hash[32];
+        calculate_coinbase_tx_hash(coinbase_1, coinbase_2, extranonce, job->extranonce2, coinbase_tx_hash);
+        calculate_merkle_root_hash(coinbase_tx_hash, NULL, 0, merkle_root);
+        memset(&expected, 0, sizeof(bm_job));
+        construct_bm_job(&rolled_notify, merkle_root, STRATUM_DEFAULT_VERSION_MASK, 1000, &expected);
+        uint32_t nonce = xorshift32(&seed);
+        uint8_t expected_hash[32];
+        uint8_t actual_hash[32];
+        calculate_nonce_hash(&expected, nonce, expected.version, expected_hash);
+        calculate_nonce_hash(job, nonce, job->version, actual_hash);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(expected_hash, actual_hash, 32);
+    }
+
+    coinbase_template_free(&tpl);
+    STRATUM_V1_free_mining_notify(notify);
+}
@@ -0,0 +1,303 @@
+#include "unity.h"
+#include "mining_notify_parser.h"
+#include "stratum_api.h"
+#include "utils.h"
+#include "esp_timer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+static const char *notify_json = "{\"id\":null,\"method\":\"mining.notify\",\"params\":"
+                                 "[\"1d2e0c4d3d\","
+                                 "\"ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000\","
+                                 "\"01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff4b03a5020cfabe6d6d379ae882651f6469f2ed6b8b40a4f9a4b41fd838a3ad6de8cba775f4e8f1d3080100000000000000\","
+                                 "\"41903d4c1b2f736c7573682f0000000003ca890d27000000001976a9147c154ed1dc59609e3d26abb2df2ea3d587cd8c4188ac00000000000000002c6a4c2952534b424c4f434b3a4cb4cb2ddfc37c41baf5ef6b6b4899e3253a8f1dfc7e5dd68a5b5b27005014ef0000000000000000266a24aa21a9ed5caa249f1af9fbf71c986fea8e076ca34ae3514fb2f86400561b28c7b15949bf00000000\","
+                                 "[\"ae23055e00f0f697cc3640124812d96d4fe8bdfa03484c1c638ce5a1c0e9aa81\",\"980fb87cb61021dd7afd314fcb0dabd096f3d56a7377f6f320684652e7410a21\",\"a52e9868343c55ce405be8971ff340f562ae9ab6353f07140d01666180e19b52\",\"7435bdfa004e603953b2ed39f118803934d9cf17b06d979ceb682f2251bafac2\",\"2a91f061a22d27cb8f44eea79938fb241ebeb359891aa907f05ffde7ed44e52e\",\"302401f80eb5e958155135e25200bb8ea181ad2d05e804a531c7314d86403cdc\",\"318ecb6161eb9b4cfd802bd730e2d36c167ddf102e70aa7b4158e2870dd47392\",\"1114332a9858e0cf84b2425bb1e59eaabf91dd102d114aa443d57fc1b3beb0c9\",\"f43f38095c810613ed795a44d9fab02ff25269706f454885db9be05cdf9c06e1\",\"3e2fc26b27fddc39668b59099cd9635761bb72ed92404204e12bdff08b16fb75\",\"463c19427286342120039a83218fa87ce45448e246895abac11fff0036076758\",\"03d287f655813e540ddb9c4e7aeb922478662b0f5d8e9d0cbd564b20146bab76\"],"
+                                 "\"20000004\",\"1705c739\",\"64495522\",true]}";
+
+static void assert_notify_equal(const mining_notify *expected, const mining_notify *actual)
+{
+    TEST_ASSERT_EQUAL_STRING(expected->job_id, actual->job_id);
+    TEST_ASSERT_EQUAL_STRING(expected->prev_block_hash, actual->prev_block_hash);
+    TEST_ASSERT_EQUAL_STRING(expected->coinbase_1, actual->coinbase_1);
+    TEST_ASSERT_EQUAL_STRING(expected->coinbase_2, actual->coinbase_2);
+    TEST_ASSERT_EQUAL(expected->coinbase_1_bin_len, actual->coinbase_1_bin_len);
+    TEST_ASSERT_EQUAL_MEMORY(expected->coinbase_1_bin, actual->coinbase_1_bin, expected->coinbase_1_bin_len);
+    TEST_ASSERT_EQUAL(expected->coinbase_2_bin_len, actual->coinbase_2_bin_len);
+    TEST_ASSERT_EQUAL_MEMORY(expected->coinbase_2_bin, actual->coinbase_2_bin, expected->coinbase_2_bin_len);
+    TEST_ASSERT_EQUAL(expected->n_merkle_branches, actual->n_merkle_branches);
+    if (expected->n_merkle_branches > 0) {
+        TEST_ASSERT_EQUAL_MEMORY(expected->merkle_branches, actual->merkle_branches, HASH_SIZE * expected->n_merkle_branches);
+    }
+    TEST_ASSERT_EQUAL_HEX32(expected->version, actual->version);
+    TEST_ASSERT_EQUAL_HEX32(expected->target, actual->target);
+    TEST_ASSERT_EQUAL_HEX32(expected->ntime, actual->ntime);
+    TEST_ASSERT_EQUAL(expected->clean_jobs, actual->clean_jobs);
+}
+
+TEST_CASE("Fast notify parser decodes all fields", "[mining.notify]")
+{
+    mining_notify *notify;
+    int message_id = 0;
+    TEST_ASSERT_TRUE(mining_notify_parse(notify_json, &message_id, &notify));
+
+    TEST_ASSERT_EQUAL(-1, message_id);
+    TEST_ASSERT_EQUAL_STRING("1d2e0c4d3d", notify->job_id);
+    TEST_ASSERT_EQUAL_STRING("ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000", notify->prev_block_hash);
+    TEST_ASSERT_EQUAL(12, notify->n_merkle_branches);
+    uint8_t branch[HASH_SIZE];
+    hex2bin("03d287f655813e540ddb9c4e7aeb922478662b0f5d8e9d0cbd564b20146bab76", branch, HASH_SIZE);
+    TEST_ASSERT_EQUAL_MEMORY(branch, notify->merkle_branches + HASH_SIZE * 11, HASH_SIZE);
+    TEST_ASSERT_EQUAL_HEX32(0x20000004, notify->version);
+    TEST_ASSERT_EQUAL_HEX32(0x1705c739, notify->target);
+    TEST_ASSERT_EQUAL_HEX32(0x64495522, notify->ntime);
+    TEST_ASSERT_TRUE(notify->clean_jobs);
+
+    StratumApiV1Message message = {};
+    STRATUM_V1_parse_cjson(&message, notify_json);
+    TEST_ASSERT_EQUAL(MINING_NOTIFY, message.method);
+    assert_notify_equal(message.mining_notification, notify);
+
+    STRATUM_V1_reset_message(&message);
+    STRATUM_V1_free_mining_notify(notify);
+}
+
+TEST_CASE("Fast notify parser accepts any key order", "[mining.notify]")
+{
+    const char *json = " { \"params\" : [\"ab\", \"00\", \"01\", \"02\", [], \"1\", \"1d00ffff\", \"FFFFFFFF\", false],"
+                       " \"extra\": {\"a\": [1, -2.5e3, null, true]}, \"Method\": \"mining.notify\", \"id\": 42 }";
+    mining_notify *notify;
+    int message_id = 0;
+    TEST_ASSERT_TRUE(mining_notify_parse(json, &message_id, &notify));
+    TEST_ASSERT_EQUAL(42, message_id);
+    TEST_ASSERT_EQUAL_STRING("ab", notify->job_id);
+    TEST_ASSERT_EQUAL(0, notify->n_merkle_branches);
+    TEST_ASSERT_EQUAL_HEX32(1, notify->version);
+    TEST_ASSERT_EQUAL_HEX32(0xffffffff, notify->ntime);
+    TEST_ASSERT_FALSE(notify->clean_jobs);
+    STRATUM_V1_free_mining_notify(notify);
+}
+
+TEST_CASE("Fast notify parser leaves other messages to cJSON", "[mining.notify]")
+{
+    const char *rejected[] = {
+        "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[1638]}",
+        "{\"id\":5,\"error\":null,\"result\":true}",
+        "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"a\\\"b\",\"00\",\"01\",\"02\",[],\"1\",\"2\",\"3\",true]}",
+        "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"ab\",\"00\",\"01\",\"02\",[],\"123456789\",\"2\",\"3\",true]}",
+        "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"ab\",\"00\",\"01\",\"02\",[],\"0x1\",\"2\",\"3\",true]}",
+        "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"ab\",\"00\",\"01\",\"02\",[\"00\"],\"1\",\"2\",\"3\",true]}",
+        "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"ab\",\"00\",\"01\",\"02\",[],\"1\",\"2\"]}",
+        "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"ab\",\"00\",\"01\",\"02\",[],\"1\",\"2\",\"3\",true,]}",
+        "{\"id\":1.5,\"method\":\"mining.notify\",\"params\":[\"ab\",\"00\",\"01\",\"02\",[],\"1\",\"2\",\"3\",true]}",
+        "{\"id\":null,\"method\":\"mining.notify\",\"params\":[1,\"00\",\"01\",\"02\",[],\"1\",\"2\",\"3\",true]}",
+        "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"ab\",\"00\",\"01\",\"02\",[],\"1\",\"2\",\"3\",true]",
+        "[\"mining.notify\"]",
+        "",
+    };
+
+    for (int i = 0; i < sizeof(rejected) / sizeof(rejected[0]); i++) {
+        mining_notify *notify;
+        int message_id;
+        TEST_ASSERT_FALSE(mining_notify_parse(rejected[i], &message_id, &notify));
+    }
+}
+
+static uint32_t rng_state = 0x12345678;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void append_whitespace(char **p)
+{
+    static const char *whitespace[] = {"", "", "", " ", "\n", "\t", "\r\n  "};
+    *p += sprintf(*p, "%s", whitespace[rng() % 7]);
+}
+
+static void append_hex(char **p, int len)
+{
+    static const char digits[] = "0123456789abcdefABCDEF";
+    for (int i = 0; i < len; i++) {
+        *(*p)++ = digits[rng() % 22];
+    }
+}
+
+static void append_hex_string(char **p, int len)
+{
+    *(*p)++ = '"';
+    append_hex(p, len);
+    *(*p)++ = '"';
+}
+
+static void append_params(char **p)
+{
+    static const char *extra[] = {"\"64495522\"", "123", "null", "{\"a\":[]}", "-0.5E+2", "\"x y\""};
+    static const char *clean[] = {"true", "false", "null", "1", "\"true\""};
+
+    *(*p)++ = '[';
+    append_whitespace(p);
+    append_hex_string(p, 1 + rng() % 16);
+    *(*p)++ = ',';
+    append_whitespace(p);
+    append_hex_string(p, 64);
+    *(*p)++ = ',';
+    append_hex_string(p, 2 * (rng() % 100));
+    *(*p)++ = ',';
+    append_hex_string(p, 2 * (rng() % 150));
+    *(*p)++ = ',';
+
+    *(*p)++ = '[';
+    int n_branches = rng() % (MAX_MERKLE_BRANCHES + 2);
+    for (int i = 0; i < n_branches; i++) {
+        if (i > 0) *(*p)++ = ',';
+        append_whitespace(p);
+        append_hex_string(p, 64);
+    }
+    *(*p)++ = ']';
+
+    for (int i = 0; i < 3; i++) {
+        *(*p)++ = ',';
+        append_whitespace(p);
+        append_hex_string(p, 1 + rng() % 9);
+    }
+    int n_extra = rng() % 3;
+    for (int i = 0; i < n_extra; i++) {
+        *p += sprintf(*p, ",%s", extra[rng() % 6]);
+    }
+    *p += sprintf(*p, ",%s", clean[rng() % 5]);
+    append_whitespace(p);
+    *(*p)++ = ']';
+}
+
+static void generate_notify(char *json)
+{
+    char *p = json;
+    int order[4] = {0, 1, 2, 3};
+    for (int i = 3; i > 0; i--) {
+        int j = rng() % (i + 1);
+        int tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    append_whitespace(&p);
+    *p++ = '{';
+    for (int i = 0; i < 4; i++) {
+        if (i > 0) *p++ = ',';
+        append_whitespace(&p);
+        switch (order[i]) {
+            case 0:
+                switch (rng() % 4) {
+                    case 0: p += sprintf(p, "\"id\":null"); break;
+                    case 1: p += sprintf(p, "\"id\":%d", (int) (rng() % 100000) - 50); break;
+                    case 2: p += sprintf(p, "\"id\":\"7\""); break;
+                    default: p += sprintf(p, "\"ID\" : %u", rng() % 1000); break;
+                }
+                break;
+            case 1:
+                p += sprintf(p, rng() % 8 ? "\"method\":\"mining.notify\"" : "\"method\":\"mining.Notify\"");
+                break;
+            case 2:
+                p += sprintf(p, "\"params\":");
+                append_whitespace(&p);
+                append_params(&p);
+                break;
+            default:
+                p += sprintf(p, rng() % 2 ? "\"jsonrpc\":\"2.0\"" : "\"x\":[[1,2],{\"y\":false}]");
+                break;
+        }
+        append_whitespace(&p);
+    }
+    *p++ = '}';
+    *p = '\0';
+}
+
+static void mutate(char *json)
+{
+    static const char alphabet[] = "\"{}[],:\\ 0aZ-.eE+tn";
+    size_t len = strlen(json);
+    int mutations = 1 + rng() % 3;
+    for (int i = 0; i < mutations && len > 0; i++) {
+        size_t pos = rng() % len;
+        switch (rng() % 3) {
+            case 0:
+                json[pos] = alphabet[rng() % (sizeof(alphabet) - 1)];
+                break;
+            case 1:
+                memmove(json + pos, json + pos + 1, len - pos);
+                len--;
+                break;
+            default:
+                memmove(json + pos + 1, json + pos, len - pos + 1);
+                json[pos] = alphabet[rng() % (sizeof(alphabet) - 1)];
+                len++;
+                break;
+        }
+    }
+}
+
+TEST_CASE("Fast notify parser matches cJSON on generated messages", "[mining.notify][fuzz]")
+{
+    static char json[12 * 1024];
+    int accepted = 0;
+    const int iterations = 2000;
+
+    for (int i = 0; i < iterations; i++) {
+        generate_notify(json);
+        if (i % 3 == 2) {
+            mutate(json);
+        }
+
+        mining_notify *notify;
+        int message_id;
+        if (!mining_notify_parse(json, &message_id, &notify)) {
+            continue;
+        }
+        accepted++;
+
+        StratumApiV1Message message = {};
+        STRATUM_V1_parse_cjson(&message, json);
+        TEST_ASSERT_EQUAL_MESSAGE(MINING_NOTIFY, message.method, json);
+        TEST_ASSERT_EQUAL_MESSAGE(message.message_id, message_id, json);
+        TEST_ASSERT_NOT_NULL_MESSAGE(message.mining_notification, json);
+        assert_notify_equal(message.mining_notification, notify);
+
+        STRATUM_V1_reset_message(&message);
+        STRATUM_V1_free_mining_notify(notify);
+    }
+
+    // Make sure the generator exercises the fast path
+    TEST_ASSERT_GREATER_THAN(iterations / 4, accepted);
+}
+
+TEST_CASE("Fast notify parser latency", "[mining.notify][benchmark][not-on-qemu]")
+{
+    const int iterations = 200;
+    StratumApiV1Message message = {};
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        STRATUM_V1_parse_cjson(&message, notify_json);
+        STRATUM_V1_reset_message(&message);
+    }
+    int64_t cjson_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        mining_notify *notify;
+        int message_id;
+        TEST_ASSERT_TRUE(mining_notify_parse(notify_json, &message_id, &notify));
+        STRATUM_V1_free_mining_notify(notify);
+    }
+    int64_t fast_us = esp_timer_get_time() - start;
+
+    printf("mining.notify parse: cJSON %.1f us, fast path %.1f us\n",
+           (double) cjson_us / iterations, (double) fast_us / iterations);
+    TEST_ASSERT_LESS_THAN(cjson_us, fast_us);
+}
@@ -0,0 +1,212 @@
+#include "unity.h"
+#include "mining_notify_pool.h"
+#include "stratum_api.h"
+#include "esp_heap_caps.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Same as QUEUE_SIZE of the stratum work queue
+#define QUEUE_DEPTH 12
+#define SOAK_ITERATIONS 5000
+
+static const char prev_block_hash[] = "ef4b9a48c7986466de4adc002f7337a6e121bc43000376ea0000000000000000";
+static char coinbase[1024];
+
+static mining_notify *create_notify(int i)
+{
+    char job_id[16];
+    snprintf(job_id, sizeof(job_id), "%x", i);
+    // Coinbase length varies between notifies like it does with real pools
+    size_t coinbase_1_len = 200 + (i * 7) % 100;
+    size_t coinbase_2_len = 300 + (i * 13) % 200;
+    return mining_notify_create(job_id, strlen(job_id),
+                                prev_block_hash, strlen(prev_block_hash),
+                                coinbase, coinbase_1_len,
+                                coinbase, coinbase_2_len,
+                                i % (MAX_MERKLE_BRANCHES + 1));
+}
+
+// The allocation pattern before the arena: one block per field
+static mining_notify *create_legacy_notify(int i)
+{
+    mining_notify *notify = malloc(sizeof(mining_notify));
+    char job_id[16];
+    snprintf(job_id, sizeof(job_id), "%x", i);
+    notify->job_id = strdup(job_id);
+    notify->prev_block_hash = strdup(prev_block_hash);
+    notify->coinbase_1 = strndup(coinbase, 200 + (i * 7) % 100);
+    notify->coinbase_2 = strndup(coinbase, 300 + (i * 13) % 200);
+    notify->n_merkle_branches = i % (MAX_MERKLE_BRANCHES + 1);
+    notify->merkle_branches = malloc(HASH_SIZE * notify->n_merkle_branches);
+    return notify;
+}
+
+// Grow every pool block to the largest notify create_notify makes
+static void warm_up_pool(void)
+{
+    mining_notify *notifies[MINING_NOTIFY_POOL_SIZE];
+    for (int i = 0; i < MINING_NOTIFY_POOL_SIZE; i++) {
+        notifies[i] = mining_notify_create("ffffffff", 8, prev_block_hash, strlen(prev_block_hash),
+                                           coinbase, 299, coinbase, 499, MAX_MERKLE_BRANCHES);
+        TEST_ASSERT_NOT_NULL(notifies[i]);
+    }
+    for (int i = 0; i < MINING_NOTIFY_POOL_SIZE; i++) {
+        STRATUM_V1_free_mining_notify(notifies[i]);
+    }
+}
+
+static void free_legacy_notify(mining_notify *notify)
+{
+    free(notify->job_id);
+    free(notify->prev_block_hash);
+    free(notify->coinbase_1);
+    free(notify->coinbase_2);
+    free(notify->merkle_branches);
+    free(notify);
+}
+
+TEST_CASE("Notify fields share one block", "[mining.notify]")
+{
+    memset(coinbase, 'a', sizeof(coinbase));
+
+    mining_notify *notify = create_notify(3);
+    TEST_ASSERT_NOT_NULL(notify);
+    TEST_ASSERT_EQUAL_STRING("3", notify->job_id);
+    TEST_ASSERT_EQUAL_STRING(prev_block_hash, notify->prev_block_hash);
+    TEST_ASSERT_EQUAL(221, strlen(notify->coinbase_1));
+    TEST_ASSERT_EQUAL(339, strlen(notify->coinbase_2));
+    TEST_ASSERT_EQUAL(3, notify->n_merkle_branches);
+
+    // Everything lives right behind the struct
+    uint8_t *start = (uint8_t *) notify;
+    uint8_t *end = (uint8_t *) notify->coinbase_2 + strlen(notify->coinbase_2) + 1;
+    TEST_ASSERT_EQUAL_PTR(start + sizeof(mining_notify), notify->merkle_branches);
+    TEST_ASSERT_EQUAL(sizeof(mining_notify) + 3 * HASH_SIZE + 110 + 169 + 2 + 65 + 222 + 340, end - start);
+
+    STRATUM_V1_free_mining_notify(notify);
+}
+
+TEST_CASE("Notify copy owns its own block", "[mining.notify]")
+{
+    memset(coinbase, 'a', sizeof(coinbase));
+
+    mining_notify *notify = create_notify(5);
+    TEST_ASSERT_NOT_NULL(notify);
+    memset(notify->merkle_branches, 0x5a, HASH_SIZE * notify->n_merkle_branches);
+    notify->version = 0x20000000;
+    notify->target = 0x1703255b;
+    notify->ntime = 0x6660a2b4;
+    notify->clean_jobs = true;
+    notify->received_us = 1234;
+
+    mining_notify *copy = mining_notify_copy(notify);
+    TEST_ASSERT_NOT_NULL(copy);
+    TEST_ASSERT_TRUE(copy != notify);
+    TEST_ASSERT_EQUAL_STRING(notify->job_id, copy->job_id);
+    TEST_ASSERT_EQUAL_STRING(notify->coinbase_1, copy->coinbase_1);
+    TEST_ASSERT_EQUAL_STRING(notify->coinbase_2, copy->coinbase_2);
+    TEST_ASSERT_EQUAL(notify->coinbase_1_bin_len, copy->coinbase_1_bin_len);
+    TEST_ASSERT_EQUAL_MEMORY(notify->coinbase_2_bin, copy->coinbase_2_bin, notify->coinbase_2_bin_len);
+    TEST_ASSERT_EQUAL(5, copy->n_merkle_branches);
+    TEST_ASSERT_EQUAL_MEMORY(notify->merkle_branches, copy->merkle_branches, 5 * HASH_SIZE);
+    TEST_ASSERT_EQUAL_HEX32(0x20000000, copy->version);
+    TEST_ASSERT_EQUAL_HEX32(0x1703255b, copy->target);
+    TEST_ASSERT_EQUAL_HEX32(0x6660a2b4, copy->ntime);
+    TEST_ASSERT_TRUE(copy->clean_jobs);
+    TEST_ASSERT_EQUAL(1234, copy->received_us);
+
+    // Either one can be released first
+    STRATUM_V1_free_mining_notify(notify);
+    TEST_ASSERT_EQUAL_STRING("5", copy->job_id);
+    STRATUM_V1_free_mining_notify(copy);
+}
+
+TEST_CASE("Notify pool reuses blocks and falls back to the heap when exhausted", "[mining.notify]")
+{
+    mining_notify *notifies[MINING_NOTIFY_POOL_SIZE + 2];
+    mining_notify_pool_stats before, after;
+
+    memset(coinbase, 'b', sizeof(coinbase));
+
+    warm_up_pool();
+
+    mining_notify_pool_get_stats(&before);
+    TEST_ASSERT_EQUAL(0, before.in_use);
+
+    for (int i = 0; i < MINING_NOTIFY_POOL_SIZE + 2; i++) {
+        notifies[i] = create_notify(i);
+        TEST_ASSERT_NOT_NULL(notifies[i]);
+    }
+    mining_notify_pool_get_stats(&after);
+    TEST_ASSERT_EQUAL(MINING_NOTIFY_POOL_SIZE, after.in_use);
+    TEST_ASSERT_EQUAL(MINING_NOTIFY_POOL_SIZE, after.block_reuses - before.block_reuses);
+    TEST_ASSERT_EQUAL(0, after.block_grows - before.block_grows);
+    TEST_ASSERT_EQUAL(2, after.heap_fallbacks - before.heap_fallbacks);
+
+    for (int i = 0; i < MINING_NOTIFY_POOL_SIZE + 2; i++) {
+        STRATUM_V1_free_mining_notify(notifies[i]);
+    }
+    mining_notify_pool_get_stats(&after);
+    TEST_ASSERT_EQUAL(0, after.in_use);
+}
+
+static void soak(bool legacy, size_t *free_after, size_t *largest_after)
+{
+    mining_notify *queue[QUEUE_DEPTH] = {0};
+    // Long lived small allocations in between, like log lines and share records
+    void *pinned[SOAK_ITERATIONS / 100];
+    int n_pinned = 0;
+
+    for (int i = 0; i < SOAK_ITERATIONS; i++) {
+        int slot = i % QUEUE_DEPTH;
+        if (queue[slot] != NULL) {
+            legacy ? free_legacy_notify(queue[slot]) : STRATUM_V1_free_mining_notify(queue[slot]);
+        }
+        queue[slot] = legacy ? create_legacy_notify(i) : create_notify(i);
+        TEST_ASSERT_NOT_NULL(queue[slot]);
+        if (i % 100 == 0) {
+            pinned[n_pinned++] = malloc(48);
+        }
+    }
+    for (int i = 0; i < QUEUE_DEPTH; i++) {
+        legacy ? free_legacy_notify(queue[i]) : STRATUM_V1_free_mining_notify(queue[i]);
+    }
+
+    *free_after = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    *largest_after = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    for (int i = 0; i < n_pinned; i++) {
+        free(pinned[i]);
+    }
+}
+
+TEST_CASE("Notify pool soak keeps the heap unfragmented", "[mining.notify][soak]")
+{
+    size_t free_before, largest_before, free_after, largest_after;
+    mining_notify_pool_stats before, after;
+
+    memset(coinbase, 'c', sizeof(coinbase));
+
+    warm_up_pool();
+
+    free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    largest_before = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    soak(true, &free_after, &largest_after);
+    printf("per-field allocations: free %u -> %u, largest block %u -> %u\n",
+           (unsigned) free_before, (unsigned) free_after, (unsigned) largest_before, (unsigned) largest_after);
+
+    free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    largest_before = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    mining_notify_pool_get_stats(&before);
+    soak(false, &free_after, &largest_after);
+    mining_notify_pool_get_stats(&after);
+    printf("notify pool: free %u -> %u, largest block %u -> %u\n",
+           (unsigned) free_before, (unsigned) free_after, (unsigned) largest_before, (unsigned) largest_after);
+
+    // Apart from the pinned allocations the pool path does not touch the heap
+    TEST_ASSERT_EQUAL(0, after.block_grows - before.block_grows);
+    TEST_ASSERT_EQUAL(0, after.heap_fallbacks - before.heap_fallbacks);
+    TEST_ASSERT_EQUAL(0, after.in_use);
+}
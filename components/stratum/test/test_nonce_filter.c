@@ -0,0 +1,91 @@
+#include "unity.h"
+#include "nonce_filter.h"
+#include "utils.h"
+
+#include <string.h>
+
+typedef struct
+{
+    uint8_t job_id;
+    uint32_t nonce;
+    uint32_t version_bits;
+} captured_result;
+
+// Result stream over two jobs in which the chip reports three nonces twice
+static const captured_result CAPTURED_RESULTS[] = {
+    { 0x18, 0x2b0c4a01, 0x00a2c000 },
+    { 0x18, 0x91fe0233, 0x01de0000 },
+    { 0x18, 0x2b0c4a01, 0x00a2c000 },  // repeat
+    { 0x20, 0x2b0c4a01, 0x00a2c000 },  // same nonce, other job
+    { 0x18, 0x2b0c4a01, 0x004ac000 },  // same nonce, other version
+    { 0x20, 0x6d31e07c, 0x00000000 },
+    { 0x20, 0x6d31e07c, 0x00000000 },  // repeat
+    { 0x18, 0x91fe0233, 0x01de0000 },  // repeat of an older job
+    { 0x20, 0xc0ffee10, 0x1fffe000 },
+};
+
+static void make_job(uint32_t ntime, bm_job *job)
+{
+    mining_notify notify = {0};
+    notify.prev_block_hash = "bf44fd3513dc7b837d60e5c628b572b448d204a8000007490000000000000000";
+    notify.version = 0x20000004;
+    notify.target = 0x1705dd01;
+    notify.ntime = ntime;
+    uint8_t merkle_root[32];
+    hex2bin("cd1be82132ef0d12053dcece1fa0247fcfdb61d4dbd3eb32ea9ef9b4c604a846", merkle_root, 32);
+    construct_bm_job(&notify, merkle_root, 0x1fffe000, 1000, job);
+}
+
+TEST_CASE("Nonce filter suppresses repeats from a captured result stream", "[nonce_filter]")
+{
+    static nonce_filter filter;
+    nonce_filter_init(&filter);
+
+    bm_job jobs[2];
+    make_job(0x64658bd8, &jobs[0]);
+    make_job(0x64658bd9, &jobs[1]);
+
+    int submitted = 0;
+    for (int i = 0; i < sizeof(CAPTURED_RESULTS) / sizeof(CAPTURED_RESULTS[0]); i++) {
+        const captured_result *result = &CAPTURED_RESULTS[i];
+        const bm_job *job = &jobs[result->job_id == 0x18 ? 0 : 1];
+        if (!nonce_filter_check(&filter, job, result->nonce, result->version_bits)) {
+            submitted++;
+        }
+    }
+
+    TEST_ASSERT_EQUAL(6, submitted);
+    TEST_ASSERT_EQUAL_UINT32(3, nonce_filter_get_suppressed(&filter));
+}
+
+TEST_CASE("Nonce filter forgets nonces after a clean job", "[nonce_filter]")
+{
+    static nonce_filter filter;
+    nonce_filter_init(&filter);
+
+    bm_job job;
+    make_job(0x64658bd8, &job);
+
+    TEST_ASSERT_FALSE(nonce_filter_check(&filter, &job, 0x2b0c4a01, 0));
+    TEST_ASSERT_TRUE(nonce_filter_check(&filter, &job, 0x2b0c4a01, 0));
+
+    nonce_filter_request_reset(&filter);
+    TEST_ASSERT_FALSE(nonce_filter_check(&filter, &job, 0x2b0c4a01, 0));
+    TEST_ASSERT_EQUAL_UINT32(1, nonce_filter_get_suppressed(&filter));
+}
+
+TEST_CASE("Nonce filter keeps accepting unique nonces when full", "[nonce_filter]")
+{
+    static nonce_filter filter;
+    nonce_filter_init(&filter);
+
+    bm_job job;
+    make_job(0x64658bd8, &job);
+
+    // Several times the capacity, the filter clears itself instead of filling up
+    for (uint32_t nonce = 0; nonce < NONCE_FILTER_SIZE * 4; nonce++) {
+        TEST_ASSERT_FALSE(nonce_filter_check(&filter, &job, nonce * 0x01000193, 0));
+        TEST_ASSERT_TRUE(nonce_filter_check(&filter, &job, nonce * 0x01000193, 0));
+    }
+    TEST_ASSERT_EQUAL_UINT32(NONCE_FILTER_SIZE * 4, nonce_filter_get_suppressed(&filter));
+}
@@ -0,0 +1,96 @@
+#include "unity.h"
+#include "pool_split.h"
+
+static pool_split split;
+
+static void setup_split(uint16_t weight_0, uint16_t weight_1)
+{
+    pool_split_init(&split, 2, 0);
+    pool_split_set_weight(&split, 0, weight_0);
+    pool_split_set_weight(&split, 1, weight_1);
+    pool_split_set_active(&split, 0, true);
+    pool_split_set_active(&split, 1, true);
+}
+
+TEST_CASE("Pool split sends jobs in the configured ratio", "[pool_split]")
+{
+    setup_split(80, 20);
+
+    int jobs[2] = {0};
+    int run = 0;
+    int longest_run = 0;
+    for (int i = 0; i < 100; i++) {
+        int pool = pool_split_next(&split, -1);
+        TEST_ASSERT_TRUE(pool == 0 || pool == 1);
+        jobs[pool]++;
+        run = pool == 0 ? run + 1 : 0;
+        if (run > longest_run) longest_run = run;
+    }
+
+    TEST_ASSERT_EQUAL(80, jobs[0]);
+    TEST_ASSERT_EQUAL(20, jobs[1]);
+    // The second pool gets every fifth job, not all of them at the end
+    TEST_ASSERT_EQUAL(4, longest_run);
+}
+
+TEST_CASE("Pool split skips inactive pools", "[pool_split]")
+{
+    setup_split(50, 50);
+    pool_split_set_active(&split, 1, false);
+
+    for (int i = 0; i < 10; i++) {
+        TEST_ASSERT_EQUAL(0, pool_split_next(&split, -1));
+    }
+
+    pool_split_set_active(&split, 0, false);
+    TEST_ASSERT_EQUAL(-1, pool_split_next(&split, -1));
+
+    // Back without a burst for the pool that was away
+    pool_split_set_active(&split, 0, true);
+    pool_split_set_active(&split, 1, true);
+    int first = pool_split_next(&split, -1);
+    int second = pool_split_next(&split, -1);
+    TEST_ASSERT_NOT_EQUAL(first, second);
+}
+
+TEST_CASE("Pool split keeps the ratio with forced jobs", "[pool_split]")
+{
+    setup_split(75, 25);
+
+    int jobs[2] = {0};
+    for (int i = 0; i < 400; i++) {
+        // Every tenth job is fresh work of the first pool
+        int pool = pool_split_next(&split, i % 10 == 0 ? 0 : -1);
+        jobs[pool]++;
+    }
+
+    TEST_ASSERT_EQUAL(300, jobs[0]);
+    TEST_ASSERT_EQUAL(100, jobs[1]);
+}
+
+TEST_CASE("Pool split accounts effective hashrate per pool", "[pool_split]")
+{
+    setup_split(80, 20);
+    for (int i = 0; i < 10; i++) {
+        pool_split_next(&split, -1);
+    }
+
+    // 1000 shares of difficulty 1000 in 1000 s is about 4295 GH/s
+    for (int i = 0; i < 1000; i++) {
+        pool_split_record_share(&split, 0, 1000, true);
+    }
+    pool_split_record_share(&split, 1, 1000, false);
+
+    pool_split_stats stats;
+    pool_split_get_stats(&split, 0, 1000000000LL, &stats);
+    TEST_ASSERT_EQUAL(80, stats.weight);
+    TEST_ASSERT_EQUAL(8, stats.jobs);
+    TEST_ASSERT_EQUAL_FLOAT(0.8f, stats.job_share);
+    TEST_ASSERT_EQUAL(1000, stats.accepted);
+    TEST_ASSERT_FLOAT_WITHIN(1, 4295, stats.hashrate);
+
+    pool_split_get_stats(&split, 1, 1000000000LL, &stats);
+    TEST_ASSERT_EQUAL(0, stats.accepted);
+    TEST_ASSERT_EQUAL(1, stats.rejected);
+    TEST_ASSERT_EQUAL_FLOAT(0, stats.hashrate);
+}
@@ -0,0 +1,126 @@
+#include "unity.h"
+#include "request_table.h"
+
+// Stand-ins for the transports of the two pool connections
+static int primary;
+static int standby;
+
+TEST_CASE("Request table matches answers by id and method", "[request_table]")
+{
+    request_table_reset();
+
+    request_table_sent(&primary, 3, REQUEST_AUTHORIZE, 1000);
+    request_table_sent(&primary, 5, REQUEST_SUBMIT, 2000);
+    request_table_sent(&primary, 6, REQUEST_SUGGEST_DIFFICULTY, 2000);
+
+    request_method method;
+    float latency_ms;
+    TEST_ASSERT_TRUE(request_table_complete(&primary, 5, true, 14000, &method, &latency_ms));
+    TEST_ASSERT_EQUAL(REQUEST_SUBMIT, method);
+    TEST_ASSERT_EQUAL_FLOAT(12.0f, latency_ms);
+
+    TEST_ASSERT_TRUE(request_table_complete(&primary, 6, false, 4000, &method, &latency_ms));
+    TEST_ASSERT_EQUAL(REQUEST_SUGGEST_DIFFICULTY, method);
+
+    // Answered once only, and never sent
+    TEST_ASSERT_FALSE(request_table_complete(&primary, 5, true, 15000, &method, &latency_ms));
+    TEST_ASSERT_FALSE(request_table_complete(&primary, 9, true, 15000, &method, &latency_ms));
+
+    request_method_stats stats;
+    request_table_get_stats(REQUEST_SUBMIT, &stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.sent);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.accepted);
+    request_table_get_stats(REQUEST_SUGGEST_DIFFICULTY, &stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.rejected);
+}
+
+TEST_CASE("Request table times out unanswered requests", "[request_table]")
+{
+    request_table_reset();
+
+    request_table_sent(&primary, 3, REQUEST_AUTHORIZE, 0);
+    request_table_sent(&primary, 10, REQUEST_SUBMIT, 20000000);
+
+    TEST_ASSERT_EQUAL(1, request_table_expire(&primary, 30000000, 30000000));
+    TEST_ASSERT_EQUAL(0, request_table_expire(&primary, 30000000, 30000000));
+
+    request_method method;
+    float latency_ms;
+    TEST_ASSERT_FALSE(request_table_complete(&primary, 3, true, 30000001, &method, &latency_ms));
+
+    // Once every slot the id may sit in is taken, the oldest request counts as timed out
+    for (int i = 1; i <= REQUEST_TABLE_PROBE; i++) {
+        request_table_sent(&primary, 10 + i * REQUEST_TABLE_SIZE, REQUEST_SUBMIT, 30000000);
+    }
+    TEST_ASSERT_FALSE(request_table_complete(&primary, 10, true, 30000001, &method, &latency_ms));
+
+    // Closing the connection gives up on the rest
+    TEST_ASSERT_EQUAL(REQUEST_TABLE_PROBE, request_table_expire(&primary, 30000001, 0));
+
+    request_method_stats stats;
+    request_table_get_stats(REQUEST_AUTHORIZE, &stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.timed_out);
+    request_table_get_stats(REQUEST_SUBMIT, &stats);
+    TEST_ASSERT_EQUAL_UINT32(1 + REQUEST_TABLE_PROBE, stats.sent);
+    TEST_ASSERT_EQUAL_UINT32(1 + REQUEST_TABLE_PROBE, stats.timed_out);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.accepted);
+}
+
+TEST_CASE("Request table keeps the ids of two connections apart", "[request_table]")
+{
+    request_table_reset();
+
+    // Both connections start with the same setup ids
+    request_table_sent(&primary, 1, REQUEST_CONFIGURE, 1000);
+    request_table_sent(&primary, 3, REQUEST_AUTHORIZE, 1000);
+    request_table_sent(&standby, 1, REQUEST_CONFIGURE, 2000);
+    request_table_sent(&standby, 3, REQUEST_AUTHORIZE, 2000);
+    request_table_sent(&standby, 7, REQUEST_SUBMIT, 3000);
+
+    request_method method;
+    float latency_ms;
+    TEST_ASSERT_TRUE(request_table_complete(&standby, 3, true, 5000, &method, &latency_ms));
+    TEST_ASSERT_EQUAL(REQUEST_AUTHORIZE, method);
+    TEST_ASSERT_EQUAL_FLOAT(3.0f, latency_ms);
+    TEST_ASSERT_TRUE(request_table_complete(&primary, 3, true, 5000, &method, &latency_ms));
+    TEST_ASSERT_EQUAL_FLOAT(4.0f, latency_ms);
+
+    // The standby does not answer for the primary
+    TEST_ASSERT_FALSE(request_table_complete(&standby, 3, true, 6000, &method, &latency_ms));
+    TEST_ASSERT_FALSE(request_table_complete(&primary, 7, true, 6000, &method, &latency_ms));
+
+    // A reconnect of the primary leaves the standby's requests in flight
+    TEST_ASSERT_EQUAL(1, request_table_expire(&primary, 7000, 0));
+    TEST_ASSERT_TRUE(request_table_complete(&standby, 7, true, 8000, &method, &latency_ms));
+    TEST_ASSERT_EQUAL(REQUEST_SUBMIT, method);
+    TEST_ASSERT_EQUAL(1, request_table_expire(NULL, 8000, 0));
+}
+
+TEST_CASE("Request table latency percentiles", "[request_table]")
+{
+    request_table_reset();
+
+    // 100 submits, 1 ms to 100 ms
+    for (int i = 1; i <= 100; i++) {
+        request_table_sent(&primary, i, REQUEST_SUBMIT, 0);
+        request_method method;
+        float latency_ms;
+        TEST_ASSERT_TRUE(request_table_complete(&primary, i, true, i * 1000, &method, &latency_ms));
+    }
+
+    request_method_stats stats;
+    request_table_get_stats(REQUEST_SUBMIT, &stats);
+    TEST_ASSERT_EQUAL_UINT32(100, stats.accepted);
+
+    // Bucket edges are at most a quarter octave above the exact value
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(50, (uint32_t) stats.p50_ms);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(63, (uint32_t) stats.p50_ms);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(90, (uint32_t) stats.p90_ms);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(113, (uint32_t) stats.p90_ms);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(99, (uint32_t) stats.p99_ms);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(124, (uint32_t) stats.p99_ms);
+
+    // Other methods have no answers yet
+    request_table_get_stats(REQUEST_AUTHORIZE, &stats);
+    TEST_ASSERT_EQUAL_FLOAT(0, stats.p99_ms);
+}
@@ -0,0 +1,163 @@
+#include "unity.h"
+#include "share_buffer.h"
+#include "utils.h"
+
+#include <string.h>
+
+static const char *PREV_HASH_A = "bf44fd3513dc7b837d60e5c628b572b448d204a8000007490000000000000000";
+static const char *PREV_HASH_B = "00000000000000000001a2b3c4d5e6f708192a3b4c5d6e7f8091a2b3c4d5e6f7";
+
+static share_submission make_share(const char *jobid, uint32_t nonce, const char *prev_hash)
+{
+    share_submission share = {0};
+    strcpy(share.jobid, jobid);
+    strcpy(share.extranonce2, "0100000000000000");
+    share.ntime = 0x64658bd8;
+    share.nonce = nonce;
+    job_prev_block_hash(prev_hash, share.prev_block_hash);
+    return share;
+}
+
+TEST_CASE("Share buffer prev hash matches the bm job", "[share_buffer]")
+{
+    mining_notify notify = {0};
+    notify.prev_block_hash = (char *) PREV_HASH_A;
+    uint8_t merkle_root[32] = {0};
+    bm_job job = {0};
+    construct_bm_job(&notify, merkle_root, 0, 1000, &job);
+
+    uint8_t prev_block_hash[32];
+    job_prev_block_hash(PREV_HASH_A, prev_block_hash);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(job.prev_block_hash, prev_block_hash, 32);
+}
+
+TEST_CASE("Share buffer replays to the same session after a reconnect", "[share_buffer]")
+{
+    share_buffer_reset();
+    uint32_t pool = share_buffer_pool_id("pool.example.com", 3333, "bc1q.worker");
+    uint8_t block_a[32];
+    job_prev_block_hash(PREV_HASH_A, block_a);
+
+    // Connection drops, two shares come in while the pool is away
+    share_submission first = make_share("1a", 1, PREV_HASH_A);
+    share_submission second = make_share("1b", 2, PREV_HASH_A);
+    TEST_ASSERT_TRUE(share_buffer_add(&first, pool, "e26e1928"));
+    TEST_ASSERT_TRUE(share_buffer_add(&second, pool, "e26e1928"));
+
+    // Reconnected and resumed with the same extranonce_1 on the same block, oldest first
+    share_submission replay;
+    TEST_ASSERT_TRUE(share_buffer_take_replay(pool, "e26e1928", block_a, &replay));
+    TEST_ASSERT_EQUAL_STRING("1a", replay.jobid);
+    TEST_ASSERT_EQUAL_UINT32(1, replay.nonce);
+    TEST_ASSERT_TRUE(share_buffer_take_replay(pool, "e26e1928", block_a, &replay));
+    TEST_ASSERT_EQUAL_STRING("1b", replay.jobid);
+    TEST_ASSERT_FALSE(share_buffer_take_replay(pool, "e26e1928", block_a, &replay));
+
+    // An extranonce_1 too long to keep can not be replayed either
+    TEST_ASSERT_FALSE(share_buffer_add(&first, pool, "0123456789abcdef0123456789abcdef0"));
+
+    share_buffer_stats stats;
+    share_buffer_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.replayed);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.in_use);
+}
+
+TEST_CASE("Share buffer drops shares a new session can not accept", "[share_buffer]")
+{
+    share_buffer_reset();
+    uint32_t pool = share_buffer_pool_id("pool.example.com", 3333, "bc1q.worker");
+    uint32_t other_pool = share_buffer_pool_id("pool.example.com", 3334, "bc1q.worker");
+    TEST_ASSERT_NOT_EQUAL(pool, other_pool);
+    uint8_t block_a[32];
+    job_prev_block_hash(PREV_HASH_A, block_a);
+
+    share_submission share = make_share("2a", 1, PREV_HASH_A);
+    TEST_ASSERT_TRUE(share_buffer_add(&share, pool, "e26e1928"));
+    TEST_ASSERT_TRUE(share_buffer_add(&share, other_pool, "e26e1928"));
+
+    // The pool handed out a new extranonce_1, the coinbase the share commits to is gone
+    share_submission replay;
+    TEST_ASSERT_FALSE(share_buffer_take_replay(pool, "77aa0011", block_a, &replay));
+
+    share_buffer_stats stats;
+    share_buffer_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.discarded_stale);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.in_use);
+
+    // The other pool's share is still there for when it comes back
+    TEST_ASSERT_TRUE(share_buffer_take_replay(other_pool, "e26e1928", block_a, &replay));
+    TEST_ASSERT_EQUAL_STRING("2a", replay.jobid);
+}
+
+TEST_CASE("Share buffer discards other blocks on clean jobs", "[share_buffer]")
+{
+    share_buffer_reset();
+    uint32_t pool = share_buffer_pool_id("pool.example.com", 3333, "bc1q.worker");
+    uint8_t block_b[32];
+    job_prev_block_hash(PREV_HASH_B, block_b);
+
+    share_submission old_block = make_share("3a", 1, PREV_HASH_A);
+    share_submission new_block = make_share("3b", 2, PREV_HASH_B);
+    TEST_ASSERT_TRUE(share_buffer_add(&old_block, pool, "e26e1928"));
+    TEST_ASSERT_TRUE(share_buffer_add(&new_block, pool, "e26e1928"));
+
+    TEST_ASSERT_EQUAL(1, share_buffer_discard_stale(block_b));
+    TEST_ASSERT_EQUAL(0, share_buffer_discard_stale(block_b));
+
+    share_submission replay;
+    TEST_ASSERT_TRUE(share_buffer_take_replay(pool, "e26e1928", block_b, &replay));
+    TEST_ASSERT_EQUAL_STRING("3b", replay.jobid);
+}
+
+TEST_CASE("Share buffer drops the oldest share when full", "[share_buffer]")
+{
+    share_buffer_reset();
+    uint32_t pool = share_buffer_pool_id("pool.example.com", 3333, "bc1q.worker");
+    uint8_t block_a[32];
+    job_prev_block_hash(PREV_HASH_A, block_a);
+
+    for (int i = 0; i < SHARE_BUFFER_SIZE + 3; i++) {
+        share_submission share = make_share("4a", i, PREV_HASH_A);
+        TEST_ASSERT_TRUE(share_buffer_add(&share, pool, "e26e1928"));
+    }
+
+    share_buffer_stats stats;
+    share_buffer_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.discarded_full);
+    TEST_ASSERT_EQUAL_UINT32(SHARE_BUFFER_SIZE, stats.in_use);
+
+    share_submission replay;
+    TEST_ASSERT_TRUE(share_buffer_take_replay(pool, "e26e1928", block_a, &replay));
+    TEST_ASSERT_EQUAL_UINT32(3, replay.nonce);
+}
+
+TEST_CASE("Share buffer keeps the order when slots are reused", "[share_buffer]")
+{
+    share_buffer_reset();
+    uint32_t pool = share_buffer_pool_id("pool.example.com", 3333, "bc1q.worker");
+    uint8_t block_b[32];
+    job_prev_block_hash(PREV_HASH_B, block_b);
+
+    // Every other share is for the old block, discarding them frees slots in between
+    for (int i = 0; i < SHARE_BUFFER_SIZE; i++) {
+        share_submission share = make_share("5a", i, i % 2 ? PREV_HASH_B : PREV_HASH_A);
+        TEST_ASSERT_TRUE(share_buffer_add(&share, pool, "e26e1928"));
+    }
+    TEST_ASSERT_EQUAL(SHARE_BUFFER_SIZE / 2, share_buffer_discard_stale(block_b));
+    for (int i = SHARE_BUFFER_SIZE; i < SHARE_BUFFER_SIZE * 3 / 2 + 1; i++) {
+        share_submission share = make_share("5a", i, PREV_HASH_B);
+        TEST_ASSERT_TRUE(share_buffer_add(&share, pool, "e26e1928"));
+    }
+
+    share_buffer_stats stats;
+    share_buffer_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.discarded_full);
+
+    share_submission replay;
+    uint32_t expected = 3;
+    while (share_buffer_take_replay(pool, "e26e1928", block_b, &replay)) {
+        TEST_ASSERT_EQUAL_UINT32(expected, replay.nonce);
+        expected += expected < SHARE_BUFFER_SIZE - 1 ? 2 : 1;
+    }
+    TEST_ASSERT_EQUAL_UINT32(SHARE_BUFFER_SIZE * 3 / 2 + 1, expected);
+}
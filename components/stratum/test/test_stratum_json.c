@@ -1,6 +1,8 @@
 #include "unity.h"
 #include "stratum_api.h"
 
+#include <string.h>
+
 TEST_CASE("Parse stratum method", "[stratum]")
 {
     StratumApiV1Message stratum_api_v1_message = {};
@@ -216,3 +218,19 @@ TEST_CASE("Parse stratum error array format", "[stratum]")
     TEST_ASSERT_FALSE(stratum_api_v1_message.response_success);
     TEST_ASSERT_EQUAL_STRING("Job not found", stratum_api_v1_message.error_str);
 }
+
+TEST_CASE("Format mining.submit lines for a batched write", "[stratum]")
+{
+    char batch[512];
+    int len = STRATUM_V1_format_submit(batch, sizeof(batch), 42, "bc1qworker.1", "1b4c3d9041", "0000000a", 0x64495522, 0xdeadbeef, 0x00e00000);
+    TEST_ASSERT_EQUAL_STRING("{\"id\":42,\"method\":\"mining.submit\",\"params\":[\"bc1qworker.1\",\"1b4c3d9041\",\"0000000a\",\"64495522\",\"deadbeef\",\"00e00000\"]}\n", batch);
+    TEST_ASSERT_EQUAL(strlen(batch), len);
+
+    // Lines are appended back to back, one newline terminated message each
+    int second = STRATUM_V1_format_submit(batch + len, sizeof(batch) - len, 43, "bc1qworker.1", "1b4c3d9042", "0000000b", 0x64495523, 1, 0);
+    TEST_ASSERT_EQUAL(len + second, strlen(batch));
+    TEST_ASSERT_EQUAL_STRING_LEN("{\"id\":43,", batch + len, 9);
+
+    // Too little room reports the full length like snprintf
+    TEST_ASSERT_EQUAL(len, STRATUM_V1_format_submit(batch, 16, 42, "bc1qworker.1", "1b4c3d9041", "0000000a", 0x64495522, 0xdeadbeef, 0x00e00000));
+}
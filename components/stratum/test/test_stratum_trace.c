@@ -0,0 +1,93 @@
+#include <string.h>
+#include "unity.h"
+#include "stratum_api.h"
+#include "stratum_trace.h"
+
+TEST_CASE("Stratum trace records lines in order", "[stratum_trace]")
+{
+    TEST_ASSERT_EQUAL(ESP_OK, stratum_trace_init());
+
+    uint32_t seq = stratum_trace_next_seq();
+    const char *submit = "{\"id\":5,\"method\":\"mining.submit\",\"params\":[]}\n";
+    const char *result = "{\"id\":5,\"result\":true,\"error\":null}";
+    stratum_trace_record(STRATUM_TRACE_TX, REQUEST_SUBMIT, 5, submit, strlen(submit));
+    stratum_trace_record(STRATUM_TRACE_RX, STRATUM_RESULT, 5, result, strlen(result));
+
+    stratum_trace_entry entries[4];
+    TEST_ASSERT_EQUAL(2, stratum_trace_read(&seq, entries, 4));
+    TEST_ASSERT_EQUAL_UINT32(stratum_trace_next_seq(), seq);
+
+    TEST_ASSERT_EQUAL(STRATUM_TRACE_TX, entries[0].direction);
+    TEST_ASSERT_EQUAL_STRING("mining.submit", stratum_trace_method_name(&entries[0]));
+    TEST_ASSERT_EQUAL(5, entries[0].id);
+    // The newline is not part of the line
+    TEST_ASSERT_EQUAL(strlen(submit) - 1, entries[0].length);
+    TEST_ASSERT_EQUAL(strlen(submit) - 1, entries[0].payload_len);
+    TEST_ASSERT_EQUAL_MEMORY(submit, entries[0].payload, entries[0].payload_len);
+
+    TEST_ASSERT_EQUAL(STRATUM_TRACE_RX, entries[1].direction);
+    TEST_ASSERT_EQUAL_STRING("result", stratum_trace_method_name(&entries[1]));
+    TEST_ASSERT_TRUE(entries[1].timestamp_us >= entries[0].timestamp_us);
+
+    // Nothing new since
+    TEST_ASSERT_EQUAL(0, stratum_trace_read(&seq, entries, 4));
+}
+
+TEST_CASE("Stratum trace keeps the start of long lines", "[stratum_trace]")
+{
+    TEST_ASSERT_EQUAL(ESP_OK, stratum_trace_init());
+
+    char notify[1024];
+    memset(notify, 'a', sizeof(notify));
+    memcpy(notify, "{\"id\":null,\"method\":\"mining.notify\"", 35);
+
+    uint32_t seq = stratum_trace_next_seq();
+    stratum_trace_record(STRATUM_TRACE_RX, MINING_NOTIFY, -1, notify, sizeof(notify));
+
+    stratum_trace_entry entry;
+    TEST_ASSERT_EQUAL(1, stratum_trace_read(&seq, &entry, 1));
+    TEST_ASSERT_EQUAL(sizeof(notify), entry.length);
+    TEST_ASSERT_EQUAL(STRATUM_TRACE_PAYLOAD_LEN, entry.payload_len);
+    TEST_ASSERT_EQUAL_MEMORY(notify, entry.payload, STRATUM_TRACE_PAYLOAD_LEN);
+    TEST_ASSERT_EQUAL_STRING("mining.notify", stratum_trace_method_name(&entry));
+
+    char line[256];
+    int len = stratum_trace_format(&entry, line, sizeof(line));
+    TEST_ASSERT_EQUAL(strlen(line), len);
+    TEST_ASSERT_NOT_NULL(strstr(line, " stratum_api: rx: {\"id\":null,\"method\":\"mining.notify\"aaa"));
+    TEST_ASSERT_NOT_NULL(strstr(line, "... (928 more bytes)\n"));
+}
+
+TEST_CASE("Stratum trace skips overwritten entries", "[stratum_trace]")
+{
+    TEST_ASSERT_EQUAL(ESP_OK, stratum_trace_init());
+
+    uint32_t seq = stratum_trace_next_seq();
+    uint32_t first = seq;
+    char line[32];
+    for (int i = 0; i < STRATUM_TRACE_SIZE + 10; i++) {
+        int len = snprintf(line, sizeof(line), "{\"id\":%d}", i);
+        stratum_trace_record(STRATUM_TRACE_TX, STRATUM_TRACE_TX_PONG, i, line, len);
+    }
+
+    // The reader fell behind, it continues with the oldest entry still there
+    stratum_trace_entry entries[4];
+    TEST_ASSERT_EQUAL(4, stratum_trace_read(&seq, entries, 4));
+    TEST_ASSERT_EQUAL_UINT32(first + 10, entries[0].seq);
+    TEST_ASSERT_EQUAL(10, entries[0].id);
+    TEST_ASSERT_EQUAL(13, entries[3].id);
+    TEST_ASSERT_EQUAL_STRING("pong", stratum_trace_method_name(&entries[0]));
+
+    // A reader ahead of the trace starts over
+    seq = stratum_trace_next_seq() + 5;
+    TEST_ASSERT_EQUAL(4, stratum_trace_read(&seq, entries, 4));
+    TEST_ASSERT_EQUAL_UINT32(first + 10, entries[0].seq);
+}
+
+TEST_CASE("Stratum trace switches payload logging", "[stratum_trace]")
+{
+    TEST_ASSERT_TRUE(stratum_trace_get_log_payloads());
+    stratum_trace_set_log_payloads(false);
+    TEST_ASSERT_FALSE(stratum_trace_get_log_payloads());
+    stratum_trace_set_log_payloads(true);
+}
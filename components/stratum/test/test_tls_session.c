@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_heap_caps.h"
+#include "tls_session.h"
+
+TEST_CASE("TLS session is kept per endpoint", "[tls_session]")
+{
+    tls_session_reset();
+    const uint8_t ticket[] = { 1, 2, 3, 4, 5 };
+    const uint8_t newer[] = { 6, 7, 8 };
+    size_t len = 0;
+
+    TEST_ASSERT_NULL(tls_session_get("pool.example.com", 443, &len));
+    TEST_ASSERT_EQUAL(ESP_OK, tls_session_store("pool.example.com", 443, ticket, sizeof(ticket)));
+
+    uint8_t *session = tls_session_get("pool.example.com", 443, &len);
+    TEST_ASSERT_NOT_NULL(session);
+    TEST_ASSERT_EQUAL(sizeof(ticket), len);
+    TEST_ASSERT_EQUAL_MEMORY(ticket, session, len);
+    heap_caps_free(session);
+
+    // Another port is another endpoint
+    TEST_ASSERT_NULL(tls_session_get("pool.example.com", 3333, &len));
+
+    TEST_ASSERT_EQUAL(ESP_OK, tls_session_store("pool.example.com", 443, newer, sizeof(newer)));
+    session = tls_session_get("pool.example.com", 443, &len);
+    TEST_ASSERT_EQUAL(sizeof(newer), len);
+    TEST_ASSERT_EQUAL_MEMORY(newer, session, len);
+    heap_caps_free(session);
+
+    tls_session_forget("pool.example.com", 443);
+    TEST_ASSERT_NULL(tls_session_get("pool.example.com", 443, &len));
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, tls_session_store("pool.example.com", 443, ticket, 0));
+}
+
+TEST_CASE("TLS session cache replaces the least recently used endpoint", "[tls_session]")
+{
+    tls_session_reset();
+    const uint8_t ticket[] = { 1 };
+    char host[32];
+    size_t len;
+
+    for (int i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+        snprintf(host, sizeof(host), "pool%d.example.com", i);
+        tls_session_store(host, 443, ticket, sizeof(ticket));
+    }
+    // pool0 is used again, pool1 is the oldest now
+    heap_caps_free(tls_session_get("pool0.example.com", 443, &len));
+    tls_session_store("new.example.com", 443, ticket, sizeof(ticket));
+
+    uint8_t *session = tls_session_get("pool0.example.com", 443, &len);
+    TEST_ASSERT_NOT_NULL(session);
+    heap_caps_free(session);
+    TEST_ASSERT_NULL(tls_session_get("pool1.example.com", 443, &len));
+    session = tls_session_get("new.example.com", 443, &len);
+    TEST_ASSERT_NOT_NULL(session);
+    heap_caps_free(session);
+}
+
+TEST_CASE("TLS handshakes are counted by kind", "[tls_session]")
+{
+    tls_session_reset();
+    tls_handshake_stats stats;
+
+    tls_session_get_stats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.full);
+    TEST_ASSERT_EQUAL(0, stats.last_full_ms);
+
+    tls_session_record_handshake(false, 412000);
+    tls_session_record_handshake(true, 38000);
+    tls_session_record_handshake(true, 41000);
+
+    tls_session_get_stats(&stats);
+    TEST_ASSERT_EQUAL(1, stats.full);
+    TEST_ASSERT_EQUAL(2, stats.resumed);
+    TEST_ASSERT_EQUAL(412, stats.last_full_ms);
+    TEST_ASSERT_EQUAL(41, stats.last_resumed_ms);
+}
+
+// A hello in a handshake record, extensions only when extensions_len is set
+static size_t build_hello(uint8_t *out, uint8_t type, uint8_t random_byte, const uint8_t *session_id,
+                          uint8_t session_id_len, const uint8_t *extensions, size_t extensions_len)
+{
+    uint8_t *p = out + 9;
+    *p++ = 0x03;
+    *p++ = 0x03;
+    memset(p, random_byte, 32);
+    p += 32;
+    *p++ = session_id_len;
+    memcpy(p, session_id, session_id_len);
+    p += session_id_len;
+    // Cipher suite and compression, a ClientHello lists one of each
+    if (type == 1) {
+        *p++ = 0;
+        *p++ = 2;
+    }
+    *p++ = 0x13;
+    *p++ = 0x01;
+    if (type == 1) {
+        *p++ = 1;
+    }
+    *p++ = 0;
+    if (extensions_len > 0) {
+        *p++ = extensions_len >> 8;
+        *p++ = extensions_len;
+        memcpy(p, extensions, extensions_len);
+        p += extensions_len;
+    }
+    size_t message_len = p - out - 9;
+    const uint8_t header[] = { 22, 0x03, 0x03, (message_len + 4) >> 8, message_len + 4,
+                               type, 0, message_len >> 8, message_len };
+    memcpy(out, header, sizeof(header));
+    return p - out;
+}
+
+TEST_CASE("TLS resumption is read from the hellos", "[tls_session]")
+{
+    const uint8_t session_id[32] = { 1, 2, 3 };
+    const uint8_t other_id[32] = { 4, 5, 6 };
+    const uint8_t tls13[] = { 0, 43, 0, 2, 0x03, 0x04 };
+    const uint8_t tls13_psk[] = { 0, 43, 0, 2, 0x03, 0x04, 0, 41, 0, 2, 0, 0 };
+    const uint8_t change_cipher_spec[] = { 20, 0x03, 0x03, 0, 1, 1 };
+    uint8_t client[TLS_HELLO_CAPTURE_LEN];
+    uint8_t server[TLS_HELLO_CAPTURE_LEN];
+    size_t client_len = build_hello(client, 1, 0x11, session_id, 32, NULL, 0);
+    size_t server_len;
+
+    // TLS 1.2 resumes when the server echoes the session ID
+    server_len = build_hello(server, 2, 0x22, session_id, 32, NULL, 0);
+    TEST_ASSERT_TRUE(tls_session_resumed(client, client_len, server, server_len));
+    server_len = build_hello(server, 2, 0x22, other_id, 32, NULL, 0);
+    TEST_ASSERT_FALSE(tls_session_resumed(client, client_len, server, server_len));
+    // A ClientHello cut off after its session ID is enough
+    server_len = build_hello(server, 2, 0x22, session_id, 32, NULL, 0);
+    TEST_ASSERT_TRUE(tls_session_resumed(client, 9 + 2 + 32 + 1 + 32, server, server_len));
+    // A ServerHello cut off is not
+    TEST_ASSERT_FALSE(tls_session_resumed(client, client_len, server, server_len - 1));
+
+    // TLS 1.3 echoes the session ID always, it resumes when the server takes a pre_shared_key
+    server_len = build_hello(server, 2, 0x22, session_id, 32, tls13, sizeof(tls13));
+    TEST_ASSERT_FALSE(tls_session_resumed(client, client_len, server, server_len));
+    server_len = build_hello(server, 2, 0x22, session_id, 32, tls13_psk, sizeof(tls13_psk));
+    TEST_ASSERT_TRUE(tls_session_resumed(client, client_len, server, server_len));
+
+    // After a HelloRetryRequest and a change_cipher_spec the next ServerHello counts
+    server_len = build_hello(server, 2, 0, session_id, 32, tls13, sizeof(tls13));
+    memcpy(server + 11, (const uint8_t[]) { 0xcf, 0x21, 0xad, 0x74, 0xe5, 0x9a, 0x61, 0x11, 0xbe, 0x1d, 0x8c,
+                                             0x02, 0x1e, 0x65, 0xb8, 0x91, 0xc2, 0xa2, 0x11, 0x16, 0x7a, 0xbb,
+                                             0x8c, 0x5e, 0x07, 0x9e, 0x09, 0xe2, 0xc8, 0xa8, 0x33, 0x9c },
+           32);
+    memcpy(server + server_len, change_cipher_spec, sizeof(change_cipher_spec));
+    server_len += sizeof(change_cipher_spec);
+    size_t retry_len = server_len;
+    server_len += build_hello(server + server_len, 2, 0x22, session_id, 32, tls13_psk, sizeof(tls13_psk));
+    TEST_ASSERT_TRUE(tls_session_resumed(client, client_len, server, server_len));
+    server_len = retry_len + build_hello(server + retry_len, 2, 0x22, session_id, 32, tls13, sizeof(tls13));
+    TEST_ASSERT_FALSE(tls_session_resumed(client, client_len, server, server_len));
+
+    // No hellos, no resumption
+    TEST_ASSERT_FALSE(tls_session_resumed(client, 0, server, 0));
+}
@@ -81,3 +81,103 @@ TEST_CASE("networkDifficulty", "[utils]")
 
     TEST_ASSERT_EQUAL_DOUBLE(expected, actual);
 }
+
+// a * m as a 288 bit little endian value
+static void mul_u32(const uint8_t a[32], uint32_t m, uint8_t out[36])
+{
+    uint64_t carry = 0;
+    for (int i = 0; i < 32; i++) {
+        carry += (uint64_t)a[i] * m;
+        out[i] = carry & 0xff;
+        carry >>= 8;
+    }
+    for (int i = 32; i < 36; i++) {
+        out[i] = carry & 0xff;
+        carry >>= 8;
+    }
+}
+
+static int cmp_le(const uint8_t *a, const uint8_t *b, int len)
+{
+    for (int i = len - 1; i >= 0; i--) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static void add_one(uint8_t v[32])
+{
+    for (int i = 0; i < 32 && ++v[i] == 0; i++);
+}
+
+TEST_CASE("difficulty_to_target", "[utils]")
+{
+    uint8_t diff1[36] = {0};
+    diff1[26] = 0xff;
+    diff1[27] = 0xff;
+
+    uint8_t target[32];
+    difficulty_to_target(1, target);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(diff1, target, 32);
+
+    uint8_t expected[32] = {0};
+    expected[26] = 0xfe;
+    expected[27] = 0xff;
+    expected[28] = 0x01;
+    difficulty_to_target(0.5, target);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, target, 32);
+
+    // target is floor(diff1 / d): target * d <= diff1 < (target + 1) * d
+    const uint32_t difficulties[] = { 3, 7, 1000, 4096, 65535, 65537, 1000003, 0xfffffffb };
+    for (int i = 0; i < sizeof(difficulties) / sizeof(difficulties[0]); i++) {
+        uint8_t product[36];
+        difficulty_to_target(difficulties[i], target);
+        mul_u32(target, difficulties[i], product);
+        TEST_ASSERT_LESS_OR_EQUAL(0, cmp_le(product, diff1, 36));
+        add_one(target);
+        mul_u32(target, difficulties[i], product);
+        TEST_ASSERT_GREATER_THAN(0, cmp_le(product, diff1, 36));
+    }
+
+    uint8_t all_ones[32];
+    memset(all_ones, 0xff, sizeof(all_ones));
+    difficulty_to_target(1e-80, target);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(all_ones, target, 32);
+}
+
+TEST_CASE("nbits_to_target", "[utils]")
+{
+    uint8_t target[32];
+    uint8_t expected[32] = {0};
+    expected[20] = 0xfb;
+    expected[21] = 0xcd;
+    expected[22] = 0x01;
+    nbits_to_target(0x1701cdfb, target);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, target, 32);
+
+    memset(expected, 0, sizeof(expected));
+    expected[0] = 0x34;
+    expected[1] = 0x12;
+    nbits_to_target(0x02123400, target);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, target, 32);
+}
+
+TEST_CASE("hash_meets_target boundaries", "[utils]")
+{
+    uint8_t target[32];
+    uint8_t hash[32];
+    nbits_to_target(0x1701cdfb, target);
+
+    memcpy(hash, target, 32);
+    TEST_ASSERT_TRUE(hash_meets_target(hash, target));
+    add_one(hash);
+    TEST_ASSERT_FALSE(hash_meets_target(hash, target));
+
+    memcpy(hash, target, 32);
+    hash[20]--;
+    TEST_ASSERT_TRUE(hash_meets_target(hash, target));
+    hash[0] = 0xff;
+    TEST_ASSERT_TRUE(hash_meets_target(hash, target));
+    hash[31] = 0x01;
+    TEST_ASSERT_FALSE(hash_meets_target(hash, target));
+}
@@ -0,0 +1,55 @@
+#include "unity.h"
+#include "vardiff.h"
+
+TEST_CASE("Vardiff picks a power of two for the share rate", "[vardiff]")
+{
+    TEST_ASSERT_EQUAL_UINT32(0, vardiff_difficulty_for(0, 20));
+    TEST_ASSERT_EQUAL_UINT32(1, vardiff_difficulty_for(0.001f, 20));
+
+    // 1 TH/s at 20 shares per minute is 698 ideally
+    TEST_ASSERT_EQUAL_UINT32(512, vardiff_difficulty_for(1000, 20));
+    // 4.2 TH/s, 2934 ideally
+    TEST_ASSERT_EQUAL_UINT32(4096, vardiff_difficulty_for(4200, 20));
+    TEST_ASSERT_EQUAL_UINT32(8192, vardiff_difficulty_for(4200, 8));
+
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 27.3f, vardiff_share_rate(1000, 512));
+}
+
+TEST_CASE("Vardiff only suggests when the rate drifts out of the band", "[vardiff]")
+{
+    vardiff controller;
+    vardiff_init(&controller, 20, 256);
+
+    // Nothing to go on yet
+    TEST_ASSERT_EQUAL_UINT32(0, vardiff_update(&controller, 0, 0, 0));
+
+    TEST_ASSERT_EQUAL_UINT32(4096, vardiff_update(&controller, 4200, 0, 0));
+    // Not again while the pool has not applied it
+    TEST_ASSERT_EQUAL_UINT32(0, vardiff_update(&controller, 4200, 256, 1000000));
+    TEST_ASSERT_EQUAL_UINT32(0, vardiff_update(&controller, 4200, 256, VARDIFF_MIN_INTERVAL_US + 1));
+
+    // The pool applied it, a hashrate change within the band does nothing
+    TEST_ASSERT_EQUAL_UINT32(0, vardiff_update(&controller, 4200, 4096, VARDIFF_MIN_INTERVAL_US + 2));
+    TEST_ASSERT_EQUAL_UINT32(0, vardiff_update(&controller, 3000, 4096, VARDIFF_MIN_INTERVAL_US + 3));
+    TEST_ASSERT_EQUAL_UINT32(0, vardiff_update(&controller, 7000, 4096, VARDIFF_MIN_INTERVAL_US + 4));
+
+    // Throttled to a quarter, the rate falls out of the band
+    TEST_ASSERT_EQUAL_UINT32(1024, vardiff_update(&controller, 1050, 4096, VARDIFF_MIN_INTERVAL_US + 5));
+}
+
+TEST_CASE("Vardiff keeps to the configured minimum", "[vardiff]")
+{
+    vardiff controller;
+    vardiff_init(&controller, 20, 1000);
+
+    TEST_ASSERT_EQUAL_UINT32(1000, vardiff_update(&controller, 500, 0, 0));
+    TEST_ASSERT_EQUAL_UINT32(0, vardiff_update(&controller, 500, 1000, VARDIFF_MIN_INTERVAL_US * 2));
+
+    // A new connection starts over
+    vardiff_reset(&controller);
+    TEST_ASSERT_EQUAL_UINT32(1000, vardiff_update(&controller, 500, 0, VARDIFF_MIN_INTERVAL_US * 2));
+
+    // Disabled
+    vardiff_init(&controller, 0, 1000);
+    TEST_ASSERT_EQUAL_UINT32(0, vardiff_update(&controller, 4200, 0, 0));
+}
@@ -0,0 +1,237 @@
+#include "unity.h"
+#include "work_queue.h"
+#include "mining_notify_pool.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define STRESS_ITEMS 20000
+#define LATENCY_SAMPLES 500
+
+static work_queue queue;
+
+typedef struct
+{
+    SemaphoreHandle_t done;
+    uint32_t received;
+    uint32_t dropped;
+    uint32_t last;
+    bool in_order;
+} stress_state;
+
+static void stress_consumer(void *pvParameters)
+{
+    stress_state *state = pvParameters;
+    for (;;) {
+        uintptr_t item = (uintptr_t) queue_dequeue_timeout(&queue, 50);
+        if (item == 0) {
+            continue;
+        }
+        if (item <= state->last) {
+            state->in_order = false;
+        }
+        state->last = item;
+        state->received++;
+        if (item == STRESS_ITEMS) {
+            break;
+        }
+    }
+    xSemaphoreGive(state->done);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("Work queue hands every item over once and in order", "[work_queue]")
+{
+    stress_state state = { .done = xSemaphoreCreateBinary(), .in_order = true };
+    queue_init(&queue);
+
+    xTaskCreate(stress_consumer, "stress_consumer", 4096, &state, uxTaskPriorityGet(NULL), NULL);
+
+    // Producer side as in stratum_task: drop the oldest item when full, sometimes clear
+    for (uintptr_t i = 1; i <= STRESS_ITEMS; i++) {
+        if (queue_count(&queue) == QUEUE_SIZE && queue_try_dequeue(&queue) != NULL) {
+            state.dropped++;
+        }
+        if (i % 1000 == 0) {
+            while (queue_try_dequeue(&queue) != NULL) {
+                state.dropped++;
+            }
+        }
+        queue_enqueue(&queue, (void *) i);
+        if (i % 64 == 0) {
+            taskYIELD();
+        }
+    }
+
+    TEST_ASSERT_TRUE(xSemaphoreTake(state.done, pdMS_TO_TICKS(10000)));
+    vSemaphoreDelete(state.done);
+
+    TEST_ASSERT_TRUE(state.in_order);
+    TEST_ASSERT_EQUAL(STRESS_ITEMS, state.received + state.dropped);
+    TEST_ASSERT_EQUAL(0, queue_count(&queue));
+}
+
+static mining_notify *create_notify(const char *job_id, bool clean_jobs)
+{
+    mining_notify *notify = mining_notify_create(job_id, strlen(job_id), "", 0, "", 0, "", 0, 0);
+    TEST_ASSERT_NOT_NULL(notify);
+    notify->clean_jobs = clean_jobs;
+    return notify;
+}
+
+TEST_CASE("Work queue latest notify replaces pending ones", "[work_queue]")
+{
+    mining_notify_pool_stats before, after;
+    mining_notify_pool_get_stats(&before);
+    queue_init(&queue);
+
+    TEST_ASSERT_EQUAL(0, queue_enqueue_latest(&queue, create_notify("1", false)));
+    TEST_ASSERT_EQUAL(1, queue_enqueue_latest(&queue, create_notify("2", true)));
+    // Replacing a clean notify keeps it clean, the consumer has not dropped its jobs yet
+    TEST_ASSERT_EQUAL(1, queue_enqueue_latest(&queue, create_notify("3", false)));
+    TEST_ASSERT_EQUAL(1, queue_count(&queue));
+    TEST_ASSERT_EQUAL(2, queue_get_coalesced(&queue));
+
+    mining_notify *notify = queue_dequeue_timeout(&queue, 0);
+    TEST_ASSERT_NOT_NULL(notify);
+    TEST_ASSERT_EQUAL_STRING("3", notify->job_id);
+    TEST_ASSERT_TRUE(notify->clean_jobs);
+    STRATUM_V1_free_mining_notify(notify);
+
+    // Nothing pending, nothing to coalesce
+    TEST_ASSERT_EQUAL(0, queue_enqueue_latest(&queue, create_notify("4", false)));
+    notify = queue_dequeue_timeout(&queue, 0);
+    TEST_ASSERT_EQUAL_STRING("4", notify->job_id);
+    TEST_ASSERT_FALSE(notify->clean_jobs);
+    STRATUM_V1_free_mining_notify(notify);
+    TEST_ASSERT_EQUAL(2, queue_get_coalesced(&queue));
+
+    mining_notify_pool_get_stats(&after);
+    TEST_ASSERT_EQUAL(before.in_use, after.in_use);
+}
+
+static void set_clock_back(void *pvParameters)
+{
+    vTaskDelay(pdMS_TO_TICKS(20));
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    now.tv_sec -= 3600;
+    settimeofday(&now, NULL);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("Work queue timeout ignores wall clock changes", "[work_queue]")
+{
+    struct timeval before;
+    gettimeofday(&before, NULL);
+    queue_init(&queue);
+
+    // Like the hourly settimeofday in SYSTEM_notify_new_ntime
+    xTaskCreate(set_clock_back, "set_clock_back", 2048, NULL, uxTaskPriorityGet(NULL) + 1, NULL);
+
+    int64_t start = esp_timer_get_time();
+    TEST_ASSERT_NULL(queue_dequeue_timeout(&queue, 100));
+    int64_t elapsed_us = esp_timer_get_time() - start;
+
+    int64_t restored_us = before.tv_sec * 1000000LL + before.tv_usec + elapsed_us;
+    struct timeval restored = { .tv_sec = restored_us / 1000000, .tv_usec = restored_us % 1000000 };
+    settimeofday(&restored, NULL);
+
+    TEST_ASSERT_GREATER_OR_EQUAL(100000, elapsed_us);
+    TEST_ASSERT_LESS_THAN(200000, elapsed_us);
+}
+
+// The queue before it was lock-free: mutex and condition variables
+typedef struct
+{
+    void *buffer[QUEUE_SIZE];
+    int head;
+    int tail;
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+} legacy_queue;
+
+static legacy_queue legacy;
+
+static void legacy_enqueue(legacy_queue *q, void *work)
+{
+    pthread_mutex_lock(&q->lock);
+    q->buffer[q->tail] = work;
+    q->tail = (q->tail + 1) % QUEUE_SIZE;
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void *legacy_dequeue(legacy_queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0) {
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    }
+    void *work = q->buffer[q->head];
+    q->head = (q->head + 1) % QUEUE_SIZE;
+    q->count--;
+    pthread_mutex_unlock(&q->lock);
+    return work;
+}
+
+typedef struct
+{
+    bool use_legacy;
+    SemaphoreHandle_t done;
+    int64_t total_us;
+} latency_state;
+
+static volatile int64_t enqueued_at;
+
+static void latency_consumer(void *pvParameters)
+{
+    latency_state *state = pvParameters;
+    for (int i = 0; i < LATENCY_SAMPLES; i++) {
+        state->use_legacy ? legacy_dequeue(&legacy) : queue_dequeue(&queue);
+        state->total_us += esp_timer_get_time() - enqueued_at;
+    }
+    xSemaphoreGive(state->done);
+    vTaskDelete(NULL);
+}
+
+static int64_t measure_wakeup(bool use_legacy)
+{
+    latency_state state = { .use_legacy = use_legacy, .done = xSemaphoreCreateBinary() };
+
+    // Consumer on the same core and higher priority, it blocks before every enqueue
+    xTaskCreatePinnedToCore(latency_consumer, "latency_consumer", 4096, &state,
+                            uxTaskPriorityGet(NULL) + 1, NULL, xPortGetCoreID());
+    for (int i = 0; i < LATENCY_SAMPLES; i++) {
+        enqueued_at = esp_timer_get_time();
+        use_legacy ? legacy_enqueue(&legacy, (void *) 1) : queue_enqueue(&queue, (void *) 1);
+    }
+    xSemaphoreTake(state.done, portMAX_DELAY);
+    vSemaphoreDelete(state.done);
+    return state.total_us;
+}
+
+TEST_CASE("Work queue enqueue to wakeup latency", "[work_queue][benchmark][not-on-qemu]")
+{
+    queue_init(&queue);
+    pthread_mutex_init(&legacy.lock, NULL);
+    pthread_cond_init(&legacy.not_empty, NULL);
+
+    int64_t legacy_us = measure_wakeup(true);
+    int64_t lock_free_us = measure_wakeup(false);
+
+    pthread_cond_destroy(&legacy.not_empty);
+    pthread_mutex_destroy(&legacy.lock);
+
+    printf("enqueue to wakeup: mutex/condvar %.2f us, lock-free %.2f us\n",
+           (double) legacy_us / LATENCY_SAMPLES, (double) lock_free_us / LATENCY_SAMPLES);
+    TEST_ASSERT_LESS_THAN(legacy_us, lock_free_us);
+}
@@ -0,0 +1,289 @@
+#include "tls_session.h"
+
+#include <pthread.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+
+typedef struct
+{
+    char host[TLS_SESSION_HOST_LEN];
+    uint16_t port;
+    uint8_t *session;
+    size_t len;
+    uint32_t used;
+} tls_session_entry;
+
+static tls_session_entry cache[TLS_SESSION_CACHE_SIZE];
+static uint32_t use_count;
+static tls_handshake_stats stats;
+// Sessions are a few hundred bytes to a few kB, too much to copy with interrupts off
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static tls_session_entry *find(const char *host, uint16_t port)
+{
+    for (int i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+        if (cache[i].session != NULL && cache[i].port == port && strcmp(cache[i].host, host) == 0) {
+            return &cache[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t tls_session_store(const char *host, uint16_t port, const uint8_t *session, size_t len)
+{
+    if (len == 0 || strlen(host) >= TLS_SESSION_HOST_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t *copy = heap_caps_malloc_prefer(len, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT);
+    if (copy == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, session, len);
+
+    pthread_mutex_lock(&cache_lock);
+    tls_session_entry *entry = find(host, port);
+    for (int i = 0; entry == NULL && i < TLS_SESSION_CACHE_SIZE; i++) {
+        if (cache[i].session == NULL) entry = &cache[i];
+    }
+    if (entry == NULL) {
+        entry = &cache[0];
+        for (int i = 1; i < TLS_SESSION_CACHE_SIZE; i++) {
+            if (cache[i].used < entry->used) entry = &cache[i];
+        }
+    }
+    uint8_t *old = entry->session;
+    strcpy(entry->host, host);
+    entry->port = port;
+    entry->session = copy;
+    entry->len = len;
+    entry->used = ++use_count;
+    pthread_mutex_unlock(&cache_lock);
+
+    heap_caps_free(old);
+    return ESP_OK;
+}
+
+uint8_t *tls_session_get(const char *host, uint16_t port, size_t *len)
+{
+    uint8_t *copy = NULL;
+
+    pthread_mutex_lock(&cache_lock);
+    tls_session_entry *entry = find(host, port);
+    if (entry != NULL) {
+        copy = heap_caps_malloc_prefer(entry->len, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT);
+        if (copy != NULL) {
+            memcpy(copy, entry->session, entry->len);
+            *len = entry->len;
+            entry->used = ++use_count;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    return copy;
+}
+
+void tls_session_forget(const char *host, uint16_t port)
+{
+    uint8_t *old = NULL;
+
+    pthread_mutex_lock(&cache_lock);
+    tls_session_entry *entry = find(host, port);
+    if (entry != NULL) {
+        old = entry->session;
+        memset(entry, 0, sizeof(*entry));
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    heap_caps_free(old);
+}
+
+#define RECORD_HEADER_LEN 5
+#define RECORD_CHANGE_CIPHER_SPEC 20
+#define RECORD_HANDSHAKE 22
+#define HANDSHAKE_CLIENT_HELLO 1
+#define HANDSHAKE_SERVER_HELLO 2
+#define HELLO_RANDOM_LEN 32
+#define EXTENSION_PRE_SHARED_KEY 41
+#define EXTENSION_SUPPORTED_VERSIONS 43
+#define TLS_1_3 0x0304
+
+// The random of a ServerHello that is a HelloRetryRequest, RFC 8446 4.1.3
+static const uint8_t HELLO_RETRY_RANDOM[HELLO_RANDOM_LEN] = {
+    0xcf, 0x21, 0xad, 0x74, 0xe5, 0x9a, 0x61, 0x11, 0xbe, 0x1d, 0x8c, 0x02, 0x1e, 0x65, 0xb8, 0x91,
+    0xc2, 0xa2, 0x11, 0x16, 0x7a, 0xbb, 0x8c, 0x5e, 0x07, 0x9e, 0x09, 0xe2, 0xc8, 0xa8, 0x33, 0x9c,
+};
+
+typedef struct
+{
+    const uint8_t *random;
+    const uint8_t *session_id;
+    uint8_t session_id_len;
+    bool tls13;
+    bool pre_shared_key;
+} hello;
+
+static uint32_t read_be(const uint8_t *p, int n)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < n; i++) {
+        value = value << 8 | p[i];
+    }
+    return value;
+}
+
+// Joins the handshake records up to the first encrypted one, a message may span records
+static size_t handshake_bytes(const uint8_t *records, size_t len, uint8_t *out)
+{
+    size_t n = 0;
+    while (len >= RECORD_HEADER_LEN) {
+        uint8_t type = records[0];
+        size_t record_len = read_be(records + 3, 2);
+        records += RECORD_HEADER_LEN;
+        len -= RECORD_HEADER_LEN;
+        size_t available = record_len < len ? record_len : len;
+        if (type == RECORD_HANDSHAKE) {
+            memcpy(out + n, records, available);
+            n += available;
+        } else if (type != RECORD_CHANGE_CIPHER_SPEC) {
+            break;
+        }
+        records += available;
+        len -= available;
+    }
+    return n;
+}
+
+// Parses the hello at *p, extensions only for a ServerHello. Advances past it.
+// A ClientHello with a ticket can be longer than what was captured, only its
+// start up to the session ID has to be there.
+static bool parse_hello(const uint8_t **p, const uint8_t *end, uint8_t type, hello *out)
+{
+    if (end - *p < 4 || (*p)[0] != type) {
+        return false;
+    }
+    const uint8_t *q = *p + 4;
+    size_t message_len = read_be(*p + 1, 3);
+    if (message_len > (size_t) (end - q)) {
+        if (type == HANDSHAKE_SERVER_HELLO) {
+            return false;
+        }
+        message_len = end - q;
+    }
+    const uint8_t *message_end = q + message_len;
+    *p = message_end;
+    memset(out, 0, sizeof(*out));
+
+    if (message_end - q < 2 + HELLO_RANDOM_LEN + 1) {
+        return false;
+    }
+    out->random = q + 2;
+    q += 2 + HELLO_RANDOM_LEN;
+    out->session_id_len = *q++;
+    out->session_id = q;
+    if (out->session_id_len > 32 || message_end - q < out->session_id_len) {
+        return false;
+    }
+    q += out->session_id_len;
+    if (type != HANDSHAKE_SERVER_HELLO) {
+        return true;
+    }
+
+    // Cipher suite and compression, then the extensions if there are any
+    if (message_end - q < 3) {
+        return false;
+    }
+    q += 3;
+    if (q == message_end) {
+        return true;
+    }
+    if (message_end - q < 2) {
+        return false;
+    }
+    const uint8_t *extensions_end = q + 2 + read_be(q, 2);
+    if (extensions_end > message_end) {
+        return false;
+    }
+    for (q += 2; extensions_end - q >= 4; ) {
+        uint16_t extension = read_be(q, 2);
+        size_t extension_len = read_be(q + 2, 2);
+        q += 4;
+        if ((size_t) (extensions_end - q) < extension_len) {
+            return false;
+        }
+        if (extension == EXTENSION_SUPPORTED_VERSIONS && extension_len == 2) {
+            out->tls13 = read_be(q, 2) == TLS_1_3;
+        } else if (extension == EXTENSION_PRE_SHARED_KEY) {
+            out->pre_shared_key = true;
+        }
+        q += extension_len;
+    }
+    return true;
+}
+
+bool tls_session_resumed(const uint8_t *client, size_t client_len, const uint8_t *server, size_t server_len)
+{
+    uint8_t messages[TLS_HELLO_CAPTURE_LEN];
+    if (client_len > sizeof(messages) || server_len > sizeof(messages)) {
+        return false;
+    }
+
+    hello server_hello;
+    size_t len = handshake_bytes(server, server_len, messages);
+    const uint8_t *p = messages;
+    if (!parse_hello(&p, messages + len, HANDSHAKE_SERVER_HELLO, &server_hello)) {
+        return false;
+    }
+    // After a HelloRetryRequest the ServerHello that counts comes next
+    if (memcmp(server_hello.random, HELLO_RETRY_RANDOM, HELLO_RANDOM_LEN) == 0 &&
+        !parse_hello(&p, messages + len, HANDSHAKE_SERVER_HELLO, &server_hello)) {
+        return false;
+    }
+    if (server_hello.tls13) {
+        return server_hello.pre_shared_key;
+    }
+
+    uint8_t server_session_id[32];
+    uint8_t server_session_id_len = server_hello.session_id_len;
+    memcpy(server_session_id, server_hello.session_id, server_session_id_len);
+
+    hello client_hello;
+    len = handshake_bytes(client, client_len, messages);
+    p = messages;
+    if (!parse_hello(&p, messages + len, HANDSHAKE_CLIENT_HELLO, &client_hello)) {
+        return false;
+    }
+    return server_session_id_len > 0 && server_session_id_len == client_hello.session_id_len &&
+           memcmp(server_session_id, client_hello.session_id, server_session_id_len) == 0;
+}
+
+void tls_session_record_handshake(bool resumed, int64_t duration_us)
+{
+    pthread_mutex_lock(&cache_lock);
+    if (resumed) {
+        stats.resumed++;
+        stats.last_resumed_ms = duration_us / 1000;
+    } else {
+        stats.full++;
+        stats.last_full_ms = duration_us / 1000;
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void tls_session_get_stats(tls_handshake_stats *out)
+{
+    pthread_mutex_lock(&cache_lock);
+    *out = stats;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void tls_session_reset(void)
+{
+    pthread_mutex_lock(&cache_lock);
+    for (int i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+        heap_caps_free(cache[i].session);
+    }
+    memset(cache, 0, sizeof(cache));
+    memset(&stats, 0, sizeof(stats));
+    use_count = 0;
+    pthread_mutex_unlock(&cache_lock);
+}
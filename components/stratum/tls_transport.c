@@ -0,0 +1,396 @@
+#include "tls_transport.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include "esp_crt_bundle.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) || defined(MBEDTLS_USE_PSA_CRYPTO)
+#include "psa/crypto.h"
+#endif
+#include "pool_connect.h"
+#include "tls_session.h"
+
+static const char *TAG = "tls_transport";
+
+typedef struct
+{
+    int sock;
+    char *cert;
+    char *common_name;
+    uint16_t port;
+    bool connected;
+
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_config conf;
+    mbedtls_x509_crt ca;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_entropy_context entropy;
+
+    // The start of the handshake each way, mbedTLS does not say if it resumed
+    uint8_t hello_sent[TLS_HELLO_CAPTURE_LEN];
+    size_t hello_sent_len;
+    uint8_t hello_received[TLS_HELLO_CAPTURE_LEN];
+    size_t hello_received_len;
+    bool capturing;
+} tls_transport;
+
+static int wait_socket(int sock, bool write, int timeout_ms)
+{
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(sock, &fds);
+    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+    return select(sock + 1, write ? NULL : &fds, write ? &fds : NULL, NULL, &tv);
+}
+
+static void capture(uint8_t *out, size_t *out_len, const unsigned char *buf, int n)
+{
+    size_t copy = TLS_HELLO_CAPTURE_LEN - *out_len;
+    if (copy > (size_t) n) {
+        copy = n;
+    }
+    memcpy(out + *out_len, buf, copy);
+    *out_len += copy;
+}
+
+static int bio_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    tls_transport *tls = ctx;
+    int n = send(tls->sock, buf, len, MSG_NOSIGNAL);
+    if (n < 0) {
+        return errno == EAGAIN || errno == EINTR ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_SEND_FAILED;
+    }
+    if (tls->capturing) {
+        capture(tls->hello_sent, &tls->hello_sent_len, buf, n);
+    }
+    return n;
+}
+
+static int bio_recv_timeout(void *ctx, unsigned char *buf, size_t len, uint32_t timeout_ms)
+{
+    tls_transport *tls = ctx;
+    int ready = wait_socket(tls->sock, false, timeout_ms);
+    if (ready == 0) {
+        return MBEDTLS_ERR_SSL_TIMEOUT;
+    }
+    if (ready < 0) {
+        return MBEDTLS_ERR_NET_RECV_FAILED;
+    }
+    int n = recv(tls->sock, buf, len, 0);
+    if (n < 0) {
+        return errno == EAGAIN || errno == EINTR ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_RECV_FAILED;
+    }
+    if (tls->capturing) {
+        capture(tls->hello_received, &tls->hello_received_len, buf, n);
+    }
+    return n;
+}
+
+static void save_session(tls_transport *tls)
+{
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    size_t len = 0;
+    if (mbedtls_ssl_get_session(&tls->ssl, &session) == 0 &&
+        mbedtls_ssl_session_save(&session, NULL, 0, &len) == MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
+        uint8_t *buffer = heap_caps_malloc_prefer(len, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT);
+        if (buffer != NULL && mbedtls_ssl_session_save(&session, buffer, len, &len) == 0) {
+            tls_session_store(tls->common_name, tls->port, buffer, len);
+        }
+        heap_caps_free(buffer);
+    }
+    mbedtls_ssl_session_free(&session);
+}
+
+static void free_tls(tls_transport *tls)
+{
+    mbedtls_ssl_free(&tls->ssl);
+    mbedtls_ssl_config_free(&tls->conf);
+    mbedtls_x509_crt_free(&tls->ca);
+    mbedtls_ctr_drbg_free(&tls->ctr_drbg);
+    mbedtls_entropy_free(&tls->entropy);
+}
+
+static int setup_tls(tls_transport *tls, int timeout_ms)
+{
+    mbedtls_ssl_init(&tls->ssl);
+    mbedtls_ssl_config_init(&tls->conf);
+    mbedtls_x509_crt_init(&tls->ca);
+    mbedtls_ctr_drbg_init(&tls->ctr_drbg);
+    mbedtls_entropy_init(&tls->entropy);
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) || defined(MBEDTLS_USE_PSA_CRYPTO)
+    // TLS 1.3 runs on PSA. esp-tls initializes it for its own connections, this
+    // transport is not one of them. Calls after the first return right away.
+    if (psa_crypto_init() != PSA_SUCCESS) {
+        ESP_LOGE(TAG, "PSA crypto initialization failed");
+        return MBEDTLS_ERR_SSL_BAD_CONFIG;
+    }
+#endif
+
+    int ret = mbedtls_ctr_drbg_seed(&tls->ctr_drbg, mbedtls_entropy_func, &tls->entropy, NULL, 0);
+    if (ret == 0) {
+        ret = mbedtls_ssl_config_defaults(&tls->conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    }
+    if (ret != 0) {
+        return ret;
+    }
+    mbedtls_ssl_conf_rng(&tls->conf, mbedtls_ctr_drbg_random, &tls->ctr_drbg);
+    mbedtls_ssl_conf_authmode(&tls->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_read_timeout(&tls->conf, timeout_ms);
+
+    if (tls->cert != NULL) {
+        ret = mbedtls_x509_crt_parse(&tls->ca, (const unsigned char *) tls->cert, strlen(tls->cert) + 1);
+        if (ret < 0) {
+            ESP_LOGE(TAG, "Invalid pool certificate (-0x%04x)", -ret);
+            return ret;
+        }
+        mbedtls_ssl_conf_ca_chain(&tls->conf, &tls->ca, NULL);
+    } else if (esp_crt_bundle_attach(&tls->conf) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to attach the certificate bundle");
+        return MBEDTLS_ERR_SSL_BAD_CONFIG;
+    }
+
+    ret = mbedtls_ssl_setup(&tls->ssl, &tls->conf);
+    if (ret == 0) {
+        ret = mbedtls_ssl_set_hostname(&tls->ssl, tls->common_name);
+    }
+    if (ret != 0) {
+        return ret;
+    }
+    mbedtls_ssl_set_bio(&tls->ssl, tls, bio_send, NULL, bio_recv_timeout);
+    return 0;
+}
+
+// Resumes the session of the endpoint if there is one, 1 when it did
+static int handshake(tls_transport *tls, int timeout_ms)
+{
+    bool offered = false;
+    size_t len;
+    uint8_t *saved = tls_session_get(tls->common_name, tls->port, &len);
+    if (saved != NULL) {
+        mbedtls_ssl_session session;
+        mbedtls_ssl_session_init(&session);
+        offered = mbedtls_ssl_session_load(&session, saved, len) == 0 && mbedtls_ssl_set_session(&tls->ssl, &session) == 0;
+        mbedtls_ssl_session_free(&session);
+        heap_caps_free(saved);
+    }
+
+    tls->hello_sent_len = 0;
+    tls->hello_received_len = 0;
+    tls->capturing = true;
+    int64_t start_us = esp_timer_get_time();
+    int64_t deadline_us = start_us + timeout_ms * 1000LL;
+    int ret;
+    while ((ret = mbedtls_ssl_handshake(&tls->ssl)) != 0) {
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) break;
+        if (esp_timer_get_time() >= deadline_us) {
+            ret = MBEDTLS_ERR_SSL_TIMEOUT;
+            break;
+        }
+    }
+    tls->capturing = false;
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Handshake with %s:%u failed (-0x%04x)", tls->common_name, tls->port, -ret);
+        if (offered) {
+            tls_session_forget(tls->common_name, tls->port);
+        }
+        return -1;
+    }
+
+    bool resumed = offered && tls_session_resumed(tls->hello_sent, tls->hello_sent_len, tls->hello_received,
+                                                  tls->hello_received_len);
+    int64_t duration_us = esp_timer_get_time() - start_us;
+    tls_session_record_handshake(resumed, duration_us);
+    ESP_LOGI(TAG, "%s handshake with %s:%u in %lld ms", resumed ? "Resumed" : "Full", tls->common_name, tls->port,
+             duration_us / 1000);
+    save_session(tls);
+    return resumed ? 1 : 0;
+}
+
+static int tls_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    if (tls->common_name == NULL) {
+        ESP_LOGE(TAG, "No hostname to check the certificate against");
+        return -1;
+    }
+    tls->port = port;
+
+    if (tls->sock < 0) {
+        dns_address address;
+        if (!dns_parse_literal(host, &address)) {
+            ESP_LOGE(TAG, "Not an address: %s", host);
+            return -1;
+        }
+        tls->sock = pool_connect_race(&address, 1, port, timeout_ms, NULL);
+        if (tls->sock < 0) {
+            return -1;
+        }
+    }
+
+    int ret = setup_tls(tls, timeout_ms);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "TLS setup failed (-0x%04x)", -ret);
+    }
+    if (ret != 0 || handshake(tls, timeout_ms) < 0) {
+        free_tls(tls);
+        close(tls->sock);
+        tls->sock = -1;
+        return -1;
+    }
+    tls->connected = true;
+    return 0;
+}
+
+static int tls_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    if (!tls->connected) {
+        return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    if (mbedtls_ssl_get_bytes_avail(&tls->ssl) == 0) {
+        int ready = wait_socket(tls->sock, false, timeout_ms);
+        if (ready == 0) {
+            return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+        }
+        if (ready < 0) {
+            return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+        }
+    }
+
+    int n = mbedtls_ssl_read(&tls->ssl, (unsigned char *) buffer, len);
+    if (n > 0) {
+        return n;
+    }
+    switch (n) {
+        case 0:
+        case MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY:
+            return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+#ifdef MBEDTLS_SSL_PROTO_TLS1_3
+        case MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET:
+            // TLS 1.3 tickets come after the handshake
+            save_session(tls);
+            return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+#endif
+        case MBEDTLS_ERR_SSL_WANT_READ:
+        case MBEDTLS_ERR_SSL_WANT_WRITE:
+        case MBEDTLS_ERR_SSL_TIMEOUT:
+            return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+        default:
+            ESP_LOGE(TAG, "Read failed (-0x%04x)", -n);
+            return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+}
+
+static int tls_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    int written = 0;
+    while (tls->connected && written < len) {
+        int n = mbedtls_ssl_write(&tls->ssl, (const unsigned char *) buffer + written, len - written);
+        if (n > 0) {
+            written += n;
+        } else if (n != MBEDTLS_ERR_SSL_WANT_WRITE && n != MBEDTLS_ERR_SSL_WANT_READ) {
+            ESP_LOGE(TAG, "Write failed (-0x%04x)", -n);
+            return -1;
+        } else if (wait_socket(tls->sock, n == MBEDTLS_ERR_SSL_WANT_WRITE, timeout_ms) <= 0) {
+            return -1;
+        }
+    }
+    return tls->connected ? written : -1;
+}
+
+static int tls_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    if (!tls->connected) {
+        return -1;
+    }
+    return mbedtls_ssl_get_bytes_avail(&tls->ssl) > 0 ? 1 : wait_socket(tls->sock, false, timeout_ms);
+}
+
+static int tls_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    return tls->connected ? wait_socket(tls->sock, true, timeout_ms) : -1;
+}
+
+// Only on the task that reads the transport, a read in progress would use the
+// freed SSL state. Another task wakes that read with shutdown() on the socket.
+static int tls_close(esp_transport_handle_t t)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    if (tls->connected) {
+        // A TLS 1.3 ticket may have come in since the handshake
+        save_session(tls);
+        mbedtls_ssl_close_notify(&tls->ssl);
+        free_tls(tls);
+        tls->connected = false;
+    }
+    if (tls->sock >= 0) {
+        close(tls->sock);
+        tls->sock = -1;
+    }
+    return 0;
+}
+
+static int tls_destroy(esp_transport_handle_t t)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    tls_close(t);
+    free(tls->cert);
+    free(tls->common_name);
+    heap_caps_free(tls);
+    return 0;
+}
+
+esp_transport_handle_t tls_transport_init(const char *cert)
+{
+    // The mbedTLS contexts are large, the record buffers are allocated by mbedTLS on connect
+    tls_transport *tls = heap_caps_calloc_prefer(1, sizeof(tls_transport), 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT);
+    if (tls == NULL) {
+        return NULL;
+    }
+    tls->sock = -1;
+    if (cert != NULL && (tls->cert = strdup(cert)) == NULL) {
+        heap_caps_free(tls);
+        return NULL;
+    }
+
+    esp_transport_handle_t t = esp_transport_init();
+    if (t == NULL) {
+        free(tls->cert);
+        heap_caps_free(tls);
+        return NULL;
+    }
+    esp_transport_set_context_data(t, tls);
+    esp_transport_set_func(t, tls_connect, tls_read, tls_write, tls_close, tls_poll_read, tls_poll_write, tls_destroy);
+    return t;
+}
+
+void tls_transport_set_common_name(esp_transport_handle_t t, const char *common_name)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    free(tls->common_name);
+    tls->common_name = strdup(common_name);
+}
+
+void tls_transport_set_socket(esp_transport_handle_t t, int sock)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    if (tls->sock >= 0 && tls->sock != sock) {
+        close(tls->sock);
+    }
+    tls->sock = sock;
+}
@@ -94,6 +94,56 @@ void midstate_sha256_bin(const uint8_t *data, const size_t data_len, uint8_t des
     mbedtls_sha256_free(&ctx);
 }
 
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+void sha256_transform(uint32_t state[8], const uint8_t block[64])
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 | (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
 void reverse_32bit_words(const uint8_t src[32], uint8_t dest[32])
 {
     const uint32_t *s = (const uint32_t *)src;
@@ -173,6 +223,110 @@ double networkDifficulty(uint32_t nBits)
     return difficulty;
 }
 
+// 256 bit values as 32 bit limbs, least significant first
+static bool u256_shift_left_1(uint32_t v[8])
+{
+    bool carry = v[7] >> 31;
+    for (int i = 7; i > 0; i--) {
+        v[i] = (v[i] << 1) | (v[i - 1] >> 31);
+    }
+    v[0] <<= 1;
+    return carry;
+}
+
+static void u256_to_le_bytes(const uint32_t v[8], uint8_t dest[32])
+{
+    for (int i = 0; i < 32; i++) {
+        dest[i] = v[i / 4] >> (8 * (i % 4));
+    }
+}
+
+/* Share target for a pool difficulty: floor(diff1 / difficulty), little endian like the hash */
+void difficulty_to_target(double difficulty, uint8_t target[32])
+{
+    if (!(difficulty > 0) || isinf(difficulty)) {
+        memset(target, isinf(difficulty) ? 0x00 : 0xff, 32);
+        return;
+    }
+
+    // difficulty = m * 2^e exactly
+    int e;
+    double f = frexp(difficulty, &e);
+    uint64_t m = (uint64_t) ldexp(f, 53);
+    e -= 53;
+    while ((m & 1) == 0) {
+        m >>= 1;
+        e++;
+    }
+
+    // diff1 = 0xffff * 2^208, divided by 2^e up front when e is positive
+    uint32_t n[8] = {0};
+    int shift = 208 - (e > 0 ? e : 0);
+    for (int b = 0; b < 16; b++) {
+        if (shift + b >= 0) {
+            n[(shift + b) / 32] |= 1u << ((shift + b) % 32);
+        }
+    }
+
+    // Long division by m, m < 2^53 so the remainder never overflows
+    uint32_t q[8] = {0};
+    uint64_t r = 0;
+    for (int i = 255; i >= 0; i--) {
+        r = (r << 1) | ((n[i / 32] >> (i % 32)) & 1);
+        u256_shift_left_1(q);
+        if (r >= m) {
+            r -= m;
+            q[0] |= 1;
+        }
+    }
+
+    // Difficulty below one: keep dividing into the remainder for the extra bits
+    for (int i = 0; i < -e; i++) {
+        r <<= 1;
+        if (u256_shift_left_1(q)) {
+            memset(target, 0xff, 32);
+            return;
+        }
+        if (r >= m) {
+            r -= m;
+            q[0] |= 1;
+        }
+    }
+
+    u256_to_le_bytes(q, target);
+}
+
+/* Network target from nBits, mantissa * 256^(exponent - 3), little endian like the hash */
+void nbits_to_target(uint32_t nBits, uint8_t target[32])
+{
+    uint32_t mantissa = nBits & 0x007fffff;
+    int exponent = (nBits >> 24) & 0xff;
+
+    memset(target, 0, 32);
+    for (int i = 0; i < 3; i++) {
+        int pos = exponent - 3 + i;
+        uint8_t byte = mantissa >> (8 * i);
+        if (pos < 0 || byte == 0) {
+            continue;
+        }
+        if (pos >= 32) {
+            memset(target, 0xff, 32);
+            return;
+        }
+        target[pos] = byte;
+    }
+}
+
+bool hash_meets_target(const uint8_t hash[32], const uint8_t target[32])
+{
+    for (int i = 31; i >= 0; i--) {
+        if (hash[i] != target[i]) {
+            return hash[i] < target[i];
+        }
+    }
+    return true;
+}
+
 /* Convert a uint64_t value into a truncated string for displaying with its
  * associated suitable for Mega, Giga etc. Buf array needs to be long enough */
 void suffixString(uint64_t val, char * buf, size_t bufsiz, int sigdigits)
@@ -0,0 +1,65 @@
+#include "vardiff.h"
+
+#include <math.h>
+
+// Each difficulty 1 share stands for 2^32 hashes on average
+#define HASHES_PER_SHARE 4294967296.0
+
+void vardiff_init(vardiff *controller, uint16_t shares_per_minute, uint32_t min_difficulty)
+{
+    controller->shares_per_minute = shares_per_minute;
+    controller->min_difficulty = min_difficulty > 0 ? min_difficulty : 1;
+    vardiff_reset(controller);
+}
+
+void vardiff_reset(vardiff *controller)
+{
+    controller->suggested = 0;
+    controller->suggested_us = 0;
+}
+
+uint32_t vardiff_difficulty_for(float hashrate_ghs, float shares_per_minute)
+{
+    if (hashrate_ghs <= 0 || shares_per_minute <= 0) return 0;
+
+    double ideal = hashrate_ghs * 1e9 * 60.0 / (HASHES_PER_SHARE * shares_per_minute);
+    if (ideal <= 1) return 1;
+
+    // Nearest power of two, on a log scale so the rate ends up within a factor sqrt(2)
+    int exponent = (int) lround(log2(ideal));
+    return exponent >= 31 ? 1u << 31 : 1u << exponent;
+}
+
+float vardiff_share_rate(float hashrate_ghs, double difficulty)
+{
+    if (difficulty <= 0) return 0;
+    return hashrate_ghs * 1e9 * 60.0 / (HASHES_PER_SHARE * difficulty);
+}
+
+uint32_t vardiff_update(vardiff *controller, float hashrate_ghs, double pool_difficulty, int64_t now_us)
+{
+    if (controller->shares_per_minute <= 0 || hashrate_ghs <= 0) return 0;
+
+    // Pools may ignore the suggestion, what counts is the difficulty they set
+    double current = pool_difficulty > 0 ? pool_difficulty : controller->suggested;
+    if (current > 0) {
+        float rate = vardiff_share_rate(hashrate_ghs, current);
+        if (rate >= controller->shares_per_minute / VARDIFF_HYSTERESIS &&
+            rate <= controller->shares_per_minute * VARDIFF_HYSTERESIS) {
+            return 0;
+        }
+    }
+
+    if (controller->suggested > 0 && now_us - controller->suggested_us < VARDIFF_MIN_INTERVAL_US) return 0;
+
+    uint32_t difficulty = vardiff_difficulty_for(hashrate_ghs, controller->shares_per_minute);
+    if (difficulty < controller->min_difficulty) {
+        difficulty = controller->min_difficulty;
+    }
+    // Asking again for what the pool did not apply only adds traffic
+    if (difficulty == controller->suggested) return 0;
+
+    controller->suggested = difficulty;
+    controller->suggested_us = now_us;
+    return difficulty;
+}
@@ -0,0 +1,147 @@
+#include "work_queue.h"
+#include "mining_notify_pool.h"
+#include "esp_timer.h"
+
+_Static_assert(MINING_NOTIFY_LIVE_MAX <= MINING_NOTIFY_POOL_SIZE, "mining_notify pool is smaller than the notifies alive at once");
+
+void queue_init(work_queue *queue)
+{
+    for (int i = 0; i < QUEUE_SIZE; i++) {
+        atomic_init(&queue->buffer[i], NULL);
+    }
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->waiting_consumer, NULL);
+    atomic_init(&queue->waiting_producer, NULL);
+    atomic_init(&queue->coalesced, 0);
+}
+
+static void wake(TaskHandle_t _Atomic *waiting)
+{
+    TaskHandle_t task = atomic_load(waiting);
+    if (task != NULL) {
+        xTaskNotifyGive(task);
+    }
+}
+
+// The waiter is parked before the condition is checked again, so a publish in
+// between either is seen by the check or sees the waiter and notifies it.
+// Stale notifications only cause an extra pass through the caller's loop.
+static void park(TaskHandle_t _Atomic *waiting)
+{
+    atomic_store(waiting, xTaskGetCurrentTaskHandle());
+}
+
+static void unpark(TaskHandle_t _Atomic *waiting)
+{
+    atomic_store(waiting, NULL);
+}
+
+void *queue_try_dequeue(work_queue *queue)
+{
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    for (;;) {
+        uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+        if (head == tail) {
+            return NULL;
+        }
+        void *work = atomic_load_explicit(&queue->buffer[head % QUEUE_SIZE], memory_order_relaxed);
+        // Only whoever moves head owns the item, a failed exchange reloads head
+        if (atomic_compare_exchange_weak_explicit(&queue->head, &head, head + 1,
+                                                  memory_order_seq_cst, memory_order_acquire)) {
+            wake(&queue->waiting_producer);
+            return work;
+        }
+    }
+}
+
+void queue_enqueue(work_queue *queue, void *new_work)
+{
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    while (tail - atomic_load_explicit(&queue->head, memory_order_acquire) == QUEUE_SIZE) {
+        park(&queue->waiting_producer);
+        if (tail - atomic_load(&queue->head) == QUEUE_SIZE) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        unpark(&queue->waiting_producer);
+    }
+
+    atomic_store_explicit(&queue->buffer[tail % QUEUE_SIZE], new_work, memory_order_relaxed);
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_seq_cst);
+    wake(&queue->waiting_consumer);
+}
+
+int queue_enqueue_latest(work_queue *queue, mining_notify *notify)
+{
+    // Only the producer adds work, so once drained nothing older can be left
+    // behind the new notify. The consumer may still take one of them first.
+    int dropped = 0;
+    mining_notify *stale;
+    while ((stale = queue_try_dequeue(queue)) != NULL) {
+        notify->clean_jobs |= stale->clean_jobs;
+        STRATUM_V1_free_mining_notify(stale);
+        dropped++;
+    }
+    atomic_fetch_add_explicit(&queue->coalesced, dropped, memory_order_relaxed);
+
+    queue_enqueue(queue, notify);
+    return dropped;
+}
+
+void *queue_dequeue(work_queue *queue)
+{
+    for (;;) {
+        void *work = queue_try_dequeue(queue);
+        if (work != NULL) {
+            return work;
+        }
+        park(&queue->waiting_consumer);
+        if (queue_count(queue) == 0) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        unpark(&queue->waiting_consumer);
+    }
+}
+
+void *queue_dequeue_timeout(work_queue *queue, int timeout_ms)
+{
+    int64_t deadline_us = esp_timer_get_time() + timeout_ms * 1000LL;
+
+    for (;;) {
+        void *work = queue_try_dequeue(queue);
+        if (work != NULL) {
+            return work;
+        }
+        int64_t remaining_us = deadline_us - esp_timer_get_time();
+        if (remaining_us <= 0) {
+            return NULL;
+        }
+        park(&queue->waiting_consumer);
+        if (queue_count(queue) == 0) {
+            // Round up, the deadline check above ends the wait once the time has passed
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS((remaining_us + 999) / 1000) + 1);
+        }
+        unpark(&queue->waiting_consumer);
+    }
+}
+
+int queue_count(work_queue *queue)
+{
+    uint32_t head = atomic_load(&queue->head);
+    uint32_t tail = atomic_load(&queue->tail);
+    return tail - head;
+}
+
+uint32_t queue_get_coalesced(work_queue *queue)
+{
+    return atomic_load_explicit(&queue->coalesced, memory_order_relaxed);
+}
+
+void queue_clear(work_queue *queue)
+{
+    mining_notify *next_work;
+    while ((next_work = queue_try_dequeue(queue)) != NULL) {
+        STRATUM_V1_free_mining_notify(next_work);
+    }
+}
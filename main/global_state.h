@@ -8,8 +8,11 @@
 #include "freertos/portmacro.h"
 #include "power_management_task.h"
 #include "hashrate_monitor_task.h"
+#include "share_submit_task.h"
 #include "coinbase_decoder.h"
 #include "work_queue.h"
+#include "nonce_filter.h"
+#include "pool_split.h"
 #include "device_config.h"
 #include "display.h"
 #include "scoreboard.h"
@@ -23,6 +26,10 @@
 #define MAX_BLOCK_SIGNALS 8
 #define MAX_BLOCK_SIGNAL_LEN 16
 
+// Pools of the pool split, bm_job.pool and share_submission.pool
+#define POOL_PRIMARY 0
+#define POOL_FALLBACK 1
+
 typedef struct {
     char message[64];
     uint32_t count;
@@ -66,6 +73,8 @@ typedef struct
     char * fallback_pool_pass;
     uint16_t pool_difficulty;
     uint16_t fallback_pool_difficulty;
+    uint16_t shares_per_minute;
+    uint16_t ntime_roll_window;
     bool pool_extranonce_subscribe;
     bool fallback_pool_extranonce_subscribe;
     bool pool_decode_coinbase_tx;
@@ -74,6 +83,8 @@ typedef struct
     float process_time;
     float cpu_usage;
     bool use_fallback_stratum;
+    bool fallback_pool_hot_standby;
+    uint16_t fallback_pool_weight;
     uint16_t pool_is_tls;
     uint16_t fallback_pool_is_tls;
     uint16_t pool_tls;
@@ -114,12 +125,37 @@ typedef struct
     // it also may return a previous nonce under some circumstances
     // so we keep a list of jobs indexed by the job id
     bm_job **active_jobs;
+    // and drop nonces that were already submitted for the same job
+    nonce_filter duplicate_filter;
+    // Bumped by create_jobs_task when a pool's prevhash changes, under valid_jobs_lock.
+    // Jobs of an older generation are invalidated and their nonces dropped unhashed.
+    uint8_t block_generation[2];
+    uint32_t stale_suppressed;
     // Current job to be processed (replaces ASIC_jobs_queue)
     bm_job *current_job;
     //semaphone
     SemaphoreHandle_t semaphore;
 } AsicTaskModule;
 
+typedef struct
+{
+    // Which pool each job goes to, and the shares accepted per pool
+    pool_split scheduler;
+    // Work of the fallback pool while it gets a share of the hashrate, fed by
+    // the standby connection in stratum_task
+    work_queue queue;
+    // Its session, jobs and shares of POOL_FALLBACK use these instead of the primary's
+    esp_transport_handle_t transport;
+    char extranonce_str[MAX_EXTRANONCE_1_LEN * 2 + 1];
+    int extranonce_2_len;
+    double difficulty;
+    uint32_t version_mask;
+    bool ready;
+    // Request ids of the standby connection, send_uid counts for the main one
+    int send_uid;
+    portMUX_TYPE lock;
+} PoolSplitModule;
+
 typedef struct
 {
     work_queue stratum_queue;
@@ -131,6 +167,8 @@ typedef struct
     PowerManagementModule POWER_MANAGEMENT_MODULE;
     SelfTestModule SELF_TEST_MODULE;
     HashrateMonitorModule HASHRATE_MONITOR_MODULE;
+    ShareSubmitModule SHARE_SUBMIT_MODULE;
+    PoolSplitModule POOL_SPLIT_MODULE;
 
     char * extranonce_str;
     int extranonce_2_len;
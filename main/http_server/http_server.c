@@ -34,6 +34,11 @@
 
 #include "cJSON.h"
 #include "global_state.h"
+#include "bm_job_slab.h"
+#include "mining_notify_pool.h"
+#include "request_table.h"
+#include "stratum_trace.h"
+#include "tls_session.h"
 #include "nvs_config.h"
 #include "vcore.h"
 #include "connect.h"
@@ -70,6 +75,9 @@ static const char * STATS_LABEL_FAN2_RPM = "fan2Rpm";
 static const char * STATS_LABEL_WIFI_RSSI = "wifiRssi";
 static const char * STATS_LABEL_FREE_HEAP = "freeHeap";
 static const char * STATS_LABEL_RESPONSE_TIME = "responseTime";
+static const char * STATS_LABEL_RESPONSE_TIME_P50 = "responseTimeP50";
+static const char * STATS_LABEL_RESPONSE_TIME_P90 = "responseTimeP90";
+static const char * STATS_LABEL_RESPONSE_TIME_P99 = "responseTimeP99";
 
 static const char * STATS_LABEL_TIMESTAMP = "timestamp";
 
@@ -98,6 +106,9 @@ typedef enum
     SRC_WIFI_RSSI,
     SRC_FREE_HEAP,
     SRC_RESPONSE_TIME,
+    SRC_RESPONSE_TIME_P50,
+    SRC_RESPONSE_TIME_P90,
+    SRC_RESPONSE_TIME_P99,
     SRC_NONE // last
 } DataSource;
 
@@ -122,6 +133,9 @@ DataSource strToDataSource(const char * sourceStr)
         if (strcmp(sourceStr, STATS_LABEL_WIFI_RSSI) == 0)    return SRC_WIFI_RSSI;
         if (strcmp(sourceStr, STATS_LABEL_FREE_HEAP) == 0)    return SRC_FREE_HEAP;
         if (strcmp(sourceStr, STATS_LABEL_RESPONSE_TIME) == 0) return SRC_RESPONSE_TIME;
+        if (strcmp(sourceStr, STATS_LABEL_RESPONSE_TIME_P50) == 0) return SRC_RESPONSE_TIME_P50;
+        if (strcmp(sourceStr, STATS_LABEL_RESPONSE_TIME_P90) == 0) return SRC_RESPONSE_TIME_P90;
+        if (strcmp(sourceStr, STATS_LABEL_RESPONSE_TIME_P99) == 0) return SRC_RESPONSE_TIME_P99;
     }
     return SRC_NONE;
 }
@@ -629,6 +643,9 @@ bool check_settings_and_update(const cJSON * const root)
                     break;
                 case TYPE_BOOL:
                     nvs_config_set_bool(key, item->valueint != 0 || cJSON_IsTrue(item));
+                    if (key == NVS_CONFIG_STRATUM_LOG_PAYLOADS) {
+                        stratum_trace_set_log_payloads(item->valueint != 0 || cJSON_IsTrue(item));
+                    }
                     break;
                 case TYPE_FLOAT:
                     nvs_config_set_float(key, (float)item->valuedouble);
@@ -983,7 +1000,69 @@ static esp_err_t GET_system_info(httpd_req_t * req)
     cJSON_AddNumberToObject(root, "fallbackStratumTLS", nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_TLS));
     cJSON_AddStringToObject(root, "fallbackStratumCert", fallbackStratumCert);
     cJSON_AddNumberToObject(root, "fallbackStratumDecodeCoinbase", nvs_config_get_bool(NVS_CONFIG_FALLBACK_STRATUM_DECODE_COINBASE_TX));
+    cJSON_AddNumberToObject(root, "fallbackStratumHotStandby", nvs_config_get_bool(NVS_CONFIG_FALLBACK_STRATUM_HOT_STANDBY));
+    cJSON_AddNumberToObject(root, "fallbackStratumWeight", nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_WEIGHT));
+    cJSON_AddNumberToObject(root, "ntimeRollWindow", nvs_config_get_u16(NVS_CONFIG_NTIME_ROLL_WINDOW));
+    cJSON_AddNumberToObject(root, "stratumLogPayloads", nvs_config_get_bool(NVS_CONFIG_STRATUM_LOG_PAYLOADS));
+    cJSON_AddNumberToObject(root, "stratumSharesPerMinute", nvs_config_get_u16(NVS_CONFIG_STRATUM_SHARES_PER_MINUTE));
     cJSON_AddFloatToObject(root, "responseTime", GLOBAL_STATE->SYSTEM_MODULE.response_time);
+
+    share_submit_stats share_stats;
+    uint32_t share_queue_depth;
+    share_submit_get_stats(GLOBAL_STATE, &share_stats, &share_queue_depth);
+    cJSON_AddNumberToObject(root, "shareQueueDepth", share_queue_depth);
+    cJSON_AddNumberToObject(root, "shareQueueMaxDepth", share_stats.max_queue_depth);
+    cJSON_AddNumberToObject(root, "sharesDropped", share_stats.dropped_full + share_stats.dropped_offline);
+    cJSON_AddFloatToObject(root, "shareSubmitLatency", share_stats.last_latency_ms);
+    cJSON_AddFloatToObject(root, "shareSubmitMaxLatency", share_stats.max_latency_ms);
+    cJSON_AddFloatToObject(root, "blockCandidateLatency", share_stats.last_candidate_latency_ms);
+
+    share_buffer_stats buffer_stats;
+    share_buffer_get_stats(&buffer_stats);
+    cJSON_AddNumberToObject(root, "sharesBuffered", buffer_stats.in_use);
+    cJSON_AddNumberToObject(root, "sharesReplayed", buffer_stats.replayed);
+    cJSON_AddNumberToObject(root, "sharesDiscardedStale", buffer_stats.discarded_stale + buffer_stats.discarded_full);
+    cJSON_AddNumberToObject(root, "duplicateNonces", nonce_filter_get_suppressed(&GLOBAL_STATE->ASIC_TASK_MODULE.duplicate_filter));
+    cJSON_AddNumberToObject(root, "staleNoncesSuppressed", GLOBAL_STATE->ASIC_TASK_MODULE.stale_suppressed);
+
+    tls_handshake_stats tls_stats;
+    tls_session_get_stats(&tls_stats);
+    cJSON_AddNumberToObject(root, "tlsHandshakesFull", tls_stats.full);
+    cJSON_AddNumberToObject(root, "tlsHandshakesResumed", tls_stats.resumed);
+    cJSON_AddNumberToObject(root, "tlsFullHandshakeMs", tls_stats.last_full_ms);
+    cJSON_AddNumberToObject(root, "tlsResumedHandshakeMs", tls_stats.last_resumed_ms);
+
+    cJSON *request_latency = cJSON_AddObjectToObject(root, "requestLatency");
+    for (request_method method = 0; method < REQUEST_METHOD_COUNT; method++) {
+        request_method_stats request_stats;
+        request_table_get_stats(method, &request_stats);
+        cJSON *method_json = cJSON_AddObjectToObject(request_latency, request_table_method_name(method));
+        cJSON_AddNumberToObject(method_json, "sent", request_stats.sent);
+        cJSON_AddNumberToObject(method_json, "accepted", request_stats.accepted);
+        cJSON_AddNumberToObject(method_json, "rejected", request_stats.rejected);
+        cJSON_AddNumberToObject(method_json, "timedOut", request_stats.timed_out);
+        cJSON_AddFloatToObject(method_json, "p50", request_stats.p50_ms);
+        cJSON_AddFloatToObject(method_json, "p90", request_stats.p90_ms);
+        cJSON_AddFloatToObject(method_json, "p99", request_stats.p99_ms);
+    }
+
+    bm_job_slab_stats slab_stats;
+    pthread_mutex_lock(&GLOBAL_STATE->valid_jobs_lock);
+    bm_job_slab_get_stats(&slab_stats);
+    pthread_mutex_unlock(&GLOBAL_STATE->valid_jobs_lock);
+    cJSON *job_slab = cJSON_AddObjectToObject(root, "jobSlab");
+    cJSON_AddNumberToObject(job_slab, "stores", slab_stats.stores);
+    cJSON_AddNumberToObject(job_slab, "reuses", slab_stats.reuses);
+    cJSON_AddNumberToObject(job_slab, "overwrites", slab_stats.overwrites);
+
+    mining_notify_pool_stats notify_stats;
+    mining_notify_pool_get_stats(&notify_stats);
+    cJSON *notify_pool = cJSON_AddObjectToObject(root, "notifyPool");
+    cJSON_AddNumberToObject(notify_pool, "allocations", notify_stats.allocations);
+    cJSON_AddNumberToObject(notify_pool, "blockReuses", notify_stats.block_reuses);
+    cJSON_AddNumberToObject(notify_pool, "blockGrows", notify_stats.block_grows);
+    cJSON_AddNumberToObject(notify_pool, "heapFallbacks", notify_stats.heap_fallbacks);
+    cJSON_AddNumberToObject(notify_pool, "inUse", notify_stats.in_use);
     cJSON_AddFloatToObject(root, "cpuUsage", GLOBAL_STATE->SYSTEM_MODULE.cpu_usage);
 
     cJSON_AddStringToObject(root, "version", GLOBAL_STATE->SYSTEM_MODULE.version);
@@ -1157,6 +1236,9 @@ static esp_err_t GET_system_statistics(httpd_req_t * req)
     if (dataSelection[SRC_WIFI_RSSI]) { cJSON_AddItemToArray(labelArray, cJSON_CreateString(STATS_LABEL_WIFI_RSSI)); }
     if (dataSelection[SRC_FREE_HEAP]) { cJSON_AddItemToArray(labelArray, cJSON_CreateString(STATS_LABEL_FREE_HEAP)); }
     if (dataSelection[SRC_RESPONSE_TIME]) { cJSON_AddItemToArray(labelArray, cJSON_CreateString(STATS_LABEL_RESPONSE_TIME)); }
+    if (dataSelection[SRC_RESPONSE_TIME_P50]) { cJSON_AddItemToArray(labelArray, cJSON_CreateString(STATS_LABEL_RESPONSE_TIME_P50)); }
+    if (dataSelection[SRC_RESPONSE_TIME_P90]) { cJSON_AddItemToArray(labelArray, cJSON_CreateString(STATS_LABEL_RESPONSE_TIME_P90)); }
+    if (dataSelection[SRC_RESPONSE_TIME_P99]) { cJSON_AddItemToArray(labelArray, cJSON_CreateString(STATS_LABEL_RESPONSE_TIME_P99)); }
     cJSON_AddItemToArray(labelArray, cJSON_CreateString(STATS_LABEL_TIMESTAMP));
 
     cJSON_AddItemToObject(root, "labels", labelArray);
@@ -1185,6 +1267,9 @@ static esp_err_t GET_system_statistics(httpd_req_t * req)
         if (dataSelection[SRC_WIFI_RSSI]) { cJSON_AddItemToArray(valueArray, cJSON_CreateNumber(statsData.wifiRSSI)); }
         if (dataSelection[SRC_FREE_HEAP]) { cJSON_AddItemToArray(valueArray, cJSON_CreateNumber(statsData.freeHeap)); }
         if (dataSelection[SRC_RESPONSE_TIME]) { cJSON_AddItemToArray(valueArray, cJSON_CreateFloat(statsData.responseTime)); }
+        if (dataSelection[SRC_RESPONSE_TIME_P50]) { cJSON_AddItemToArray(valueArray, cJSON_CreateFloat(statsData.responseTimeP50)); }
+        if (dataSelection[SRC_RESPONSE_TIME_P90]) { cJSON_AddItemToArray(valueArray, cJSON_CreateFloat(statsData.responseTimeP90)); }
+        if (dataSelection[SRC_RESPONSE_TIME_P99]) { cJSON_AddItemToArray(valueArray, cJSON_CreateFloat(statsData.responseTimeP99)); }
         cJSON_AddItemToArray(valueArray, cJSON_CreateNumber(statsData.timestamp));
 
         cJSON_AddItemToArray(statsArray, valueArray);
@@ -1249,6 +1334,114 @@ static esp_err_t GET_scoreboard(httpd_req_t * req)
     return ESP_OK;
 }
 
+static esp_err_t GET_pools(httpd_req_t * req)
+{
+    if (is_network_allowed(req) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "Unauthorized");
+    }
+
+    httpd_resp_set_type(req, "application/json");
+
+    // Set CORS headers
+    if (set_cors_headers(req) != ESP_OK) {
+        httpd_resp_send_500(req);
+        return ESP_OK;
+    }
+
+    SystemModule *SYSTEM_MODULE = &GLOBAL_STATE->SYSTEM_MODULE;
+    int64_t now_us = esp_timer_get_time();
+    cJSON * root = cJSON_CreateArray();
+
+    for (int pool = POOL_PRIMARY; pool <= POOL_FALLBACK; pool++) {
+        pool_split_stats stats;
+        pool_split_get_stats(&GLOBAL_STATE->POOL_SPLIT_MODULE.scheduler, pool, now_us, &stats);
+        bool fallback = pool == POOL_FALLBACK;
+
+        cJSON *entry = cJSON_CreateObject();
+        cJSON_AddStringToObject(entry, "url", fallback ? SYSTEM_MODULE->fallback_pool_url : SYSTEM_MODULE->pool_url);
+        cJSON_AddNumberToObject(entry, "port", fallback ? SYSTEM_MODULE->fallback_pool_port : SYSTEM_MODULE->pool_port);
+        cJSON_AddStringToObject(entry, "user", fallback ? SYSTEM_MODULE->fallback_pool_user : SYSTEM_MODULE->pool_user);
+        cJSON_AddNumberToObject(entry, "weight", stats.weight);
+        cJSON_AddBoolToObject(entry, "mining", stats.active);
+        cJSON_AddNumberToObject(entry, "jobs", stats.jobs);
+        cJSON_AddNumberToObject(entry, "jobShare", stats.job_share * 100);
+        cJSON_AddNumberToObject(entry, "sharesAccepted", stats.accepted);
+        cJSON_AddNumberToObject(entry, "sharesRejected", stats.rejected);
+        cJSON_AddNumberToObject(entry, "hashrate", stats.hashrate);
+        cJSON_AddItemToArray(root, entry);
+    }
+
+    const char *response = cJSON_Print(root);
+    httpd_resp_sendstr(req, response);
+
+    free((void *)response);
+    cJSON_Delete(root);
+
+    return ESP_OK;
+}
+
+static esp_err_t GET_stratum_trace(httpd_req_t * req)
+{
+    if (is_network_allowed(req) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "Unauthorized");
+    }
+
+    httpd_resp_set_type(req, "application/json");
+
+    // Set CORS headers
+    if (set_cors_headers(req) != ESP_OK) {
+        httpd_resp_send_500(req);
+        return ESP_OK;
+    }
+
+    // Only entries from ?since=<seq> on, the "next" of the previous response
+    uint32_t seq = 0;
+    char query[32];
+    char since[12];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "since", since, sizeof(since)) == ESP_OK) {
+        seq = strtoul(since, NULL, 10);
+    }
+
+    stratum_trace_entry *entries = heap_caps_malloc_prefer(STRATUM_TRACE_SIZE * sizeof(stratum_trace_entry), 2,
+                                                           MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT);
+    if (entries == NULL) {
+        httpd_resp_send_500(req);
+        return ESP_OK;
+    }
+    size_t count = stratum_trace_read(&seq, entries, STRATUM_TRACE_SIZE);
+
+    cJSON * root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "next", seq);
+    cJSON * array = cJSON_AddArrayToObject(root, "entries");
+
+    for (size_t i = 0; i < count; i++) {
+        stratum_trace_entry *entry = &entries[i];
+        char payload[STRATUM_TRACE_PAYLOAD_LEN + 1];
+        memcpy(payload, entry->payload, entry->payload_len);
+        payload[entry->payload_len] = '\0';
+
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "seq", entry->seq);
+        cJSON_AddNumberToObject(item, "timestamp", entry->timestamp_us / 1000);
+        cJSON_AddStringToObject(item, "direction", entry->direction == STRATUM_TRACE_RX ? "rx" : "tx");
+        cJSON_AddStringToObject(item, "method", stratum_trace_method_name(entry));
+        cJSON_AddNumberToObject(item, "id", entry->id);
+        cJSON_AddNumberToObject(item, "length", entry->length);
+        cJSON_AddStringToObject(item, "payload", payload);
+        cJSON_AddItemToArray(array, item);
+    }
+    free(entries);
+
+    const char *response = cJSON_Print(root);
+    httpd_resp_sendstr(req, response);
+
+    free((void *)response);
+    cJSON_Delete(root);
+
+    return ESP_OK;
+}
+
 esp_err_t POST_WWW_update(httpd_req_t * req)
 {
     if (is_network_allowed(req) != ESP_OK) {
@@ -1503,6 +1696,22 @@ esp_err_t start_rest_server(void * pvParameters)
     };
     httpd_register_uri_handler(server, &scoreboard_get_uri);
 
+    httpd_uri_t pools_get_uri = {
+        .uri = "/api/system/pools",
+        .method = HTTP_GET,
+        .handler = GET_pools,
+        .user_ctx = rest_context
+    };
+    httpd_register_uri_handler(server, &pools_get_uri);
+
+    httpd_uri_t stratum_trace_get_uri = {
+        .uri = "/api/system/stratum/trace",
+        .method = HTTP_GET,
+        .handler = GET_stratum_trace,
+        .user_ctx = rest_context
+    };
+    httpd_register_uri_handler(server, &stratum_trace_get_uri);
+
     /* URI handler for WiFi scan */
     httpd_uri_t wifi_scan_get_uri = {
         .uri = "/api/system/wifi/scan",
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
@@ -11,6 +12,7 @@
 #include "websocket.h"
 #include "http_server.h"
 #include "log_buffer.h"
+#include "stratum_trace.h"
 
 #define WS_LOG_SCRATCH_SIZE 2048
 
@@ -155,6 +157,25 @@ esp_err_t websocket_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+static void send_to_clients(httpd_handle_t https_handle, char *buf, size_t len)
+{
+    for (int i = 0; i < MAX_WEBSOCKET_CLIENTS; i++) {
+        int client_fd = clients[i];
+        if (client_fd != -1) {
+            httpd_ws_frame_t ws_pkt;
+            memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
+            ws_pkt.payload = (uint8_t *)buf;
+            ws_pkt.len = len;
+            ws_pkt.type = HTTPD_WS_TYPE_TEXT;
+
+            if (httpd_ws_send_frame_async(https_handle, client_fd, &ws_pkt) != ESP_OK) {
+                ESP_LOGW(TAG, "Failed to send WebSocket frame to fd: %d", client_fd);
+                remove_client(client_fd);
+            }
+        }
+    }
+}
+
 void websocket_task(void *pvParameters)
 {
     ESP_LOGI(TAG, "websocket_task starting");
@@ -165,6 +186,7 @@ void websocket_task(void *pvParameters)
     clients_mutex = xSemaphoreCreateMutex();
 
     uint64_t last_read_abs = log_buffer_get_total_written();
+    uint32_t last_trace_seq = stratum_trace_next_seq();
     char *scratch_buf = (char *)malloc(WS_LOG_SCRATCH_SIZE);
 
     while (true) {
@@ -172,6 +194,7 @@ void websocket_task(void *pvParameters)
 
         if (active_clients == 0) {
             last_read_abs = log_buffer_get_total_written();
+            last_trace_seq = stratum_trace_next_seq();
             continue;
         }
 
@@ -180,22 +203,19 @@ void websocket_task(void *pvParameters)
             if (read_len == 0) {
                 break;
             }
+            send_to_clients(https_handle, scratch_buf, read_len);
+        }
 
-            for (int i = 0; i < MAX_WEBSOCKET_CLIENTS; i++) {
-                int client_fd = clients[i];
-                if (client_fd != -1) {
-                    httpd_ws_frame_t ws_pkt;
-                    memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
-                    ws_pkt.payload = (uint8_t *)scratch_buf;
-                    ws_pkt.len = read_len;
-                    ws_pkt.type = HTTPD_WS_TYPE_TEXT;
-
-                    if (httpd_ws_send_frame_async(https_handle, client_fd, &ws_pkt) != ESP_OK) {
-                        ESP_LOGW(TAG, "Failed to send WebSocket frame to fd: %d", client_fd);
-                        remove_client(client_fd);
-                    }
-                }
-            }
+        // Without full payload logging the stratum messages are not in the log buffer,
+        // show them from the trace instead, formatted only now that someone is watching
+        if (stratum_trace_get_log_payloads()) {
+            last_trace_seq = stratum_trace_next_seq();
+            continue;
+        }
+        stratum_trace_entry entry;
+        while (stratum_trace_read(&last_trace_seq, &entry, 1) == 1) {
+            int len = stratum_trace_format(&entry, scratch_buf, WS_LOG_SCRATCH_SIZE);
+            send_to_clients(https_handle, scratch_buf, MIN(len, WS_LOG_SCRATCH_SIZE - 1));
         }
     }
 
@@ -1,10 +1,12 @@
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_psram.h"
+#include "esp_timer.h"
 
 #include "asic_result_task.h"
 #include "create_jobs_task.h"
 #include "hashrate_monitor_task.h"
+#include "share_submit_task.h"
 #include "fan_controller_task.h"
 #include "statistics_task.h"
 #include "system.h"
@@ -25,6 +27,7 @@
 #include "filesystem.h"
 #include "input.h"
 #include "log_buffer.h"
+#include "stratum_trace.h"
 
 static GlobalState GLOBAL_STATE;
 
@@ -137,6 +140,23 @@ void app_main(void)
     }
 
     queue_init(&GLOBAL_STATE.stratum_queue);
+    nonce_filter_init(&GLOBAL_STATE.ASIC_TASK_MODULE.duplicate_filter);
+
+    if (stratum_trace_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate the stratum trace");
+    }
+    stratum_trace_set_log_payloads(nvs_config_get_bool(NVS_CONFIG_STRATUM_LOG_PAYLOADS));
+
+    PoolSplitModule *POOL_SPLIT_MODULE = &GLOBAL_STATE.POOL_SPLIT_MODULE;
+    queue_init(&POOL_SPLIT_MODULE->queue);
+    portMUX_INITIALIZE(&POOL_SPLIT_MODULE->lock);
+    pool_split_init(&POOL_SPLIT_MODULE->scheduler, 2, esp_timer_get_time());
+    pool_split_set_weight(&POOL_SPLIT_MODULE->scheduler, POOL_PRIMARY, 100 - GLOBAL_STATE.SYSTEM_MODULE.fallback_pool_weight);
+    pool_split_set_weight(&POOL_SPLIT_MODULE->scheduler, POOL_FALLBACK, GLOBAL_STATE.SYSTEM_MODULE.fallback_pool_weight);
+
+    if (share_submit_init(&GLOBAL_STATE) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create share queue");
+    }
 
     if (system_init_ret == ESP_OK) {
         if (asic_initialize(&GLOBAL_STATE, ASIC_INIT_COLD_BOOT, 0) == 0) {
@@ -149,6 +169,9 @@ void app_main(void)
         if (xTaskCreate(ASIC_result_task, "asic result", 8192, (void *) &GLOBAL_STATE, 15, NULL) != pdPASS) {
             ESP_LOGE(TAG, "Error creating asic result task");
         }
+        if (xTaskCreate(share_submit_task, "share submit", 8192, (void *) &GLOBAL_STATE, 10, NULL) != pdPASS) {
+            ESP_LOGE(TAG, "Error creating share submit task");
+        }
 
         if (!GLOBAL_STATE.SELF_TEST_MODULE.is_active) {
             if (xTaskCreate(stratum_task, "stratum admin", 8192, (void *) &GLOBAL_STATE, 5, NULL) != pdPASS) {
@@ -70,6 +70,11 @@ static Settings settings[NVS_CONFIG_COUNT] = {
     [NVS_CONFIG_FALLBACK_STRATUM_CERT]                 = {.nvs_key_name = "fbstratumcert",   .type = TYPE_STR,   .default_value = {.str = (char *)CONFIG_FALLBACK_STRATUM_CERT},        .rest_name = "fallbackStratumCert",                .min = 0,  .max = NVS_STR_LIMIT},
     [NVS_CONFIG_FALLBACK_STRATUM_DECODE_COINBASE_TX]   = {.nvs_key_name = "fbstratumdecode", .type = TYPE_BOOL,  .default_value = {.b   = true},                                        .rest_name = "fallbackStratumDecodeCoinbase",      .min = 0,  .max = 1},
     [NVS_CONFIG_USE_FALLBACK_STRATUM]                  = {.nvs_key_name = "usefbstartum",    .type = TYPE_BOOL,                                                                         .rest_name = "useFallbackStratum",                 .min = 0,  .max = 1},
+    [NVS_CONFIG_FALLBACK_STRATUM_HOT_STANDBY]          = {.nvs_key_name = "fbstandby",       .type = TYPE_BOOL,                                                                         .rest_name = "fallbackStratumHotStandby",          .min = 0,  .max = 1},
+    [NVS_CONFIG_FALLBACK_STRATUM_WEIGHT]               = {.nvs_key_name = "fbweight",        .type = TYPE_U16,                                                                          .rest_name = "fallbackStratumWeight",              .min = 0,  .max = 100},
+    [NVS_CONFIG_NTIME_ROLL_WINDOW]                     = {.nvs_key_name = "ntimeroll",       .type = TYPE_U16,   .default_value = {.u16 = 0},                                           .rest_name = "ntimeRollWindow",                    .min = 0,  .max = 3600},
+    [NVS_CONFIG_STRATUM_LOG_PAYLOADS]                  = {.nvs_key_name = "stratumlog",      .type = TYPE_BOOL,  .default_value = {.b   = true},                                        .rest_name = "stratumLogPayloads",                 .min = 0,  .max = 1},
+    [NVS_CONFIG_STRATUM_SHARES_PER_MINUTE]             = {.nvs_key_name = "sharespermin",    .type = TYPE_U16,   .default_value = {.u16 = 0},                                           .rest_name = "stratumSharesPerMinute",             .min = 0,  .max = 600},
 
     [NVS_CONFIG_ASIC_FREQUENCY]                        = {.nvs_key_name = "asicfrequency_f", .type = TYPE_FLOAT, .default_value = {.f   = CONFIG_ASIC_FREQUENCY},                       .rest_name = "frequency",                          .min = 1,  .max = UINT16_MAX},
     [NVS_CONFIG_ASIC_VOLTAGE]                          = {.nvs_key_name = "asicvoltage",     .type = TYPE_U16,   .default_value = {.u16 = CONFIG_ASIC_VOLTAGE},                         .rest_name = "coreVoltage",                        .min = 1,  .max = UINT16_MAX},
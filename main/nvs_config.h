@@ -29,6 +29,11 @@ typedef enum {
     NVS_CONFIG_FALLBACK_STRATUM_CERT,
     NVS_CONFIG_FALLBACK_STRATUM_DECODE_COINBASE_TX,
     NVS_CONFIG_USE_FALLBACK_STRATUM,
+    NVS_CONFIG_FALLBACK_STRATUM_HOT_STANDBY,
+    NVS_CONFIG_FALLBACK_STRATUM_WEIGHT,
+    NVS_CONFIG_NTIME_ROLL_WINDOW,
+    NVS_CONFIG_STRATUM_LOG_PAYLOADS,
+    NVS_CONFIG_STRATUM_SHARES_PER_MINUTE,
     
     NVS_CONFIG_ASIC_FREQUENCY,
     NVS_CONFIG_ASIC_VOLTAGE,
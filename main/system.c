@@ -85,6 +85,12 @@ void SYSTEM_init_system(GlobalState * GLOBAL_STATE)
     module->pool_difficulty = nvs_config_get_u16(NVS_CONFIG_STRATUM_DIFFICULTY);
     module->fallback_pool_difficulty = nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_DIFFICULTY);
 
+    // target share rate the suggested difficulty follows, 0 keeps it fixed
+    module->shares_per_minute = nvs_config_get_u16(NVS_CONFIG_STRATUM_SHARES_PER_MINUTE);
+
+    // seconds of ntime the job task rolls a notify forward, 0 keeps the pool's ntime
+    module->ntime_roll_window = nvs_config_get_u16(NVS_CONFIG_NTIME_ROLL_WINDOW);
+
     // set the pool extranonce subscribe
     module->pool_extranonce_subscribe = nvs_config_get_bool(NVS_CONFIG_STRATUM_EXTRANONCE_SUBSCRIBE);
     module->fallback_pool_extranonce_subscribe = nvs_config_get_bool(NVS_CONFIG_FALLBACK_STRATUM_EXTRANONCE_SUBSCRIBE);
@@ -96,6 +102,12 @@ void SYSTEM_init_system(GlobalState * GLOBAL_STATE)
     // use fallback stratum
     module->use_fallback_stratum = nvs_config_get_bool(NVS_CONFIG_USE_FALLBACK_STRATUM);
 
+    // keep the fallback pool connected in the background
+    module->fallback_pool_hot_standby = nvs_config_get_bool(NVS_CONFIG_FALLBACK_STRATUM_HOT_STANDBY);
+
+    // percentage of the hashrate mined on the fallback pool alongside the primary
+    module->fallback_pool_weight = nvs_config_get_u16(NVS_CONFIG_FALLBACK_STRATUM_WEIGHT);
+
     // set based on config
     module->is_using_fallback = module->use_fallback_stratum;
 
@@ -301,7 +313,7 @@ void SYSTEM_notify_new_ntime(GlobalState * GLOBAL_STATE, uint32_t ntime)
     settimeofday(&tv, NULL);
 }
 
-void SYSTEM_notify_found_nonce(GlobalState * GLOBAL_STATE, double diff, uint8_t job_id)
+void SYSTEM_notify_found_nonce(GlobalState * GLOBAL_STATE, double diff, const bm_job * job, bool is_block)
 {
     SystemModule * module = &GLOBAL_STATE->SYSTEM_MODULE;
 
@@ -310,8 +322,8 @@ void SYSTEM_notify_found_nonce(GlobalState * GLOBAL_STATE, double diff, uint8_t
         suffixString((uint64_t) diff, module->best_session_diff_string, DIFF_STRING_SIZE, 0);
     }
 
-    double network_diff = networkDifficulty(GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id]->target);
-    if (diff >= network_diff) {
+    if (is_block) {
+        double network_diff = networkDifficulty(job->target);
         module->block_found++;
         module->show_new_block = true;
         ESP_LOGI(TAG, "FOUND BLOCK!!!!!!!!!!!!!!!!!!!!!! %f >= %f (count: %d)", diff, network_diff, module->block_found);
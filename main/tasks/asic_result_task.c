@@ -12,6 +12,7 @@
 #include "asic.h"
 #include "freertos/task.h"
 #include "scoreboard.h"
+#include "share_submit_task.h"
 
 static const char *TAG = "asic_result";
 
@@ -42,61 +43,71 @@ void ASIC_result_task(void *pvParameters)
 
         uint8_t job_id = asic_result->job_id;
 
+        // Copy the job out of its slab slot, the slot is overwritten when the job id comes around again
+        bm_job job;
         pthread_mutex_lock(&GLOBAL_STATE->valid_jobs_lock);
-        bool valid = (GLOBAL_STATE->valid_jobs[job_id] != 0);
-        bm_job *active_job = valid ? GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id] : NULL;
+        const bm_job *slot = GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[job_id];
+        bool valid = (GLOBAL_STATE->valid_jobs[job_id] != 0) && slot != NULL;
+        // Its pool moved on to the next block, the pool could only reject the share as stale
+        bool stale = !valid && slot != NULL && slot->generation != GLOBAL_STATE->ASIC_TASK_MODULE.block_generation[slot->pool];
+        if (valid) {
+            job = *slot;
+        }
         pthread_mutex_unlock(&GLOBAL_STATE->valid_jobs_lock);
+        const bm_job *active_job = &job;
 
-        if (!valid || active_job == NULL)
+        if (stale) {
+            GLOBAL_STATE->ASIC_TASK_MODULE.stale_suppressed++;
+            continue;
+        }
+        if (!valid)
         {
             ESP_LOGW(TAG, "Invalid job nonce found, 0x%02X", job_id);
             continue;
         }
-        // check the nonce difficulty
-        double nonce_diff = test_nonce_value(active_job, asic_result->nonce, asic_result->rolled_version);
+        // check the nonce against the job targets
+        uint8_t nonce_hash[32];
+        calculate_nonce_hash(active_job, asic_result->nonce, asic_result->rolled_version, nonce_hash);
 
         if (GLOBAL_STATE->SELF_TEST_MODULE.is_active) continue;
 
         uint32_t version_bits = asic_result->rolled_version ^ active_job->version;
-        if (nonce_diff >= active_job->pool_diff)
-        {
-            char * user = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_user : GLOBAL_STATE->SYSTEM_MODULE.pool_user;
-
-            taskENTER_CRITICAL(&GLOBAL_STATE->stratum_mux);
-            esp_transport_handle_t transport = GLOBAL_STATE->transport;
-            int uid = GLOBAL_STATE->send_uid++;
-            taskEXIT_CRITICAL(&GLOBAL_STATE->stratum_mux);
+        // The ASIC may report a nonce again, the pool would only reject it as a duplicate
+        if (nonce_filter_check(&GLOBAL_STATE->ASIC_TASK_MODULE.duplicate_filter, active_job, asic_result->nonce, version_bits)) {
+            ESP_LOGW(TAG, "Duplicate nonce %08" PRIX32 " for job %s suppressed", asic_result->nonce, active_job->jobid);
+            continue;
+        }
 
-            if (transport == NULL) {
-                ESP_LOGW(TAG, "No stratum connection, dropping share (job 0x%02X)", job_id);
+        bool is_block = hash_meets_target(nonce_hash, active_job->network_target);
+        if (is_block || hash_meets_target(nonce_hash, active_job->pool_target))
+        {
+            // Formatting and the socket write happen on the submit task, a slow pool must not stall UART draining.
+            // A block candidate is written from here ahead of the queue and the logging below, unless a write is stalled.
+            share_submission share = {
+                .ntime = active_job->ntime,
+                .nonce = asic_result->nonce,
+                .version_bits = version_bits,
+                .found_us = asic_result->timestamp_us,
+                .pool = active_job->pool,
+                .block_candidate = is_block,
+            };
+            strcpy(share.jobid, active_job->jobid);
+            strcpy(share.extranonce2, active_job->extranonce2);
+            memcpy(share.prev_block_hash, active_job->prev_block_hash, sizeof(share.prev_block_hash));
+            if (is_block) {
+                share_submit_block_candidate(GLOBAL_STATE, &share);
             } else {
-                uint64_t sent_time_us = 0;
-                int ret = STRATUM_V1_submit_share(
-                    transport,
-                    uid,
-                    user,
-                    active_job->jobid,
-                    active_job->extranonce2,
-                    active_job->ntime,
-                    asic_result->nonce,
-                    version_bits,
-                    &sent_time_us);
-
-                if (ret < 0) {
-                    ESP_LOGW(TAG, "Unable to write share to socket (ret: %d, errno %d: %s)", ret, errno, strerror(errno));
-                    // stratum_task recv loop will detect a broken connection on its next read and handle reconnection
-                }
-
-                float process_time = (sent_time_us - asic_result->timestamp_us) / 1000.0f;
-                GLOBAL_STATE->SYSTEM_MODULE.process_time = process_time;
-                ESP_LOGI(TAG, "Processing time: %0.1f ms", process_time);
+                share_submit_enqueue(GLOBAL_STATE, &share);
             }
         }
 
+        // difficulty is only needed for display, best difficulty and the scoreboard
+        double nonce_diff = nonce_hash_difficulty(nonce_hash);
+
         //log the ASIC response
         ESP_LOGI(TAG, "ID: %s, ASIC nr: %d, Core: %d/%d, ver: %08" PRIX32 " Nonce %08" PRIX32 " diff %.1f of %g.", active_job->jobid, asic_result->asic_nr, asic_result->core_id, asic_result->small_core_id, asic_result->rolled_version, asic_result->nonce, nonce_diff, active_job->pool_diff);
 
-        SYSTEM_notify_found_nonce(GLOBAL_STATE, nonce_diff, job_id);
+        SYSTEM_notify_found_nonce(GLOBAL_STATE, nonce_diff, active_job, is_block);
 
         scoreboard_add(&GLOBAL_STATE->SYSTEM_MODULE.scoreboard, nonce_diff, active_job->jobid, active_job->extranonce2, active_job->ntime, asic_result->nonce, version_bits);
     }
@@ -2,10 +2,12 @@
 #include <limits.h>
 
 #include "work_queue.h"
+#include "mining_notify_pool.h"
 #include "global_state.h"
 #include "esp_log.h"
 #include "esp_system.h"
 #include "mining.h"
+#include "bm_job_slab.h"
 #include "string.h"
 #include "esp_timer.h"
 
@@ -15,118 +17,381 @@
 
 static const char *TAG = "create_jobs_task";
 
-#define MAX_EXTRANONCE2_LEN 32
 #define MAX_EXTRANONCE2_STR (MAX_EXTRANONCE2_LEN * 2 + 1)
 
-static void generate_work(GlobalState *GLOBAL_STATE, mining_notify *notification, uint64_t extranonce_2, double difficulty);
+// Jobs built ahead for the current notify, so a dispatch tick only has to send one
+#define JOB_PREFETCH_DEPTH 4
+#define DISPATCH_REPORT_INTERVAL 256
+
+typedef struct
+{
+    bm_job jobs[JOB_PREFETCH_DEPTH];
+    int head;
+    int count;
+} job_ring;
+
+typedef struct
+{
+    uint32_t dispatches;
+    uint32_t ring_misses;   // ring was empty at the tick, job built synchronously
+    int64_t jitter_sum_us;  // dispatch time past the scheduled tick
+    int64_t jitter_max_us;
+    uint32_t notifies;          // notifies that got a first job
+    int64_t first_job_sum_us;   // notify line read to its first job sent
+    int64_t first_job_max_us;
+} dispatch_stats;
+
+// Work of one pool: the primary connection, or the fallback pool while it gets
+// a share of the hashrate. Indexed by POOL_PRIMARY and POOL_FALLBACK.
+typedef struct
+{
+    mining_notify *notify;
+    coinbase_template coinbase;
+    job_roller roller;
+    double difficulty;
+    job_ring ring;
+    bool prefetch_failed;
+    // Last job with a freshly computed merkle root, ntime rolls are copied from it
+    bm_job last_job;
+    bool last_job_valid;
+    // Receive time of the current notify until its first job is sent
+    int64_t first_job_pending_us;
+    // Block the pool's work builds on, in bm_job byte order
+    uint8_t prev_block_hash[32];
+    // Session of the fallback pool, the primary's is in GLOBAL_STATE
+    char extranonce_str[MAX_EXTRANONCE_1_LEN * 2 + 1];
+    int extranonce_2_len;
+    uint32_t version_mask;
+} job_source;
+
+static job_source sources[2];
+_Static_assert(sizeof(sources) / sizeof(sources[0]) == MINING_NOTIFY_POOL_SOURCES, "mining_notify pool does not count every pool source");
+static dispatch_stats stats;
+// Version bits the chip is rolling
+static uint32_t chip_version_mask;
+
+static bool generate_work(GlobalState *GLOBAL_STATE, int pool, bm_job *next_job);
+
+static void dispatch_job(GlobalState *GLOBAL_STATE, job_source *source, const bm_job *job, int64_t scheduled_us, bool ring_miss)
+{
+    int64_t jitter_us = esp_timer_get_time() - scheduled_us;
+
+    // Check if ASIC is initialized before trying to send work
+    if (GLOBAL_STATE->ASIC_initalized) {
+        // The ASIC send function copies it into the job slab slot for its job id
+        ASIC_send_work(GLOBAL_STATE, (bm_job *) job);
+    }
+
+    stats.dispatches++;
+    stats.ring_misses += ring_miss;
+    stats.jitter_sum_us += jitter_us;
+    if (jitter_us > stats.jitter_max_us) {
+        stats.jitter_max_us = jitter_us;
+    }
+    if (source->first_job_pending_us != 0) {
+        int64_t first_job_us = esp_timer_get_time() - source->first_job_pending_us;
+        stats.notifies++;
+        stats.first_job_sum_us += first_job_us;
+        if (first_job_us > stats.first_job_max_us) {
+            stats.first_job_max_us = first_job_us;
+        }
+        source->first_job_pending_us = 0;
+    }
+    if (stats.dispatches == DISPATCH_REPORT_INTERVAL) {
+        ESP_LOGI(TAG, "Dispatch jitter over %d jobs: avg %lld us, max %lld us, prefetch misses %lu",
+                 DISPATCH_REPORT_INTERVAL, stats.jitter_sum_us / stats.dispatches, stats.jitter_max_us,
+                 (unsigned long) stats.ring_misses);
+        if (stats.notifies > 0) {
+            ESP_LOGI(TAG, "Notify to first job over %lu notifies: avg %lld us, max %lld us, %lu notifies coalesced in total",
+                     (unsigned long) stats.notifies, stats.first_job_sum_us / stats.notifies, stats.first_job_max_us,
+                     (unsigned long) queue_get_coalesced(&GLOBAL_STATE->stratum_queue));
+        }
+        memset(&stats, 0, sizeof(stats));
+    }
+}
+
+// Switch a source to new work, or to none
+static void set_source_work(GlobalState *GLOBAL_STATE, job_source *source, mining_notify *notify)
+{
+    if (source->notify != NULL) {
+        STRATUM_V1_free_mining_notify(source->notify);
+    }
+    source->notify = notify;
+    source->coinbase.len = 0;
+
+    // Prefetched jobs belong to the previous notify
+    source->ring.head = 0;
+    source->ring.count = 0;
+    source->prefetch_failed = false;
+    source->last_job_valid = false;
+    source->first_job_pending_us = notify != NULL ? notify->received_us : 0;
+    if (notify != NULL) {
+        job_roller_init(&source->roller, GLOBAL_STATE->SYSTEM_MODULE.ntime_roll_window);
+    }
+}
+
+// A new prevhash makes every job of the pool stale. Start a new block generation
+// and invalidate the pool's older jobs at once, so the result task drops their
+// nonces instead of hashing and submitting them for a block that is gone.
+static void update_block_generation(GlobalState *GLOBAL_STATE, int pool, const mining_notify *notify)
+{
+    job_source *source = &sources[pool];
+    uint8_t prev_block_hash[32];
+    job_prev_block_hash(notify->prev_block_hash, prev_block_hash);
+    if (memcmp(prev_block_hash, source->prev_block_hash, sizeof(prev_block_hash)) == 0) {
+        return;
+    }
+    memcpy(source->prev_block_hash, prev_block_hash, sizeof(prev_block_hash));
+
+    pthread_mutex_lock(&GLOBAL_STATE->valid_jobs_lock);
+    uint8_t generation = ++GLOBAL_STATE->ASIC_TASK_MODULE.block_generation[pool];
+    int invalidated = bm_job_slab_invalidate(pool, generation, GLOBAL_STATE->valid_jobs);
+    pthread_mutex_unlock(&GLOBAL_STATE->valid_jobs_lock);
+
+    ESP_LOGI(TAG, "New block on pool %d, %d jobs invalidated", pool, invalidated);
+}
+
+// Take new work of the fallback pool. It is polled, so it is picked up by the
+// next dispatch tick at the latest, which is the earliest it could be sent anyway.
+static void poll_fallback_work(GlobalState *GLOBAL_STATE)
+{
+    PoolSplitModule *POOL_SPLIT_MODULE = &GLOBAL_STATE->POOL_SPLIT_MODULE;
+    job_source *source = &sources[POOL_FALLBACK];
+
+    taskENTER_CRITICAL(&POOL_SPLIT_MODULE->lock);
+    bool ready = POOL_SPLIT_MODULE->ready;
+    taskEXIT_CRITICAL(&POOL_SPLIT_MODULE->lock);
+
+    mining_notify *notify;
+    while ((notify = (mining_notify *) queue_try_dequeue(&POOL_SPLIT_MODULE->queue)) != NULL) {
+        if (!ready) {
+            STRATUM_V1_free_mining_notify(notify);
+            continue;
+        }
+
+        ESP_LOGI(TAG, "New fallback pool work dequeued %s", notify->job_id);
+        set_source_work(GLOBAL_STATE, source, notify);
+        update_block_generation(GLOBAL_STATE, POOL_FALLBACK, notify);
+
+        taskENTER_CRITICAL(&POOL_SPLIT_MODULE->lock);
+        strcpy(source->extranonce_str, POOL_SPLIT_MODULE->extranonce_str);
+        source->extranonce_2_len = POOL_SPLIT_MODULE->extranonce_2_len;
+        source->difficulty = POOL_SPLIT_MODULE->difficulty;
+        source->version_mask = POOL_SPLIT_MODULE->version_mask;
+        taskEXIT_CRITICAL(&POOL_SPLIT_MODULE->lock);
+    }
+
+    if (!ready && source->notify != NULL) {
+        ESP_LOGI(TAG, "Fallback pool left the pool split");
+        set_source_work(GLOBAL_STATE, source, NULL);
+    }
+    pool_split_set_active(&POOL_SPLIT_MODULE->scheduler, POOL_FALLBACK, source->notify != NULL);
+}
+
+// The chip rolls the same version bits for every job, only those all pools in use allow
+static uint32_t job_version_mask(GlobalState *GLOBAL_STATE)
+{
+    uint32_t version_mask = GLOBAL_STATE->version_mask;
+    if (sources[POOL_FALLBACK].notify != NULL) {
+        version_mask &= sources[POOL_FALLBACK].version_mask;
+    }
+    return version_mask;
+}
+
+static void update_version_mask(GlobalState *GLOBAL_STATE)
+{
+    uint32_t version_mask = job_version_mask(GLOBAL_STATE);
+    if ((GLOBAL_STATE->new_stratum_version_rolling_msg || version_mask != chip_version_mask) && GLOBAL_STATE->ASIC_initalized) {
+        ESP_LOGI(TAG, "Set chip version rolls %i", (int)(version_mask >> 13));
+        if (version_mask != chip_version_mask) {
+            // Prefetched jobs and the job ntime rolls start from were built for the old mask
+            for (int i = 0; i < 2; i++) {
+                sources[i].ring.head = 0;
+                sources[i].ring.count = 0;
+                sources[i].prefetch_failed = false;
+                sources[i].last_job_valid = false;
+            }
+        }
+        ASIC_set_version_mask(GLOBAL_STATE, version_mask);
+        GLOBAL_STATE->new_stratum_version_rolling_msg = false;
+        chip_version_mask = version_mask;
+    }
+}
+
+// Pool to build a job ahead for, the one with the fewest prefetched jobs
+static int prefetch_pool(void)
+{
+    int pool = -1;
+    for (int i = 0; i < 2; i++) {
+        const job_source *source = &sources[i];
+        if (source->notify == NULL || source->prefetch_failed || source->ring.count >= JOB_PREFETCH_DEPTH) {
+            continue;
+        }
+        if (pool < 0 || source->ring.count < sources[pool].ring.count) {
+            pool = i;
+        }
+    }
+    return pool;
+}
 
 void create_jobs_task(void *pvParameters)
 {
     GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
+    pool_split *scheduler = &GLOBAL_STATE->POOL_SPLIT_MODULE.scheduler;
 
     // Initialize ASIC task module (moved from ASIC_task)
     GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs = heap_caps_malloc(sizeof(bm_job *) * 128, MALLOC_CAP_SPIRAM);
     GLOBAL_STATE->valid_jobs = heap_caps_malloc(sizeof(uint8_t) * 128, MALLOC_CAP_SPIRAM);
+    if (bm_job_slab_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate job slab");
+        vTaskDelete(NULL);
+    }
     for (int i = 0; i < 128; i++) {
         GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[i] = NULL;
         GLOBAL_STATE->valid_jobs[i] = 0;
     }
 
-    double difficulty = GLOBAL_STATE->pool_difficulty;
-    mining_notify *current_mining_notification = NULL;
-    uint64_t extranonce_2 = 0;
-    int timeout_ms = ASIC_get_asic_job_frequency_ms(GLOBAL_STATE);
+    job_source *primary = &sources[POOL_PRIMARY];
+    primary->difficulty = GLOBAL_STATE->pool_difficulty;
+    chip_version_mask = GLOBAL_STATE->version_mask;
+    int interval_ms = ASIC_get_asic_job_frequency_ms(GLOBAL_STATE);
+    int64_t next_dispatch_us = esp_timer_get_time() + interval_ms * 1000LL;
 
-    ESP_LOGI(TAG, "ASIC Job Interval: %d ms", timeout_ms);
+    ESP_LOGI(TAG, "ASIC Job Interval: %d ms", interval_ms);
     ESP_LOGI(TAG, "ASIC Ready!");
     
     while (1) {
-        uint64_t start_time = esp_timer_get_time();
-        mining_notify *new_mining_notification = (mining_notify *)queue_dequeue_timeout(&GLOBAL_STATE->stratum_queue, timeout_ms);
-        timeout_ms -= (esp_timer_get_time() - start_time) / 1000;
+        poll_fallback_work(GLOBAL_STATE);
+        update_version_mask(GLOBAL_STATE);
 
-        if (new_mining_notification != NULL) {
-            if (current_mining_notification != NULL) {
-                STRATUM_V1_free_mining_notify(current_mining_notification);
-            }
+        // Fill the rings one job per pass until the next tick, new work is picked up in between
+        int64_t now_us = esp_timer_get_time();
+        int prefetch = now_us < next_dispatch_us ? prefetch_pool() : -1;
+        int wait_ms = prefetch >= 0 || now_us >= next_dispatch_us ? 0 : (next_dispatch_us - now_us + 999) / 1000;
+        mining_notify *new_mining_notification = (mining_notify *)queue_dequeue_timeout(&GLOBAL_STATE->stratum_queue, wait_ms);
+        int force_pool = -1;
 
+        if (new_mining_notification != NULL) {
             ESP_LOGI(TAG, "New Work Dequeued %s", new_mining_notification->job_id);
 
-            current_mining_notification = new_mining_notification;
+            set_source_work(GLOBAL_STATE, primary, new_mining_notification);
+            update_block_generation(GLOBAL_STATE, POOL_PRIMARY, new_mining_notification);
+            pool_split_set_active(scheduler, POOL_PRIMARY, true);
 
             if (GLOBAL_STATE->new_set_mining_difficulty_msg) {
                 ESP_LOGI(TAG, "New pool difficulty %.2f", GLOBAL_STATE->pool_difficulty);
-                difficulty = GLOBAL_STATE->pool_difficulty;
+                primary->difficulty = GLOBAL_STATE->pool_difficulty;
                 GLOBAL_STATE->new_set_mining_difficulty_msg = false;
             }
 
-            if (GLOBAL_STATE->new_stratum_version_rolling_msg && GLOBAL_STATE->ASIC_initalized) {
-                ESP_LOGI(TAG, "Set chip version rolls %i", (int)(GLOBAL_STATE->version_mask >> 13));
-                ASIC_set_version_mask(GLOBAL_STATE, GLOBAL_STATE->version_mask);
-                GLOBAL_STATE->new_stratum_version_rolling_msg = false;
-            }
-
-            extranonce_2 = 0;
+            update_version_mask(GLOBAL_STATE);
 
-            if (!current_mining_notification->clean_jobs) {
+            if (!new_mining_notification->clean_jobs) {
                 continue;
             }
-        } else {
-            if (current_mining_notification == NULL) {
-                vTaskDelay(100 / portTICK_PERIOD_MS);
-                continue;
+            // Clean jobs are sent right away, nothing can have been prefetched for them
+            force_pool = POOL_PRIMARY;
+            next_dispatch_us = esp_timer_get_time();
+        } else if (primary->notify == NULL && sources[POOL_FALLBACK].notify == NULL) {
+            vTaskDelay(100 / portTICK_PERIOD_MS);
+            next_dispatch_us = esp_timer_get_time() + interval_ms * 1000LL;
+            continue;
+        } else if (prefetch >= 0) {
+            job_source *source = &sources[prefetch];
+            bm_job *slot = &source->ring.jobs[(source->ring.head + source->ring.count) % JOB_PREFETCH_DEPTH];
+            if (generate_work(GLOBAL_STATE, prefetch, slot)) {
+                source->ring.count++;
+            } else {
+                source->prefetch_failed = true;
             }
+            continue;
         }
 
-        // Generate and send job (either new work or incremented extranonce_2)
-        generate_work(GLOBAL_STATE, current_mining_notification, extranonce_2, difficulty);
-        extranonce_2++;
-        timeout_ms = ASIC_get_asic_job_frequency_ms(GLOBAL_STATE);
+        // Dispatch tick: the pool split picks whose job it is, send its oldest
+        // prefetched job, build one now only if the ring ran dry
+        int pool = pool_split_next(scheduler, force_pool);
+        if (pool < 0 || sources[pool].notify == NULL) {
+            // Only a pool with a weight of 0 has work
+            pool = primary->notify != NULL ? POOL_PRIMARY : POOL_FALLBACK;
+        }
+        job_source *source = &sources[pool];
+
+        int64_t scheduled_us = next_dispatch_us;
+        interval_ms = ASIC_get_asic_job_frequency_ms(GLOBAL_STATE);
+        if (source->ring.count > 0) {
+            dispatch_job(GLOBAL_STATE, source, &source->ring.jobs[source->ring.head], scheduled_us, false);
+            source->ring.head = (source->ring.head + 1) % JOB_PREFETCH_DEPTH;
+            source->ring.count--;
+        } else {
+            bm_job next_job;
+            if (generate_work(GLOBAL_STATE, pool, &next_job)) {
+                dispatch_job(GLOBAL_STATE, source, &next_job, scheduled_us, force_pool < 0);
+            }
+        }
+        next_dispatch_us = esp_timer_get_time() + interval_ms * 1000LL;
     }
 }
 
-static void generate_work(GlobalState *GLOBAL_STATE, mining_notify *notification, uint64_t extranonce_2, double difficulty)
+static bool generate_work(GlobalState *GLOBAL_STATE, int pool, bm_job *next_job)
 {
-    if (GLOBAL_STATE->extranonce_2_len > MAX_EXTRANONCE2_LEN) {
-        ESP_LOGE(TAG, "extranonce_2_len %d exceeds maximum %d, skipping job", GLOBAL_STATE->extranonce_2_len, MAX_EXTRANONCE2_LEN);
-        return;
+    job_source *source = &sources[pool];
+    mining_notify *notification = source->notify;
+    const char *extranonce_str = pool == POOL_PRIMARY ? GLOBAL_STATE->extranonce_str : source->extranonce_str;
+    int extranonce_2_len = pool == POOL_PRIMARY ? GLOBAL_STATE->extranonce_2_len : source->extranonce_2_len;
+
+    bool ntime_roll = job_roller_next(&source->roller);
+    uint32_t ntime = notification->ntime + source->roller.ntime_offset;
+
+    // Same extranonce_2, so the merkle root and midstates of the last job still hold.
+    // After mining.set_extranonce they do not, the job is built again with the rolled ntime.
+    if (ntime_roll && source->last_job_valid
+        && coinbase_template_matches(&source->coinbase, extranonce_str, extranonce_2_len)) {
+        roll_bm_job_ntime(&source->last_job, ntime, next_job);
+        return true;
+    }
+
+    if (extranonce_2_len > MAX_EXTRANONCE2_LEN) {
+        ESP_LOGE(TAG, "extranonce_2_len %d exceeds maximum %d, skipping job", extranonce_2_len, MAX_EXTRANONCE2_LEN);
+        return false;
+    }
+
+    if (strlen(notification->job_id) > MAX_JOB_ID_LEN) {
+        ESP_LOGE(TAG, "Job id %s longer than %d, skipping job", notification->job_id, MAX_JOB_ID_LEN);
+        return false;
     }
+
+    // Rebuilt on new work and whenever mining.set_extranonce changed the extranonces
+    if (source->coinbase.len == 0 || !coinbase_template_matches(&source->coinbase, extranonce_str, extranonce_2_len)) {
+        if (!coinbase_template_build(&source->coinbase, notification, extranonce_str, extranonce_2_len)) {
+            ESP_LOGE(TAG, "Failed to allocate memory for coinbase");
+            return false;
+        }
+    }
+
     char extranonce_2_str[MAX_EXTRANONCE2_STR];
-    extranonce_2_generate(extranonce_2, GLOBAL_STATE->extranonce_2_len, extranonce_2_str);
+    extranonce_2_generate(source->roller.extranonce_2, extranonce_2_len, extranonce_2_str);
 
     //print generated extranonce_2
     //ESP_LOGI(TAG, "Generated extranonce_2: %s", extranonce_2_str);
 
     uint8_t coinbase_tx_hash[32];
-    calculate_coinbase_tx_hash(notification->coinbase_1, notification->coinbase_2, GLOBAL_STATE->extranonce_str, extranonce_2_str, coinbase_tx_hash);
+    coinbase_template_set_extranonce_2(&source->coinbase, source->roller.extranonce_2);
+    coinbase_template_hash(&source->coinbase, coinbase_tx_hash);
 
     uint8_t merkle_root[32];
     calculate_merkle_root_hash(coinbase_tx_hash, (uint8_t(*)[32])notification->merkle_branches, notification->n_merkle_branches, merkle_root);
 
-    bm_job *next_job = malloc(sizeof(bm_job));
+    memset(next_job, 0, sizeof(bm_job));
+    construct_bm_job(notification, merkle_root, job_version_mask(GLOBAL_STATE), source->difficulty, next_job);
 
-    if (next_job == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for new job");
-        return;
-    }
+    strcpy(next_job->extranonce2, extranonce_2_str);
+    strcpy(next_job->jobid, notification->job_id);
+    next_job->ntime = ntime;
+    next_job->pool = pool;
+    next_job->generation = GLOBAL_STATE->ASIC_TASK_MODULE.block_generation[pool];
 
-    construct_bm_job(notification, merkle_root, GLOBAL_STATE->version_mask, difficulty, next_job);
-
-    next_job->extranonce2 = strdup(extranonce_2_str);
-    next_job->jobid = strdup(notification->job_id);
-    next_job->version_mask = GLOBAL_STATE->version_mask;
-
-    // Check if ASIC is initialized before trying to send work
-    if (!GLOBAL_STATE->ASIC_initalized) {
-        // Clean up the job since we're not sending it
-        // Note: This job was never stored in active_jobs, so it's safe to free
-        free(next_job->jobid);
-        free(next_job->extranonce2);
-        free(next_job);
-        return;
-    }
+    source->last_job = *next_job;
+    source->last_job_valid = true;
 
-    // The ASIC send function will store it in active_jobs array
-    // Job cleanup will be handled by the ASIC result processing
-    ASIC_send_work(GLOBAL_STATE, next_job);
+    return true;
 }
@@ -0,0 +1,371 @@
+#include <string.h>
+#include <errno.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "global_state.h"
+#include "share_submit_task.h"
+
+static const char *TAG = "share_submit";
+
+// Shares already waiting are sent with the first one in a single write
+#define SHARE_BATCH_MAX 8
+#define SHARE_BATCH_BUFFER_SIZE 4096
+// A block candidate is formatted on the result task's stack
+#define BLOCK_CANDIDATE_LINE_SIZE 1024
+// How long a block candidate waits for a write in progress before the submit task gets it
+#define BLOCK_CANDIDATE_LOCK_WAIT_MS 5
+
+esp_err_t share_submit_init(void *pvParameters)
+{
+    GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
+    ShareSubmitModule *SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
+
+    memset(&SHARE_SUBMIT_MODULE->stats, 0, sizeof(share_submit_stats));
+    portMUX_INITIALIZE(&SHARE_SUBMIT_MODULE->lock);
+    SHARE_SUBMIT_MODULE->queue = xQueueCreate(SHARE_QUEUE_SIZE, sizeof(share_submission));
+    SHARE_SUBMIT_MODULE->write_lock = xSemaphoreCreateMutex();
+    return SHARE_SUBMIT_MODULE->queue != NULL && SHARE_SUBMIT_MODULE->write_lock != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+bool share_submit_enqueue(void *pvParameters, const share_submission *share)
+{
+    GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
+    ShareSubmitModule *SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
+
+    bool queued = SHARE_SUBMIT_MODULE->queue != NULL && xQueueSend(SHARE_SUBMIT_MODULE->queue, share, 0) == pdTRUE;
+    UBaseType_t depth = queued ? uxQueueMessagesWaiting(SHARE_SUBMIT_MODULE->queue) : 0;
+
+    taskENTER_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+    if (!queued) {
+        SHARE_SUBMIT_MODULE->stats.dropped_full++;
+    } else if (depth > SHARE_SUBMIT_MODULE->stats.max_queue_depth) {
+        SHARE_SUBMIT_MODULE->stats.max_queue_depth = depth;
+    }
+    taskEXIT_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+
+    if (!queued) {
+        ESP_LOGW(TAG, "Share queue full, dropping share (job %s)", share->jobid);
+    }
+    return queued;
+}
+
+void share_submit_set_pool_ready(void *pvParameters, bool pool_ready)
+{
+    GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
+    ShareSubmitModule *SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
+
+    taskENTER_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+    SHARE_SUBMIT_MODULE->pool_ready = pool_ready;
+    taskEXIT_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+}
+
+void share_submit_set_session(void *pvParameters, uint32_t pool_id, const char *extranonce_1)
+{
+    GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
+    ShareSubmitModule *SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
+
+    taskENTER_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+    SHARE_SUBMIT_MODULE->pool_id = pool_id;
+    if (extranonce_1 != NULL && strlen(extranonce_1) < sizeof(SHARE_SUBMIT_MODULE->extranonce_1)) {
+        strcpy(SHARE_SUBMIT_MODULE->extranonce_1, extranonce_1);
+    } else {
+        // Too long to buffer shares for, share_buffer_add refuses it as well
+        SHARE_SUBMIT_MODULE->extranonce_1[0] = '\0';
+    }
+    taskEXIT_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+}
+
+bool share_submit_get_session(void *pvParameters, uint32_t pool_id, char *extranonce_1)
+{
+    GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
+    ShareSubmitModule *SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
+
+    taskENTER_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+    bool same_pool = SHARE_SUBMIT_MODULE->pool_id == pool_id;
+    strcpy(extranonce_1, same_pool ? SHARE_SUBMIT_MODULE->extranonce_1 : "");
+    taskEXIT_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+    return same_pool && extranonce_1[0] != '\0';
+}
+
+int share_submit_notify_work(void *pvParameters, const mining_notify *notify, bool replay)
+{
+    GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
+    ShareSubmitModule *SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
+
+    uint8_t prev_block_hash[32];
+    job_prev_block_hash(notify->prev_block_hash, prev_block_hash);
+
+    if (notify->clean_jobs) {
+        int dropped = share_buffer_discard_stale(prev_block_hash);
+        if (dropped > 0) {
+            ESP_LOGI(TAG, "Dropped %d buffered share(s) for a previous block", dropped);
+        }
+    }
+    if (!replay) {
+        return 0;
+    }
+
+    taskENTER_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+    uint32_t pool_id = SHARE_SUBMIT_MODULE->pool_id;
+    char extranonce_1[sizeof(SHARE_SUBMIT_MODULE->extranonce_1)];
+    strcpy(extranonce_1, SHARE_SUBMIT_MODULE->extranonce_1);
+    taskEXIT_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+
+    int replayed = 0;
+    share_submission share;
+    while (share_buffer_take_replay(pool_id, extranonce_1, prev_block_hash, &share)) {
+        if (share_submit_enqueue(GLOBAL_STATE, &share)) {
+            replayed++;
+        }
+    }
+    if (replayed > 0) {
+        ESP_LOGI(TAG, "Resubmitting %d buffered share(s)", replayed);
+    }
+    return replayed;
+}
+
+// Keep shares that could not be written for the next session of the same pool
+static void buffer_shares(ShareSubmitModule *SHARE_SUBMIT_MODULE, const share_submission *shares, int n_shares)
+{
+    taskENTER_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+    uint32_t pool_id = SHARE_SUBMIT_MODULE->pool_id;
+    char extranonce_1[sizeof(SHARE_SUBMIT_MODULE->extranonce_1)];
+    strcpy(extranonce_1, SHARE_SUBMIT_MODULE->extranonce_1);
+    taskEXIT_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+
+    int dropped = 0;
+    for (int i = 0; i < n_shares; i++) {
+        if (extranonce_1[0] == '\0' || !share_buffer_add(&shares[i], pool_id, extranonce_1)) {
+            dropped++;
+        }
+    }
+
+    if (dropped > 0) {
+        ESP_LOGW(TAG, "No pool connection, dropping %d share(s)", dropped);
+        taskENTER_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+        SHARE_SUBMIT_MODULE->stats.dropped_offline += dropped;
+        taskEXIT_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+    }
+    if (dropped < n_shares) {
+        ESP_LOGI(TAG, "No pool connection, buffered %d share(s)", n_shares - dropped);
+    }
+}
+
+void share_submit_get_stats(void *pvParameters, share_submit_stats *stats, uint32_t *queue_depth)
+{
+    GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
+    ShareSubmitModule *SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
+
+    taskENTER_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+    *stats = SHARE_SUBMIT_MODULE->stats;
+    taskEXIT_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+    *queue_depth = SHARE_SUBMIT_MODULE->queue != NULL ? uxQueueMessagesWaiting(SHARE_SUBMIT_MODULE->queue) : 0;
+}
+
+// Write shares that all belong to one pool in a single write, false if the write lock was not free within lock_wait
+static bool submit_shares(GlobalState *GLOBAL_STATE, char *batch, size_t batch_size, const share_submission *shares, int n_shares,
+                          TickType_t lock_wait)
+{
+    ShareSubmitModule *SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
+    PoolSplitModule *POOL_SPLIT_MODULE = &GLOBAL_STATE->POOL_SPLIT_MODULE;
+
+    // Mined for the fallback pool alongside the primary, they go out on its
+    // standby connection. After that connection took over, it is the main one.
+    bool split_share = shares[0].pool == POOL_FALLBACK && !GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback;
+
+    // Held from the lookup to the end of the write, close_transport and standby_close
+    // close the transports under it
+    if (xSemaphoreTake(SHARE_SUBMIT_MODULE->write_lock, lock_wait) != pdTRUE) {
+        return false;
+    }
+    // Each connection numbers its own requests, answers are matched by id
+    esp_transport_handle_t transport = NULL;
+    int first_uid = 0;
+    if (split_share) {
+        taskENTER_CRITICAL(&POOL_SPLIT_MODULE->lock);
+        if (POOL_SPLIT_MODULE->ready) {
+            transport = POOL_SPLIT_MODULE->transport;
+            first_uid = POOL_SPLIT_MODULE->send_uid;
+            POOL_SPLIT_MODULE->send_uid += n_shares;
+        }
+        taskEXIT_CRITICAL(&POOL_SPLIT_MODULE->lock);
+    }
+
+    char *user = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback || split_share ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_user : GLOBAL_STATE->SYSTEM_MODULE.pool_user;
+
+    taskENTER_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+    bool pool_ready = SHARE_SUBMIT_MODULE->pool_ready;
+    taskEXIT_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+
+    if (!split_share && pool_ready) {
+        taskENTER_CRITICAL(&GLOBAL_STATE->stratum_mux);
+        transport = GLOBAL_STATE->transport;
+        first_uid = GLOBAL_STATE->send_uid;
+        if (transport != NULL) {
+            GLOBAL_STATE->send_uid += n_shares;
+        }
+        taskEXIT_CRITICAL(&GLOBAL_STATE->stratum_mux);
+    }
+
+    // Disconnected, reconnecting or not authorized yet
+    if (transport == NULL) {
+        xSemaphoreGive(SHARE_SUBMIT_MODULE->write_lock);
+        if (split_share) {
+            ESP_LOGW(TAG, "Fallback pool left the pool split, dropping %d share(s)", n_shares);
+            taskENTER_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+            SHARE_SUBMIT_MODULE->stats.dropped_offline += n_shares;
+            taskEXIT_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+        } else {
+            buffer_shares(SHARE_SUBMIT_MODULE, shares, n_shares);
+        }
+        return true;
+    }
+
+    int uids[SHARE_BATCH_MAX];
+    int sent[SHARE_BATCH_MAX];
+    size_t len = 0;
+    int n_lines = 0;
+    for (int i = 0; i < n_shares; i++) {
+        const share_submission *share = &shares[i];
+        int line_len = STRATUM_V1_format_submit(batch + len, batch_size - len, first_uid + i, user,
+                                                share->jobid, share->extranonce2, share->ntime, share->nonce,
+                                                share->version_bits);
+        if (line_len < 0 || len + line_len >= batch_size) {
+            ESP_LOGW(TAG, "Share batch buffer full, dropping share (job %s)", share->jobid);
+            batch[len] = '\0';
+            continue;
+        }
+        sent[n_lines] = i;
+        uids[n_lines++] = first_uid + i;
+        len += line_len;
+    }
+    if (n_lines == 0) {
+        xSemaphoreGive(SHARE_SUBMIT_MODULE->write_lock);
+        return true;
+    }
+
+    uint64_t sent_time_us = 0;
+    int ret = STRATUM_V1_submit_batch(transport, batch, len, uids, n_lines, &sent_time_us);
+    xSemaphoreGive(SHARE_SUBMIT_MODULE->write_lock);
+    if (ret < 0) {
+        ESP_LOGW(TAG, "Unable to write share to socket (ret: %d, errno %d: %s)", ret, errno, strerror(errno));
+        if (split_share) {
+            // The standby task sees the broken connection on its next read
+            taskENTER_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+            SHARE_SUBMIT_MODULE->stats.dropped_offline += n_lines;
+            taskEXIT_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+            return true;
+        }
+        // stratum_task recv loop will detect a broken connection on its next read and handle reconnection
+        share_submission unsent[SHARE_BATCH_MAX];
+        for (int i = 0; i < n_lines; i++) {
+            unsent[i] = shares[sent[i]];
+        }
+        buffer_shares(SHARE_SUBMIT_MODULE, unsent, n_lines);
+        return true;
+    }
+
+    // Only the shares that made it into the write, not those the batch buffer had no room for
+    float max_latency_ms = 0;
+    for (int i = 0; i < n_lines; i++) {
+        float latency_ms = (sent_time_us - shares[sent[i]].found_us) / 1000.0f;
+        if (latency_ms > max_latency_ms) {
+            max_latency_ms = latency_ms;
+        }
+    }
+    const share_submission *first = &shares[sent[0]];
+    float process_time = (sent_time_us - first->found_us) / 1000.0f;
+    GLOBAL_STATE->SYSTEM_MODULE.process_time = process_time;
+    if (first->block_candidate) {
+        ESP_LOGI(TAG, "Block candidate written %0.1f ms after the ASIC found it", process_time);
+    } else {
+        ESP_LOGI(TAG, "Processing time: %0.1f ms (%d share(s) in one write)", process_time, n_lines);
+    }
+
+    taskENTER_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+    SHARE_SUBMIT_MODULE->stats.submitted += n_lines;
+    SHARE_SUBMIT_MODULE->stats.writes++;
+    SHARE_SUBMIT_MODULE->stats.last_latency_ms = process_time;
+    if (max_latency_ms > SHARE_SUBMIT_MODULE->stats.max_latency_ms) {
+        SHARE_SUBMIT_MODULE->stats.max_latency_ms = max_latency_ms;
+    }
+    if (first->block_candidate) {
+        SHARE_SUBMIT_MODULE->stats.block_candidates++;
+        SHARE_SUBMIT_MODULE->stats.last_candidate_latency_ms = process_time;
+    }
+    taskEXIT_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+    return true;
+}
+
+void share_submit_block_candidate(void *pvParameters, const share_submission *share)
+{
+    GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
+
+    ShareSubmitModule *SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
+
+    char line[BLOCK_CANDIDATE_LINE_SIZE];
+    if (submit_shares(GLOBAL_STATE, line, sizeof(line), share, 1, pdMS_TO_TICKS(BLOCK_CANDIDATE_LOCK_WAIT_MS))) {
+        return;
+    }
+
+    // A write is stalled on the socket, the result task must get back to draining the ASIC.
+    // The submit task writes the candidate ahead of every queued share once the lock is free.
+    share_submission displaced;
+    while (xQueueSendToFront(SHARE_SUBMIT_MODULE->queue, share, 0) != pdTRUE) {
+        // Full, the oldest share makes room like one the full queue refused
+        if (xQueueReceive(SHARE_SUBMIT_MODULE->queue, &displaced, 0) == pdTRUE) {
+            ESP_LOGW(TAG, "Share queue full, dropping share (job %s) for a block candidate", displaced.jobid);
+            taskENTER_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+            SHARE_SUBMIT_MODULE->stats.dropped_full++;
+            taskEXIT_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+        }
+    }
+    ESP_LOGW(TAG, "Write lock busy, block candidate (job %s) queued first", share->jobid);
+    taskENTER_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+    SHARE_SUBMIT_MODULE->stats.candidates_queued++;
+    taskEXIT_CRITICAL(&SHARE_SUBMIT_MODULE->lock);
+}
+
+void share_submit_task(void *pvParameters)
+{
+    GlobalState *GLOBAL_STATE = (GlobalState *)pvParameters;
+    ShareSubmitModule *SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
+
+    char *batch = heap_caps_malloc_prefer(SHARE_BATCH_BUFFER_SIZE, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT);
+    if (batch == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate share batch buffer");
+        vTaskDelete(NULL);
+    }
+
+    share_submission shares[SHARE_BATCH_MAX];
+    share_submission fallback_shares[SHARE_BATCH_MAX];
+
+    while (1) {
+        int n_shares = 0;
+        if (xQueueReceive(SHARE_SUBMIT_MODULE->queue, &shares[n_shares], portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        n_shares++;
+        while (n_shares < SHARE_BATCH_MAX && xQueueReceive(SHARE_SUBMIT_MODULE->queue, &shares[n_shares], 0) == pdTRUE) {
+            n_shares++;
+        }
+
+        // Shares go back to the pool their job came from, one write per pool
+        int n_primary = 0;
+        int n_fallback = 0;
+        for (int i = 0; i < n_shares; i++) {
+            if (shares[i].pool == POOL_FALLBACK) {
+                fallback_shares[n_fallback++] = shares[i];
+            } else {
+                shares[n_primary++] = shares[i];
+            }
+        }
+        if (n_primary > 0) {
+            submit_shares(GLOBAL_STATE, batch, SHARE_BATCH_BUFFER_SIZE, shares, n_primary, portMAX_DELAY);
+        }
+        if (n_fallback > 0) {
+            submit_shares(GLOBAL_STATE, batch, SHARE_BATCH_BUFFER_SIZE, fallback_shares, n_fallback, portMAX_DELAY);
+        }
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef SHARE_SUBMIT_TASK_H_
+#define SHARE_SUBMIT_TASK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "mining.h"
+#include "share_buffer.h"
+
+// Shares waiting for the network, a burst beyond this is dropped instead of stalling the result task
+#define SHARE_QUEUE_SIZE 32
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t writes;            // transport writes, several shares may share one
+    uint32_t dropped_full;      // queue was full when the result task offered the share
+    uint32_t dropped_offline;   // no authorized pool and the share could not be buffered
+    uint32_t max_queue_depth;
+    float last_latency_ms;      // ASIC result to written to the socket
+    float max_latency_ms;
+    uint32_t block_candidates;  // shares that met the network target
+    uint32_t candidates_queued; // write lock was busy, handed to the submit task
+    float last_candidate_latency_ms;
+} share_submit_stats;
+
+typedef struct {
+    QueueHandle_t queue;
+    // Shares are written by this task, block candidates by the result task.
+    // close_transport and standby_close hold it while they close the transports
+    // shares go out on, so a write never runs on a closed connection.
+    SemaphoreHandle_t write_lock;
+    share_submit_stats stats;
+    // Session shares are sent to, set by stratum_task
+    bool pool_ready;
+    uint32_t pool_id;
+    char extranonce_1[MAX_EXTRANONCE_1_LEN * 2 + 1];
+    portMUX_TYPE lock;
+} ShareSubmitModule;
+
+esp_err_t share_submit_init(void *pvParameters);
+void share_submit_task(void *pvParameters);
+
+/**
+ * @brief Hand a share to the submit task without blocking
+ *
+ * @return false if the queue is full and the share was dropped
+ */
+bool share_submit_enqueue(void *pvParameters, const share_submission *share);
+
+/**
+ * @brief Write a block candidate to its pool from the calling task
+ *
+ * The candidate skips the queue and the shares waiting in it. If another write
+ * holds the write lock for more than a few milliseconds, it goes to the head of
+ * the queue instead, so the caller never waits out a stalled socket. Without an
+ * authorized pool it is buffered like any share.
+ */
+void share_submit_block_candidate(void *pvParameters, const share_submission *share);
+
+/**
+ * @brief Tell the submit task whether the pool session accepts shares
+ *
+ * Until it does, shares go to the offline share buffer instead of the socket.
+ */
+void share_submit_set_pool_ready(void *pvParameters, bool pool_ready);
+
+/**
+ * @brief Set the pool and extranonce_1 the current work belongs to, buffered shares are tagged with them
+ */
+void share_submit_set_session(void *pvParameters, uint32_t pool_id, const char *extranonce_1);
+
+/**
+ * @brief extranonce_1 of the last session with pool_id, to ask the pool to resume it
+ *
+ * @param extranonce_1 At least MAX_EXTRANONCE_1_LEN * 2 + 1 bytes, left empty for another pool
+ * @return false if the last session was with another pool
+ */
+bool share_submit_get_session(void *pvParameters, uint32_t pool_id, char *extranonce_1);
+
+/**
+ * @brief Let buffered shares follow new work
+ *
+ * clean_jobs drops shares for other blocks. With replay set, which stratum_task
+ * does on the first notify after the pool authorized again, the shares still
+ * valid for this session are queued for submission.
+ *
+ * @return Number of shares queued again
+ */
+int share_submit_notify_work(void *pvParameters, const mining_notify *notify, bool replay);
+
+void share_submit_get_stats(void *pvParameters, share_submit_stats *stats, uint32_t *queue_depth);
+
+#endif /* SHARE_SUBMIT_TASK_H_ */
@@ -10,6 +10,7 @@
 #include "nvs_config.h"
 #include "connect.h"
 #include "bm1370.h"
+#include "request_table.h"
 
 #define DEFAULT_POLL_RATE 5000
 
@@ -150,6 +151,12 @@ void statistics_task(void * pvParameters)
                 statsData.freeHeap = esp_get_free_heap_size();
                 statsData.responseTime = sys_module->response_time;
 
+                request_method_stats submit_stats;
+                request_table_get_stats(REQUEST_SUBMIT, &submit_stats);
+                statsData.responseTimeP50 = submit_stats.p50_ms;
+                statsData.responseTimeP90 = submit_stats.p90_ms;
+                statsData.responseTimeP99 = submit_stats.p99_ms;
+
                 addStatisticData(&statsData);
             }
         } else {
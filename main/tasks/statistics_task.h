@@ -26,6 +26,10 @@ struct StatisticsData
     int8_t wifiRSSI;
     uint32_t freeHeap;
     float responseTime;
+    // Share submit latency percentiles since boot
+    float responseTimeP50;
+    float responseTimeP90;
+    float responseTimeP99;
 };
 
 bool getStatisticData(uint16_t index, StatisticsDataPtr dataOut);
@@ -3,9 +3,12 @@
 #include "global_state.h"
 #include <lwip/tcpip.h>
 #include <lwip/netdb.h>
+#include <lwip/dns.h>
+#include <unistd.h>
 #include "stratum_task.h"
 #include "work_queue.h"
 #include "esp_wifi.h"
+#include "esp_system.h"
 #include <esp_sntp.h>
 #include "esp_timer.h"
 #include <sys/time.h>
@@ -15,8 +18,15 @@
 #include "coinbase_decoder.h"
 #include <esp_heap_caps.h>
 #include "hashrate_monitor_task.h"
-#include "esp_transport_ssl.h"
+#include "share_submit_task.h"
+#include "request_table.h"
+#include "vardiff.h"
+#include "pool_connect.h"
+#include "mining_notify_pool.h"
+#include "tls_transport.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <stdatomic.h>
 
 #define MAX_RETRY_ATTEMPTS 3
 #define MAX_CRITICAL_RETRY_ATTEMPTS 5
@@ -37,6 +47,13 @@
 #define STRATUM_DIFFICULTY CONFIG_STRATUM_DIFFICULTY
 
 #define TRANSPORT_TIMEOUT_MS 5000
+// A request without an answer by then counts as timed out
+#define REQUEST_TIMEOUT_MS 30000
+
+// Hot standby: read timeout, also how quickly the standby task answers a takeover
+#define STANDBY_POLL_MS 100
+#define STANDBY_RETRY_MS 30000
+#define STANDBY_TAKEOVER_TIMEOUT_MS 500
 
 #define BUFFER_SIZE 1024
 
@@ -68,140 +85,151 @@ struct timeval tcp_rcv_timeout = {
 static uint16_t primary_stratum_tls;
 static char * primary_stratum_cert;
 
+// lwIP's resolver is only the fallback, it gives one address and no TTL
+#define NAME_SERVER_PORT 53
+#define NAME_SERVER_TIMEOUT_MS 2000
+
 typedef struct {
-    struct sockaddr_storage dest_addr;  // Stores IPv4 or IPv6 address with scope_id for IPv6
-    socklen_t addrlen;
+    dns_address addresses[DNS_CACHE_MAX_ADDRESSES];
+    int count;
     int addr_family;
-    int ip_protocol;
+    int sock;
     char host_ip[INET6_ADDRSTRLEN + 16];  // IPv6 address + zone identifier (e.g., "fe80::1%wlan0")
 } stratum_connection_info_t;
 
-static esp_err_t resolve_stratum_address(const char *hostname, uint16_t port, stratum_connection_info_t *conn_info)
+static socklen_t name_server_address(struct sockaddr_storage *storage)
 {
-    // Input validation
-    if (hostname == NULL || conn_info == NULL) {
-        return ESP_ERR_INVALID_ARG;
-    }
-    if (port == 0) {
-        ESP_LOGE(TAG, "Invalid port: 0");
-        return ESP_ERR_INVALID_ARG;
+    const ip_addr_t *server = dns_getserver(0);
+    if (server == NULL || ip_addr_isany(server)) {
+        return 0;
     }
 
-    char port_str[6];
-    snprintf(port_str, sizeof(port_str), "%u", port);
-
-    ESP_LOGD(TAG, "Resolving address for %s:%u", hostname, port);
+    memset(storage, 0, sizeof(*storage));
+    if (IP_IS_V4(server)) {
+        struct sockaddr_in *addr4 = (struct sockaddr_in *)storage;
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(NAME_SERVER_PORT);
+        inet_addr_from_ip4addr(&addr4->sin_addr, ip_2_ip4(server));
+        return sizeof(*addr4);
+    }
+    struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)storage;
+    addr6->sin6_family = AF_INET6;
+    addr6->sin6_port = htons(NAME_SERVER_PORT);
+    inet6_addr_from_ip6addr(&addr6->sin6_addr, ip_2_ip6(server));
+    return sizeof(*addr6);
+}
 
+static int resolve_with_getaddrinfo(const char *hostname, dns_address *addresses, int max_addresses)
+{
     struct addrinfo hints = {
         .ai_family   = AF_UNSPEC,
         .ai_socktype = SOCK_STREAM,
         .ai_protocol = IPPROTO_TCP,
-        .ai_flags    = AI_NUMERICSERV
     };
 
     struct addrinfo *res = NULL;
-    int gai_err = esp_getaddrinfo(hostname, port_str, &hints, &res);
+    int gai_err = esp_getaddrinfo(hostname, NULL, &hints, &res);
     if (gai_err != 0 || res == NULL) {
-        ESP_LOGE(TAG, "DNS resolution failed for %s:%u (error: %d)", hostname, port, gai_err);
-        return ESP_ERR_NOT_FOUND;
+        ESP_LOGE(TAG, "DNS resolution failed for %s (error: %d)", hostname, gai_err);
+        return 0;
     }
 
-    // Initialize connection info
-    memset(conn_info, 0, sizeof(*conn_info));
-    conn_info->addr_family = AF_UNSPEC;
+    int count = 0;
+    for (const struct addrinfo *p = res; p != NULL && count < max_addresses; p = p->ai_next) {
+        dns_address *address = &addresses[count];
+        memset(address, 0, sizeof(*address));
+        if (p->ai_family == AF_INET) {
+            address->family = AF_INET;
+            memcpy(address->addr, &((struct sockaddr_in *)p->ai_addr)->sin_addr, 4);
+        } else if (p->ai_family == AF_INET6) {
+            struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)p->ai_addr;
+            address->family = AF_INET6;
+            memcpy(address->addr, &addr6->sin6_addr, 16);
+            address->scope_id = addr6->sin6_scope_id;
+        } else {
+            continue;
+        }
+        count++;
+    }
+    freeaddrinfo(res);
 
-    // Preferred order: IPv4 first, then IPv6
-    const int preferred_families[] = { AF_INET, AF_INET6 };
-    const size_t num_families = sizeof(preferred_families) / sizeof(preferred_families[0]);
+    dns_interleave_addresses(addresses, count);
+    return count;
+}
 
-    const struct addrinfo *selected = NULL;
+static esp_err_t resolve_stratum_address(const char *hostname, uint16_t port, stratum_connection_info_t *conn_info)
+{
+    // Input validation
+    if (hostname == NULL || conn_info == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (port == 0) {
+        ESP_LOGE(TAG, "Invalid port: 0");
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    for (size_t i = 0; i < num_families && selected == NULL; i++) {
-        int family = preferred_families[i];
+    ESP_LOGD(TAG, "Resolving address for %s:%u", hostname, port);
 
-        for (const struct addrinfo *p = res; p != NULL; p = p->ai_next) {
-            if (p->ai_family == family) {
-                selected = p;
-                break;
-            }
-        }
+    memset(conn_info, 0, sizeof(*conn_info));
+    conn_info->addr_family = AF_UNSPEC;
+    conn_info->sock = -1;
+
+    // Every A and AAAA address, cached for their TTL
+    struct sockaddr_storage name_server;
+    socklen_t name_server_len = name_server_address(&name_server);
+    conn_info->count = pool_resolve(name_server_len > 0 ? (struct sockaddr *)&name_server : NULL, name_server_len,
+                                    hostname, NAME_SERVER_TIMEOUT_MS, conn_info->addresses, DNS_CACHE_MAX_ADDRESSES);
+    if (conn_info->count == 0) {
+        conn_info->count = resolve_with_getaddrinfo(hostname, conn_info->addresses, DNS_CACHE_MAX_ADDRESSES);
     }
-
-    if (selected == NULL) {
-        ESP_LOGE(TAG, "No supported address family (IPv4 or IPv6) found for %s", hostname);
-        freeaddrinfo(res);
-        return ESP_ERR_NOT_SUPPORTED;
+    if (conn_info->count == 0) {
+        return ESP_ERR_NOT_FOUND;
     }
 
-    // Copy selected address
-    memcpy(&conn_info->dest_addr, selected->ai_addr, selected->ai_addrlen);
-    conn_info->addrlen     = selected->ai_addrlen;
-    conn_info->addr_family = selected->ai_family;
-    conn_info->ip_protocol = (selected->ai_family == AF_INET) ? IPPROTO_IP : IPPROTO_IPV6;
-
     // Handle IPv6 link-local scope ID if needed
-    if (selected->ai_family == AF_INET6) {
-        struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&conn_info->dest_addr;
-
-        if (IN6_IS_ADDR_LINKLOCAL(&addr6->sin6_addr)) {
-            if (addr6->sin6_scope_id == 0) {
-                ESP_LOGW(TAG, "Link-local IPv6 address without scope ID - attempting to set from WiFi STA interface");
-
-                esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
-                if (netif) {
-                    int index = esp_netif_get_netif_impl_index(netif);
-                    if (index >= 0) {
-                        addr6->sin6_scope_id = (uint32_t)index;
-                        ESP_LOGI(TAG, "Set IPv6 scope_id to interface index: %lu", (unsigned long)addr6->sin6_scope_id);
-                    } else {
-                        ESP_LOGW(TAG, "Failed to get valid interface index for WIFI_STA_DEF");
-                    }
-                } else {
-                    ESP_LOGW(TAG, "Could not get netif handle for WIFI_STA_DEF");
-                }
+    for (int i = 0; i < conn_info->count; i++) {
+        dns_address *address = &conn_info->addresses[i];
+        bool link_local = address->addr[0] == 0xfe && (address->addr[1] & 0xc0) == 0x80;
+        if (address->family != AF_INET6 || !link_local || address->scope_id != 0) {
+            continue;
+        }
+        ESP_LOGW(TAG, "Link-local IPv6 address without scope ID - attempting to set from WiFi STA interface");
+
+        esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+        if (netif) {
+            int index = esp_netif_get_netif_impl_index(netif);
+            if (index >= 0) {
+                address->scope_id = (uint32_t)index;
+                ESP_LOGI(TAG, "Set IPv6 scope_id to interface index: %lu", (unsigned long)address->scope_id);
             } else {
-                ESP_LOGI(TAG, "Link-local IPv6 address with existing scope_id: %lu", (unsigned long)addr6->sin6_scope_id);
+                ESP_LOGW(TAG, "Failed to get valid interface index for WIFI_STA_DEF");
             }
+        } else {
+            ESP_LOGW(TAG, "Could not get netif handle for WIFI_STA_DEF");
         }
     }
 
-    // Convert resolved address to string for logging and storage
-    const void *src_addr;
-    int af = conn_info->addr_family;
-
-    if (af == AF_INET) {
-        struct sockaddr_in *addr4 = (struct sockaddr_in *)&conn_info->dest_addr;
-        src_addr = &addr4->sin_addr;
-    } else {
-        struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&conn_info->dest_addr;
-        src_addr = &addr6->sin6_addr;
-    }
+    dns_address_to_string(&conn_info->addresses[0], conn_info->host_ip, sizeof(conn_info->host_ip));
+    ESP_LOGI(TAG, "Resolved %s:%u → %s (%d address%s)", hostname, port, conn_info->host_ip, conn_info->count,
+             conn_info->count == 1 ? "" : "es");
+    return ESP_OK;
+}
 
-    if (inet_ntop(af, src_addr, conn_info->host_ip, sizeof(conn_info->host_ip)) == NULL) {
-        ESP_LOGW(TAG, "inet_ntop failed (errno: %d)", errno);
-        snprintf(conn_info->host_ip, sizeof(conn_info->host_ip), "[invalid %s addr]",
-                 (af == AF_INET) ? "IPv4" : "IPv6");
-    } else if (af == AF_INET6) {
-        struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&conn_info->dest_addr;
-        if (IN6_IS_ADDR_LINKLOCAL(&addr6->sin6_addr) && addr6->sin6_scope_id != 0) {
-            char zone[16];
-            snprintf(zone, sizeof(zone), "%%%lu", (unsigned long)addr6->sin6_scope_id);
-            strncat(conn_info->host_ip, zone,
-                    sizeof(conn_info->host_ip) - strlen(conn_info->host_ip) - 1);
-            // Ensure null termination
-            conn_info->host_ip[sizeof(conn_info->host_ip) - 1] = '\0';
-        }
+// Races the resolved addresses, conn_info then holds the connected socket and its address
+static esp_err_t connect_stratum_address(stratum_connection_info_t *conn_info, uint16_t port)
+{
+    int winner;
+    conn_info->sock = pool_connect_race(conn_info->addresses, conn_info->count, port, TRANSPORT_TIMEOUT_MS, &winner);
+    if (conn_info->sock < 0) {
+        return ESP_FAIL;
     }
-
-    ESP_LOGI(TAG, "Resolved %s:%u → %s", hostname, port, conn_info->host_ip);
-
-    freeaddrinfo(res);
+    conn_info->addr_family = conn_info->addresses[winner].family;
+    dns_address_to_string(&conn_info->addresses[winner], conn_info->host_ip, sizeof(conn_info->host_ip));
     return ESP_OK;
 }
 
-static void set_socket_options(esp_transport_handle_t transport)
+static void set_socket_options(int sock)
 {
-    int sock = esp_transport_get_socket(transport);
     if (sock >= 0) {
         // Set send and receive timeouts
         if (setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tcp_snd_timeout, sizeof(tcp_snd_timeout)) < 0) {
@@ -231,8 +259,34 @@ static void set_socket_options(esp_transport_handle_t transport)
             ESP_LOGE(TAG, "Failed to set TCP_KEEPCNT");
         }
     } else {
-        ESP_LOGE(TAG, "Failed to get socket from transport");
+        ESP_LOGE(TAG, "No socket to set options on");
+    }
+}
+
+// The transport carries on over the socket that won the race, TLS runs its handshake on it
+static esp_transport_handle_t stratum_transport_init(tls_mode tls, char * cert, stratum_connection_info_t *conn_info)
+{
+    int sock = conn_info->sock;
+    conn_info->sock = -1;
+    set_socket_options(sock);
+
+    esp_transport_handle_t transport = tls == DISABLED ? pool_connect_transport(sock) : STRATUM_V1_transport_init(tls, cert);
+    if (transport == NULL) {
+        close(sock);
+    } else if (tls != DISABLED) {
+        tls_transport_set_socket(transport, sock);
     }
+    return transport;
+}
+
+static esp_err_t stratum_transport_connect(esp_transport_handle_t transport, tls_mode tls, const char *hostname, uint16_t port,
+                                           const stratum_connection_info_t *conn_info)
+{
+    if (tls == DISABLED) {
+        return ESP_OK;
+    }
+    tls_transport_set_common_name(transport, hostname);
+    return esp_transport_connect(transport, conn_info->host_ip, port, TRANSPORT_TIMEOUT_MS);
 }
 
 bool is_wifi_connected() {
@@ -266,21 +320,74 @@ void stratum_reset_uid(GlobalState * GLOBAL_STATE)
     taskEXIT_CRITICAL(&GLOBAL_STATE->stratum_mux);
 }
 
-void stratum_close_connection(GlobalState * GLOBAL_STATE)
+// Socket of GLOBAL_STATE->transport once it is connected, -1 before. Under write_lock.
+static int transport_sock = -1;
+
+static void publish_transport_sock(GlobalState * GLOBAL_STATE, int sock)
+{
+    ShareSubmitModule * SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
+
+    xSemaphoreTake(SHARE_SUBMIT_MODULE->write_lock, portMAX_DELAY);
+    transport_sock = sock;
+    xSemaphoreGive(SHARE_SUBMIT_MODULE->write_lock);
+}
+
+// Only stratum_task closes its connection, a read in progress would use the freed TLS state
+static void close_transport(GlobalState * GLOBAL_STATE)
 {
+    ShareSubmitModule * SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
+
     ESP_LOGE(TAG, "Shutting down socket and restarting...");
+    share_submit_set_pool_ready(GLOBAL_STATE, false);
+    // A share or block candidate write in progress finishes first, later ones see the transport is gone
+    xSemaphoreTake(SHARE_SUBMIT_MODULE->write_lock, portMAX_DELAY);
     taskENTER_CRITICAL(&GLOBAL_STATE->stratum_mux);
     esp_transport_handle_t transport = GLOBAL_STATE->transport;
     GLOBAL_STATE->transport = NULL;
     taskEXIT_CRITICAL(&GLOBAL_STATE->stratum_mux);
+    transport_sock = -1;
 
     if (transport != NULL) {
         esp_transport_close(transport);
+        // Answers to requests of this connection never arrive, the standby's are still expected
+        request_table_expire(transport, esp_timer_get_time(), 0);
+        // The next connection gets a new transport
+        esp_transport_destroy(transport);
     }
+    xSemaphoreGive(SHARE_SUBMIT_MODULE->write_lock);
     cleanQueue(GLOBAL_STATE);
+}
+
+// Wake stratum_task from its read, it closes the connection and connects again
+static void stratum_wake_connection(GlobalState * GLOBAL_STATE)
+{
+    ShareSubmitModule * SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
+
+    xSemaphoreTake(SHARE_SUBMIT_MODULE->write_lock, portMAX_DELAY);
+    if (transport_sock >= 0) {
+        shutdown(transport_sock, SHUT_RDWR);
+    }
+    xSemaphoreGive(SHARE_SUBMIT_MODULE->write_lock);
+}
+
+void stratum_close_connection(GlobalState * GLOBAL_STATE)
+{
+    close_transport(GLOBAL_STATE);
     vTaskDelay(1000 / portTICK_PERIOD_MS);
 }
 
+static void reset_share_stats(GlobalState * GLOBAL_STATE)
+{
+    for (int i = 0; i < GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats_count; i++) {
+        GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats[i].count = 0;
+        GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats[i].message[0] = '\0';
+    }
+    GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats_count = 0;
+    GLOBAL_STATE->SYSTEM_MODULE.shares_accepted = 0;
+    GLOBAL_STATE->SYSTEM_MODULE.shares_rejected = 0;
+    GLOBAL_STATE->SYSTEM_MODULE.work_received = 0;
+}
+
 void stratum_primary_heartbeat(void * pvParameters)
 {
     GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
@@ -310,37 +417,42 @@ void stratum_primary_heartbeat(void * pvParameters)
             continue;
         }
        
+        if (connect_stratum_address(&conn_info, primary_stratum_port) != ESP_OK) {
+            ESP_LOGD(TAG, "Heartbeat. Failed connect check: %s:%d", primary_stratum_url, primary_stratum_port);
+            vTaskDelay(60000 / portTICK_PERIOD_MS);
+            continue;
+        }
+
         tls_mode tls = GLOBAL_STATE->SYSTEM_MODULE.pool_tls;
         char * cert = GLOBAL_STATE->SYSTEM_MODULE.pool_cert;
-        esp_transport_handle_t transport = STRATUM_V1_transport_init(tls, cert);
+        esp_transport_handle_t transport = stratum_transport_init(tls, cert, &conn_info);
         if (transport == NULL) {
             ESP_LOGD(TAG, "Heartbeat. Failed transport init check!");
             vTaskDelay(60000 / portTICK_PERIOD_MS);
             continue;
         }
 
-        if (tls != DISABLED) {
-            esp_transport_ssl_set_common_name(transport, primary_stratum_url);
-        }
-        esp_err_t err = esp_transport_connect(transport, conn_info.host_ip, primary_stratum_port, TRANSPORT_TIMEOUT_MS);
+        esp_err_t err = stratum_transport_connect(transport, tls, primary_stratum_url, primary_stratum_port, &conn_info);
         if (err != ESP_OK) {
             ESP_LOGD(TAG, "Heartbeat. Failed connect check: %s:%d (%s) (errno %d: %s)", primary_stratum_url, primary_stratum_port, conn_info.host_ip, err, strerror(err));
-            esp_transport_close(transport);
+            esp_transport_destroy(transport);
             vTaskDelay(60000 / portTICK_PERIOD_MS);
             continue;
         }
 
-        set_socket_options(transport);
-
         int send_uid = 1;
-        STRATUM_V1_subscribe(transport, send_uid++, GLOBAL_STATE->DEVICE_CONFIG.family.asic.name);
+        // A probe must not take over the session of the connection that is mining
+        STRATUM_V1_subscribe(transport, send_uid++, GLOBAL_STATE->DEVICE_CONFIG.family.asic.name, NULL);
         STRATUM_V1_authorize(transport, send_uid++, GLOBAL_STATE->SYSTEM_MODULE.pool_user, GLOBAL_STATE->SYSTEM_MODULE.pool_pass);
 
         char recv_buffer[BUFFER_SIZE];
         memset(recv_buffer, 0, BUFFER_SIZE);
         int bytes_received = esp_transport_read(transport, recv_buffer, BUFFER_SIZE - 1, TRANSPORT_TIMEOUT_MS); 
 
+        // Every probe is a new transport, a TLS one holds the whole mbedTLS context
         esp_transport_close(transport);
+        request_table_expire(transport, esp_timer_get_time(), 0);
+        esp_transport_destroy(transport);
 
         if (bytes_received == -1)  {
             vTaskDelay(60000 / portTICK_PERIOD_MS);
@@ -350,7 +462,7 @@ void stratum_primary_heartbeat(void * pvParameters)
         if (strstr(recv_buffer, "mining.notify") != NULL && !GLOBAL_STATE->SYSTEM_MODULE.use_fallback_stratum) {
             ESP_LOGI(TAG, "Heartbeat successful and in fallback mode. Switching back to primary.");
             GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback = false;
-            stratum_close_connection(GLOBAL_STATE);
+            stratum_wake_connection(GLOBAL_STATE);
             continue;
         }
 
@@ -447,9 +559,438 @@ static void decode_mining_notification(GlobalState * GLOBAL_STATE, const mining_
     free(result);
 }
 
+// Second connection to the fallback pool, kept subscribed and authorized in the
+// background so a failover only has to switch to it. Owned by the standby task
+// until stratum_task takes it over, see stratum_standby_take_over.
+typedef struct {
+    esp_transport_handle_t transport;
+    int sock;
+    line_reader_t reader;
+    char pool_connection_info[64];
+    char * extranonce_str;
+    int extranonce_2_len;
+    double difficulty;
+    uint32_t version_mask;
+    bool version_mask_set;
+    bool authorized;
+    int authorize_message_id;
+    mining_notify * latest_notify;
+    _Atomic bool ready;
+
+    bool takeover_requested;
+    SemaphoreHandle_t takeover_ack;
+    TaskHandle_t task;
+} stratum_standby;
+
+static stratum_standby standby;
+static portMUX_TYPE standby_mux = portMUX_INITIALIZER_UNLOCKED;
+static StratumApiV1Message standby_message = {};
+
+// Requests of the standby connection after its setup, its answers are matched by these ids
+static int standby_get_next_uid(GlobalState * GLOBAL_STATE)
+{
+    PoolSplitModule * POOL_SPLIT_MODULE = &GLOBAL_STATE->POOL_SPLIT_MODULE;
+    taskENTER_CRITICAL(&POOL_SPLIT_MODULE->lock);
+    int uid = POOL_SPLIT_MODULE->send_uid++;
+    taskEXIT_CRITICAL(&POOL_SPLIT_MODULE->lock);
+    return uid;
+}
+
+// Whether the standby connection also mines a share of the hashrate
+static bool standby_splits_hashrate(GlobalState * GLOBAL_STATE)
+{
+    return GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_weight > 0 && !GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback;
+}
+
+// Suggested difficulty of the active connection, it follows the measured hashrate
+static vardiff share_rate;
+
+// Hashrate mined on the active connection, the pool split sends the rest to the standby
+static float active_pool_hashrate(GlobalState * GLOBAL_STATE)
+{
+    float hashrate = GLOBAL_STATE->SYSTEM_MODULE.hashrate_1m;
+    if (standby_splits_hashrate(GLOBAL_STATE)) {
+        hashrate *= (100 - GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_weight) / 100.0f;
+    }
+    return hashrate;
+}
+
+static void suggest_difficulty_for_share_rate(GlobalState * GLOBAL_STATE, int64_t now_us)
+{
+    ShareSubmitModule * SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
+    float hashrate = active_pool_hashrate(GLOBAL_STATE);
+    uint32_t difficulty = vardiff_update(&share_rate, hashrate, GLOBAL_STATE->pool_difficulty, now_us);
+    if (difficulty > 0) {
+        ESP_LOGI(TAG, "%.1f shares/min at difficulty %.0f, suggesting difficulty %lu",
+                 vardiff_share_rate(hashrate, GLOBAL_STATE->pool_difficulty), GLOBAL_STATE->pool_difficulty, (unsigned long) difficulty);
+        // share_submit_task writes to the same transport
+        xSemaphoreTake(SHARE_SUBMIT_MODULE->write_lock, portMAX_DELAY);
+        STRATUM_V1_suggest_difficulty(GLOBAL_STATE->transport, stratum_get_next_uid(GLOBAL_STATE), difficulty);
+        xSemaphoreGive(SHARE_SUBMIT_MODULE->write_lock);
+    }
+}
+
+// Hand the standby session to create_jobs_task and share_submit_task for the pool split
+static void standby_publish_session(GlobalState * GLOBAL_STATE, bool ready)
+{
+    PoolSplitModule * POOL_SPLIT_MODULE = &GLOBAL_STATE->POOL_SPLIT_MODULE;
+    ready = ready && standby_splits_hashrate(GLOBAL_STATE);
+    if (ready && strlen(standby.extranonce_str) >= sizeof(POOL_SPLIT_MODULE->extranonce_str)) {
+        ESP_LOGW(TAG, "Hot standby: extranonce_1 too long to split hashrate with the fallback pool");
+        ready = false;
+    }
+
+    taskENTER_CRITICAL(&POOL_SPLIT_MODULE->lock);
+    POOL_SPLIT_MODULE->ready = ready;
+    POOL_SPLIT_MODULE->transport = ready ? standby.transport : NULL;
+    if (ready) {
+        strcpy(POOL_SPLIT_MODULE->extranonce_str, standby.extranonce_str);
+        POOL_SPLIT_MODULE->extranonce_2_len = standby.extranonce_2_len;
+        POOL_SPLIT_MODULE->difficulty = standby.difficulty;
+        // Without an answer to mining.configure the pool does not restrict the mask
+        POOL_SPLIT_MODULE->version_mask = standby.version_mask_set ? standby.version_mask : UINT32_MAX;
+    }
+    taskEXIT_CRITICAL(&POOL_SPLIT_MODULE->lock);
+}
+
+static void standby_close(GlobalState * GLOBAL_STATE)
+{
+    ShareSubmitModule * SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
+
+    atomic_store(&standby.ready, false);
+    // A split share write in progress finishes first, later ones see the transport is gone
+    xSemaphoreTake(SHARE_SUBMIT_MODULE->write_lock, portMAX_DELAY);
+    standby_publish_session(GLOBAL_STATE, false);
+    if (standby.transport != NULL) {
+        esp_transport_close(standby.transport);
+        request_table_expire(standby.transport, esp_timer_get_time(), 0);
+        esp_transport_destroy(standby.transport);
+        standby.transport = NULL;
+    }
+    standby.sock = -1;
+    xSemaphoreGive(SHARE_SUBMIT_MODULE->write_lock);
+    free(standby.extranonce_str);
+    standby.extranonce_str = NULL;
+    if (standby.latest_notify != NULL) {
+        STRATUM_V1_free_mining_notify(standby.latest_notify);
+        standby.latest_notify = NULL;
+    }
+    standby.authorized = false;
+    standby.version_mask_set = false;
+    if (standby.reader.buffer != NULL) {
+        line_reader_reset(&standby.reader);
+    }
+}
+
+static bool standby_connect(GlobalState * GLOBAL_STATE)
+{
+    SystemModule * SYSTEM_MODULE = &GLOBAL_STATE->SYSTEM_MODULE;
+
+    stratum_connection_info_t conn_info;
+    if (resolve_stratum_address(SYSTEM_MODULE->fallback_pool_url, SYSTEM_MODULE->fallback_pool_port, &conn_info) != ESP_OK) {
+        ESP_LOGW(TAG, "Hot standby: address resolution failed for %s", SYSTEM_MODULE->fallback_pool_url);
+        return false;
+    }
+
+    if (connect_stratum_address(&conn_info, SYSTEM_MODULE->fallback_pool_port) != ESP_OK) {
+        ESP_LOGW(TAG, "Hot standby: no address of %s:%d answered", SYSTEM_MODULE->fallback_pool_url, SYSTEM_MODULE->fallback_pool_port);
+        return false;
+    }
+
+    tls_mode tls = SYSTEM_MODULE->fallback_pool_tls;
+    int sock = conn_info.sock;
+    standby.transport = stratum_transport_init(tls, SYSTEM_MODULE->fallback_pool_cert, &conn_info);
+    if (standby.transport == NULL) {
+        ESP_LOGW(TAG, "Hot standby: transport initialization failed");
+        return false;
+    }
+    esp_err_t ret = stratum_transport_connect(standby.transport, tls, SYSTEM_MODULE->fallback_pool_url, SYSTEM_MODULE->fallback_pool_port, &conn_info);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Hot standby: unable to connect to %s:%d (errno %d)", SYSTEM_MODULE->fallback_pool_url, SYSTEM_MODULE->fallback_pool_port, ret);
+        standby_close(GLOBAL_STATE);
+        return false;
+    }
+    standby.sock = sock;
+
+    if (standby.reader.buffer == NULL && line_reader_init(&standby.reader, STRATUM_LINE_BUFFER_SIZE) != ESP_OK) {
+        ESP_LOGE(TAG, "Hot standby: failed to allocate receive buffer");
+        standby_close(GLOBAL_STATE);
+        return false;
+    }
+
+    snprintf(standby.pool_connection_info, sizeof(standby.pool_connection_info), "%s%s",
+             conn_info.addr_family == AF_INET6 ? "IPv6" : "IPv4",
+             tls == DISABLED ? "" : (tls == CUSTOM_CRT ? " (TLS Cert)" : " (TLS)"));
+    standby.difficulty = GLOBAL_STATE->pool_difficulty;
+
+    // Same setup ids as the main connection, the parser tells setup results apart by id.
+    // Later requests count on from 5, the parser takes answers to lower ids for setup results.
+    taskENTER_CRITICAL(&GLOBAL_STATE->POOL_SPLIT_MODULE.lock);
+    GLOBAL_STATE->POOL_SPLIT_MODULE.send_uid = 5;
+    taskEXIT_CRITICAL(&GLOBAL_STATE->POOL_SPLIT_MODULE.lock);
+    STRATUM_V1_configure_version_rolling(standby.transport, STRATUM_ID_CONFIGURE, NULL);
+    STRATUM_V1_subscribe(standby.transport, STRATUM_ID_SUBSCRIBE, GLOBAL_STATE->DEVICE_CONFIG.family.asic.name, NULL);
+    standby.authorize_message_id = STRATUM_ID_SUBSCRIBE + 1;
+    STRATUM_V1_authorize(standby.transport, standby.authorize_message_id, SYSTEM_MODULE->fallback_pool_user, SYSTEM_MODULE->fallback_pool_pass);
+
+    ESP_LOGI(TAG, "Hot standby connected to %s:%d (%s)", SYSTEM_MODULE->fallback_pool_url, SYSTEM_MODULE->fallback_pool_port, conn_info.host_ip);
+    return true;
+}
+
+// Returns false if the standby connection has to be dropped
+static bool standby_handle_line(GlobalState * GLOBAL_STATE, const char * line)
+{
+    ShareSubmitModule * SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
+    int64_t receive_time_us = esp_timer_get_time();
+    bool keep = true;
+
+    STRATUM_V1_parse(&standby_message, line);
+
+    stratum_method message_method = standby_message.method;
+    request_method method;
+    float response_time_ms;
+    bool new_work = false;
+    if (message_method == STRATUM_RESULT || message_method == STRATUM_RESULT_SETUP) {
+        bool in_flight = request_table_complete(standby.transport, standby_message.message_id, standby_message.response_success, receive_time_us, &method, &response_time_ms);
+        // Shares mined for the fallback pool while the hashrate is split
+        if (in_flight && method == REQUEST_SUBMIT) {
+            pool_split_record_share(&GLOBAL_STATE->POOL_SPLIT_MODULE.scheduler, POOL_FALLBACK, standby.difficulty, standby_message.response_success);
+            if (standby_message.response_success) {
+                SYSTEM_notify_accepted_share(GLOBAL_STATE);
+            } else {
+                ESP_LOGW(TAG, "Fallback pool rejected share: %s", standby_message.error_str);
+                SYSTEM_notify_rejected_share(GLOBAL_STATE, standby_message.error_str);
+            }
+        }
+    } else if (message_method == STRATUM_RESULT_VERSION_MASK || message_method == STRATUM_RESULT_SUBSCRIBE) {
+        request_table_complete(standby.transport, standby_message.message_id, true, receive_time_us, &method, &response_time_ms);
+    }
+
+    // A notify the parser rejected comes without work
+    if (message_method == MINING_NOTIFY && standby_message.mining_notification != NULL) {
+        // Only the newest work is kept, it is what mining continues with after a takeover
+        if (standby.latest_notify != NULL) {
+            STRATUM_V1_free_mining_notify(standby.latest_notify);
+        }
+        standby.latest_notify = standby_message.mining_notification;
+        standby_message.mining_notification = NULL;
+        standby.latest_notify->received_us = receive_time_us;
+        new_work = true;
+    } else if (message_method == MINING_SET_DIFFICULTY) {
+        standby.difficulty = standby_message.new_difficulty;
+    } else if (message_method == MINING_SET_VERSION_MASK || message_method == STRATUM_RESULT_VERSION_MASK) {
+        standby.version_mask = standby_message.version_mask;
+        standby.version_mask_set = true;
+    } else if (message_method == MINING_SET_EXTRANONCE || message_method == STRATUM_RESULT_SUBSCRIBE) {
+        if (standby_message.extranonce_2_len > MAX_EXTRANONCE_2_LEN) {
+            standby_message.extranonce_2_len = MAX_EXTRANONCE_2_LEN;
+        }
+        free(standby.extranonce_str);
+        standby.extranonce_str = standby_message.extranonce_str;
+        standby_message.extranonce_str = NULL;
+        standby.extranonce_2_len = standby_message.extranonce_2_len;
+    } else if (message_method == MINING_PING) {
+        xSemaphoreTake(SHARE_SUBMIT_MODULE->write_lock, portMAX_DELAY);
+        STRATUM_V1_pong(standby.transport, standby_message.message_id);
+        xSemaphoreGive(SHARE_SUBMIT_MODULE->write_lock);
+    } else if (message_method == CLIENT_RECONNECT) {
+        ESP_LOGI(TAG, "Hot standby: pool requested a reconnect");
+        keep = false;
+    } else if (message_method == STRATUM_RESULT_SETUP && standby_message.message_id == standby.authorize_message_id) {
+        if (standby_message.response_success) {
+            standby.authorized = true;
+            // Split shares are written to the standby transport by share_submit_task
+            xSemaphoreTake(SHARE_SUBMIT_MODULE->write_lock, portMAX_DELAY);
+            if (GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_difficulty > 0) {
+                STRATUM_V1_suggest_difficulty(standby.transport, standby_get_next_uid(GLOBAL_STATE), GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_difficulty);
+            }
+            if (GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_extranonce_subscribe) {
+                STRATUM_V1_extranonce_subscribe(standby.transport, standby_get_next_uid(GLOBAL_STATE));
+            }
+            xSemaphoreGive(SHARE_SUBMIT_MODULE->write_lock);
+        } else {
+            ESP_LOGW(TAG, "Hot standby: authorization rejected: %s", standby_message.error_str);
+            keep = false;
+        }
+    }
+    STRATUM_V1_reset_message(&standby_message);
+
+    bool ready = keep && standby.authorized && standby.latest_notify != NULL && standby.extranonce_str != NULL;
+    bool was_ready = atomic_load(&standby.ready);
+    if (ready && !was_ready) {
+        ESP_LOGI(TAG, "Hot standby ready on %s", GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_url);
+    }
+    atomic_store(&standby.ready, ready);
+
+    // With a weight the fallback pool is mined alongside the primary, its work
+    // goes to create_jobs_task like the primary's. The copy is owned by the queue,
+    // latest_notify stays with the standby for a takeover.
+    standby_publish_session(GLOBAL_STATE, ready);
+    if (ready && (new_work || !was_ready) && standby_splits_hashrate(GLOBAL_STATE)) {
+        mining_notify * split_notify = mining_notify_copy(standby.latest_notify);
+        if (split_notify == NULL) {
+            ESP_LOGE(TAG, "Hot standby: failed to copy work for the pool split");
+        } else {
+            queue_enqueue_latest(&GLOBAL_STATE->POOL_SPLIT_MODULE.queue, split_notify);
+        }
+    }
+    return keep;
+}
+
+static void standby_check_takeover(void)
+{
+    taskENTER_CRITICAL(&standby_mux);
+    bool requested = standby.takeover_requested;
+    standby.takeover_requested = false;
+    taskEXIT_CRITICAL(&standby_mux);
+
+    if (requested) {
+        xSemaphoreGive(standby.takeover_ack);
+        // Parked while stratum_task takes the connection over or leaves it
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+static void stratum_standby_task(void * pvParameters)
+{
+    GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
+    SystemModule * SYSTEM_MODULE = &GLOBAL_STATE->SYSTEM_MODULE;
+    int64_t next_attempt_us = 0;
+
+    ESP_LOGI(TAG, "Starting hot standby for fallback pool: %s:%d", SYSTEM_MODULE->fallback_pool_url, SYSTEM_MODULE->fallback_pool_port);
+
+    while (1) {
+        standby_check_takeover();
+
+        // Only needed while mining on the primary
+        if (SYSTEM_MODULE->is_using_fallback || !GLOBAL_STATE->ASIC_initalized) {
+            if (standby.transport != NULL) {
+                ESP_LOGI(TAG, "Hot standby no longer needed, disconnecting");
+                standby_close(GLOBAL_STATE);
+            }
+            vTaskDelay(STANDBY_POLL_MS / portTICK_PERIOD_MS);
+            continue;
+        }
+
+        if (standby.transport == NULL) {
+            if (esp_timer_get_time() < next_attempt_us || !is_wifi_connected()) {
+                vTaskDelay(STANDBY_POLL_MS / portTICK_PERIOD_MS);
+                continue;
+            }
+            if (!standby_connect(GLOBAL_STATE)) {
+                next_attempt_us = esp_timer_get_time() + STANDBY_RETRY_MS * 1000LL;
+                continue;
+            }
+        }
+
+        bool timed_out;
+        const char * line = STRATUM_V1_receive_jsonrpc_line_timeout(&standby.reader, standby.transport, STANDBY_POLL_MS, &timed_out);
+        if (line == NULL && timed_out) {
+            continue;
+        }
+        if (line == NULL || !standby_handle_line(GLOBAL_STATE, line)) {
+            ESP_LOGW(TAG, "Hot standby connection lost, retrying in %d s", STANDBY_RETRY_MS / 1000);
+            standby_close(GLOBAL_STATE);
+            next_attempt_us = esp_timer_get_time() + STANDBY_RETRY_MS * 1000LL;
+        }
+    }
+}
+
+// The hot standby is authorized and has work, mining moves to it once the primary is lost
+static bool standby_can_take_over(GlobalState * GLOBAL_STATE)
+{
+    return atomic_load(&standby.ready) && !GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback;
+}
+
+// Switch mining to the standby connection of the fallback pool, false if it is not ready
+static bool stratum_standby_take_over(GlobalState * GLOBAL_STATE)
+{
+    if (standby.task == NULL || !atomic_load(&standby.ready)) {
+        return false;
+    }
+
+    taskENTER_CRITICAL(&standby_mux);
+    standby.takeover_requested = true;
+    taskEXIT_CRITICAL(&standby_mux);
+
+    if (xSemaphoreTake(standby.takeover_ack, STANDBY_TAKEOVER_TIMEOUT_MS / portTICK_PERIOD_MS) != pdTRUE) {
+        taskENTER_CRITICAL(&standby_mux);
+        bool seen = !standby.takeover_requested;
+        standby.takeover_requested = false;
+        taskEXIT_CRITICAL(&standby_mux);
+        if (!seen) {
+            return false;
+        }
+        // The standby task picked the request up just now, it is about to park
+        xSemaphoreTake(standby.takeover_ack, portMAX_DELAY);
+    }
+
+    // The standby task is parked, its connection can be moved over
+    bool ready = atomic_load(&standby.ready);
+    if (ready) {
+        SystemModule * SYSTEM_MODULE = &GLOBAL_STATE->SYSTEM_MODULE;
+
+        // It stops being the second pool of the pool split and becomes the only one
+        standby_publish_session(GLOBAL_STATE, false);
+
+        SYSTEM_MODULE->is_using_fallback = true;
+        reset_share_stats(GLOBAL_STATE);
+        strcpy(SYSTEM_MODULE->pool_connection_info, standby.pool_connection_info);
+
+        // Its ids count on, requests of the standby may still be waiting for an answer
+        taskENTER_CRITICAL(&GLOBAL_STATE->POOL_SPLIT_MODULE.lock);
+        int send_uid = GLOBAL_STATE->POOL_SPLIT_MODULE.send_uid;
+        taskEXIT_CRITICAL(&GLOBAL_STATE->POOL_SPLIT_MODULE.lock);
+        taskENTER_CRITICAL(&GLOBAL_STATE->stratum_mux);
+        GLOBAL_STATE->transport = standby.transport;
+        GLOBAL_STATE->send_uid = send_uid;
+        taskEXIT_CRITICAL(&GLOBAL_STATE->stratum_mux);
+        publish_transport_sock(GLOBAL_STATE, standby.sock);
+        STRATUM_V1_adopt_line_reader(&standby.reader);
+
+        char * old_extranonce_str = GLOBAL_STATE->extranonce_str;
+        GLOBAL_STATE->extranonce_str = standby.extranonce_str;
+        GLOBAL_STATE->extranonce_2_len = standby.extranonce_2_len;
+        free(old_extranonce_str);
+        GLOBAL_STATE->pool_difficulty = standby.difficulty;
+        GLOBAL_STATE->new_set_mining_difficulty_msg = true;
+        if (standby.version_mask_set) {
+            GLOBAL_STATE->version_mask = standby.version_mask;
+            GLOBAL_STATE->new_stratum_version_rolling_msg = true;
+        }
+
+        share_submit_set_session(GLOBAL_STATE,
+                                 share_buffer_pool_id(SYSTEM_MODULE->fallback_pool_url, SYSTEM_MODULE->fallback_pool_port, SYSTEM_MODULE->fallback_pool_user),
+                                 GLOBAL_STATE->extranonce_str);
+        share_submit_set_pool_ready(GLOBAL_STATE, true);
+
+        // Jobs of the primary can not be submitted here, start over on the standby's newest work
+        mining_notify * notify = standby.latest_notify;
+        notify->clean_jobs = true;
+        notify->received_us = esp_timer_get_time();
+        SYSTEM_MODULE->work_received++;
+        share_submit_notify_work(GLOBAL_STATE, notify, true);
+        nonce_filter_request_reset(&GLOBAL_STATE->ASIC_TASK_MODULE.duplicate_filter);
+        queue_enqueue_latest(&GLOBAL_STATE->stratum_queue, notify);
+        decode_mining_notification(GLOBAL_STATE, notify);
+
+        standby.transport = NULL;
+        standby.sock = -1;
+        standby.extranonce_str = NULL;
+        standby.latest_notify = NULL;
+        standby.authorized = false;
+        standby.version_mask_set = false;
+        atomic_store(&standby.ready, false);
+    }
+
+    xTaskNotifyGive(standby.task);
+    return ready;
+}
+
 void stratum_task(void * pvParameters)
 {
     GlobalState * GLOBAL_STATE = (GlobalState *) pvParameters;
+    ShareSubmitModule * SHARE_SUBMIT_MODULE = &GLOBAL_STATE->SHARE_SUBMIT_MODULE;
 
     primary_stratum_url = GLOBAL_STATE->SYSTEM_MODULE.pool_url;
     primary_stratum_port = GLOBAL_STATE->SYSTEM_MODULE.pool_port;
@@ -461,9 +1002,19 @@ void stratum_task(void * pvParameters)
     STRATUM_V1_initialize_buffer();
     int retry_attempts = 0;
     int retry_critical_attempts = 0;
+    int64_t connection_lost_us = 0;
 
     xTaskCreateWithCaps(stratum_primary_heartbeat, "stratum primary heartbeat", 8192, pvParameters, 1, NULL, MALLOC_CAP_SPIRAM);
 
+    // The standby connection is also what the pool split mines the fallback pool on
+    bool standby_enabled = GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_hot_standby || GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_weight > 0;
+    if (standby_enabled && GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_url != NULL &&
+        GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_url[0] != '\0') {
+        standby.sock = -1;
+        standby.takeover_ack = xSemaphoreCreateBinary();
+        xTaskCreateWithCaps(stratum_standby_task, "stratum standby", 8192, pvParameters, 5, &standby.task, MALLOC_CAP_SPIRAM);
+    }
+
     ESP_LOGI(TAG, "Opening connection to pool: %s:%d", stratum_url, port);
     while (1) {
         if (!GLOBAL_STATE->ASIC_initalized) {
@@ -477,6 +1028,12 @@ void stratum_task(void * pvParameters)
             continue;
         }
 
+        // No retries of the primary with a hot standby, a blackholed one would cost a connect timeout each
+        bool took_over = retry_attempts > 0 && standby_can_take_over(GLOBAL_STATE) && stratum_standby_take_over(GLOBAL_STATE);
+        if (took_over) {
+            retry_attempts = 0;
+        }
+
         if (retry_attempts >= MAX_RETRY_ATTEMPTS)
         {
             if (GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_url == NULL || GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_url[0] == '\0') {
@@ -489,14 +1046,7 @@ void stratum_task(void * pvParameters)
             GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback = !GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback;
             
             // Reset share stats at failover
-            for (int i = 0; i < GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats_count; i++) {
-                GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats[i].count = 0;
-                GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats[i].message[0] = '\0';
-            }
-            GLOBAL_STATE->SYSTEM_MODULE.rejected_reason_stats_count = 0;
-            GLOBAL_STATE->SYSTEM_MODULE.shares_accepted = 0;
-            GLOBAL_STATE->SYSTEM_MODULE.shares_rejected = 0;
-            GLOBAL_STATE->SYSTEM_MODULE.work_received = 0;
+            reset_share_stats(GLOBAL_STATE);
 
             ESP_LOGI(TAG, "Switching target due to too many failures (retries: %d)...", retry_attempts);
             retry_attempts = 0;
@@ -505,95 +1055,134 @@ void stratum_task(void * pvParameters)
         stratum_url = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_url : GLOBAL_STATE->SYSTEM_MODULE.pool_url;
         port = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_port : GLOBAL_STATE->SYSTEM_MODULE.pool_port;
 
-        stratum_connection_info_t conn_info;
-        if (resolve_stratum_address(stratum_url, port, &conn_info) != ESP_OK) {
-            ESP_LOGE(TAG, "Address resolution failed for %s", stratum_url);
-            retry_attempts++;
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
-            continue;
-        }
-
-        ESP_LOGI(TAG, "Connecting to: stratum+tcp://%s:%d (%s)", stratum_url, port, conn_info.host_ip);
+        char * username = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_user : GLOBAL_STATE->SYSTEM_MODULE.pool_user;
+        int authorize_message_id = -1;
+        // Buffered shares wait for the first notify after authorization, it tells whether their block is still current
+        bool replay_pending = false;
+        // Difficulty suggestions only go out once authorized, like the first one
+        bool authorized = took_over;
+
+        // The hot standby is already subscribed and authorized, mining continues on its latest notify
+        if (took_over) {
+            ESP_LOGI(TAG, "Switched to hot standby %s:%d in %lld ms", stratum_url, port,
+                     (esp_timer_get_time() - connection_lost_us) / 1000);
+            connection_lost_us = 0;
+        } else {
+            stratum_connection_info_t conn_info;
+            if (resolve_stratum_address(stratum_url, port, &conn_info) != ESP_OK) {
+                ESP_LOGE(TAG, "Address resolution failed for %s", stratum_url);
+                retry_attempts++;
+                if (!standby_can_take_over(GLOBAL_STATE)) {
+                    vTaskDelay(1000 / portTICK_PERIOD_MS);
+                }
+                continue;
+            }
 
-        tls_mode tls = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_tls : GLOBAL_STATE->SYSTEM_MODULE.pool_tls;
-        char * cert = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_cert : GLOBAL_STATE->SYSTEM_MODULE.pool_cert;
-        retry_critical_attempts = 0;
+            ESP_LOGI(TAG, "Connecting to: stratum+tcp://%s:%d (%s)", stratum_url, port, conn_info.host_ip);
+            if (connect_stratum_address(&conn_info, port) != ESP_OK) {
+                retry_attempts ++;
+                ESP_LOGE(TAG, "No address of %s:%d answered. Attempt: %d", stratum_url, port, retry_attempts);
+                if (!standby_can_take_over(GLOBAL_STATE)) {
+                    vTaskDelay(5000 / portTICK_PERIOD_MS);
+                }
+                continue;
+            }
 
-        GLOBAL_STATE->transport = STRATUM_V1_transport_init(tls, cert);
-        // Check if transport was initialized
-        if(GLOBAL_STATE->transport == NULL) {
-            ESP_LOGE(TAG, "Transport initialization failed.");
-            if (++retry_critical_attempts > MAX_CRITICAL_RETRY_ATTEMPTS) {
-                ESP_LOGE(TAG, "Max retry attempts reached, restarting...");
-                esp_restart();
+            tls_mode tls = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_tls : GLOBAL_STATE->SYSTEM_MODULE.pool_tls;
+            char * cert = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_cert : GLOBAL_STATE->SYSTEM_MODULE.pool_cert;
+            retry_critical_attempts = 0;
+
+            int sock = conn_info.sock;
+            GLOBAL_STATE->transport = stratum_transport_init(tls, cert, &conn_info);
+            // Check if transport was initialized
+            if(GLOBAL_STATE->transport == NULL) {
+                ESP_LOGE(TAG, "Transport initialization failed.");
+                if (++retry_critical_attempts > MAX_CRITICAL_RETRY_ATTEMPTS) {
+                    ESP_LOGE(TAG, "Max retry attempts reached, restarting...");
+                    esp_restart();
+                }
+                vTaskDelay(5000 / portTICK_PERIOD_MS);
+                continue;
             }
-            vTaskDelay(5000 / portTICK_PERIOD_MS);
-            continue;
-        }
-        retry_critical_attempts = 0;
-
-        // Use the already-resolved IP to avoid a second DNS lookup inside esp_transport_connect.
-        // This prevents long DNS timeouts from blocking the lwIP stack and starving the HTTP server.
-        if (tls != DISABLED) {
-            esp_transport_ssl_set_common_name(GLOBAL_STATE->transport, stratum_url);
-        }
-        ESP_LOGI(TAG, "Transport initialized, connecting to %s:%d (%s)", stratum_url, port, conn_info.host_ip);
-        esp_err_t ret = esp_transport_connect(GLOBAL_STATE->transport, conn_info.host_ip, port, TRANSPORT_TIMEOUT_MS);
-        if (ret != ESP_OK) {
-            retry_attempts ++;
-            ESP_LOGE(TAG, "Transport unable to connect to %s:%d (errno %d). Attempt: %d", stratum_url, port, ret, retry_attempts);
-            // close the transport
-            esp_transport_close(GLOBAL_STATE->transport);
-            // instead of restarting, retry this every 5 seconds
-            vTaskDelay(5000 / portTICK_PERIOD_MS);
-            continue;
-        }
+            retry_critical_attempts = 0;
+
+            // Use the already-resolved IP to avoid a second DNS lookup inside esp_transport_connect.
+            // This prevents long DNS timeouts from blocking the lwIP stack and starving the HTTP server.
+            ESP_LOGI(TAG, "Transport initialized, connecting to %s:%d (%s)", stratum_url, port, conn_info.host_ip);
+            esp_err_t ret = stratum_transport_connect(GLOBAL_STATE->transport, tls, stratum_url, port, &conn_info);
+            if (ret != ESP_OK) {
+                retry_attempts ++;
+                ESP_LOGE(TAG, "Transport unable to connect to %s:%d (errno %d). Attempt: %d", stratum_url, port, ret, retry_attempts);
+                // destroy the transport, the next attempt makes a new one
+                esp_transport_destroy(GLOBAL_STATE->transport);
+                GLOBAL_STATE->transport = NULL;
+                // instead of restarting, retry this every 5 seconds
+                if (!standby_can_take_over(GLOBAL_STATE)) {
+                    vTaskDelay(5000 / portTICK_PERIOD_MS);
+                }
+                continue;
+            }
+            publish_transport_sock(GLOBAL_STATE, sock);
 
-        set_socket_options(GLOBAL_STATE->transport);
+            const char* protocol = (conn_info.addr_family == AF_INET6) ? "IPv6" : "IPv4";
+            const char *tls_status;
 
-        const char* protocol = (conn_info.addr_family == AF_INET6) ? "IPv6" : "IPv4";
-        const char *tls_status;
+            switch (tls) {
+                case DISABLED:     tls_status = ""; break;
+                case BUNDLED_CRT:  tls_status = " (TLS)"; break;
+                case CUSTOM_CRT:   tls_status = " (TLS Cert)"; break;
+                default:           tls_status = ""; break;
+            }
 
-        switch (tls) {
-            case DISABLED:     tls_status = ""; break;
-            case BUNDLED_CRT:  tls_status = " (TLS)"; break;
-            case CUSTOM_CRT:   tls_status = " (TLS Cert)"; break;
-            default:           tls_status = ""; break;
-        }
+            snprintf(GLOBAL_STATE->SYSTEM_MODULE.pool_connection_info,
+                     sizeof(GLOBAL_STATE->SYSTEM_MODULE.pool_connection_info),
+                     "%s%s", protocol, tls_status);        
 
-        snprintf(GLOBAL_STATE->SYSTEM_MODULE.pool_connection_info,
-                 sizeof(GLOBAL_STATE->SYSTEM_MODULE.pool_connection_info),
-                 "%s%s", protocol, tls_status);        
+            stratum_reset_uid(GLOBAL_STATE);
+            cleanQueue(GLOBAL_STATE);
 
-        stratum_reset_uid(GLOBAL_STATE);
-        cleanQueue(GLOBAL_STATE);
+            ///// Start Stratum Action
+            // mining.configure - ID: 1
+            STRATUM_V1_configure_version_rolling(GLOBAL_STATE->transport, stratum_get_next_uid(GLOBAL_STATE), &GLOBAL_STATE->version_mask);
 
-        ///// Start Stratum Action
-        // mining.configure - ID: 1
-        STRATUM_V1_configure_version_rolling(GLOBAL_STATE->transport, stratum_get_next_uid(GLOBAL_STATE), &GLOBAL_STATE->version_mask);
+            // Back on the pool of the last session, ask to resume it so buffered shares can be replayed
+            char session[MAX_EXTRANONCE_1_LEN * 2 + 1];
+            if (share_submit_get_session(GLOBAL_STATE, share_buffer_pool_id(stratum_url, port, username), session)) {
+                ESP_LOGI(TAG, "Resuming session %s", session);
+            }
 
-        // mining.subscribe - ID: 2
-        STRATUM_V1_subscribe(GLOBAL_STATE->transport, stratum_get_next_uid(GLOBAL_STATE), GLOBAL_STATE->DEVICE_CONFIG.family.asic.name);
+            // mining.subscribe - ID: 2
+            STRATUM_V1_subscribe(GLOBAL_STATE->transport, stratum_get_next_uid(GLOBAL_STATE), GLOBAL_STATE->DEVICE_CONFIG.family.asic.name, session);
 
-        char * username = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_user : GLOBAL_STATE->SYSTEM_MODULE.pool_user;
-        char * password = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_pass : GLOBAL_STATE->SYSTEM_MODULE.pool_pass;
+            char * password = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_pass : GLOBAL_STATE->SYSTEM_MODULE.pool_pass;
 
-        int authorize_message_id = stratum_get_next_uid(GLOBAL_STATE);
+            authorize_message_id = stratum_get_next_uid(GLOBAL_STATE);
+
+            //mining.authorize - ID: 3
+            STRATUM_V1_authorize(GLOBAL_STATE->transport, authorize_message_id, username, password);
+        }
 
-        //mining.authorize - ID: 3
-        STRATUM_V1_authorize(GLOBAL_STATE->transport, authorize_message_id, username, password);
+        vardiff_init(&share_rate, GLOBAL_STATE->SYSTEM_MODULE.shares_per_minute,
+                     GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_difficulty : GLOBAL_STATE->SYSTEM_MODULE.pool_difficulty);
 
         while (1) {
-            char * line = STRATUM_V1_receive_jsonrpc_line(GLOBAL_STATE->transport);
+            const char * line = STRATUM_V1_receive_jsonrpc_line(GLOBAL_STATE->transport);
             if (!line) {
                 ESP_LOGE(TAG, "Failed to receive JSON-RPC line, reconnecting...");
                 retry_attempts++;
-                stratum_close_connection(GLOBAL_STATE);
+                if (connection_lost_us == 0) {
+                    connection_lost_us = esp_timer_get_time();
+                }
+                if (standby_can_take_over(GLOBAL_STATE)) {
+                    // No reconnect backoff, the hot standby takes over right away
+                    close_transport(GLOBAL_STATE);
+                } else {
+                    stratum_close_connection(GLOBAL_STATE);
+                }
                 break;
             }
 
             if (!GLOBAL_STATE->ASIC_initalized) {
-                free(line);
                 ESP_LOGI(TAG, "Mining paused, disconnecting from pool");
                 retry_attempts = 0;
                 stratum_close_connection(GLOBAL_STATE);
@@ -602,23 +1191,50 @@ void stratum_task(void * pvParameters)
 
             int64_t receive_time_us = esp_timer_get_time();
 
+            int timed_out = request_table_expire(NULL, receive_time_us, REQUEST_TIMEOUT_MS * 1000LL);
+            if (timed_out > 0) {
+                ESP_LOGW(TAG, "%d request(s) got no answer within %d ms", timed_out, REQUEST_TIMEOUT_MS);
+            }
+
             STRATUM_V1_parse(&stratum_api_v1_message, line);
-            free(line);
 
-            if (stratum_api_v1_message.method == MINING_NOTIFY) {
+            // Match answers to their request, for the response time and the per-method histograms
+            stratum_method message_method = stratum_api_v1_message.method;
+            request_method method = REQUEST_METHOD_COUNT;
+            float response_time_ms = 0;
+            bool in_flight = false;
+            if (message_method == STRATUM_RESULT || message_method == STRATUM_RESULT_SETUP) {
+                in_flight = request_table_complete(GLOBAL_STATE->transport, stratum_api_v1_message.message_id, stratum_api_v1_message.response_success,
+                                                   receive_time_us, &method, &response_time_ms);
+            } else if (message_method == STRATUM_RESULT_VERSION_MASK || message_method == STRATUM_RESULT_SUBSCRIBE) {
+                in_flight = request_table_complete(GLOBAL_STATE->transport, stratum_api_v1_message.message_id, true, receive_time_us, &method, &response_time_ms);
+            }
+
+            // A notify the parser rejected comes without work
+            if (stratum_api_v1_message.method == MINING_NOTIFY && stratum_api_v1_message.mining_notification != NULL) {
                 GLOBAL_STATE->SYSTEM_MODULE.work_received++;
                 SYSTEM_notify_new_ntime(GLOBAL_STATE, stratum_api_v1_message.mining_notification->ntime);
+                stratum_api_v1_message.mining_notification->received_us = receive_time_us;
+                share_submit_notify_work(GLOBAL_STATE, stratum_api_v1_message.mining_notification, replay_pending);
+                replay_pending = false;
+                if (stratum_api_v1_message.mining_notification->clean_jobs) {
+                    nonce_filter_request_reset(&GLOBAL_STATE->ASIC_TASK_MODULE.duplicate_filter);
+                }
                 if (stratum_api_v1_message.mining_notification->clean_jobs &&
-                    (GLOBAL_STATE->stratum_queue.count > 0)) {
+                    (queue_count(&GLOBAL_STATE->stratum_queue) > 0)) {
                     cleanQueue(GLOBAL_STATE);
                 }
-                if (GLOBAL_STATE->stratum_queue.count == QUEUE_SIZE) {
-                    mining_notify * next_notify_json_str = (mining_notify *) queue_dequeue(&GLOBAL_STATE->stratum_queue);
-                    STRATUM_V1_free_mining_notify(next_notify_json_str);
+                // Latest wins, work still waiting in the queue is stale now
+                int coalesced = queue_enqueue_latest(&GLOBAL_STATE->stratum_queue, stratum_api_v1_message.mining_notification);
+                if (coalesced > 0) {
+                    ESP_LOGI(TAG, "Replaced %d pending notifies, %lu in total", coalesced,
+                             (unsigned long) queue_get_coalesced(&GLOBAL_STATE->stratum_queue));
                 }
-                queue_enqueue(&GLOBAL_STATE->stratum_queue, stratum_api_v1_message.mining_notification);
                 decode_mining_notification(GLOBAL_STATE, stratum_api_v1_message.mining_notification);
                 stratum_api_v1_message.mining_notification = NULL;
+                if (authorized) {
+                    suggest_difficulty_for_share_rate(GLOBAL_STATE, receive_time_us);
+                }
             } else if (stratum_api_v1_message.method == MINING_SET_DIFFICULTY) {
                 ESP_LOGI(TAG, "Set pool difficulty: %.2f", stratum_api_v1_message.new_difficulty);
                 GLOBAL_STATE->pool_difficulty = stratum_api_v1_message.new_difficulty;
@@ -642,39 +1258,64 @@ void stratum_task(void * pvParameters)
                 stratum_api_v1_message.extranonce_str = NULL;
                 GLOBAL_STATE->extranonce_2_len = stratum_api_v1_message.extranonce_2_len;
                 free(old_extranonce_str);
+                share_submit_set_session(GLOBAL_STATE, share_buffer_pool_id(stratum_url, port, username), GLOBAL_STATE->extranonce_str);
             } else if (stratum_api_v1_message.method == MINING_PING) { 
+                xSemaphoreTake(SHARE_SUBMIT_MODULE->write_lock, portMAX_DELAY);
                 STRATUM_V1_pong(GLOBAL_STATE->transport, stratum_api_v1_message.message_id);
+                xSemaphoreGive(SHARE_SUBMIT_MODULE->write_lock);
             } else if (stratum_api_v1_message.method == CLIENT_RECONNECT) {
                 ESP_LOGE(TAG, "Pool requested client reconnect...");
                 stratum_close_connection(GLOBAL_STATE);
                 break;
             } else if (stratum_api_v1_message.method == STRATUM_RESULT) {
-                float response_time_ms = STRATUM_V1_get_response_time_ms(stratum_api_v1_message.message_id, receive_time_us);
+                // Only answers to shares count as accepted or rejected, not to suggest_difficulty and the like
+                bool share_result = in_flight && method == REQUEST_SUBMIT;
                 if (stratum_api_v1_message.response_success) {
                     ESP_LOGI(TAG, "message result accepted");
-                    if (response_time_ms >= 0) {
+                    if (share_result) {
                         ESP_LOGI(TAG, "Stratum response time: %.1f ms", response_time_ms);
                         GLOBAL_STATE->SYSTEM_MODULE.response_time = response_time_ms;
                         SYSTEM_notify_accepted_share(GLOBAL_STATE);
                     }
                 } else {
                     ESP_LOGW(TAG, "message result rejected: %s", stratum_api_v1_message.error_str);
-                    if (response_time_ms >= 0) {
+                    if (share_result) {
                         SYSTEM_notify_rejected_share(GLOBAL_STATE, stratum_api_v1_message.error_str);
                     }
                 }
+                if (share_result) {
+                    int pool = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? POOL_FALLBACK : POOL_PRIMARY;
+                    pool_split_record_share(&GLOBAL_STATE->POOL_SPLIT_MODULE.scheduler, pool, GLOBAL_STATE->pool_difficulty,
+                                            stratum_api_v1_message.response_success);
+                }
             } else if (stratum_api_v1_message.method == STRATUM_RESULT_SETUP) {
                 // Reset retry attempts after successfully receiving data.
                 retry_attempts = 0;
+                connection_lost_us = 0;
                 if (stratum_api_v1_message.response_success) {
                     ESP_LOGI(TAG, "setup message accepted");
                     uint16_t difficulty = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_difficulty : GLOBAL_STATE->SYSTEM_MODULE.pool_difficulty;
-                    if (stratum_api_v1_message.message_id == authorize_message_id && difficulty > 0) {
-                        STRATUM_V1_suggest_difficulty(GLOBAL_STATE->transport, stratum_get_next_uid(GLOBAL_STATE), difficulty);
+                    if (stratum_api_v1_message.message_id == authorize_message_id) {
+                        authorized = true;
+                        // Right for the measured hashrate if there is one yet, the configured difficulty otherwise
+                        uint32_t suggested = vardiff_update(&share_rate, active_pool_hashrate(GLOBAL_STATE), 0, receive_time_us);
+                        if (suggested == 0) {
+                            suggested = difficulty;
+                        }
+                        if (suggested > 0) {
+                            xSemaphoreTake(SHARE_SUBMIT_MODULE->write_lock, portMAX_DELAY);
+                            STRATUM_V1_suggest_difficulty(GLOBAL_STATE->transport, stratum_get_next_uid(GLOBAL_STATE), suggested);
+                            xSemaphoreGive(SHARE_SUBMIT_MODULE->write_lock);
+                        }
+                        // Only now, a share must not take id 4: answers to ids below 5 are parsed as setup answers
+                        share_submit_set_pool_ready(GLOBAL_STATE, true);
+                        replay_pending = true;
                     }
                     bool extranonce_subscribe = GLOBAL_STATE->SYSTEM_MODULE.is_using_fallback ? GLOBAL_STATE->SYSTEM_MODULE.fallback_pool_extranonce_subscribe : GLOBAL_STATE->SYSTEM_MODULE.pool_extranonce_subscribe;
                     if (extranonce_subscribe) {
+                        xSemaphoreTake(SHARE_SUBMIT_MODULE->write_lock, portMAX_DELAY);
                         STRATUM_V1_extranonce_subscribe(GLOBAL_STATE->transport, stratum_get_next_uid(GLOBAL_STATE));
+                        xSemaphoreGive(SHARE_SUBMIT_MODULE->write_lock);
                     }
                 } else {
                     ESP_LOGE(TAG, "setup message rejected: %s", stratum_api_v1_message.error_str);
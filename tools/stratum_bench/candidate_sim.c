@@ -0,0 +1,324 @@
+// ASIC to wire latency of block candidates, see README.md
+//
+// Plays ASIC_result_task and share_submit_task over a socket pair: the result
+// task verifies a burst of nonces and queues their shares, the submit task
+// batches them into writes like on the device, a wire thread timestamps each
+// line as it arrives. One nonce of every burst is a block candidate. Two ways
+// to handle it are compared:
+//
+//   queued   handed to the submit task like any share
+//   direct   written by the result task itself, share_submit_block_candidate
+//
+// The console is part of the path on the device. A log line holds it for as
+// long as the UART takes to send the line; the result task logs every nonce,
+// the submit task every write. A queued share waits while the submit task
+// logs its last write. Formatting and the write are the component's
+// STRATUM_V1_format_submit and STRATUM_V1_submit_batch.
+
+#include <getopt.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "mining.h"
+#include "pool_connect.h"
+#include "share_buffer.h"
+#include "stratum_api.h"
+
+// Same as share_submit_task
+#define SHARE_QUEUE_SIZE 32
+#define SHARE_BATCH_MAX 8
+#define SHARE_BATCH_BUFFER_SIZE 4096
+
+// Log lines as the device prints them, timestamp and color codes included
+#define NONCE_LOG_LEN 150
+#define BLOCK_LOG_LEN 90
+#define SUBMIT_LOG_LEN 80
+
+#define MAX_UIDS 65536
+#define ROUND_TIMEOUT_US 10000000LL
+
+typedef struct
+{
+    int burst;
+    int rounds;
+    int baud;
+} sim_options;
+
+typedef struct
+{
+    int64_t found_us;
+    int64_t wire_us;
+    bool candidate;
+} share_timing;
+
+typedef struct
+{
+    float values[MAX_UIDS];
+    int count;
+} samples;
+
+static sim_options options = {
+    .burst = 24,
+    .rounds = 100,
+    .baud = 115200,
+};
+
+static bool direct;
+static QueueHandle_t share_queue;
+static esp_transport_handle_t transport;
+static pthread_mutex_t console_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static share_timing timings[MAX_UIDS];
+static _Atomic int next_uid = 1;
+static _Atomic int dropped;  // queue full
+static _Atomic int written;
+static _Atomic int on_wire;
+static _Atomic int candidate_index = -1;
+static TaskHandle_t result_task_handle;
+
+// The line takes 10 bit times per character on the UART
+static void console_log(int len)
+{
+    if (options.baud == 0) {
+        return;
+    }
+    int64_t duration_ns = len * 10 * 1000000000LL / options.baud;
+    struct timespec delay = { .tv_sec = duration_ns / 1000000000LL, .tv_nsec = duration_ns % 1000000000LL };
+    pthread_mutex_lock(&console_lock);
+    nanosleep(&delay, NULL);
+    pthread_mutex_unlock(&console_lock);
+}
+
+// submit_shares of share_submit_task, both tasks write under the same lock
+static void submit_shares(char *batch, size_t batch_size, const share_submission *shares, int n_shares)
+{
+    int uids[SHARE_BATCH_MAX];
+    size_t len = 0;
+    for (int i = 0; i < n_shares; i++) {
+        uids[i] = atomic_fetch_add(&next_uid, 1) % MAX_UIDS;
+        timings[uids[i]].found_us = shares[i].found_us;
+        timings[uids[i]].candidate = shares[i].block_candidate;
+        len += STRATUM_V1_format_submit(batch + len, batch_size - len, uids[i], "sim.worker", shares[i].jobid,
+                                        shares[i].extranonce2, shares[i].ntime, shares[i].nonce, 0);
+    }
+    uint64_t sent_us;
+    pthread_mutex_lock(&write_lock);
+    int ret = STRATUM_V1_submit_batch(transport, batch, len, uids, n_shares, &sent_us);
+    pthread_mutex_unlock(&write_lock);
+    if (ret < 0) {
+        fprintf(stderr, "write failed\n");
+        exit(1);
+    }
+    atomic_fetch_add(&written, n_shares);
+    console_log(SUBMIT_LOG_LEN);
+}
+
+// ASIC_result_task: each burst of nonces is verified, handed on and logged one by one
+static void result_task(void *pvParameters)
+{
+    bm_job job = {0};
+    job.version = 0x20000000;
+    strcpy(job.jobid, "6a1b");
+    strcpy(job.extranonce2, "0000000000000001");
+
+    uint32_t nonce = 0;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        for (int i = 0; i < options.burst; i++, nonce++) {
+            share_submission share = {
+                .ntime = 0x66000000,
+                .nonce = nonce,
+                .found_us = esp_timer_get_time(),
+                .block_candidate = i == atomic_load(&candidate_index),
+            };
+            strcpy(share.jobid, job.jobid);
+            strcpy(share.extranonce2, job.extranonce2);
+
+            uint8_t nonce_hash[32];
+            calculate_nonce_hash(&job, nonce, job.version, nonce_hash);
+            if (share.block_candidate && direct) {
+                char line[1024];
+                submit_shares(line, sizeof(line), &share, 1);
+            } else if (xQueueSend(share_queue, &share, 0) != pdTRUE) {
+                atomic_fetch_add(&dropped, 1);
+            }
+
+            console_log(NONCE_LOG_LEN);
+            if (share.block_candidate) {
+                console_log(BLOCK_LOG_LEN);
+            }
+        }
+    }
+}
+
+// share_submit_task
+static void submit_task(void *pvParameters)
+{
+    static char batch[SHARE_BATCH_BUFFER_SIZE];
+    share_submission shares[SHARE_BATCH_MAX];
+
+    while (1) {
+        int n_shares = 0;
+        if (xQueueReceive(share_queue, &shares[n_shares], portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        n_shares++;
+        while (n_shares < SHARE_BATCH_MAX && xQueueReceive(share_queue, &shares[n_shares], 0) == pdTRUE) {
+            n_shares++;
+        }
+
+        submit_shares(batch, sizeof(batch), shares, n_shares);
+    }
+}
+
+// The pool end: timestamps every line by its id
+static void wire_task(void *pvParameters)
+{
+    int sock = *(int *) pvParameters;
+    char buffer[SHARE_BATCH_BUFFER_SIZE * 2];
+    size_t len = 0;
+
+    while (1) {
+        ssize_t n = recv(sock, buffer + len, sizeof(buffer) - len - 1, 0);
+        if (n <= 0) {
+            return;
+        }
+        int64_t now_us = esp_timer_get_time();
+        len += n;
+        buffer[len] = '\0';
+
+        char *line = buffer;
+        char *newline;
+        while ((newline = strchr(line, '\n')) != NULL) {
+            int uid = atoi(line + strlen("{\"id\":"));
+            timings[uid % MAX_UIDS].wire_us = now_us;
+            atomic_fetch_add(&on_wire, 1);
+            line = newline + 1;
+        }
+        len -= line - buffer;
+        memmove(buffer, line, len);
+    }
+}
+
+static int compare_float(const void *a, const void *b)
+{
+    float x = *(const float *) a, y = *(const float *) b;
+    return (x > y) - (x < y);
+}
+
+static float percentile(samples *s, float p)
+{
+    if (s->count == 0) {
+        return 0;
+    }
+    int index = (int) (p * s->count + 0.999f) - 1;
+    return s->values[index < 0 ? 0 : index];
+}
+
+// Returns the number of candidates that never made it to the wire
+static int run(const char *name, bool direct_write)
+{
+    static samples candidates, others;
+    candidates.count = 0;
+    others.count = 0;
+    direct = direct_write;
+    int first_uid = atomic_load(&next_uid);
+
+    for (int round = 0; round < options.rounds; round++) {
+        atomic_store(&candidate_index, rand() % options.burst);
+        int before = atomic_load(&written) + atomic_load(&dropped);
+        xTaskNotifyGive(result_task_handle);
+
+        // The round is done when every share of the burst was written or dropped and is on the wire
+        int64_t deadline_us = esp_timer_get_time() + ROUND_TIMEOUT_US;
+        while (atomic_load(&written) + atomic_load(&dropped) - before < options.burst ||
+               atomic_load(&on_wire) < atomic_load(&written)) {
+            if (esp_timer_get_time() > deadline_us) {
+                fprintf(stderr, "round %d did not finish\n", round);
+                return 1;
+            }
+            vTaskDelay(1);
+        }
+    }
+
+    int last_uid = atomic_load(&next_uid);
+    int candidates_expected = options.rounds;
+    for (int uid = first_uid; uid < last_uid; uid++) {
+        share_timing *timing = &timings[uid % MAX_UIDS];
+        float latency_ms = (timing->wire_us - timing->found_us) / 1000.0f;
+        if (timing->candidate) {
+            candidates.values[candidates.count++] = latency_ms;
+        } else {
+            others.values[others.count++] = latency_ms;
+        }
+    }
+    qsort(candidates.values, candidates.count, sizeof(float), compare_float);
+    qsort(others.values, others.count, sizeof(float), compare_float);
+
+    printf("%-12s %8.1f %8.1f %8.1f   %8.1f %8.1f\n", name, percentile(&candidates, 0.5f),
+           percentile(&candidates, 0.9f), percentile(&candidates, 1), percentile(&others, 0.5f), percentile(&others, 1));
+    return candidates_expected - candidates.count;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-b burst] [-r rounds] [-B baud]\n"
+            "  -b  nonces the result task gets at once, one of them a block candidate, default 24\n"
+            "  -r  bursts per way, default 100\n"
+            "  -B  console baud rate, 0 for free logging, default 115200\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "b:r:B:h")) != -1) {
+        switch (opt) {
+            case 'b': options.burst = atoi(optarg); break;
+            case 'r': options.rounds = atoi(optarg); break;
+            case 'B': options.baud = atoi(optarg); break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (options.burst < 1 || options.burst > SHARE_QUEUE_SIZE || options.rounds < 1 ||
+        options.rounds * options.burst * 2 >= MAX_UIDS) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        perror("socketpair");
+        return 1;
+    }
+    transport = pool_connect_transport(pair[0]);
+    share_queue = xQueueCreate(SHARE_QUEUE_SIZE, sizeof(share_submission));
+    srand(1);
+
+    xTaskCreate(wire_task, "wire", 8192, &pair[1], 5, NULL);
+    xTaskCreate(submit_task, "share submit", 8192, NULL, 10, NULL);
+    xTaskCreate(result_task, "asic result", 8192, NULL, 15, &result_task_handle);
+
+    printf("%d nonces per burst, console at %d baud\n\n", options.burst, options.baud);
+    printf("                 block candidate ms          other shares ms\n");
+    printf("way               p50      p90      max        p50      max\n");
+    int lost = run("queued", false);
+    lost += run("direct", true);
+
+    if (lost > 0) {
+        fprintf(stderr, "%d block candidates did not reach the wire\n", lost);
+        return 1;
+    }
+    return 0;
+}
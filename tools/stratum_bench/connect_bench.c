@@ -0,0 +1,254 @@
+// Time to connected for a pool reconnect, see README.md
+//
+// Resolves the pool name at dns_standin.py and connects to a local listener.
+// The first address the name server returns is blackholed: a listener whose
+// accept queue is full, so its SYNs are dropped like on a dead route. Three
+// ways to get connected are compared, each over several rounds:
+//
+//   sequential  A then AAAA query, one at a time, then the addresses in order
+//               with the 5 s connect timeout of stratum_task
+//   race, miss  pool_resolve with an empty cache, then pool_connect_race
+//   race, hit   the same with the answer cached from the round before
+//
+// The winning socket of the race goes through pool_connect_transport, a line
+// written to it has to arrive at the listener.
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_timer.h"
+#include "esp_transport_tcp.h"
+#include "pool_connect.h"
+
+#define TRANSPORT_TIMEOUT_MS 5000
+#define NAME_SERVER_TIMEOUT_MS 2000
+#define BLACKHOLE_ADDRESS "127.0.0.2"
+
+typedef struct
+{
+    double resolve_ms;
+    double connect_ms;
+    int family;
+    char address[64];
+} connect_result;
+
+static int listen_on(int family, const char *address, int port, int backlog)
+{
+    struct sockaddr_storage storage = { 0 };
+    socklen_t len;
+    if (family == AF_INET) {
+        struct sockaddr_in *addr4 = (struct sockaddr_in *) &storage;
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(port);
+        inet_pton(AF_INET, address, &addr4->sin_addr);
+        len = sizeof(*addr4);
+    } else {
+        struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *) &storage;
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(port);
+        inet_pton(AF_INET6, address, &addr6->sin6_addr);
+        len = sizeof(*addr6);
+    }
+
+    int sock = socket(family, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (family == AF_INET6) {
+        setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof(one));
+    }
+    if (bind(sock, (struct sockaddr *) &storage, len) < 0 || listen(sock, backlog) < 0) {
+        perror(address);
+        exit(2);
+    }
+    return sock;
+}
+
+// Fills the accept queue, further SYNs are dropped without an answer
+static void blackhole(int port)
+{
+    listen_on(AF_INET, BLACKHOLE_ADDRESS, port, 0);
+    dns_address address;
+    dns_parse_literal(BLACKHOLE_ADDRESS, &address);
+    for (int i = 0; i < 4; i++) {
+        // Whatever gets in stays there, never accepted
+        int sock = pool_connect_race(&address, 1, port, 200, NULL);
+        if (sock < 0) return;
+    }
+}
+
+static double elapsed_ms(int64_t since_us)
+{
+    return (esp_timer_get_time() - since_us) / 1000.0;
+}
+
+static int query_one(const struct sockaddr_in *name_server, const char *hostname, uint16_t type, dns_address *addresses, int max)
+{
+    uint8_t message[512];
+    uint16_t id = random();
+    int len = dns_build_query(message, sizeof(message), id, hostname, type);
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    connect(sock, (const struct sockaddr *) name_server, sizeof(*name_server));
+    send(sock, message, len, 0);
+
+    int count = 0;
+    struct pollfd pfd = { .fd = sock, .events = POLLIN };
+    if (poll(&pfd, 1, NAME_SERVER_TIMEOUT_MS) > 0) {
+        len = recv(sock, message, sizeof(message), 0);
+        count = len > 0 ? dns_parse_response(message, len, id, addresses, max, NULL) : 0;
+    }
+    close(sock);
+    return count > 0 ? count : 0;
+}
+
+static int connect_sequential(const struct sockaddr_in *name_server, const char *hostname, int port, connect_result *result)
+{
+    dns_address addresses[DNS_CACHE_MAX_ADDRESSES];
+    int64_t start_us = esp_timer_get_time();
+    int count = query_one(name_server, hostname, DNS_TYPE_A, addresses, DNS_CACHE_MAX_ADDRESSES);
+    count += query_one(name_server, hostname, DNS_TYPE_AAAA, addresses + count, DNS_CACHE_MAX_ADDRESSES - count);
+    result->resolve_ms = elapsed_ms(start_us);
+
+    start_us = esp_timer_get_time();
+    for (int i = 0; i < count; i++) {
+        char ip[64];
+        dns_address_to_string(&addresses[i], ip, sizeof(ip));
+        esp_transport_handle_t transport = esp_transport_tcp_init();
+        int ret = esp_transport_connect(transport, ip, port, TRANSPORT_TIMEOUT_MS);
+        esp_transport_destroy(transport);
+        if (ret == 0) {
+            result->connect_ms = elapsed_ms(start_us);
+            result->family = addresses[i].family;
+            snprintf(result->address, sizeof(result->address), "%s", ip);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int connect_race(const struct sockaddr_in *name_server, const char *hostname, int port, const int listeners[2],
+                        connect_result *result)
+{
+    dns_address addresses[DNS_CACHE_MAX_ADDRESSES];
+    int64_t start_us = esp_timer_get_time();
+    int count = pool_resolve((const struct sockaddr *) name_server, sizeof(*name_server), hostname, NAME_SERVER_TIMEOUT_MS,
+                             addresses, DNS_CACHE_MAX_ADDRESSES);
+    result->resolve_ms = elapsed_ms(start_us);
+
+    start_us = esp_timer_get_time();
+    int winner;
+    int sock = pool_connect_race(addresses, count, port, TRANSPORT_TIMEOUT_MS, &winner);
+    if (sock < 0) {
+        return -1;
+    }
+    result->connect_ms = elapsed_ms(start_us);
+    dns_address_to_string(&addresses[winner], result->address, sizeof(result->address));
+
+    // The transport carries on over the winning socket
+    esp_transport_handle_t transport = pool_connect_transport(sock);
+    const char line[] = "{\"id\":1,\"method\":\"mining.subscribe\",\"params\":[]}\n";
+    int ret = esp_transport_write(transport, line, sizeof(line) - 1, TRANSPORT_TIMEOUT_MS);
+    int peer = accept(listeners[addresses[winner].family == AF_INET6], NULL, NULL);
+    char received[sizeof(line)] = { 0 };
+    int n = peer >= 0 ? recv(peer, received, sizeof(received) - 1, MSG_WAITALL) : -1;
+    if (peer >= 0) close(peer);
+    esp_transport_destroy(transport);
+    if (ret != (int) sizeof(line) - 1 || n != ret || memcmp(received, line, n) != 0) {
+        fprintf(stderr, "line written to the transport did not arrive\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void report(const char *name, connect_result *results, int rounds)
+{
+    double resolve = 0, connect = 0, worst = 0;
+    for (int i = 0; i < rounds; i++) {
+        resolve += results[i].resolve_ms;
+        connect += results[i].connect_ms;
+        double total = results[i].resolve_ms + results[i].connect_ms;
+        if (total > worst) worst = total;
+    }
+    printf("%-12s %10.1f %10.1f %10.1f %10.1f   %s\n", name, resolve / rounds, connect / rounds, (resolve + connect) / rounds,
+           worst, results[rounds - 1].address);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-n name server port] [-H hostname] [-p pool port] [-r rounds]\n"
+            "  -n  dns_standin.py on 127.0.0.1, default 5353\n"
+            "  -H  name to resolve, default pool.test; its first address should be " BLACKHOLE_ADDRESS "\n"
+            "  -p  pool port, listened on at 127.0.0.1, ::1 and the blackhole, default 3334\n"
+            "  -r  rounds per way to connect, default 3\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    int name_server_port = 5353;
+    const char *hostname = "pool.test";
+    int port = 3334;
+    int rounds = 3;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:H:p:r:h")) != -1) {
+        switch (opt) {
+            case 'n': name_server_port = atoi(optarg); break;
+            case 'H': hostname = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'r': rounds = atoi(optarg); break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (rounds < 1) rounds = 1;
+
+    struct sockaddr_in name_server = { .sin_family = AF_INET, .sin_port = htons(name_server_port) };
+    inet_pton(AF_INET, "127.0.0.1", &name_server.sin_addr);
+
+    // IPv4 and IPv6
+    int listeners[2] = { listen_on(AF_INET, "127.0.0.1", port, 16), listen_on(AF_INET6, "::1", port, 16) };
+    blackhole(port);
+
+    connect_result *sequential = calloc(rounds, sizeof(connect_result));
+    connect_result *miss = calloc(rounds, sizeof(connect_result));
+    connect_result *hit = calloc(rounds, sizeof(connect_result));
+    int failed = 0;
+
+    for (int i = 0; i < rounds; i++) {
+        if (connect_sequential(&name_server, hostname, port, &sequential[i]) < 0) {
+            failed++;
+        } else {
+            // Drops the sequential connection the listener queued
+            int peer = accept(listeners[sequential[i].family == AF_INET6], NULL, NULL);
+            if (peer >= 0) close(peer);
+        }
+
+        dns_cache_reset();
+        if (connect_race(&name_server, hostname, port, listeners, &miss[i]) < 0) failed++;
+        if (connect_race(&name_server, hostname, port, listeners, &hit[i]) < 0) failed++;
+    }
+
+    printf("%d rounds, %s with the first address blackholed\n\n", rounds, hostname);
+    printf("%-12s %10s %10s %10s %10s   %s\n", "", "resolve ms", "connect ms", "total ms", "worst ms", "connected to");
+    report("sequential", sequential, rounds);
+    report("race, miss", miss, rounds);
+    report("race, hit", hit, rounds);
+
+    close(listeners[0]);
+    close(listeners[1]);
+    free(sequential);
+    free(miss);
+    free(hit);
+    if (failed > 0) {
+        fprintf(stderr, "%d connect(s) failed\n", failed);
+        return 1;
+    }
+    return 0;
+}
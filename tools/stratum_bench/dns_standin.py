@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""
+dns_standin.py
+==============
+Minimal UDP name server for the pool connect benchmark.
+
+It answers A and AAAA queries for the configured names and NXDOMAIN for any
+other name. The AAAA answers can be held back to play a resolver that is slow
+on IPv6, and queries can be dropped to play a lost datagram. Answers carry a
+CNAME to exercise name compression like a pool behind a CDN does.
+
+Usage examples
+--------------
+1. pool.test with a dead first address, an IPv4 and an IPv6 address, AAAA
+   answered 300 ms after the query:
+
+    $ python3 dns_standin.py --record pool.test=127.0.0.2,127.0.0.1,::1 \\
+          --aaaa-delay 0.3 --port 5353
+
+2. Drop every third query:
+
+    $ python3 dns_standin.py --record pool.test=127.0.0.1 --drop-every 3
+
+On exit a JSON summary of the queries is printed to stdout.
+"""
+from __future__ import annotations
+
+import argparse
+import asyncio
+import ipaddress
+import json
+import signal
+import struct
+import sys
+from typing import Dict, List
+
+TYPE_A = 1
+TYPE_CNAME = 5
+TYPE_AAAA = 28
+CLASS_IN = 1
+
+FLAG_QR = 0x8000
+FLAG_RD = 0x0100
+FLAG_RA = 0x0080
+RCODE_FORMERR = 1
+RCODE_NXDOMAIN = 3
+
+
+def parse_question(data: bytes):
+    """Name, type and end offset of the first question."""
+    labels = []
+    pos = 12
+    while data[pos] != 0:
+        length = data[pos]
+        labels.append(data[pos + 1:pos + 1 + length].decode("ascii").lower())
+        pos += 1 + length
+    qtype, qclass = struct.unpack("!HH", data[pos + 1:pos + 5])
+    return ".".join(labels), qtype, pos + 5
+
+
+def encode_name(name: str) -> bytes:
+    return b"".join(bytes([len(label)]) + label.encode("ascii") for label in name.split(".")) + b"\0"
+
+
+class NameServer(asyncio.DatagramProtocol):
+    def __init__(self, records: Dict[str, List[str]], ttl: int, aaaa_delay: float, drop_every: int, verbose: bool):
+        self.records = records
+        self.ttl = ttl
+        self.aaaa_delay = aaaa_delay
+        self.drop_every = drop_every
+        self.verbose = verbose
+        self.transport = None
+        self.stats = {"queries": 0, "A": 0, "AAAA": 0, "nxdomain": 0, "dropped": 0}
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def log(self, message: str):
+        if self.verbose:
+            print(message, file=sys.stderr)
+
+    def answer(self, query: bytes, name: str, qtype: int, question_end: int) -> bytes:
+        qid, = struct.unpack("!H", query[:2])
+        question = query[12:question_end]
+        addresses = self.records.get(name)
+        if addresses is None:
+            self.stats["nxdomain"] += 1
+            header = struct.pack("!HHHHHH", qid, FLAG_QR | FLAG_RD | FLAG_RA | RCODE_NXDOMAIN, 1, 0, 0, 0)
+            return header + question
+
+        # CNAME to a name under the one asked for, records point back with compression
+        target = "edge." + name
+        cname = struct.pack("!HHHIH", 0xC00C, TYPE_CNAME, CLASS_IN, self.ttl * 2, 7) + b"\x04edge\xc0\x0c"
+        target_offset = 12 + len(question) + 12
+        answers = [cname]
+        for address in addresses:
+            ip = ipaddress.ip_address(address)
+            rtype = TYPE_A if ip.version == 4 else TYPE_AAAA
+            if rtype != qtype:
+                continue
+            answers.append(struct.pack("!HHHIH", 0xC000 | target_offset, rtype, CLASS_IN, self.ttl, len(ip.packed)) + ip.packed)
+        self.log("%s %s -> %d record(s) via %s" % (name, "A" if qtype == TYPE_A else "AAAA", len(answers) - 1, target))
+
+        header = struct.pack("!HHHHHH", qid, FLAG_QR | FLAG_RD | FLAG_RA, 1, len(answers), 0, 0)
+        return header + question + b"".join(answers)
+
+    def datagram_received(self, data: bytes, addr):
+        self.stats["queries"] += 1
+        if self.drop_every and self.stats["queries"] % self.drop_every == 0:
+            self.stats["dropped"] += 1
+            return
+        try:
+            name, qtype, question_end = parse_question(data)
+        except (IndexError, struct.error, UnicodeDecodeError):
+            header = struct.pack("!HHHHHH", struct.unpack("!H", data[:2])[0], FLAG_QR | RCODE_FORMERR, 0, 0, 0, 0)
+            self.transport.sendto(header, addr)
+            return
+
+        if qtype == TYPE_A:
+            self.stats["A"] += 1
+        elif qtype == TYPE_AAAA:
+            self.stats["AAAA"] += 1
+        response = self.answer(data, name, qtype, question_end)
+        delay = self.aaaa_delay if qtype == TYPE_AAAA else 0
+        if delay > 0:
+            asyncio.get_running_loop().call_later(delay, self.transport.sendto, response, addr)
+        else:
+            self.transport.sendto(response, addr)
+
+
+async def main_async(args) -> dict:
+    records: Dict[str, List[str]] = {}
+    for record in args.record:
+        name, _, addresses = record.partition("=")
+        records[name.lower().rstrip(".")] = [a for a in addresses.split(",") if a]
+
+    loop = asyncio.get_running_loop()
+    server = NameServer(records, args.ttl, args.aaaa_delay, args.drop_every, args.verbose)
+    transport, _ = await loop.create_datagram_endpoint(lambda: server, local_addr=(args.host, args.port))
+
+    stop = asyncio.Event()
+    for sig in (signal.SIGINT, signal.SIGTERM):
+        loop.add_signal_handler(sig, stop.set)
+    await stop.wait()
+    transport.close()
+    return server.stats
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="UDP name server stand-in")
+    parser.add_argument("--record", action="append", default=[], metavar="NAME=ADDR[,ADDR...]",
+                        help="A and AAAA addresses of a name, in answer order")
+    parser.add_argument("--ttl", type=int, default=60)
+    parser.add_argument("--aaaa-delay", type=float, default=0, help="seconds before an AAAA answer goes out")
+    parser.add_argument("--drop-every", type=int, default=0, help="drop every Nth query")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=5353)
+    parser.add_argument("-v", "--verbose", action="store_true")
+    args = parser.parse_args()
+
+    print(json.dumps(asyncio.run(main_async(args)), indent=2))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,16 @@
+#ifndef HOST_ALLOC_COUNT_H
+#define HOST_ALLOC_COUNT_H
+
+#include <stdint.h>
+
+// Heap calls made by the objects linked with -Wl,--wrap, see ALLOC_WRAP in the Makefile
+typedef struct
+{
+    uint64_t allocations; // malloc, calloc, strdup, strndup and realloc of NULL
+    uint64_t reallocations;
+    uint64_t frees;
+} alloc_count;
+
+void alloc_count_get(alloc_count *count);
+
+#endif // HOST_ALLOC_COUNT_H
@@ -0,0 +1,12 @@
+#ifndef HOST_ESP_CRT_BUNDLE_H
+#define HOST_ESP_CRT_BUNDLE_H
+
+#include "esp_err.h"
+
+// No certificate bundle on the host, the benchmarks pass the pool certificate
+static inline esp_err_t esp_crt_bundle_attach(void *conf)
+{
+    return ESP_FAIL;
+}
+
+#endif // HOST_ESP_CRT_BUNDLE_H
@@ -0,0 +1,15 @@
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+#define MALLOC_CAP_8BIT (1 << 2)
+
+static inline void *heap_caps_malloc(size_t size, int caps) { return malloc(size); }
+static inline void *heap_caps_malloc_prefer(size_t size, int num, ...) { return malloc(size); }
+static inline void *heap_caps_calloc_prefer(size_t n, size_t size, int num, ...) { return calloc(n, size); }
+static inline void heap_caps_free(void *ptr) { free(ptr); }
+
+#endif // HOST_ESP_HEAP_CAPS_H
@@ -0,0 +1,12 @@
+#ifndef HOST_ESP_RANDOM_H
+#define HOST_ESP_RANDOM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+static inline uint32_t esp_random(void)
+{
+    return (uint32_t) random() << 16 ^ (uint32_t) random();
+}
+
+#endif // HOST_ESP_RANDOM_H
@@ -0,0 +1,4 @@
+#ifndef HOST_ESP_SNTP_H
+#define HOST_ESP_SNTP_H
+
+#endif // HOST_ESP_SNTP_H
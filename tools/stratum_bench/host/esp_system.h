@@ -0,0 +1,11 @@
+#ifndef HOST_ESP_SYSTEM_H
+#define HOST_ESP_SYSTEM_H
+
+#include <stdlib.h>
+
+static inline void esp_restart(void)
+{
+    abort();
+}
+
+#endif // HOST_ESP_SYSTEM_H
@@ -0,0 +1,49 @@
+#ifndef HOST_ESP_TRANSPORT_H
+#define HOST_ESP_TRANSPORT_H
+
+#include "esp_err.h"
+
+// Plain POSIX sockets behind the esp_transport calls the stratum component makes
+
+enum tcp_transport_errors
+{
+    ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT = 0,
+    ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN = -1,
+    ERR_TCP_TRANSPORT_CONNECTION_FAILED = -2,
+    ERR_TCP_TRANSPORT_NO_MEM = -3,
+};
+
+typedef struct host_transport *esp_transport_handle_t;
+
+typedef int (*connect_func)(esp_transport_handle_t t, const char *host, int port, int timeout_ms);
+typedef int (*io_func)(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms);
+typedef int (*io_read_func)(esp_transport_handle_t t, char *buffer, int len, int timeout_ms);
+typedef int (*trans_func)(esp_transport_handle_t t);
+typedef int (*poll_func)(esp_transport_handle_t t, int timeout_ms);
+
+// A transport of its own, like pool_connect_transport, calls its functions instead of the sockets
+esp_transport_handle_t esp_transport_init(void);
+
+esp_err_t esp_transport_set_func(esp_transport_handle_t t, connect_func _connect, io_read_func _read, io_func _write,
+                                 trans_func _close, poll_func _poll_read, poll_func _poll_write, trans_func _destroy);
+
+esp_err_t esp_transport_set_context_data(esp_transport_handle_t t, void *data);
+
+void *esp_transport_get_context_data(esp_transport_handle_t t);
+
+int esp_transport_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms);
+
+/**
+ * @return Bytes read, 0 on a timeout, a tcp_transport_errors value on errors
+ */
+int esp_transport_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms);
+
+int esp_transport_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms);
+
+int esp_transport_close(esp_transport_handle_t t);
+
+esp_err_t esp_transport_destroy(esp_transport_handle_t t);
+
+int esp_transport_get_socket(esp_transport_handle_t t);
+
+#endif // HOST_ESP_TRANSPORT_H
@@ -0,0 +1,29 @@
+#ifndef HOST_ESP_WIFI_H
+#define HOST_ESP_WIFI_H
+
+#include "esp_err.h"
+
+// Always connected, without an interface index for link-local IPv6
+typedef struct
+{
+    int rssi;
+} wifi_ap_record_t;
+
+typedef struct host_netif esp_netif_t;
+
+static inline esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    return ESP_OK;
+}
+
+static inline esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key)
+{
+    return NULL;
+}
+
+static inline int esp_netif_get_netif_impl_index(esp_netif_t *netif)
+{
+    return -1;
+}
+
+#endif // HOST_ESP_WIFI_H
@@ -0,0 +1,6 @@
+#ifndef HOST_FREERTOS_PORTMACRO_H
+#define HOST_FREERTOS_PORTMACRO_H
+
+#include "FreeRTOS.h"
+
+#endif // HOST_FREERTOS_PORTMACRO_H
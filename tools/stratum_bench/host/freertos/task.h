@@ -0,0 +1,38 @@
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+/**
+ * A task is a thread with a notification counter, enough for the work queue
+ * to park and wake its producer and consumer.
+ */
+typedef struct host_task
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notifications;
+    void (*function)(void *);
+    void *parameters;
+} *TaskHandle_t;
+
+BaseType_t xTaskCreate(void (*function)(void *), const char *name, uint32_t stack_depth, void *parameters,
+                       int priority, TaskHandle_t *created_task);
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+void xTaskNotifyGive(TaskHandle_t task);
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait);
+
+void vTaskDelay(TickType_t ticks);
+
+// Ends the calling task, the host has no other task to delete
+void vTaskDelete(TaskHandle_t task);
+
+// The stack goes on the heap of the host like any thread's
+#define xTaskCreateWithCaps(function, name, stack_depth, parameters, priority, created_task, caps) \
+    xTaskCreate(function, name, stack_depth, parameters, priority, created_task)
+
+#endif // HOST_FREERTOS_TASK_H
@@ -0,0 +1,455 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "esp_app_desc.h"
+#include "esp_transport_tcp.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+struct host_transport
+{
+    int sock;
+    void *context;
+    connect_func _connect;
+    io_read_func _read;
+    io_func _write;
+    trans_func _close;
+    trans_func _destroy;
+};
+
+static const esp_app_desc_t app_desc = {
+    .version = "stratum-bench",
+    .project_name = "esp-miner",
+};
+
+const esp_app_desc_t *esp_app_get_description(void)
+{
+    return &app_desc;
+}
+
+esp_transport_handle_t esp_transport_tcp_init(void)
+{
+    esp_transport_handle_t t = calloc(1, sizeof(struct host_transport));
+    if (t != NULL) {
+        t->sock = -1;
+    }
+    return t;
+}
+
+esp_transport_handle_t esp_transport_init(void)
+{
+    return esp_transport_tcp_init();
+}
+
+esp_err_t esp_transport_set_func(esp_transport_handle_t t, connect_func _connect, io_read_func _read, io_func _write,
+                                 trans_func _close, poll_func _poll_read, poll_func _poll_write, trans_func _destroy)
+{
+    t->_connect = _connect;
+    t->_read = _read;
+    t->_write = _write;
+    t->_close = _close;
+    t->_destroy = _destroy;
+    return ESP_OK;
+}
+
+esp_err_t esp_transport_set_context_data(esp_transport_handle_t t, void *data)
+{
+    t->context = data;
+    return ESP_OK;
+}
+
+void *esp_transport_get_context_data(esp_transport_handle_t t)
+{
+    return t->context;
+}
+
+static int wait_socket(int sock, short events, int timeout_ms)
+{
+    struct pollfd pfd = { .fd = sock, .events = events };
+    int ret;
+    do {
+        ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+int esp_transport_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    if (t->_connect != NULL) {
+        return t->_connect(t, host, port, timeout_ms);
+    }
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res;
+    char port_str[8];
+
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    if (getaddrinfo(host, port_str, &hints, &res) != 0) {
+        return -1;
+    }
+
+    int sock = socket(res->ai_family, SOCK_STREAM, 0);
+    if (sock < 0) {
+        freeaddrinfo(res);
+        return -1;
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+    int ret = connect(sock, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (ret < 0 && errno == EINPROGRESS && wait_socket(sock, POLLOUT, timeout_ms) > 0) {
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &error_len);
+        ret = error == 0 ? 0 : -1;
+    }
+    if (ret < 0) {
+        close(sock);
+        return -1;
+    }
+
+    // Like lwIP with TCP_NODELAY, a share goes out with its own write
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    t->sock = sock;
+    return 0;
+}
+
+int esp_transport_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    if (t->_read != NULL) {
+        return t->_read(t, buffer, len, timeout_ms);
+    }
+    if (t->sock < 0) {
+        return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    int ready = wait_socket(t->sock, POLLIN, timeout_ms);
+    if (ready == 0) {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    if (ready < 0) {
+        return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    ssize_t n = recv(t->sock, buffer, len, 0);
+    if (n == 0) {
+        return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+    }
+    if (n < 0) {
+        return errno == EAGAIN ? ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT : ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    return n;
+}
+
+int esp_transport_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    if (t->_write != NULL) {
+        return t->_write(t, buffer, len, timeout_ms);
+    }
+    int written = 0;
+    while (written < len) {
+        if (t->sock < 0 || wait_socket(t->sock, POLLOUT, timeout_ms) <= 0) {
+            return -1;
+        }
+        ssize_t n = send(t->sock, buffer + written, len - written, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        written += n;
+    }
+    return written;
+}
+
+int esp_transport_close(esp_transport_handle_t t)
+{
+    if (t->_close != NULL) {
+        return t->_close(t);
+    }
+    if (t->sock >= 0) {
+        // Wakes a read blocked on the socket in another thread
+        shutdown(t->sock, SHUT_RDWR);
+        close(t->sock);
+        t->sock = -1;
+    }
+    return 0;
+}
+
+esp_err_t esp_transport_destroy(esp_transport_handle_t t)
+{
+    if (t->_destroy != NULL) {
+        t->_destroy(t);
+    } else {
+        esp_transport_close(t);
+    }
+    free(t);
+    return ESP_OK;
+}
+
+int esp_transport_get_socket(esp_transport_handle_t t)
+{
+    return t->sock;
+}
+
+static __thread TaskHandle_t current_task;
+
+static TaskHandle_t task_new(void)
+{
+    TaskHandle_t task = calloc(1, sizeof(struct host_task));
+    pthread_condattr_t attr;
+
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&task->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    task->thread = pthread_self();
+    return task;
+}
+
+static void *task_entry(void *arg)
+{
+    TaskHandle_t task = arg;
+    current_task = task;
+    task->function(task->parameters);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(void (*function)(void *), const char *name, uint32_t stack_depth, void *parameters,
+                       int priority, TaskHandle_t *created_task)
+{
+    TaskHandle_t task = task_new();
+    task->function = function;
+    task->parameters = parameters;
+    if (pthread_create(&task->thread, NULL, task_entry, task) != 0) {
+        return pdFALSE;
+    }
+    if (created_task != NULL) {
+        *created_task = task;
+    }
+    return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    // The main thread becomes a task the first time it waits
+    if (current_task == NULL) {
+        current_task = task_new();
+    }
+    return current_task;
+}
+
+void xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notifications++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+}
+
+static void deadline_after(TickType_t ticks, struct timespec *deadline)
+{
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += ticks / 1000;
+    deadline->tv_nsec += (ticks % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline;
+    deadline_after(ticks_to_wait, &deadline);
+
+    pthread_mutex_lock(&task->lock);
+    while (task->notifications == 0) {
+        int ret = ticks_to_wait == portMAX_DELAY ? pthread_cond_wait(&task->cond, &task->lock)
+                                                 : pthread_cond_timedwait(&task->cond, &task->lock, &deadline);
+        if (ret == ETIMEDOUT) {
+            break;
+        }
+    }
+    uint32_t value = task->notifications;
+    if (clear_count_on_exit) {
+        task->notifications = 0;
+    } else if (value > 0) {
+        task->notifications--;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec delay = { .tv_sec = ticks / 1000, .tv_nsec = (ticks % 1000) * 1000000L };
+    nanosleep(&delay, NULL);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    pthread_exit(NULL);
+}
+
+struct host_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t queue = calloc(1, sizeof(struct host_queue));
+    pthread_condattr_t attr;
+
+    queue->items = calloc(length, item_size);
+    queue->length = length;
+    queue->item_size = item_size;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == queue->length) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+    UBaseType_t index = (queue->head + queue->count) % queue->length;
+    memcpy(queue->items + index * queue->item_size, item, queue->item_size);
+    queue->count++;
+    pthread_cond_signal(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == queue->length) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+    queue->head = (queue->head + queue->length - 1) % queue->length;
+    memcpy(queue->items + queue->head * queue->item_size, item, queue->item_size);
+    queue->count++;
+    pthread_cond_signal(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait)
+{
+    struct timespec deadline;
+    deadline_after(ticks_to_wait, &deadline);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && ticks_to_wait != 0) {
+        int ret = ticks_to_wait == portMAX_DELAY ? pthread_cond_wait(&queue->cond, &queue->lock)
+                                                 : pthread_cond_timedwait(&queue->cond, &queue->lock, &deadline);
+        if (ret == ETIMEDOUT) {
+            break;
+        }
+    }
+    if (queue->count == 0) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+    memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+struct host_semaphore
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int count;
+};
+
+static SemaphoreHandle_t semaphore_new(int count)
+{
+    SemaphoreHandle_t semaphore = calloc(1, sizeof(struct host_semaphore));
+    pthread_condattr_t attr;
+
+    semaphore->count = count;
+    pthread_mutex_init(&semaphore->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&semaphore->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return semaphore_new(1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return semaphore_new(0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+    struct timespec deadline;
+    deadline_after(ticks_to_wait, &deadline);
+
+    pthread_mutex_lock(&semaphore->lock);
+    while (semaphore->count == 0 && ticks_to_wait != 0) {
+        int ret = ticks_to_wait == portMAX_DELAY ? pthread_cond_wait(&semaphore->cond, &semaphore->lock)
+                                                 : pthread_cond_timedwait(&semaphore->cond, &semaphore->lock, &deadline);
+        if (ret == ETIMEDOUT) {
+            break;
+        }
+    }
+    BaseType_t taken = semaphore->count > 0 ? pdTRUE : pdFALSE;
+    if (taken) {
+        semaphore->count--;
+    }
+    pthread_mutex_unlock(&semaphore->lock);
+    return taken;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    pthread_mutex_lock(&semaphore->lock);
+    BaseType_t given = semaphore->count == 0 ? pdTRUE : pdFALSE;
+    semaphore->count = 1;
+    pthread_cond_signal(&semaphore->cond);
+    pthread_mutex_unlock(&semaphore->lock);
+    return given;
+}
@@ -0,0 +1,25 @@
+#ifndef HOST_LWIP_DNS_H
+#define HOST_LWIP_DNS_H
+
+#include <stdbool.h>
+#include <string.h>
+#include "tcpip.h"
+
+// The name server of stratum_task's resolver, set by the benchmark like DHCP sets lwIP's
+typedef struct
+{
+    bool v6;
+    struct in_addr addr4;
+    struct in6_addr addr6;
+} ip_addr_t;
+
+const ip_addr_t *dns_getserver(int index);
+
+#define ip_addr_isany(ip) (!(ip)->v6 && (ip)->addr4.s_addr == INADDR_ANY)
+#define IP_IS_V4(ip) (!(ip)->v6)
+#define ip_2_ip4(ip) (&(ip)->addr4)
+#define ip_2_ip6(ip) (&(ip)->addr6)
+#define inet_addr_from_ip4addr(target, source) (*(target) = *(source))
+#define inet6_addr_from_ip6addr(target, source) (*(target) = *(source))
+
+#endif // HOST_LWIP_DNS_H
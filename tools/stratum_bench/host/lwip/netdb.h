@@ -0,0 +1,9 @@
+#ifndef HOST_LWIP_NETDB_H
+#define HOST_LWIP_NETDB_H
+
+#include <netdb.h>
+#include "tcpip.h"
+
+#define esp_getaddrinfo getaddrinfo
+
+#endif // HOST_LWIP_NETDB_H
@@ -0,0 +1,56 @@
+#ifndef HOST_MBEDTLS_SHA256_H
+#define HOST_MBEDTLS_SHA256_H
+
+#include <string.h>
+#include <openssl/sha.h>
+
+// OpenSSL's SHA-256 behind the mbedtls calls. state holds the words in the
+// byte order of the ESP32 hardware SHA port, the midstate is read from there.
+typedef struct
+{
+    SHA256_CTX ctx;
+    uint32_t state[8];
+} mbedtls_sha256_context;
+
+static inline void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static inline void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
+{
+}
+
+static inline void mbedtls_sha256_clone(mbedtls_sha256_context *dst, const mbedtls_sha256_context *src)
+{
+    *dst = *src;
+}
+
+static inline int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224)
+{
+    SHA256_Init(&ctx->ctx);
+    return 0;
+}
+
+static inline int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t len)
+{
+    SHA256_Update(&ctx->ctx, input, len);
+    for (int i = 0; i < 8; i++) {
+        ctx->state[i] = __builtin_bswap32(ctx->ctx.h[i]);
+    }
+    return 0;
+}
+
+static inline int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char output[32])
+{
+    SHA256_Final(output, &ctx->ctx);
+    return 0;
+}
+
+static inline int mbedtls_sha256(const unsigned char *input, size_t len, unsigned char output[32], int is224)
+{
+    SHA256(input, len, output);
+    return 0;
+}
+
+#endif // HOST_MBEDTLS_SHA256_H
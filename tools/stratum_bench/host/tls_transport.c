@@ -0,0 +1,275 @@
+// OpenSSL in place of mbedTLS behind tls_transport.h, with the same session
+// cache and handshake accounting as components/stratum/tls_transport.c
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "pool_connect.h"
+#include "tls_session.h"
+#include "tls_transport.h"
+
+typedef struct
+{
+    int sock;
+    char *common_name;
+    uint16_t port;
+    SSL_CTX *ctx;
+    SSL *ssl;
+} tls_transport;
+
+static int wait_socket(int sock, short events, int timeout_ms)
+{
+    struct pollfd pfd = { .fd = sock, .events = events };
+    int ret;
+    do {
+        ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+static void save_session(tls_transport *tls)
+{
+    SSL_SESSION *session = SSL_get1_session(tls->ssl);
+    if (session == NULL) return;
+    int len = i2d_SSL_SESSION(session, NULL);
+    uint8_t *buffer = len > 0 ? malloc(len) : NULL;
+    if (buffer != NULL) {
+        uint8_t *p = buffer;
+        i2d_SSL_SESSION(session, &p);
+        tls_session_store(tls->common_name, tls->port, buffer, len);
+    }
+    free(buffer);
+    SSL_SESSION_free(session);
+}
+
+static void free_tls(tls_transport *tls)
+{
+    SSL_free(tls->ssl);
+    tls->ssl = NULL;
+}
+
+// The context is made once per transport. OpenSSL 3 takes longer to set one
+// up than a full handshake on the loopback, that would hide what is measured.
+static SSL_CTX *create_context(const char *cert)
+{
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (ctx == NULL) return NULL;
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    // Sessions live in tls_session like on the device, not in OpenSSL's cache
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+
+    if (cert == NULL) {
+        SSL_CTX_set_default_verify_paths(ctx);
+        return ctx;
+    }
+    BIO *bio = BIO_new_mem_buf(cert, -1);
+    X509 *ca = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+    BIO_free(bio);
+    if (ca == NULL) {
+        fprintf(stderr, "E tls_transport: invalid pool certificate\n");
+        SSL_CTX_free(ctx);
+        return NULL;
+    }
+    X509_STORE_add_cert(SSL_CTX_get_cert_store(ctx), ca);
+    X509_free(ca);
+    return ctx;
+}
+
+static int setup_tls(tls_transport *tls)
+{
+    tls->ssl = SSL_new(tls->ctx);
+    if (tls->ssl == NULL) return -1;
+    SSL_set_fd(tls->ssl, tls->sock);
+    SSL_set_tlsext_host_name(tls->ssl, tls->common_name);
+    SSL_set1_host(tls->ssl, tls->common_name);
+    return 0;
+}
+
+static int handshake(tls_transport *tls, int timeout_ms)
+{
+    bool offered = false;
+    size_t len;
+    uint8_t *saved = tls_session_get(tls->common_name, tls->port, &len);
+    if (saved != NULL) {
+        const uint8_t *p = saved;
+        SSL_SESSION *session = d2i_SSL_SESSION(NULL, &p, len);
+        offered = session != NULL && SSL_set_session(tls->ssl, session) == 1;
+        SSL_SESSION_free(session);
+        heap_caps_free(saved);
+    }
+
+    struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+    setsockopt(tls->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    int64_t start_us = esp_timer_get_time();
+    if (SSL_connect(tls->ssl) != 1) {
+        unsigned long error = ERR_get_error();
+        fprintf(stderr, "E tls_transport: handshake with %s:%u failed: %s\n", tls->common_name, tls->port,
+                error ? ERR_error_string(error, NULL) : "connection closed");
+        if (offered) {
+            tls_session_forget(tls->common_name, tls->port);
+        }
+        return -1;
+    }
+
+    bool resumed = offered && SSL_session_reused(tls->ssl);
+    tls_session_record_handshake(resumed, esp_timer_get_time() - start_us);
+    save_session(tls);
+    return resumed ? 1 : 0;
+}
+
+static int tls_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    if (tls->common_name == NULL) {
+        return -1;
+    }
+    tls->port = port;
+
+    if (tls->sock < 0) {
+        dns_address address;
+        if (!dns_parse_literal(host, &address)) {
+            return -1;
+        }
+        tls->sock = pool_connect_race(&address, 1, port, timeout_ms, NULL);
+        if (tls->sock < 0) {
+            return -1;
+        }
+    }
+
+    if (setup_tls(tls) != 0 || handshake(tls, timeout_ms) < 0) {
+        free_tls(tls);
+        close(tls->sock);
+        tls->sock = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static int tls_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    if (tls->ssl == NULL) {
+        return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    if (SSL_pending(tls->ssl) == 0) {
+        int ready = wait_socket(tls->sock, POLLIN, timeout_ms);
+        if (ready == 0) {
+            return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+        }
+        if (ready < 0) {
+            return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+        }
+    }
+
+    int n = SSL_read(tls->ssl, buffer, len);
+    if (n > 0) {
+        return n;
+    }
+    switch (SSL_get_error(tls->ssl, n)) {
+        case SSL_ERROR_ZERO_RETURN:
+            return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            // Also a TLS 1.3 ticket and nothing else
+            return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+        default:
+            return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+}
+
+static int tls_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    if (tls->ssl == NULL) {
+        return -1;
+    }
+    size_t written;
+    return SSL_write_ex(tls->ssl, buffer, len, &written) == 1 ? (int) written : -1;
+}
+
+static int tls_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    if (tls->ssl == NULL) {
+        return -1;
+    }
+    return SSL_pending(tls->ssl) > 0 ? 1 : wait_socket(tls->sock, POLLIN, timeout_ms);
+}
+
+static int tls_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    return tls->ssl != NULL ? wait_socket(tls->sock, POLLOUT, timeout_ms) : -1;
+}
+
+static int tls_close(esp_transport_handle_t t)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    if (tls->ssl != NULL) {
+        save_session(tls);
+        SSL_shutdown(tls->ssl);
+        free_tls(tls);
+    }
+    if (tls->sock >= 0) {
+        close(tls->sock);
+        tls->sock = -1;
+    }
+    return 0;
+}
+
+static int tls_destroy(esp_transport_handle_t t)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    tls_close(t);
+    SSL_CTX_free(tls->ctx);
+    free(tls->common_name);
+    free(tls);
+    return 0;
+}
+
+esp_transport_handle_t tls_transport_init(const char *cert)
+{
+    tls_transport *tls = calloc(1, sizeof(tls_transport));
+    if (tls == NULL) {
+        return NULL;
+    }
+    tls->sock = -1;
+    tls->ctx = create_context(cert);
+    if (tls->ctx == NULL) {
+        free(tls);
+        return NULL;
+    }
+
+    esp_transport_handle_t t = esp_transport_init();
+    esp_transport_set_context_data(t, tls);
+    esp_transport_set_func(t, tls_connect, tls_read, tls_write, tls_close, tls_poll_read, tls_poll_write, tls_destroy);
+    return t;
+}
+
+void tls_transport_set_common_name(esp_transport_handle_t t, const char *common_name)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    free(tls->common_name);
+    tls->common_name = strdup(common_name);
+}
+
+void tls_transport_set_socket(esp_transport_handle_t t, int sock)
+{
+    tls_transport *tls = esp_transport_get_context_data(t);
+    if (tls->sock >= 0 && tls->sock != sock) {
+        close(tls->sock);
+    }
+    tls->sock = sock;
+}
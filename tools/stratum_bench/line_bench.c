@@ -0,0 +1,275 @@
+// Receive path throughput over recorded pool traffic, see README.md
+//
+// Replays a recording of what a pool sent, by default one made with
+// standin.py --record, in reads of a fixed size like TCP segments arriving
+// at the socket. Two ways to split it into lines are compared:
+//
+//   legacy       the receive loop stratum_api.c had before the line reader,
+//                copied here: a 1 KiB read buffer cleared for every read,
+//                strncat into a heap buffer grown by realloc, strstr over
+//                all of it, then strndup of the line and memmove of the rest
+//   line_reader  the component's line_reader.c with the buffer size of
+//                STRATUM_V1_receive_jsonrpc_line, reads go straight into it
+//
+// Heap calls are counted by wrapping malloc and friends at link time.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc_count.h"
+#include "esp_timer.h"
+#include "line_reader.h"
+#include "stratum_api.h"
+
+// As in stratum_api.c before the line reader
+#define LEGACY_BUFFER_SIZE 1024
+
+#define MAX_CHUNKS 8
+
+typedef struct
+{
+    const char *data;
+    size_t len;
+    size_t offset;
+    size_t chunk;       // bytes arriving at once
+    size_t segment_end; // end of the chunk reads are currently served from
+} replay_socket;
+
+typedef struct
+{
+    double seconds;
+    uint64_t bytes;
+    uint64_t lines;
+    alloc_count heap;
+} reader_result;
+
+// A read returns what is left of the current chunk, up to len
+static int socket_read(replay_socket *socket, char *buffer, size_t len)
+{
+    if (socket->offset == socket->segment_end) {
+        if (socket->offset == socket->len) {
+            return -1;
+        }
+        socket->segment_end = socket->offset + socket->chunk;
+        if (socket->segment_end > socket->len) {
+            socket->segment_end = socket->len;
+        }
+    }
+    size_t n = socket->segment_end - socket->offset;
+    if (n > len) {
+        n = len;
+    }
+    memcpy(buffer, socket->data + socket->offset, n);
+    socket->offset += n;
+    return n;
+}
+
+static char *legacy_buffer;
+static size_t legacy_buffer_size;
+
+static void legacy_realloc_buffer(size_t len)
+{
+    size_t old = strlen(legacy_buffer);
+    size_t new = old + len + 1;
+
+    if (new < legacy_buffer_size) {
+        return;
+    }
+
+    new = new + (LEGACY_BUFFER_SIZE - (new % LEGACY_BUFFER_SIZE));
+    legacy_buffer = realloc(legacy_buffer, new);
+    memset(legacy_buffer + old, 0, new - old);
+    legacy_buffer_size = new;
+}
+
+static char *legacy_receive_line(replay_socket *socket)
+{
+    char recv_buffer[LEGACY_BUFFER_SIZE];
+
+    while (!strstr(legacy_buffer, "\n")) {
+        memset(recv_buffer, 0, LEGACY_BUFFER_SIZE);
+        int nbytes = socket_read(socket, recv_buffer, LEGACY_BUFFER_SIZE - 1);
+        if (nbytes < 0) {
+            return NULL;
+        }
+        legacy_realloc_buffer(nbytes);
+        strncat(legacy_buffer, recv_buffer, nbytes);
+    }
+
+    size_t buflen = strlen(legacy_buffer);
+    char *newline_pos = strchr(legacy_buffer, '\n');
+    size_t line_len = newline_pos - legacy_buffer;
+    char *line = strndup(legacy_buffer, line_len);
+    size_t remaining_len = buflen - line_len - 1;
+    if (remaining_len > 0) {
+        memmove(legacy_buffer, newline_pos + 1, remaining_len);
+        legacy_buffer[remaining_len] = '\0';
+    } else {
+        legacy_buffer[0] = '\0';
+    }
+    return line;
+}
+
+static uint64_t run_legacy(replay_socket *socket, uint64_t *bytes)
+{
+    uint64_t lines = 0;
+    char *line;
+    while ((line = legacy_receive_line(socket)) != NULL) {
+        *bytes += strlen(line) + 1;
+        lines++;
+        free(line);
+    }
+    return lines;
+}
+
+static uint64_t run_line_reader(line_reader_t *reader, replay_socket *socket, uint64_t *bytes)
+{
+    uint64_t lines = 0;
+    for (;;) {
+        size_t len;
+        while (line_reader_next_line(reader, &len) != NULL) {
+            *bytes += len + 1;
+            lines++;
+        }
+        size_t available;
+        char *dest = line_reader_get_write_space(reader, &available);
+        if (dest == NULL) {
+            return lines;
+        }
+        int nbytes = socket_read(socket, dest, available);
+        if (nbytes < 0) {
+            return lines;
+        }
+        line_reader_commit(reader, nbytes);
+    }
+}
+
+static void measure(bool legacy, const char *data, size_t len, size_t chunk, int iterations, reader_result *result)
+{
+    line_reader_t reader = {};
+    if (legacy) {
+        legacy_buffer = calloc(1, LEGACY_BUFFER_SIZE);
+        legacy_buffer_size = LEGACY_BUFFER_SIZE;
+    } else {
+        line_reader_init(&reader, STRATUM_LINE_BUFFER_SIZE);
+    }
+
+    alloc_count before, after;
+    alloc_count_get(&before);
+    uint64_t bytes = 0, lines = 0;
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        replay_socket socket = {.data = data, .len = len, .chunk = chunk};
+        lines += legacy ? run_legacy(&socket, &bytes) : run_line_reader(&reader, &socket, &bytes);
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    alloc_count_get(&after);
+
+    if (legacy) {
+        free(legacy_buffer);
+        legacy_buffer = NULL;
+    } else {
+        line_reader_free(&reader);
+    }
+
+    result->seconds = elapsed / 1e6;
+    result->bytes = bytes;
+    result->lines = lines;
+    result->heap.allocations = after.allocations - before.allocations;
+    result->heap.reallocations = after.reallocations - before.reallocations;
+    result->heap.frees = after.frees - before.frees;
+}
+
+static char *read_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = calloc(1, size + 1);
+    if (data != NULL && fread(data, 1, size, f) != (size_t) size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *len = size;
+    return data;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-f recording] [-c chunk] [-i iterations]\n"
+            "  -f  lines sent by a pool, default recordings/basic.log\n"
+            "  -c  bytes per read, may be given up to %d times, default 64, 1460 and 16384\n"
+            "  -i  times the recording is replayed, default 2000\n",
+            name, MAX_CHUNKS);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = "recordings/basic.log";
+    size_t chunks[MAX_CHUNKS];
+    int chunk_count = 0;
+    int iterations = 2000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:c:i:h")) != -1) {
+        switch (opt) {
+            case 'f': path = optarg; break;
+            case 'c':
+                if (chunk_count == MAX_CHUNKS || atoi(optarg) < 1) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                chunks[chunk_count++] = atoi(optarg);
+                break;
+            case 'i': iterations = atoi(optarg); break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (iterations < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (chunk_count == 0) {
+        chunks[chunk_count++] = 64;
+        chunks[chunk_count++] = 1460;
+        chunks[chunk_count++] = 16384;
+    }
+
+    size_t len;
+    char *data = read_file(path, &len);
+    if (data == NULL || len == 0) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 2;
+    }
+    size_t recorded_lines = 0;
+    for (size_t i = 0; i < len; i++) {
+        recorded_lines += data[i] == '\n';
+    }
+    printf("%s: %zu bytes, %zu lines, replayed %d times\n\n", path, len, recorded_lines, iterations);
+    printf("chunk  reader           MB/s    lines/s   allocs/line  reallocs/line\n");
+
+    int failed = 0;
+    for (int c = 0; c < chunk_count; c++) {
+        for (int legacy = 1; legacy >= 0; legacy--) {
+            reader_result result;
+            measure(legacy, data, len, chunks[c], iterations, &result);
+            printf("%5zu  %-12s %8.1f %10.0f %13.2f %14.2f\n", chunks[c], legacy ? "legacy" : "line_reader",
+                   result.bytes / result.seconds / 1e6, result.lines / result.seconds,
+                   (double) result.heap.allocations / result.lines, (double) result.heap.reallocations / result.lines);
+            // Both have to see every line, the line reader without touching the heap
+            if (result.lines != recorded_lines * iterations || (!legacy && result.heap.allocations != 0)) {
+                failed = 1;
+            }
+        }
+    }
+    free(data);
+    return failed;
+}
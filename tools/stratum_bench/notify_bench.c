@@ -0,0 +1,187 @@
+// mining.notify parse latency over recorded pool traffic, see README.md
+//
+// Takes the notifies from a recording made with standin.py --record and
+// parses each of them with the component's two parsers:
+//
+//   cjson   STRATUM_V1_parse_cjson, the generic path over a cJSON tree
+//   fast    mining_notify_parse, the single pass notify parser
+//
+// Both have to give the same notify, heap calls are counted by wrapping
+// malloc and friends at link time.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc_count.h"
+#include "esp_timer.h"
+#include "mining_notify_parser.h"
+#include "mining_notify_pool.h"
+#include "stratum_api.h"
+
+#define MAX_NOTIFIES 1024
+
+typedef struct
+{
+    int64_t elapsed_us;
+    alloc_count heap;
+} parser_result;
+
+static bool same_notify(const mining_notify *a, const mining_notify *b)
+{
+    return strcmp(a->job_id, b->job_id) == 0 && strcmp(a->prev_block_hash, b->prev_block_hash) == 0 &&
+           strcmp(a->coinbase_1, b->coinbase_1) == 0 && strcmp(a->coinbase_2, b->coinbase_2) == 0 &&
+           a->coinbase_1_bin_len == b->coinbase_1_bin_len &&
+           memcmp(a->coinbase_1_bin, b->coinbase_1_bin, a->coinbase_1_bin_len) == 0 &&
+           a->coinbase_2_bin_len == b->coinbase_2_bin_len &&
+           memcmp(a->coinbase_2_bin, b->coinbase_2_bin, a->coinbase_2_bin_len) == 0 &&
+           a->n_merkle_branches == b->n_merkle_branches &&
+           memcmp(a->merkle_branches, b->merkle_branches, a->n_merkle_branches * 32) == 0 &&
+           a->version == b->version && a->target == b->target && a->ntime == b->ntime && a->clean_jobs == b->clean_jobs;
+}
+
+// Parses every notify once with each parser and compares the results
+static int check_notifies(char **notifies, int count)
+{
+    int mismatches = 0;
+    for (int i = 0; i < count; i++) {
+        StratumApiV1Message message = {};
+        STRATUM_V1_parse_cjson(&message, notifies[i]);
+        mining_notify *notify = NULL;
+        int message_id;
+        if (message.method != MINING_NOTIFY || !mining_notify_parse(notifies[i], &message_id, &notify) ||
+            message_id != message.message_id || !same_notify(notify, message.mining_notification)) {
+            fprintf(stderr, "notify %d parsed differently\n", i);
+            mismatches++;
+        }
+        if (notify != NULL) {
+            STRATUM_V1_free_mining_notify(notify);
+        }
+        STRATUM_V1_reset_message(&message);
+    }
+    return mismatches;
+}
+
+static void measure(bool cjson, char **notifies, int count, int iterations, parser_result *result)
+{
+    alloc_count before, after;
+    alloc_count_get(&before);
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+        for (int n = 0; n < count; n++) {
+            if (cjson) {
+                StratumApiV1Message message = {};
+                STRATUM_V1_parse_cjson(&message, notifies[n]);
+                STRATUM_V1_reset_message(&message);
+            } else {
+                mining_notify *notify;
+                int message_id;
+                if (mining_notify_parse(notifies[n], &message_id, &notify)) {
+                    STRATUM_V1_free_mining_notify(notify);
+                }
+            }
+        }
+    }
+    result->elapsed_us = esp_timer_get_time() - start;
+    alloc_count_get(&after);
+    result->heap.allocations = after.allocations - before.allocations;
+    result->heap.reallocations = after.reallocations - before.reallocations;
+    result->heap.frees = after.frees - before.frees;
+}
+
+static char *read_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = calloc(1, len + 1);
+    if (data != NULL && fread(data, 1, len, f) != (size_t) len) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-f recording] [-i iterations]\n"
+            "  -f  lines sent by a pool, default recordings/basic.log\n"
+            "  -i  times every notify is parsed, default 2000\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = "recordings/basic.log";
+    int iterations = 2000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:i:h")) != -1) {
+        switch (opt) {
+            case 'f': path = optarg; break;
+            case 'i': iterations = atoi(optarg); break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (iterations < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    char *data = read_file(path);
+    if (data == NULL) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 2;
+    }
+    static char *notifies[MAX_NOTIFIES];
+    int count = 0;
+    size_t bytes = 0;
+    for (char *line = strtok(data, "\n"); line != NULL && count < MAX_NOTIFIES; line = strtok(NULL, "\n")) {
+        if (strstr(line, "\"mining.notify\"") != NULL && strstr(line, "\"params\"") != NULL) {
+            notifies[count++] = line;
+            bytes += strlen(line);
+        }
+    }
+    if (count == 0) {
+        fprintf(stderr, "no mining.notify in %s\n", path);
+        free(data);
+        return 2;
+    }
+    printf("%s: %d notifies of %zu bytes on average, each parsed %d times\n\n", path, count, bytes / count,
+           iterations);
+
+    int failed = check_notifies(notifies, count) != 0;
+
+    // Fill the notify pool first, as a running device has
+    parser_result warmup;
+    measure(false, notifies, count, 1, &warmup);
+
+    printf("parser    us/parse   allocs/parse   frees/parse\n");
+    parser_result results[2];
+    for (int cjson = 1; cjson >= 0; cjson--) {
+        parser_result *result = &results[cjson];
+        measure(cjson, notifies, count, iterations, result);
+        double parses = (double) count * iterations;
+        printf("%-8s %9.2f %14.2f %13.2f\n", cjson ? "cjson" : "fast", result->elapsed_us / parses,
+               result->heap.allocations / parses, result->heap.frees / parses);
+    }
+
+    mining_notify_pool_stats pool;
+    mining_notify_pool_get_stats(&pool);
+    printf("\nnotify pool: %u allocations, %u block reuses, %u heap fallbacks\n", (unsigned) pool.allocations,
+           (unsigned) pool.block_reuses, (unsigned) pool.heap_fallbacks);
+
+    free(data);
+    if (results[0].elapsed_us >= results[1].elapsed_us) {
+        fprintf(stderr, "fast path not faster than cJSON\n");
+        failed = 1;
+    }
+    return failed;
+}
@@ -0,0 +1,584 @@
+// End-to-end benchmark of the stratum pipeline on the host.
+//
+// stratum_task, create_jobs_task, ASIC_result_task and share_submit_task are
+// the firmware's sources from main/tasks, built against the FreeRTOS, lwIP and
+// esp_transport shims in host/. This file sets up GLOBAL_STATE like main.c,
+// plays the ASIC driver with a thread that searches nonces in software, and
+// stands in for the parts of main that are not built: the SYSTEM_notify_*
+// hooks, the hashrate monitor and the scoreboard. Pointed at standin.py it
+// reports notify to job latency, share round trip time and the CPU time the
+// tasks spend per share.
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "asic.h"
+#include "asic_result_task.h"
+#include "bm_job_slab.h"
+#include "create_jobs_task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "global_state.h"
+#include "hashrate_monitor_task.h"
+#include "lwip/dns.h"
+#include "mining.h"
+#include "nonce_filter.h"
+#include "pool_connect.h"
+#include "request_table.h"
+#include "scoreboard.h"
+#include "share_buffer.h"
+#include "share_submit_task.h"
+#include "stratum_api.h"
+#include "stratum_task.h"
+#include "stratum_trace.h"
+#include "system.h"
+#include "utils.h"
+#include "work_queue.h"
+
+static const char *TAG = "pipeline_bench";
+
+// Job ids of the BM1370 driver, which steps them by 24
+#define JOB_ID_STEP 24
+#define JOB_ID_COUNT 128
+#define RESULT_QUEUE_SIZE 64
+// How long ASIC_process_work waits for a result, like the UART read timeout
+#define RESULT_TIMEOUT_MS 100
+#define MAX_SAMPLES 65536
+// Nonces the software ASIC tries before it looks for a newer job
+#define NONCE_BATCH 4096
+// Every so many results the ASIC reports a nonce twice, like the chips occasionally do
+#define DUPLICATE_EVERY 16
+#define KILL_AFTER_S 5
+
+typedef struct
+{
+    const char *host;
+    int port;
+    int fallback_port;
+    bool hot_standby;
+    const char *user;
+    const char *pass;
+    int duration_s;
+    int job_interval_ms;
+    bool json;
+    bool expect_replay;
+    pid_t kill_pid;
+    int kill_after_s;
+    bool blackhole;
+} bench_options;
+
+typedef struct
+{
+    float values[MAX_SAMPLES];
+    int count;
+} samples;
+
+static bench_options options = {
+    .host = "127.0.0.1",
+    .port = 3333,
+    .user = "bench.worker",
+    .pass = "x",
+    .duration_s = 30,
+    .job_interval_ms = 500,
+    .kill_after_s = KILL_AFTER_S,
+};
+
+static GlobalState GLOBAL_STATE;
+
+// The chip: the job it works on and the version bits it rolls
+static pthread_mutex_t chip_lock = PTHREAD_MUTEX_INITIALIZER;
+static bm_job chip_job;
+static uint8_t chip_job_id;
+static uint32_t chip_job_seq;
+static uint32_t chip_version_mask;
+static QueueHandle_t result_queue;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static samples notify_to_job;
+static samples block_to_job;
+static struct
+{
+    uint32_t notifies;
+    uint32_t jobs;
+    uint64_t hashes;
+    uint32_t results;
+    uint32_t accepted;
+    uint32_t rejected;
+    // Receive of the newest notify not yet seen in a job
+    int64_t notify_pending_us;
+    char last_jobid[MAX_JOB_ID_LEN + 1];
+    uint8_t last_prev_block_hash[32];
+    // Set when the primary is killed, the gap ends with the first job for another block
+    int64_t failover_lost_us;
+    uint8_t failover_prev_block_hash[32];
+    int64_t failover_us;
+} stats;
+
+static void add_sample(samples *s, float value)
+{
+    if (s->count < MAX_SAMPLES) {
+        s->values[s->count++] = value;
+    }
+}
+
+static int compare_float(const void *a, const void *b)
+{
+    float x = *(const float *) a, y = *(const float *) b;
+    return (x > y) - (x < y);
+}
+
+static float percentile(const samples *s, float p)
+{
+    if (s->count == 0) {
+        return 0;
+    }
+    int index = (int) ceilf(p * s->count) - 1;
+    return s->values[index < 0 ? 0 : index];
+}
+
+// A job went to the chip: the first one of a notify ends its notify to job time
+static void record_job(const bm_job *job)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    pthread_mutex_lock(&stats_lock);
+    stats.jobs++;
+    bool new_block = memcmp(job->prev_block_hash, stats.last_prev_block_hash, sizeof(stats.last_prev_block_hash)) != 0;
+    if (strcmp(job->jobid, stats.last_jobid) != 0 && stats.notify_pending_us != 0) {
+        float ms = (now_us - stats.notify_pending_us) / 1000.0f;
+        add_sample(&notify_to_job, ms);
+        if (new_block) {
+            add_sample(&block_to_job, ms);
+        }
+        stats.notify_pending_us = 0;
+    }
+    strcpy(stats.last_jobid, job->jobid);
+    memcpy(stats.last_prev_block_hash, job->prev_block_hash, sizeof(stats.last_prev_block_hash));
+    if (stats.failover_lost_us != 0 && stats.failover_us == 0 &&
+        memcmp(job->prev_block_hash, stats.failover_prev_block_hash, sizeof(stats.failover_prev_block_hash)) != 0) {
+        stats.failover_us = now_us - stats.failover_lost_us;
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+// The ASIC driver, what BM1370_send_work does with the job apart from the UART frame
+void ASIC_send_work(GlobalState *GLOBAL_STATE, void *next_job)
+{
+    static uint8_t id = 0;
+    bm_job *job = (bm_job *) next_job;
+
+    id = (id + JOB_ID_STEP) % JOB_ID_COUNT;
+    pthread_mutex_lock(&GLOBAL_STATE->valid_jobs_lock);
+    GLOBAL_STATE->ASIC_TASK_MODULE.active_jobs[id] = bm_job_slab_store(id, job, GLOBAL_STATE->valid_jobs[id]);
+    GLOBAL_STATE->valid_jobs[id] = 1;
+    pthread_mutex_unlock(&GLOBAL_STATE->valid_jobs_lock);
+
+    pthread_mutex_lock(&chip_lock);
+    chip_job = *job;
+    chip_job_id = id;
+    chip_job_seq++;
+    pthread_mutex_unlock(&chip_lock);
+
+    record_job(job);
+}
+
+void ASIC_set_version_mask(GlobalState *GLOBAL_STATE, uint32_t mask)
+{
+    pthread_mutex_lock(&chip_lock);
+    chip_version_mask = mask;
+    pthread_mutex_unlock(&chip_lock);
+}
+
+double ASIC_get_asic_job_frequency_ms(GlobalState *GLOBAL_STATE)
+{
+    return options.job_interval_ms;
+}
+
+task_result *ASIC_process_work(GlobalState *GLOBAL_STATE)
+{
+    static task_result result;
+    if (xQueueReceive(result_queue, &result, pdMS_TO_TICKS(RESULT_TIMEOUT_MS)) != pdTRUE) {
+        return NULL;
+    }
+    return &result;
+}
+
+// Software stand-in for the chip: searches the current job for nonces below the pool target
+static void asic_task(void *pvParameters)
+{
+    uint32_t nonce = (uint32_t) esp_timer_get_time();
+    uint32_t found = 0;
+    uint32_t job_seq = 0;
+
+    while (1) {
+        pthread_mutex_lock(&chip_lock);
+        bm_job job = chip_job;
+        uint8_t job_id = chip_job_id;
+        job_seq = chip_job_seq;
+        uint32_t version_mask = chip_version_mask;
+        pthread_mutex_unlock(&chip_lock);
+        if (job_seq == 0) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+
+        // Roll the version once per job, so version bits go out with the shares
+        uint32_t rolled_version = version_mask != 0 ? increment_bitmask(job.version, version_mask) : job.version;
+
+        bool same_job = true;
+        while (same_job) {
+            for (int i = 0; i < NONCE_BATCH; i++, nonce++) {
+                uint8_t hash[32];
+                calculate_nonce_hash(&job, nonce, rolled_version, hash);
+                if (!hash_meets_target(hash, job.pool_target)) {
+                    continue;
+                }
+                task_result result = {
+                    .job_id = job_id,
+                    .nonce = nonce,
+                    .rolled_version = rolled_version,
+                    .register_type = REGISTER_INVALID,
+                    .timestamp_us = esp_timer_get_time(),
+                };
+                int copies = ++found % DUPLICATE_EVERY == 0 ? 2 : 1;
+                for (int copy = 0; copy < copies; copy++) {
+                    xQueueSend(result_queue, &result, 0);
+                }
+                pthread_mutex_lock(&stats_lock);
+                stats.results += copies;
+                pthread_mutex_unlock(&stats_lock);
+            }
+            pthread_mutex_lock(&chip_lock);
+            same_job = chip_job_seq == job_seq;
+            pthread_mutex_unlock(&chip_lock);
+            pthread_mutex_lock(&stats_lock);
+            stats.hashes += NONCE_BATCH;
+            pthread_mutex_unlock(&stats_lock);
+        }
+    }
+}
+
+// What main/system.c does with these is statistics for the display and the API
+void SYSTEM_notify_accepted_share(GlobalState *GLOBAL_STATE)
+{
+    pthread_mutex_lock(&stats_lock);
+    stats.accepted++;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void SYSTEM_notify_rejected_share(GlobalState *GLOBAL_STATE, char *error_msg)
+{
+    pthread_mutex_lock(&stats_lock);
+    stats.rejected++;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void SYSTEM_notify_found_nonce(GlobalState *GLOBAL_STATE, double diff, const bm_job *job, bool is_block)
+{
+}
+
+void SYSTEM_notify_new_ntime(GlobalState *GLOBAL_STATE, uint32_t ntime)
+{
+    pthread_mutex_lock(&stats_lock);
+    stats.notifies++;
+    stats.notify_pending_us = esp_timer_get_time();
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void hashrate_monitor_register_read(void *pvParameters, register_type_t register_type, uint8_t asic_nr, uint32_t value,
+                                    uint64_t timestamp_us)
+{
+}
+
+void hashrate_monitor_reset_measurements(void *pvParameters)
+{
+}
+
+esp_err_t scoreboard_add(Scoreboard *scoreboard, double difficulty, const char *job_id, const char *extranonce2,
+                         uint32_t ntime, uint32_t nonce, uint32_t version_bits)
+{
+    return ESP_OK;
+}
+
+// No name server, stratum_task resolves with getaddrinfo
+const ip_addr_t *dns_getserver(int index)
+{
+    static const ip_addr_t any;
+    return &any;
+}
+
+// SYSTEM_init_system and main.c, with the settings from the command line
+static void init_global_state(void)
+{
+    SystemModule *module = &GLOBAL_STATE.SYSTEM_MODULE;
+    module->pool_url = (char *) options.host;
+    module->pool_port = options.port;
+    module->pool_user = (char *) options.user;
+    module->pool_pass = (char *) options.pass;
+    module->pool_tls = DISABLED;
+    module->pool_difficulty = 1;
+    if (options.fallback_port != 0) {
+        module->fallback_pool_url = (char *) options.host;
+        module->fallback_pool_port = options.fallback_port;
+        module->fallback_pool_user = (char *) options.user;
+        module->fallback_pool_pass = (char *) options.pass;
+        module->fallback_pool_tls = DISABLED;
+        module->fallback_pool_difficulty = 1;
+        module->fallback_pool_hot_standby = options.hot_standby;
+    }
+    module->is_connected = true;
+    strcpy(module->pool_connection_info, "Not Connected");
+    pthread_mutex_init(&GLOBAL_STATE.valid_jobs_lock, NULL);
+    GLOBAL_STATE.stratum_mux = (portMUX_TYPE) portMUX_INITIALIZER_UNLOCKED;
+    GLOBAL_STATE.DEVICE_CONFIG.family.asic.name = "BM1370";
+
+    queue_init(&GLOBAL_STATE.stratum_queue);
+    nonce_filter_init(&GLOBAL_STATE.ASIC_TASK_MODULE.duplicate_filter);
+    if (stratum_trace_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate the stratum trace");
+    }
+
+    PoolSplitModule *POOL_SPLIT_MODULE = &GLOBAL_STATE.POOL_SPLIT_MODULE;
+    queue_init(&POOL_SPLIT_MODULE->queue);
+    portMUX_INITIALIZE(&POOL_SPLIT_MODULE->lock);
+    pool_split_init(&POOL_SPLIT_MODULE->scheduler, 2, esp_timer_get_time());
+    pool_split_set_weight(&POOL_SPLIT_MODULE->scheduler, POOL_PRIMARY, 100);
+    pool_split_set_weight(&POOL_SPLIT_MODULE->scheduler, POOL_FALLBACK, 0);
+
+    if (share_submit_init(&GLOBAL_STATE) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create share queue");
+    }
+    result_queue = xQueueCreate(RESULT_QUEUE_SIZE, sizeof(task_result));
+    GLOBAL_STATE.ASIC_initalized = true;
+}
+
+static double thread_cpu_us(TaskHandle_t task)
+{
+    clockid_t clock;
+    struct timespec cpu;
+    if (pthread_getcpuclockid(task->thread, &clock) != 0 || clock_gettime(clock, &cpu) != 0) {
+        return 0;
+    }
+    return cpu.tv_sec * 1e6 + cpu.tv_nsec / 1e3;
+}
+
+// Takes the killed primary's port with a full accept queue, the SYNs of a
+// reconnect are dropped like on a dead route and each connect runs into its timeout
+static bool blackhole_primary(void)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(options.port) };
+    inet_pton(AF_INET, options.host, &addr.sin_addr);
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    // The port is free once the kernel has torn the killed process down
+    int64_t deadline_us = esp_timer_get_time() + 1000000;
+    while (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        if (esp_timer_get_time() > deadline_us) {
+            perror("blackhole");
+            return false;
+        }
+        usleep(1000);
+    }
+    if (listen(sock, 0) < 0) {
+        perror("blackhole");
+        return false;
+    }
+
+    dns_address address;
+    dns_parse_literal(options.host, &address);
+    for (int i = 0; i < 4; i++) {
+        // Whatever gets in stays there, never accepted
+        if (pool_connect_race(&address, 1, options.port, 200, NULL) < 0) {
+            break;
+        }
+    }
+    return true;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-H host] [-p port] [-F fallback port] [-S] [-K pid] [-k seconds] [-B] [-u user] [-w password]\n"
+            "          [-t seconds] [-i job interval ms] [-j] [-R]\n"
+            "  -F  fallback pool on the same host\n"
+            "  -S  keep a hot standby connection to the fallback pool\n"
+            "  -K  SIGKILL this process, the primary pool, after -k seconds (default %d), fails without a failover\n"
+            "  -B  blackhole the port of the killed primary, reconnects to it time out instead of being refused\n"
+            "  -j  print the report as JSON\n"
+            "  -R  fail unless buffered shares were replayed and others discarded, and no share was rejected\n",
+            name, KILL_AFTER_S);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "H:p:F:SK:k:Bu:w:t:i:jRh")) != -1) {
+        switch (opt) {
+            case 'H': options.host = optarg; break;
+            case 'p': options.port = atoi(optarg); break;
+            case 'F': options.fallback_port = atoi(optarg); break;
+            case 'S': options.hot_standby = true; break;
+            case 'K': options.kill_pid = atoi(optarg); break;
+            case 'k': options.kill_after_s = atoi(optarg); break;
+            case 'B': options.blackhole = true; break;
+            case 'u': options.user = optarg; break;
+            case 'w': options.pass = optarg; break;
+            case 't': options.duration_s = atoi(optarg); break;
+            case 'i': options.job_interval_ms = atoi(optarg); break;
+            case 'j': options.json = true; break;
+            case 'R': options.expect_replay = true; break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if ((options.hot_standby || options.kill_pid != 0) && options.fallback_port == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (options.kill_pid != 0 && options.kill_after_s >= options.duration_s) {
+        usage(argv[0]);
+        return 2;
+    }
+    struct in_addr host_addr;
+    if (options.blackhole && (options.kill_pid == 0 || inet_pton(AF_INET, options.host, &host_addr) != 1)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    init_global_state();
+
+    // Priorities of main.c, the host scheduler ignores them
+    TaskHandle_t jobs_handle, result_handle, submit_handle, stratum_handle, asic_handle;
+    xTaskCreate(create_jobs_task, "stratum miner", 8192, &GLOBAL_STATE, 20, &jobs_handle);
+    xTaskCreate(ASIC_result_task, "asic result", 8192, &GLOBAL_STATE, 15, &result_handle);
+    xTaskCreate(share_submit_task, "share submit", 8192, &GLOBAL_STATE, 10, &submit_handle);
+    xTaskCreate(stratum_task, "stratum admin", 8192, &GLOBAL_STATE, 5, &stratum_handle);
+    xTaskCreate(asic_task, "asic", 8192, NULL, 1, &asic_handle);
+
+    int elapsed_s = 0;
+    if (options.kill_pid != 0) {
+        vTaskDelay(pdMS_TO_TICKS(options.kill_after_s * 1000));
+        elapsed_s = options.kill_after_s;
+        pthread_mutex_lock(&stats_lock);
+        memcpy(stats.failover_prev_block_hash, stats.last_prev_block_hash, sizeof(stats.failover_prev_block_hash));
+        stats.failover_lost_us = esp_timer_get_time();
+        pthread_mutex_unlock(&stats_lock);
+        if (kill(options.kill_pid, SIGKILL) != 0) {
+            perror("kill");
+            return 2;
+        }
+        if (options.blackhole && !blackhole_primary()) {
+            return 2;
+        }
+    }
+    vTaskDelay(pdMS_TO_TICKS((options.duration_s - elapsed_s) * 1000));
+
+    // Tasks keep running, the numbers are read under their locks and the process exits afterwards
+    double cpu_stratum_us = thread_cpu_us(stratum_handle);
+    double cpu_jobs_us = thread_cpu_us(jobs_handle);
+    double cpu_result_us = thread_cpu_us(result_handle);
+    double cpu_submit_us = thread_cpu_us(submit_handle);
+    double cpu_total_us = cpu_stratum_us + cpu_jobs_us + cpu_result_us + cpu_submit_us;
+    request_method_stats rtt;
+    request_table_get_stats(REQUEST_SUBMIT, &rtt);
+    share_buffer_stats buffer;
+    share_buffer_get_stats(&buffer);
+    share_submit_stats submit;
+    uint32_t queue_depth;
+    share_submit_get_stats(&GLOBAL_STATE, &submit, &queue_depth);
+    pthread_mutex_lock(&GLOBAL_STATE.valid_jobs_lock);
+    uint32_t stale = GLOBAL_STATE.ASIC_TASK_MODULE.stale_suppressed;
+    pthread_mutex_unlock(&GLOBAL_STATE.valid_jobs_lock);
+    uint32_t duplicates = nonce_filter_get_suppressed(&GLOBAL_STATE.ASIC_TASK_MODULE.duplicate_filter);
+
+    pthread_mutex_lock(&stats_lock);
+    qsort(notify_to_job.values, notify_to_job.count, sizeof(float), compare_float);
+    qsort(block_to_job.values, block_to_job.count, sizeof(float), compare_float);
+    uint32_t answered = stats.accepted + stats.rejected;
+    double per_share = answered > 0 ? 1.0 / answered : 0;
+    double mhs = stats.hashes / (options.duration_s * 1e6);
+
+    if (options.json) {
+        printf("{\"seconds\":%d,\"notifies\":%" PRIu32 ",\"jobs\":%" PRIu32 ",\"coalesced\":%" PRIu32 ",",
+               options.duration_s, stats.notifies, stats.jobs, queue_get_coalesced(&GLOBAL_STATE.stratum_queue));
+        printf("\"notify_to_job_ms\":{\"n\":%d,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f},",
+               notify_to_job.count, percentile(&notify_to_job, 0.5f), percentile(&notify_to_job, 0.9f),
+               percentile(&notify_to_job, 0.99f), percentile(&notify_to_job, 1));
+        printf("\"new_block_to_job_ms\":{\"n\":%d,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f},",
+               block_to_job.count, percentile(&block_to_job, 0.5f), percentile(&block_to_job, 0.9f),
+               percentile(&block_to_job, 0.99f), percentile(&block_to_job, 1));
+        printf("\"found_to_sent_ms\":{\"last\":%.3f,\"max\":%.3f},", submit.last_latency_ms, submit.max_latency_ms);
+        printf("\"share_rtt_ms\":{\"sent\":%" PRIu32 ",\"timed_out\":%" PRIu32 ",\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f},",
+               rtt.sent, rtt.timed_out, rtt.p50_ms, rtt.p90_ms, rtt.p99_ms);
+        printf("\"shares\":{\"results\":%" PRIu32 ",\"duplicates\":%" PRIu32 ",\"stale\":%" PRIu32
+               ",\"submitted\":%" PRIu32 ",\"writes\":%" PRIu32 ",\"dropped_full\":%" PRIu32
+               ",\"dropped_offline\":%" PRIu32 ",\"accepted\":%" PRIu32 ",\"rejected\":%" PRIu32 "},",
+               stats.results, duplicates, stale, submit.submitted, submit.writes, submit.dropped_full,
+               submit.dropped_offline, stats.accepted, stats.rejected);
+        printf("\"share_buffer\":{\"buffered\":%" PRIu32 ",\"replayed\":%" PRIu32 ",\"discarded_stale\":%" PRIu32
+               ",\"discarded_full\":%" PRIu32 "},",
+               buffer.buffered, buffer.replayed, buffer.discarded_stale, buffer.discarded_full);
+        printf("\"cpu_per_share_us\":{\"stratum\":%.1f,\"create_jobs\":%.1f,\"result\":%.1f,\"submit\":%.1f,\"total\":%.1f},",
+               cpu_stratum_us * per_share, cpu_jobs_us * per_share, cpu_result_us * per_share,
+               cpu_submit_us * per_share, cpu_total_us * per_share);
+        if (options.kill_pid != 0) {
+            printf("\"failover\":{\"standby\":\"%s\",\"primary\":\"%s\",\"ms\":%.1f},", options.hot_standby ? "hot" : "cold",
+                   options.blackhole ? "blackholed" : "killed", stats.failover_us / 1000.0);
+        }
+        printf("\"software_mhs\":%.2f}\n", mhs);
+    } else {
+        printf("notifies           %" PRIu32 " received, %" PRIu32 " coalesced, %" PRIu32 " jobs\n", stats.notifies,
+               queue_get_coalesced(&GLOBAL_STATE.stratum_queue), stats.jobs);
+        printf("notify to job      n=%d p50 %.3f p90 %.3f p99 %.3f max %.3f ms\n", notify_to_job.count,
+               percentile(&notify_to_job, 0.5f), percentile(&notify_to_job, 0.9f), percentile(&notify_to_job, 0.99f),
+               percentile(&notify_to_job, 1));
+        printf("  new block only   n=%d p50 %.3f p90 %.3f p99 %.3f max %.3f ms\n", block_to_job.count,
+               percentile(&block_to_job, 0.5f), percentile(&block_to_job, 0.9f), percentile(&block_to_job, 0.99f),
+               percentile(&block_to_job, 1));
+        printf("found to sent      last %.3f max %.3f ms\n", submit.last_latency_ms, submit.max_latency_ms);
+        printf("share round trip   sent %" PRIu32 ", timed out %" PRIu32 ", p50 %.3f p90 %.3f p99 %.3f ms\n", rtt.sent,
+               rtt.timed_out, rtt.p50_ms, rtt.p90_ms, rtt.p99_ms);
+        printf("shares             %" PRIu32 " results, %" PRIu32 " duplicates suppressed, %" PRIu32 " stale, %" PRIu32
+               " submitted in %" PRIu32 " writes, %" PRIu32 " dropped full, %" PRIu32 " dropped offline, %" PRIu32
+               " accepted, %" PRIu32 " rejected\n",
+               stats.results, duplicates, stale, submit.submitted, submit.writes, submit.dropped_full,
+               submit.dropped_offline, stats.accepted, stats.rejected);
+        printf("share buffer       %" PRIu32 " buffered, %" PRIu32 " replayed, %" PRIu32 " discarded stale, %" PRIu32
+               " discarded full\n",
+               buffer.buffered, buffer.replayed, buffer.discarded_stale, buffer.discarded_full);
+        printf("cpu per share      stratum %.1f us, create_jobs %.1f us, result %.1f us, submit %.1f us, total %.1f us\n",
+               cpu_stratum_us * per_share, cpu_jobs_us * per_share, cpu_result_us * per_share,
+               cpu_submit_us * per_share, cpu_total_us * per_share);
+        if (options.kill_pid != 0) {
+            printf("failover           %s standby, %.1f ms from killing the primary%s to the first job of the fallback\n",
+                   options.hot_standby ? "hot" : "cold", stats.failover_us / 1000.0, options.blackhole ? " and blackholing its port" : "");
+        }
+        printf("software hashrate  %.2f MH/s\n", mhs);
+    }
+    int status = stats.accepted > 0 ? 0 : 1;
+    if (options.expect_replay && (buffer.replayed == 0 || buffer.discarded_stale == 0 || stats.rejected > 0)) {
+        status = 1;
+    }
+    if (options.kill_pid != 0 && stats.failover_us == 0) {
+        status = 1;
+    }
+    pthread_mutex_unlock(&stats_lock);
+
+    fflush(stdout);
+    // The tasks never return, like on the device
+    _exit(status);
+}
@@ -0,0 +1,464 @@
+#!/usr/bin/env python3
+"""
+standin.py
+==========
+Scriptable stratum v1 pool for benchmarking and regression testing the mining
+pipeline without a real pool.
+
+The stand-in plays a scenario (see ``scenarios/``): it sends ``mining.notify``,
+``mining.set_difficulty`` and ``mining.set_version_mask`` in the scripted order
+and timing, delays its messages to simulate a slow pool and drops connections
+on purpose. Every ``mining.submit`` is checked against the job it was mined
+for: the coinbase, merkle root and header are rebuilt and the double SHA-256
+must meet the share difficulty. Stale, duplicate, low difficulty and malformed
+shares are rejected with the usual stratum error codes.
+
+Any stratum client can connect, the host benchmark in this directory as well
+as a real device pointed at this machine.
+
+Usage examples
+--------------
+1. Serve the default scenario on port 3333 until interrupted:
+
+    $ python3 standin.py scenarios/basic.json
+
+2. Stop once the scenario ran through and write the summary to a file:
+
+    $ python3 standin.py scenarios/flaky.json --exit-when-done --summary out.json
+
+3. Serve over TLS, with session resumption:
+
+    $ python3 standin.py scenarios/basic.json --port 3334 --tls-cert pool.pem
+
+4. Record the traffic sent to the clients, for line_bench:
+
+    $ python3 standin.py scenarios/basic.json --record recordings/basic.log
+
+On exit a JSON summary of the connections and shares is printed to stdout.
+"""
+from __future__ import annotations
+
+import argparse
+import asyncio
+import hashlib
+import json
+import os
+import signal
+import ssl
+import struct
+import sys
+import time
+from typing import Dict, List, Optional, Tuple
+
+DIFF1_TARGET = 0xFFFF << 208
+
+# Error codes as used by most pools
+ERR_OTHER = 20
+ERR_STALE = 21
+ERR_DUPLICATE = 22
+ERR_LOW_DIFFICULTY = 23
+ERR_UNAUTHORIZED = 24
+
+
+def sha256d(data: bytes) -> bytes:
+    return hashlib.sha256(hashlib.sha256(data).digest()).digest()
+
+
+def swap_words(data: bytes) -> bytes:
+    """Reverse the bytes of each 32 bit word, stratum prevhash <-> header order."""
+    return b"".join(data[i:i + 4][::-1] for i in range(0, len(data), 4))
+
+
+class Job:
+    def __init__(self, job_id: str, prevhash: bytes, coinbase_1: bytes, coinbase_2: bytes,
+                 branches: List[bytes], version: int, nbits: int, ntime: int, difficulty: float):
+        self.job_id = job_id
+        self.prevhash = prevhash
+        self.coinbase_1 = coinbase_1
+        self.coinbase_2 = coinbase_2
+        self.branches = branches
+        self.version = version
+        self.nbits = nbits
+        self.ntime = ntime
+        self.difficulty = difficulty
+
+    def notify(self, clean: bool) -> dict:
+        return {
+            "id": None,
+            "method": "mining.notify",
+            "params": [
+                self.job_id,
+                swap_words(self.prevhash[::-1]).hex(),
+                self.coinbase_1.hex(),
+                self.coinbase_2.hex(),
+                [branch.hex() for branch in self.branches],
+                "%08x" % self.version,
+                "%08x" % self.nbits,
+                "%08x" % self.ntime,
+                clean,
+            ],
+        }
+
+    def share_hash(self, extranonce_1: bytes, extranonce_2: bytes, ntime: int, nonce: int, version: int) -> int:
+        merkle_root = sha256d(self.coinbase_1 + extranonce_1 + extranonce_2 + self.coinbase_2)
+        for branch in self.branches:
+            merkle_root = sha256d(merkle_root + branch)
+        header = (struct.pack("<I", version) + self.prevhash[::-1] + merkle_root
+                  + struct.pack("<III", ntime, self.nbits, nonce))
+        return int.from_bytes(sha256d(header), "little")
+
+
+class Stats:
+    def __init__(self):
+        self.connections = 0
+        self.resumed = 0
+        self.disconnects_injected = 0
+        self.notifies = 0
+        self.accepted = 0
+        self.rejected: Dict[str, int] = {"stale": 0, "duplicate": 0, "low_difficulty": 0, "invalid": 0,
+                                         "unauthorized": 0}
+        self.accepted_difficulty = 0.0
+        self.best_difficulty = 0.0
+        self.started = time.monotonic()
+
+    def summary(self) -> dict:
+        return {
+            "seconds": round(time.monotonic() - self.started, 3),
+            "connections": self.connections,
+            "resumed": self.resumed,
+            "disconnects_injected": self.disconnects_injected,
+            "notifies": self.notifies,
+            "shares": {
+                "accepted": self.accepted,
+                "rejected": self.rejected,
+                "accepted_difficulty": self.accepted_difficulty,
+                "best_difficulty": self.best_difficulty,
+            },
+        }
+
+
+class Session:
+    """One client connection."""
+
+    def __init__(self, pool: "Pool", reader: asyncio.StreamReader, writer: asyncio.StreamWriter, extranonce_1: bytes):
+        self.pool = pool
+        self.reader = reader
+        self.writer = writer
+        self.extranonce_1 = extranonce_1
+        self.version_mask = 0
+        self.authorized = False
+        self.outbox: asyncio.Queue = asyncio.Queue()
+        self.peer = writer.get_extra_info("peername")
+
+    def send(self, message: dict):
+        # Every message waits out the latency in order, like behind a slow link
+        self.outbox.put_nowait((time.monotonic() + self.pool.latency, json.dumps(message) + "\n"))
+
+    async def write_loop(self):
+        while True:
+            due, line = await self.outbox.get()
+            delay = due - time.monotonic()
+            if delay > 0:
+                await asyncio.sleep(delay)
+            self.writer.write(line.encode())
+            if self.pool.record is not None:
+                self.pool.record.write(line)
+            await self.writer.drain()
+
+    def close(self):
+        self.writer.close()
+
+    async def serve(self):
+        writer_task = asyncio.create_task(self.write_loop())
+        try:
+            while True:
+                line = await self.reader.readline()
+                if not line:
+                    break
+                try:
+                    request = json.loads(line)
+                except ValueError:
+                    self.pool.log("%s: malformed line %r" % (self.peer, line[:80]))
+                    continue
+                self.handle(request)
+        except (ConnectionError, asyncio.IncompleteReadError):
+            pass
+        finally:
+            writer_task.cancel()
+            self.pool.sessions.discard(self)
+            self.writer.close()
+
+    def reply(self, request_id, result=None, error=None):
+        self.send({"id": request_id, "result": result, "error": error})
+
+    def handle(self, request: dict):
+        method = request.get("method")
+        request_id = request.get("id")
+        params = request.get("params") or []
+
+        if method == "mining.configure":
+            requested = int(params[1].get("version-rolling.mask", "0"), 16) if len(params) > 1 else 0
+            self.version_mask = requested & self.pool.version_mask
+            self.reply(request_id, {"version-rolling": True, "version-rolling.mask": "%08x" % self.version_mask})
+        elif method == "mining.subscribe":
+            # The second param names a session to resume, by the extranonce1 it was given
+            if self.pool.resume_sessions and len(params) > 1 and params[1] in self.pool.issued:
+                self.extranonce_1 = bytes.fromhex(params[1])
+                self.pool.stats.resumed += 1
+            self.pool.issued.add(self.extranonce_1.hex())
+            self.reply(request_id, [[["mining.notify", "1"]], self.extranonce_1.hex(), self.pool.extranonce_2_size])
+        elif method == "mining.authorize":
+            self.authorized = True
+            self.reply(request_id, True)
+            # Like a pool right after authorize: difficulty, then the current job
+            self.send({"id": None, "method": "mining.set_difficulty", "params": [self.pool.difficulty]})
+            if self.pool.job is not None:
+                self.send(self.pool.job.notify(True))
+        elif method in ("mining.suggest_difficulty", "mining.extranonce.subscribe"):
+            self.reply(request_id, True)
+        elif method == "mining.submit":
+            error = self.check_share(params)
+            if error is None:
+                self.reply(request_id, True)
+            else:
+                self.reply(request_id, None, [error[0], error[1], None])
+        elif method == "pong":
+            pass
+        else:
+            self.reply(request_id, None, [ERR_OTHER, "Unsupported method", None])
+
+    def check_share(self, params: list):
+        stats = self.pool.stats
+        if not self.authorized:
+            stats.rejected["unauthorized"] += 1
+            return ERR_UNAUTHORIZED, "Unauthorized worker"
+        try:
+            _, job_id, extranonce_2, ntime, nonce = params[:5]
+            version_bits = int(params[5], 16) if len(params) > 5 else 0
+            extranonce_2_bin = bytes.fromhex(extranonce_2)
+            ntime_value = int(ntime, 16)
+            nonce_value = int(nonce, 16)
+        except (ValueError, TypeError):
+            stats.rejected["invalid"] += 1
+            return ERR_OTHER, "Malformed share"
+
+        job = self.pool.jobs.get(job_id)
+        if job is None:
+            stats.rejected["stale"] += 1
+            return ERR_STALE, "Job not found"
+        if len(extranonce_2_bin) != self.pool.extranonce_2_size or version_bits & ~self.version_mask:
+            stats.rejected["invalid"] += 1
+            return ERR_OTHER, "Invalid extranonce2 or version bits"
+
+        key = (job_id, self.extranonce_1, extranonce_2_bin, ntime_value, nonce_value, version_bits)
+        if key in self.pool.submitted:
+            stats.rejected["duplicate"] += 1
+            return ERR_DUPLICATE, "Duplicate share"
+        self.pool.submitted.add(key)
+
+        hash_value = job.share_hash(self.extranonce_1, extranonce_2_bin, ntime_value, nonce_value,
+                                    job.version ^ version_bits)
+        share_difficulty = DIFF1_TARGET / max(hash_value, 1)
+        # A difficulty change applies from the next job on, the client may still mine the old one
+        if share_difficulty < min(job.difficulty, self.pool.difficulty):
+            stats.rejected["low_difficulty"] += 1
+            self.pool.log("%s: low difficulty share %.6g for job %s" % (self.peer, share_difficulty, job_id))
+            return ERR_LOW_DIFFICULTY, "Low difficulty share"
+
+        stats.accepted += 1
+        stats.accepted_difficulty += self.pool.difficulty
+        stats.best_difficulty = max(stats.best_difficulty, share_difficulty)
+        return None
+
+
+class Pool:
+    def __init__(self, scenario: dict, verbose: bool):
+        self.verbose = verbose
+        self.extranonce_1 = bytes.fromhex(scenario.get("extranonce1", "f0000000"))
+        self.extranonce_2_size = scenario.get("extranonce2_size", 4)
+        self.difficulty = float(scenario.get("difficulty", 0.0001))
+        self.version_mask = int(scenario.get("version_mask", "1fffe000"), 16)
+        self.n_branches = scenario.get("merkle_branches", 12)
+        # Like a pool that resumes the session a client asks for in mining.subscribe
+        self.resume_sessions = scenario.get("resume_sessions", False)
+        self.issued = set()
+        self.steps = scenario.get("steps", [])
+        self.latency = 0.0
+        self.sessions = set()
+        self.jobs: Dict[str, Job] = {}
+        self.job: Optional[Job] = None
+        self.submitted = set()
+        self.prevhash = os.urandom(32)
+        self.height = 850000
+        self.next_job_id = 1
+        self.stats = Stats()
+        self.connected = asyncio.Event()
+        self.record = None
+        self.listen = None
+        self.server = None
+
+    def log(self, message: str):
+        if self.verbose:
+            print(message, file=sys.stderr)
+
+    async def handle_client(self, reader, writer):
+        self.stats.connections += 1
+        # A new extranonce_1 for each connection, like a pool handing out a new session
+        value = (int.from_bytes(self.extranonce_1, "big") + self.stats.connections - 1) % (1 << (8 * len(self.extranonce_1)))
+        extranonce_1 = value.to_bytes(len(self.extranonce_1), "big")
+        session = Session(self, reader, writer, extranonce_1)
+        self.sessions.add(session)
+        self.log("connection %d from %s" % (self.stats.connections, session.peer))
+        self.connected.set()
+        await session.serve()
+        if not self.sessions:
+            self.connected.clear()
+
+    def broadcast(self, message: dict):
+        for session in list(self.sessions):
+            if session.authorized:
+                session.send(message)
+
+    def coinbase(self) -> Tuple[bytes, bytes]:
+        height = self.height.to_bytes(3, "little")
+        extranonce_len = len(self.extranonce_1) + self.extranonce_2_size
+        tag = b"/stratum-standin/"
+        script = bytes([3]) + height + bytes([len(tag)]) + tag
+        coinbase_1 = (struct.pack("<I", 2) + b"\x01" + b"\x00" * 32 + b"\xff\xff\xff\xff"
+                      + bytes([len(script) + extranonce_len]) + script)
+        payout = bytes.fromhex("0014") + hashlib.sha256(b"standin").digest()[:20]
+        coinbase_2 = (b"\xff\xff\xff\xff" + b"\x01" + struct.pack("<Q", 312500000)
+                      + bytes([len(payout)]) + payout + b"\x00\x00\x00\x00")
+        return coinbase_1, coinbase_2
+
+    def new_job(self, new_block: bool) -> Job:
+        if new_block:
+            self.prevhash = os.urandom(32)
+            self.height += 1
+        coinbase_1, coinbase_2 = self.coinbase()
+        job = Job("%x" % self.next_job_id, self.prevhash, coinbase_1, coinbase_2,
+                  [os.urandom(32) for _ in range(self.n_branches)], 0x20000000, 0x17031a4b,
+                  int(time.time()), self.difficulty)
+        self.next_job_id += 1
+        return job
+
+    async def run_steps(self, steps: list):
+        for step in steps:
+            if "notify" in step:
+                options = step["notify"] or {}
+                new_block = options.get("new_block", False)
+                clean = options.get("clean", False) or new_block
+                job = self.new_job(new_block)
+                if clean:
+                    self.jobs.clear()
+                    self.submitted.clear()
+                self.jobs[job.job_id] = job
+                self.job = job
+                self.stats.notifies += 1
+                self.broadcast(job.notify(clean))
+            elif "sleep" in step:
+                await asyncio.sleep(step["sleep"])
+            elif "set_difficulty" in step:
+                self.difficulty = float(step["set_difficulty"])
+                self.broadcast({"id": None, "method": "mining.set_difficulty", "params": [self.difficulty]})
+            elif "set_version_mask" in step:
+                self.version_mask = int(step["set_version_mask"], 16)
+                for session in self.sessions:
+                    session.version_mask = self.version_mask
+                self.broadcast({"id": None, "method": "mining.set_version_mask",
+                                "params": ["%08x" % self.version_mask]})
+            elif "latency" in step:
+                self.latency = float(step["latency"])
+            elif "disconnect" in step:
+                self.stats.disconnects_injected += 1
+                for session in list(self.sessions):
+                    session.close()
+            elif "offline" in step:
+                # Gone altogether: connections are dropped and new ones refused
+                self.stats.disconnects_injected += 1
+                self.server.close()
+                for session in list(self.sessions):
+                    session.close()
+            elif "online" in step:
+                self.server = await self.listen()
+            elif "wait_for_client" in step:
+                await self.connected.wait()
+            elif "repeat" in step:
+                for _ in range(step["repeat"]):
+                    await self.run_steps(step["steps"])
+            else:
+                raise ValueError("unknown scenario step %r" % step)
+            self.log("step %s" % json.dumps(step)[:80])
+
+
+async def main_async(args) -> dict:
+    with open(args.scenario) as f:
+        scenario = json.load(f)
+    pool = Pool(scenario, args.verbose)
+    if args.record:
+        pool.record = open(args.record, "w")
+    tls = None
+    if args.tls_cert:
+        # Python's defaults hand out session tickets and keep a session id cache
+        tls = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        tls.load_cert_chain(args.tls_cert, args.tls_key)
+        if args.tls_max == "1.2":
+            tls.maximum_version = ssl.TLSVersion.TLSv1_2
+
+    async def listen():
+        return await asyncio.start_server(pool.handle_client, args.host, args.port, ssl=tls)
+
+    pool.listen = listen
+    pool.server = await listen()
+
+    stop = asyncio.Event()
+    loop = asyncio.get_running_loop()
+    for sig in (signal.SIGINT, signal.SIGTERM):
+        loop.add_signal_handler(sig, stop.set)
+
+    async def play():
+        # Jobs only matter once someone mines them
+        await pool.connected.wait()
+        await pool.run_steps(pool.steps)
+        pool.log("scenario done")
+        if args.exit_when_done:
+            stop.set()
+
+    player = asyncio.create_task(play())
+    await stop.wait()
+    player.cancel()
+    pool.server.close()
+    for session in list(pool.sessions):
+        session.close()
+    # Let the connections see their end, the loop cancels what is still running
+    await asyncio.sleep(0.1)
+    if pool.record is not None:
+        pool.record.close()
+    return pool.stats.summary()
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Scriptable stratum v1 stand-in pool")
+    parser.add_argument("scenario", help="scenario JSON file")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=3333)
+    parser.add_argument("--exit-when-done", action="store_true", help="exit after the last scenario step")
+    parser.add_argument("--tls-cert", help="serve over TLS with this PEM certificate")
+    parser.add_argument("--tls-key", help="PEM key of --tls-cert, if it is not in the same file")
+    parser.add_argument("--tls-max", choices=("1.2", "1.3"), default="1.3", help="highest TLS version offered")
+    parser.add_argument("--summary", help="also write the summary to this file")
+    parser.add_argument("--record", help="write every line sent to the clients to this file")
+    parser.add_argument("-v", "--verbose", action="store_true")
+    args = parser.parse_args()
+
+    summary = asyncio.run(main_async(args))
+    text = json.dumps(summary, indent=2)
+    print(text)
+    if args.summary:
+        with open(args.summary, "w") as f:
+            f.write(text + "\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,196 @@
+// Handshake cost of a TLS pool reconnect, see README.md
+//
+// Connects to standin.py serving TLS the way stratum_task reconnects: a new
+// transport from STRATUM_V1_transport_init for each connection, a subscribe
+// and its answer, then close. Two ways are compared over several rounds:
+//
+//   full      the session cache is emptied before each connect
+//   resumed   the session of the connection before is offered
+//
+// Handshake wall and thread CPU time are measured around esp_transport_connect.
+// tls_bench links host/tls_transport.c, OpenSSL in place of mbedTLS.
+// tls_bench_mbedtls links the component's tls_transport.c against mbedTLS.
+// Either way the session cache and the resumed/full accounting are the
+// component's.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_timer.h"
+#include "stratum_api.h"
+#include "tls_session.h"
+#include "tls_transport.h"
+
+#define TRANSPORT_TIMEOUT_MS 5000
+#define MAX_ROUNDS 1000
+
+typedef struct
+{
+    double wall_ms;
+    double cpu_ms;
+} handshake_sample;
+
+static double thread_cpu_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static char *read_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = calloc(1, len + 1);
+    if (data != NULL && fread(data, 1, len, f) != (size_t) len) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+static int reconnect(const char *cert, const char *common_name, const char *host, int port, handshake_sample *sample)
+{
+    esp_transport_handle_t transport = STRATUM_V1_transport_init(CUSTOM_CRT, (char *) cert);
+    if (transport == NULL) {
+        return -1;
+    }
+    tls_transport_set_common_name(transport, common_name);
+
+    int64_t start_us = esp_timer_get_time();
+    double start_cpu = thread_cpu_ms();
+    int ret = esp_transport_connect(transport, host, port, TRANSPORT_TIMEOUT_MS);
+    sample->cpu_ms = thread_cpu_ms() - start_cpu;
+    sample->wall_ms = (esp_timer_get_time() - start_us) / 1000.0;
+
+    if (ret == 0) {
+        const char line[] = "{\"id\":1,\"method\":\"mining.subscribe\",\"params\":[\"tls_bench\"]}\n";
+        bool sent = esp_transport_write(transport, line, sizeof(line) - 1, TRANSPORT_TIMEOUT_MS) == sizeof(line) - 1;
+        char reply[1024];
+        int len = 0;
+        ret = -1;
+        // The answer to the subscribe, TLS 1.3 tickets are read on the way
+        while (sent && len < (int) sizeof(reply) - 1) {
+            int n = esp_transport_read(transport, reply + len, sizeof(reply) - 1 - len, TRANSPORT_TIMEOUT_MS);
+            if (n <= 0) break;
+            len += n;
+            reply[len] = '\0';
+            if (strchr(reply, '\n') != NULL) {
+                ret = 0;
+                break;
+            }
+        }
+        if (ret != 0) {
+            fprintf(stderr, "no answer to the subscribe\n");
+        }
+    }
+    esp_transport_close(transport);
+    esp_transport_destroy(transport);
+    return ret;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, handshake_sample *samples, int rounds)
+{
+    double wall[MAX_ROUNDS], cpu[MAX_ROUNDS];
+    for (int i = 0; i < rounds; i++) {
+        wall[i] = samples[i].wall_ms;
+        cpu[i] = samples[i].cpu_ms;
+    }
+    qsort(wall, rounds, sizeof(double), compare_double);
+    qsort(cpu, rounds, sizeof(double), compare_double);
+    printf("%-10s %8d %10.2f %10.2f %10.2f %10.2f\n", name, rounds, wall[rounds / 2], wall[rounds - 1], cpu[rounds / 2],
+           cpu[rounds - 1]);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s -c cert [-H host] [-N name] [-p port] [-r rounds]\n"
+            "  -c  PEM certificate of the stand-in, trusted as the pool CA\n"
+            "  -H  address of standin.py, default 127.0.0.1\n"
+            "  -N  name the certificate is checked against, default localhost\n"
+            "  -p  port of standin.py, default 3334\n"
+            "  -r  reconnects per way, default 20\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    const char *cert_path = NULL;
+    const char *host = "127.0.0.1";
+    const char *common_name = "localhost";
+    int port = 3334;
+    int rounds = 20;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:H:N:p:r:h")) != -1) {
+        switch (opt) {
+            case 'c': cert_path = optarg; break;
+            case 'H': host = optarg; break;
+            case 'N': common_name = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'r': rounds = atoi(optarg); break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+    if (cert_path == NULL || rounds < 1 || rounds > MAX_ROUNDS) {
+        usage(argv[0]);
+        return 2;
+    }
+    char *cert = read_file(cert_path);
+    if (cert == NULL) {
+        fprintf(stderr, "cannot read %s\n", cert_path);
+        return 2;
+    }
+
+    static handshake_sample full[MAX_ROUNDS], resumed[MAX_ROUNDS];
+    handshake_sample first;
+    int failed = 0;
+
+    tls_session_reset();
+    for (int i = 0; i < rounds; i++) {
+        tls_session_reset();
+        failed |= reconnect(cert, common_name, host, port, &full[i]);
+    }
+
+    // The first connection leaves the session the others resume
+    tls_session_reset();
+    failed |= reconnect(cert, common_name, host, port, &first);
+    for (int i = 0; i < rounds; i++) {
+        failed |= reconnect(cert, common_name, host, port, &resumed[i]);
+    }
+    free(cert);
+
+    tls_handshake_stats stats;
+    tls_session_get_stats(&stats);
+
+    printf("handshake    rounds  p50 wall ms  max wall   p50 cpu ms    max cpu\n");
+    report("full", full, rounds);
+    report("resumed", resumed, rounds);
+    printf("\nresumed run: %lu full, %lu resumed handshakes\n", (unsigned long) stats.full, (unsigned long) stats.resumed);
+
+    if (failed) {
+        fprintf(stderr, "a reconnect failed\n");
+        return 1;
+    }
+    if (stats.full != 1 || stats.resumed != (uint32_t) rounds) {
+        fprintf(stderr, "expected 1 full and %d resumed handshakes\n", rounds);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+// Simulated miner for the vardiff controller, see README.md
+//
+// Shares are drawn per second from the hashrate and the difficulty the pool
+// set. The controller runs on every notify like in stratum_task, fed with the
+// 1 minute hashrate average of noisy 5 second samples like the one of
+// hashrate_monitor_task. The pool applies a suggestion with its next notify.
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "vardiff.h"
+
+#define SAMPLE_S 5
+#define SAMPLES_1M (60 / SAMPLE_S)
+#define NOTIFY_S 30
+
+typedef struct
+{
+    int minute;
+    float hashrate_ghs;
+} hashrate_step;
+
+static double uniform(void)
+{
+    return (rand() + 1.0) / (RAND_MAX + 2.0);
+}
+
+static double gaussian(void)
+{
+    return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+static int poisson(double mean)
+{
+    // Knuth, the mean per second stays small
+    double limit = exp(-mean);
+    double p = uniform();
+    int k = 0;
+    while (p > limit) {
+        p *= uniform();
+        k++;
+    }
+    return k;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-r shares/min] [-d difficulty] [-g GH/s] [-m minutes] [-s seed]\n"
+            "  -r  target share rate, default 20\n"
+            "  -d  configured suggested difficulty, default 1000\n"
+            "  -g  hashrate, default 4200 GH/s; it halves a third into the run and recovers at two thirds\n"
+            "  -m  minutes to simulate, default 90\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    float shares_per_minute = 20;
+    unsigned configured = 1000;
+    float hashrate_ghs = 4200;
+    int minutes = 90;
+    unsigned seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:d:g:m:s:h")) != -1) {
+        switch (opt) {
+            case 'r': shares_per_minute = atof(optarg); break;
+            case 'd': configured = strtoul(optarg, NULL, 10); break;
+            case 'g': hashrate_ghs = atof(optarg); break;
+            case 'm': minutes = atoi(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 10); break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    srand(seed);
+
+    // Ramps up after the first minute, throttles, recovers
+    const hashrate_step profile[] = {
+        { 0, 0 },
+        { 1, hashrate_ghs },
+        { minutes / 3, hashrate_ghs / 2 },
+        { minutes * 2 / 3, hashrate_ghs },
+    };
+
+    vardiff controller;
+    vardiff_init(&controller, shares_per_minute, configured);
+
+    float samples[SAMPLES_1M] = { 0 };
+    int sample_count = 0;
+    double pool_difficulty = configured;
+    uint32_t pending = 0;
+    int suggestions = 0;
+    int static_shares = 0;
+    int shares = 0;
+    double settled_sum = 0;
+    int settled_minutes = 0;
+
+    printf("%6s %10s %10s %12s %12s\n", "minute", "GH/s", "difficulty", "shares/min", "fixed diff");
+    for (int t = 0; t < minutes * 60; t++) {
+        float actual = 0;
+        for (size_t i = 0; i < sizeof(profile) / sizeof(profile[0]); i++) {
+            if (t >= profile[i].minute * 60) actual = profile[i].hashrate_ghs;
+        }
+
+        if (t % SAMPLE_S == 0 && actual > 0) {
+            samples[sample_count++ % SAMPLES_1M] = actual * (1 + 0.05 * gaussian());
+        }
+
+        if (t % NOTIFY_S == 0) {
+            if (pending > 0) {
+                pool_difficulty = pending;
+                pending = 0;
+            }
+            int n = sample_count < SAMPLES_1M ? sample_count : SAMPLES_1M;
+            float measured = 0;
+            for (int i = 0; i < n; i++) measured += samples[i];
+            measured = n > 0 ? measured / n : 0;
+
+            uint32_t difficulty = vardiff_update(&controller, measured, pool_difficulty, t * 1000000LL);
+            if (difficulty > 0) {
+                pending = difficulty;
+                suggestions++;
+            }
+        }
+
+        double per_share = 4294967296.0 / 1e9;
+        shares += poisson(actual / (pool_difficulty * per_share));
+        static_shares += poisson(actual / (configured * per_share));
+
+        if (t % 60 == 59) {
+            int minute = t / 60;
+            printf("%6d %10.0f %10.0f %12d %12d\n", minute, actual, pool_difficulty, shares, static_shares);
+            // Settled: past the first suggestions and a few minutes after each hashrate step
+            int since_step = minute;
+            for (size_t i = 0; i < sizeof(profile) / sizeof(profile[0]); i++) {
+                if (minute >= profile[i].minute) since_step = minute - profile[i].minute;
+            }
+            if (since_step >= 5) {
+                settled_sum += shares;
+                settled_minutes++;
+            }
+            shares = 0;
+            static_shares = 0;
+        }
+    }
+
+    printf("\ntarget %.1f shares/min, settled average %.1f shares/min, %d suggestions\n", shares_per_minute,
+           settled_minutes > 0 ? settled_sum / settled_minutes : 0.0, suggestions);
+
+    // Settled within the hysteresis band, or it did not converge
+    double settled = settled_minutes > 0 ? settled_sum / settled_minutes : 0;
+    return settled >= shares_per_minute / VARDIFF_HYSTERESIS && settled <= shares_per_minute * VARDIFF_HYSTERESIS ? 0 : 1;
+}